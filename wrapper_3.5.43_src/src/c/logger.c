@@ -68,6 +68,8 @@ typedef long intptr_t;
  #include <pthread.h>
  #include <sys/time.h>
  #include <limits.h>
+ #include <unistd.h>
+ #include <signal.h>
 
  #if defined(SOLARIS)
   #include <sys/errno.h>
@@ -79,12 +81,18 @@ typedef long intptr_t;
  #else /* LINUX */
   #include <asm/errno.h>
   #include <gnu/libc-version.h>
+  #include <sys/mman.h>
+  #include <wchar.h>
  #endif
 
 #endif
 
 #include "wrapper_i18n.h"
 #include "logger.h"
+#include "wrapper_uring.h"
+#ifdef CUNIT
+#include "CUnit/Basic.h"
+#endif
 
 #ifndef TRUE
  #define TRUE -1
@@ -114,6 +122,10 @@ time_t previousLogLag;
 time_t previousNow;
 int    previousNowMillis;
 
+/* Time of the entry currently being logged.  Only valid while locked. */
+time_t currentNow;
+int    currentNowMicros;
+
 /* Initialize all log levels to unknown until they are set */
 int currentConsoleLevel = LEVEL_UNKNOWN;
 int currentLogfileLevel = LEVEL_UNKNOWN;
@@ -189,9 +201,154 @@ TCHAR logFileLastNowDate[9];
 /* Defualt formats (Must be 4 chars) */
 TCHAR consoleFormat[32];
 TCHAR logfileFormat[32];
+/* TRUE if the log file is written as JSON Lines rather than columns. */
+int logfileFormatJSON = FALSE;
+/* Set while the lines of a multi-line message are logged if the whole message was already written to the log file. */
+int logfileSkipLines = FALSE;
+/* TRUE if the log file is written as binary records rather than text. */
+int logfileFormatBinary = FALSE;
+/* Buffer used to encode binary records.  Only used while locked. */
+unsigned char *logfileBinaryBuffer = NULL;
+size_t logfileBinaryBufferSize = 0;
+/* FALSE until a record with an absolute time was written to the current log file handle.  Later records only store the delta. */
+int logfileBinaryHasBase = FALSE;
+time_t logfileBinaryLastNow;
+int logfileBinaryLastMicros;
 /* Flag to keep track of whether the console output should be flushed or not. */
 int consoleFlush = FALSE;
 
+/* TRUE if log files rolled by size should be preallocated and written through a memory mapping. */
+int logfileMmap = FALSE;
+#if defined(LINUX) && defined(UNICODE)
+ #define LOG_MMAP_SUPPORTED
+#endif
+#ifdef LOG_MMAP_SUPPORTED
+/* Space mapped beyond wrapper.logfile.maxsize as the file is only rolled once it is exceeded. */
+ #define LOG_MMAP_SLACK 65536
+/* Space added when a mapping is full. */
+ #define LOG_MMAP_GROW_SIZE 1048576
+
+/* A log file written through a memory mapping.  The file is preallocated up to the size of the
+ *  mapping and truncated to the length actually written when it is closed. */
+typedef struct LogMmapFile LogMmapFile;
+struct LogMmapFile {
+    FILE *fp;
+    int fd;
+    char *data;
+    size_t size;   /* Size of the mapping and of the preallocated file. */
+    size_t length; /* Bytes written. */
+    LogMmapFile *next;
+};
+/* Open mapped log files.  Only used while locked. */
+LogMmapFile *logMmapFiles = NULL;
+#endif
+
+/* TRUE if log files should be written asynchronously through io_uring when the kernel supports it. */
+int logfileUring = FALSE;
+#if defined(WRAPPER_URING_SUPPORTED) && defined(UNICODE)
+ #define LOG_URING_SUPPORTED
+#endif
+#ifdef LOG_URING_SUPPORTED
+/* A log file whose writes are submitted to the io_uring ring.  The stream buffers the output as
+ *  usual and a copy of each flushed chunk is queued. */
+typedef struct LogUringFile LogUringFile;
+struct LogUringFile {
+    FILE *fp;
+    int fd;
+    off64_t length; /* Bytes queued, including those already in the file. */
+    LogUringFile *next;
+};
+/* Open log files written through the ring.  Only used while locked. */
+LogUringFile *logUringFiles = NULL;
+#endif
+
+/* A log route writes the messages selected by its rule to an additional log file, which is rolled
+ *  independently of the main log file. */
+typedef struct LogRoute LogRoute;
+struct LogRoute {
+    TCHAR *sourcePattern; /* Matched against the source name.  NULL for any source. */
+    int minLevel;
+    int maxLevel;
+    TCHAR *path;
+    int maxSize;          /* Size at which the file is rolled.  0 to never roll it. */
+    int maxFiles;         /* Number of rolled files to keep.  0 to keep them all. */
+    FILE *fp;
+    int openFailed;       /* TRUE once a failure to open the file was reported. */
+    LogRoute *next;
+};
+/* Configured routes.  Only used while locked. */
+LogRoute *logRoutes = NULL;
+LogRoute *logRoutesLast = NULL;
+/* Lowest level accepted by any route. */
+int logRoutesLowLevel = LEVEL_NONE;
+
+/* Group commit of the log file.  Data written to the log file is synced to the disk by a background
+ *  thread at most logfileSyncInterval milliseconds later, or sooner once logfileSyncBytes have been
+ *  written or a message at or above logfileSyncLevel is logged.  The logging itself never waits for
+ *  the disk. */
+int logfileSyncInterval = 0;
+int logfileSyncBytes = 0;
+int logfileSyncLevel = LEVEL_WARN;
+/* TRUE if the log file has data which was not yet synced.  Only used while locked. */
+int logfileSyncDirty = FALSE;
+/* Number of bytes written since the last sync.  Only used while locked. */
+size_t logfileSyncPendingBytes = 0;
+/* Duplicated descriptors of log files which were closed before their data was synced.  Grown as
+ *  needed and handed over to the sync thread as a whole.  Only used while locked. */
+#define LOG_SYNC_RETAINED_INITIAL 4
+int *logfileSyncRetained = NULL;
+int logfileSyncRetainedSize = 0;
+int logfileSyncRetainedCount = 0;
+int logfileSyncThreadStarted = FALSE;
+/* TRUE once the sync thread may be started.  Set when the main loop is reached. */
+int logfileSyncStartable = FALSE;
+volatile int logfileSyncRequested = FALSE;
+volatile int logfileSyncStop = FALSE;
+#ifdef WIN32
+HANDLE logfileSyncThreadHandle = NULL;
+HANDLE logfileSyncEvent = NULL;
+ #define LOG_SYNC_FD(fd) _commit(fd)
+ #define LOG_SYNC_CLOSE(fd) _close(fd)
+#else
+pthread_t logfileSyncThreadId;
+pthread_mutex_t logfileSyncMutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t logfileSyncCond = PTHREAD_COND_INITIALIZER;
+ #if defined(LINUX)
+  /* Only the data and the size need to be synced. */
+  #define LOG_SYNC_FD(fd) fdatasync(fd)
+ #else
+  #define LOG_SYNC_FD(fd) fsync(fd)
+ #endif
+ #define LOG_SYNC_CLOSE(fd) close(fd)
+#endif
+
+/* Maximum number of characters of a message kept in the crash buffer. */
+#define CRASH_BUFFER_MESSAGE_MAX 512
+
+/* A log entry kept in the crash buffer. */
+typedef struct CrashBufferRecord CrashBufferRecord;
+struct CrashBufferRecord {
+    time_t now;
+    int    nowMillis;
+    time_t durationMillis;
+    int    source_id;
+    int    level;
+    int    threadId;
+    int    queued;
+    TCHAR  message[CRASH_BUFFER_MESSAGE_MAX];
+};
+
+/* Ring of the most recent log entries.  It is allocated once when its size is set and only
+ *  accessed while locked, so it needs no further synchronization. */
+CrashBufferRecord *crashBuffer = NULL;
+int crashBufferSize = 0;
+int crashBufferNext = 0;
+int crashBufferCount = 0;
+int currentCrashBufferLevel = LEVEL_NONE;
+TCHAR *crashBufferFile = NULL;
+/* Reason of a requested dump of the crash buffer.  Set by requestCrashBufferDump() and cleared in maintainLogger(). */
+const TCHAR * volatile pendingCrashBufferDump = NULL;
+
 #ifdef WIN32
 /* Flag to keep track of whether we should write directly to the console or not. */
 int consoleDirect = TRUE;
@@ -222,16 +379,62 @@ int doesFtellCauseMemoryLeak();
 void checkAndRollLogs(const TCHAR *nowDate, size_t printBufferSize);
 int lockLoggingMutex();
 int releaseLoggingMutex();
+static void addCrashBufferRecord(int source_id, int level, int threadId, int queued, const TCHAR *message, time_t now, int nowMillis, time_t durationMillis);
+static void closeLogfileFP();
+static int getLogfileFD(FILE *fp);
+static void requestLogfileSync(int level, size_t bytes);
+static void stopLogfileSync();
+static void closeLogRoutes();
+static void flushLogRoutes();
+#ifdef LINUX
+static void disposeLogSplice();
+static void closeLogRawFile();
+static void terminateLogRawLine(int source_id);
+#endif
+static void freeLogRoutes();
 
-#if defined(UNICODE) && !defined(WIN32)
-TCHAR formatMessages[WRAPPER_THREAD_COUNT][QUEUED_BUFFER_SIZE];
+/* Atomic operations used by the log queues.  Compilers without them fall back to plain volatile
+ *  accesses, which is as safe as the queues have always been as long as signals do not nest. */
+#if defined(WIN32)
+ #define LOG_QUEUE_CAS(ptr, oldValue, newValue) (InterlockedCompareExchange((ptr), (newValue), (oldValue)) == (oldValue))
+ #define LOG_QUEUE_BARRIER() MemoryBarrier()
+#elif defined(__GNUC__)
+ #define LOG_QUEUE_CAS(ptr, oldValue, newValue) __sync_bool_compare_and_swap((ptr), (oldValue), (newValue))
+ #define LOG_QUEUE_BARRIER() __sync_synchronize()
+#else
+ #define LOG_QUEUE_CAS(ptr, oldValue, newValue) ((*(ptr) == (oldValue)) ? ((*(ptr) = (newValue)), TRUE) : FALSE)
+ #define LOG_QUEUE_BARRIER()
 #endif
-int queueWrapped[WRAPPER_THREAD_COUNT];
-int queueWriteIndex[WRAPPER_THREAD_COUNT];
-int queueReadIndex[WRAPPER_THREAD_COUNT];
-TCHAR queueMessages[WRAPPER_THREAD_COUNT][QUEUE_SIZE][QUEUED_BUFFER_SIZE];
-int queueSourceIds[WRAPPER_THREAD_COUNT][QUEUE_SIZE];
-int queueLevels[WRAPPER_THREAD_COUNT][QUEUE_SIZE];
+
+#define LOG_QUEUE_RECORD_FREE  0
+#define LOG_QUEUE_RECORD_READY 1
+#define LOG_QUEUE_RECORD_PAD   2
+
+/* Header of a queued message.  The message follows the header and records are always a multiple
+ *  of the header size so that every header is aligned.  Unused space of a queue is kept zeroed,
+ *  so a record which has been reserved but not yet written is seen as FREE. */
+typedef struct LogQueueRecord LogQueueRecord;
+struct LogQueueRecord {
+    volatile int state;
+    int source_id;
+    int level;
+    int size; /* Bytes used by the record including this header. */
+};
+
+/* Ring of queued messages of a thread.  Positions run from 0 to twice the capacity so that a full
+ *  queue can be told apart from an empty one. */
+typedef struct LogQueue LogQueue;
+struct LogQueue {
+    char *buffer;
+    long capacity;
+    volatile long head;    /* Advanced by the thread owning the queue when reserving a record. */
+    volatile long tail;    /* Advanced by maintainLogger once a record has been logged. */
+    volatile long dropped; /* Messages which did not fit.  Reset by maintainLogger once reported. */
+};
+LogQueue logQueues[WRAPPER_THREAD_COUNT];
+int logQueueSize = 0;
+/* TRUE if records only use the space needed by their message rather than a full sized slot. */
+int logQueueVariableRecords = FALSE;
 
 /* Thread specific work buffers. */
 int threadSets[WRAPPER_THREAD_COUNT];
@@ -265,6 +468,14 @@ int autoCloseLogfile = 0;
 /* The number of lines sent to the log file since the getLogfileActivity method was last called. */
 DWORD logfileActivityCount = 0;
 
+/* The number of bytes written to the log file since startup.  Kept in two halves as not all
+ *  supported compilers have a 64 bit type. */
+static unsigned int logfileBytesLow = 0;
+static unsigned int logfileBytesHigh = 0;
+
+/* The number of queued log messages which were dropped since startup. */
+static unsigned int logQueueDroppedTotal = 0;
+
 
 /* Mutex for synchronization of the log_printf function. */
 #ifdef WIN32
@@ -384,6 +595,126 @@ TCHAR *replaceStringLongWithShort(TCHAR *string, const TCHAR *oldToken, const TC
     return string;
 }
 
+/**
+ * Returns the number of bytes used by a queued record for a message of the specified length,
+ *  not counting its terminating null character.
+ */
+static long getLogQueueRecordSize(size_t len) {
+    long size = (long)(sizeof(LogQueueRecord) + sizeof(TCHAR) * (len + 1));
+    
+    return (size + (long)sizeof(LogQueueRecord) - 1) / (long)sizeof(LogQueueRecord) * (long)sizeof(LogQueueRecord);
+}
+
+static long getLogQueueOffset(LogQueue *queue, long position) {
+    return (position >= queue->capacity) ? position - queue->capacity : position;
+}
+
+static long advanceLogQueuePosition(LogQueue *queue, long position, long size) {
+    position += size;
+    if (position >= queue->capacity * 2) {
+        position -= queue->capacity * 2;
+    }
+    return position;
+}
+
+/**
+ * Allocates the queues of all threads so that each can hold the specified number of full sized
+ *  messages.  Any existing queues must be empty.  The existing queues are kept on failure.
+ *
+ * @return TRUE if there was not enough memory.
+ */
+static int allocateLogQueues(int size) {
+    char *buffers[WRAPPER_THREAD_COUNT];
+    long capacity;
+    int threadId;
+    
+    capacity = getLogQueueRecordSize(QUEUED_BUFFER_SIZE - 1) * size;
+    for (threadId = 0; threadId < WRAPPER_THREAD_COUNT; threadId++) {
+        buffers[threadId] = calloc(capacity, 1);
+        if (!buffers[threadId]) {
+            while (--threadId >= 0) {
+                free(buffers[threadId]);
+            }
+            return TRUE;
+        }
+    }
+    
+    for (threadId = 0; threadId < WRAPPER_THREAD_COUNT; threadId++) {
+        if (logQueues[threadId].buffer) {
+            free(logQueues[threadId].buffer);
+        }
+        logQueues[threadId].buffer = buffers[threadId];
+        logQueues[threadId].capacity = capacity;
+        logQueues[threadId].head = 0;
+        logQueues[threadId].tail = 0;
+    }
+    logQueueSize = size;
+    return FALSE;
+}
+
+/**
+ * Adds a message to the queue of a thread.  This can be called from within a signal handler so
+ *  it must not allocate memory or take any locks.  If the message does not fit, it is dropped
+ *  and counted.
+ */
+static void enqueueLogMessage(int threadId, int source_id, int level, const TCHAR *message) {
+    LogQueue *queue = &logQueues[threadId];
+    LogQueueRecord *record;
+    size_t len;
+    long size;
+    long used;
+    long pad;
+    long offset;
+    long head;
+    long dropped;
+    
+    if (!queue->buffer) {
+        return;
+    }
+    
+    len = _tcslen(message);
+    size = getLogQueueRecordSize(logQueueVariableRecords ? len : QUEUED_BUFFER_SIZE - 1);
+    
+    /* Reserve the space.  A signal handler may queue its own messages on this thread between the
+     *  time the head is read and updated, so retry until the head was not changed meanwhile. */
+    do {
+        head = queue->head;
+        used = head - queue->tail;
+        if (used < 0) {
+            used += queue->capacity * 2;
+        }
+        offset = getLogQueueOffset(queue, head);
+        /* Records are never split.  Skip the space remaining at the end of the buffer if needed. */
+        pad = (queue->capacity - offset < size) ? queue->capacity - offset : 0;
+        if (used + pad + size > queue->capacity) {
+            do {
+                dropped = queue->dropped;
+            } while (!LOG_QUEUE_CAS(&queue->dropped, dropped, dropped + 1));
+            return;
+        }
+    } while (!LOG_QUEUE_CAS(&queue->head, head, advanceLogQueuePosition(queue, head, pad + size)));
+    
+    if (pad > 0) {
+        record = (LogQueueRecord *)(queue->buffer + offset);
+        record->size = (int)pad;
+        LOG_QUEUE_BARRIER();
+        record->state = LOG_QUEUE_RECORD_PAD;
+        offset = 0;
+    }
+    
+    record = (LogQueueRecord *)(queue->buffer + offset);
+    record->source_id = source_id;
+    record->level = level;
+    record->size = (int)size;
+    memcpy(record + 1, message, sizeof(TCHAR) * (len + 1));
+    /* Make sure the record is complete before it is seen as ready by maintainLogger. */
+    LOG_QUEUE_BARRIER();
+    record->state = LOG_QUEUE_RECORD_READY;
+#ifdef _DEBUG_QUEUE
+    _tprintf(TEXT("LOG ENQUEUE[%ld] Thread[%d]: %s\n"), offset, threadId, message);
+#endif
+}
+
 static int isInitialized = FALSE;
 
 /**
@@ -397,7 +728,7 @@ int isLogInitialized() {
  * Initializes the logger.  Returns 0 if the operation was successful.
  */
 int initLogging(void (*logFileChanged)(const TCHAR *logFile)) {
-    int threadId, i;
+    int threadId;
 
     logFileChangedCallback = logFileChanged;
 
@@ -427,18 +758,12 @@ int initLogging(void (*logFileChanged)(const TCHAR *logFile)) {
         threadSets[threadId] = FALSE;
         /* threadIds[threadId] = 0; */
 
-#if defined(UNICODE) && !defined(WIN32)
-        formatMessages[threadId][0] = TEXT('\0');
-#endif
-        for ( i = 0; i < QUEUE_SIZE; i++ )
-        {
-            queueWrapped[threadId] = 0;
-            queueWriteIndex[threadId] = 0;
-            queueReadIndex[threadId] = 0;
-            queueMessages[threadId][i][0] = TEXT('\0');
-            queueSourceIds[threadId][i] = 0;
-            queueLevels[threadId][i] = 0;
-        }
+        memset(&logQueues[threadId], 0, sizeof(LogQueue));
+    }
+    logQueueSize = 0;
+    if (allocateLogQueues(LOG_QUEUE_SIZE_DEFAULT)) {
+        _tprintf(TEXT("Out of memory in logging code (%s)\n"), TEXT("IL2"));
+        return 1;
     }
     isInitialized = TRUE;
     return 0;
@@ -448,9 +773,15 @@ int initLogging(void (*logFileChanged)(const TCHAR *logFile)) {
  * Disposes of any logging resouces prior to shutdown.
  */
 int disposeLogging() {
+    int threadId;
+    char *queueBuffer;
+
     /* Always call maintain logger once to make sure that all queued messages are logged before we exit. */
     maintainLogger();
     
+    /* Stop the sync thread.  Anything not yet synced is synced now. */
+    stopLogfileSync();
+    
     isInitialized = FALSE;
     
 #ifdef WIN32
@@ -471,6 +802,28 @@ int disposeLogging() {
         threadMessageBuffer = NULL;
         threadMessageBufferSize = 0;
     }
+    if (logfileBinaryBuffer) {
+        free(logfileBinaryBuffer);
+        logfileBinaryBuffer = NULL;
+        logfileBinaryBufferSize = 0;
+    }
+    if (crashBuffer) {
+        free(crashBuffer);
+        crashBuffer = NULL;
+        crashBufferSize = 0;
+    }
+    if (crashBufferFile) {
+        free(crashBufferFile);
+        crashBufferFile = NULL;
+    }
+    for (threadId = 0; threadId < WRAPPER_THREAD_COUNT; threadId++) {
+        /* Clear the reference first as a late signal could still try to queue a message. */
+        queueBuffer = logQueues[threadId].buffer;
+        logQueues[threadId].buffer = NULL;
+        if (queueBuffer) {
+            free(queueBuffer);
+        }
+    }
 
 
     if (defaultLogFile) {
@@ -511,9 +864,15 @@ int disposeLogging() {
         logFilePurgePattern = NULL;
     }
     if (logfileFP) {
-        fclose(logfileFP);
-        logfileFP = NULL;
+        closeLogfileFP();
     }
+    freeLogRoutes();
+#ifdef LINUX
+    disposeLogSplice();
+#endif
+#ifdef WRAPPER_URING_SUPPORTED
+    wrapperUringDispose();
+#endif
     return 0;
 }
 
@@ -1129,6 +1488,8 @@ void setLogfileGroup(gid_t log_file_group) {
 void setLogfileFormat( const TCHAR *log_file_format ) {
     if ( log_file_format != NULL ) {
         _tcsncpy( logfileFormat, log_file_format, 32 );
+        logfileFormatJSON = (strcmpIgnoreCase(log_file_format, TEXT("JSON")) == 0);
+        logfileFormatBinary = (strcmpIgnoreCase(log_file_format, TEXT("BINARY")) == 0);
         
         /* We only want to time logging if it is needed. */
         if ((logPrintfWarnThreshold <= 0) && (_tcschr(log_file_format, TEXT('G')))) {
@@ -1151,49 +1512,63 @@ void setLogfileLevel( const TCHAR *log_file_level ) {
     setLogfileLevelInt(getLogLevelForName(log_file_level));
 }
 
-void setLogfileMaxFileSize( const TCHAR *max_file_size ) {
+/**
+ * Parses a file size which can be followed by 'k' for kilobytes or 'm' for megabytes.
+ *
+ * @param max_file_size The value to parse.
+ * @param size Set to the size in bytes.  0 or less if the size is not limited.
+ *
+ * @return TRUE if there was not enough memory.
+ */
+static int parseLogfileSize( const TCHAR *max_file_size, int *size ) {
     int multiple, i, newLength;
     TCHAR *tmpFileSizeBuff;
     TCHAR chr;
 
-    if ( max_file_size != NULL ) {
-        /* Allocate buffer */
-        tmpFileSizeBuff = malloc(sizeof(TCHAR) * (_tcslen( max_file_size ) + 1));
-        if (!tmpFileSizeBuff) {
-            outOfMemoryQueued(TEXT("SLMFS"), 1);
-            return;
-        }
-
-        /* Generate multiple and remove unwanted chars */
-        multiple = 1;
-        newLength = 0;
-        for( i = 0; i < (int)_tcslen(max_file_size); i++ ) {
-            chr = max_file_size[i];
+    /* Allocate buffer */
+    tmpFileSizeBuff = malloc(sizeof(TCHAR) * (_tcslen( max_file_size ) + 1));
+    if (!tmpFileSizeBuff) {
+        return TRUE;
+    }
 
-            switch( chr ) {
-                case TEXT('k'): /* Kilobytes */
-                case TEXT('K'):
-                    multiple = 1024;
-                break;
+    /* Generate multiple and remove unwanted chars */
+    multiple = 1;
+    newLength = 0;
+    for( i = 0; i < (int)_tcslen(max_file_size); i++ ) {
+        chr = max_file_size[i];
 
-                case TEXT('M'): /* Megabytes */
-                case TEXT('m'):
-                    multiple = 1048576;
-                break;
-            }
+        switch( chr ) {
+            case TEXT('k'): /* Kilobytes */
+            case TEXT('K'):
+                multiple = 1024;
+            break;
 
-            if( (chr >= TEXT('0') && chr <= TEXT('9')) || (chr == TEXT('-')) )
-                tmpFileSizeBuff[newLength++] = max_file_size[i];
+            case TEXT('M'): /* Megabytes */
+            case TEXT('m'):
+                multiple = 1048576;
+            break;
         }
-        tmpFileSizeBuff[newLength] = TEXT('\0');/* Crop string */
 
-        logFileMaxSize = _ttoi( tmpFileSizeBuff );
-        if( logFileMaxSize > 0 )
-            logFileMaxSize *= multiple;
+        if( (chr >= TEXT('0') && chr <= TEXT('9')) || (chr == TEXT('-')) )
+            tmpFileSizeBuff[newLength++] = max_file_size[i];
+    }
+    tmpFileSizeBuff[newLength] = TEXT('\0');/* Crop string */
+
+    *size = _ttoi( tmpFileSizeBuff );
+    if( *size > 0 )
+        *size *= multiple;
+
+    /* Free memory */
+    free( tmpFileSizeBuff );
+    return FALSE;
+}
 
-        /* Free memory */
-        free( tmpFileSizeBuff );
-        tmpFileSizeBuff = NULL;
+void setLogfileMaxFileSize( const TCHAR *max_file_size ) {
+    if ( max_file_size != NULL ) {
+        if (parseLogfileSize(max_file_size, &logFileMaxSize)) {
+            outOfMemoryQueued(TEXT("SLMFS"), 1);
+            return;
+        }
 
         if ((logFileMaxSize > 0) && (logFileMaxSize < 1024)) {
             log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN, TEXT(
@@ -1292,6 +1667,27 @@ DWORD getLogfileActivity() {
     return logfileLines;
 }
 
+static void countLogfileBytes(size_t bytes) {
+    unsigned int low = logfileBytesLow + (unsigned int)bytes;
+
+    if (low < logfileBytesLow) {
+        logfileBytesHigh++;
+    }
+    logfileBytesLow = low;
+}
+
+/** Returns the number of bytes written to the log file since startup, as two 32 bit halves. */
+void getLogfileBytesWritten(unsigned int *low, unsigned int *high) {
+    /* Don't worry about synchronization here.  The values are only used for monitoring. */
+    *low = logfileBytesLow;
+    *high = logfileBytesHigh;
+}
+
+/** Returns the number of queued log messages which were dropped since startup. */
+unsigned int getLogQueueDropped() {
+    return logQueueDroppedTotal;
+}
+
 /** Obtains a lock on the logging mutex. */
 int lockLoggingMutex() {
 #ifdef WIN32
@@ -1340,6 +1736,16 @@ void setLogfileAutoFlush(int autoFlush) {
     autoFlushLogfile = autoFlush;
 }
 
+/** Sets whether log files rolled by size are preallocated and written through a memory mapping. */
+void setLogfileMmap(int mmap) {
+    logfileMmap = mmap;
+}
+
+/** Sets whether the log file and status files are written asynchronously through io_uring. */
+void setLogfileUring(int uring) {
+    logfileUring = uring;
+}
+
 /** Sets the auto close log file flag. */
 void setLogfileAutoClose(int autoClose) {
     autoCloseLogfile = autoClose;
@@ -1359,10 +1765,10 @@ void closeLogfile() {
         _tprintf(TEXT("Closing logfile by request...\n"));
 #endif
 
-        fclose(logfileFP);
-        logfileFP = NULL;
+        closeLogfileFP();
         /* Do not clean the currentLogFileName here as the name is not actually changing. */
     }
+    closeLogRoutes();
 
     /* Release the lock we have on this function so that other threads can get in. */
     if (releaseLoggingMutex()) {
@@ -1386,6 +1792,7 @@ void flushLogfile() {
 
         fflush(logfileFP);
     }
+    flushLogRoutes();
 
     /* Release the lock we have on this function so that other threads can get in. */
     if (releaseLoggingMutex()) {
@@ -1393,63 +1800,471 @@ void flushLogfile() {
     }
 }
 
-/* Console functions */
-void setConsoleLogFormat( const TCHAR *console_log_format ) {
-    if ( console_log_format != NULL ) {
-        _tcsncpy( consoleFormat, console_log_format, 32 );
-        
-        /* We only want to time logging if it is needed. */
-        if ((logPrintfWarnThreshold <= 0) && (_tcschr(console_log_format, TEXT('G')))) {
-            logPrintfWarnThreshold = 99999999;
-        }
-    }
-}
-
-void setConsoleLogLevelInt( int console_log_level ) {
-    currentConsoleLevel = console_log_level;
-}
+/**
+ * Duplicates the descriptor of the log file for the sync thread.  The duplicate is not inherited
+ *  by child processes, as a JVM may be launched while it is kept.
+ *
+ * @return The new descriptor, or -1 on failure.
+ */
+static int dupLogSyncFD(int fd) {
+    int newFd;
 
-int getConsoleLogLevelInt() {
-    return currentConsoleLevel;
+#ifdef WIN32
+    newFd = _dup(fd);
+    if (newFd >= 0) {
+        SetHandleInformation((HANDLE)_get_osfhandle(newFd), HANDLE_FLAG_INHERIT, 0);
+    }
+#elif defined(F_DUPFD_CLOEXEC)
+    newFd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+#else
+    newFd = dup(fd);
+    if (newFd >= 0) {
+        fcntl(newFd, F_SETFD, FD_CLOEXEC);
+    }
+#endif
+    return newFd;
 }
 
-void setConsoleLogLevel( const TCHAR *console_log_level ) {
-    setConsoleLogLevelInt(getLogLevelForName(console_log_level));
+/**
+ * Wakes up the sync thread so it syncs immediately.
+ */
+static void wakeLogfileSyncThread() {
+#ifdef WIN32
+    logfileSyncRequested = TRUE;
+    SetEvent(logfileSyncEvent);
+#else
+    pthread_mutex_lock(&logfileSyncMutex);
+    logfileSyncRequested = TRUE;
+    pthread_cond_signal(&logfileSyncCond);
+    pthread_mutex_unlock(&logfileSyncMutex);
+#endif
 }
 
-void setConsoleFlush( int flush ) {
-    consoleFlush = flush;
-}
+/**
+ * Keeps a descriptor of a closed log file until the sync thread has synced it.
+ *
+ * Must be called while locked.
+ */
+static void retainLogSyncFD(int fd) {
+    int *newRetained;
+    int newSize;
     
-#ifdef WIN32
-void setConsoleDirect( int direct ) {
-    consoleDirect = direct;
-}
+    if (logfileSyncRetainedCount >= logfileSyncRetainedSize) {
+        /* Several files were closed within one interval.  Should be very rare. */
+        newSize = (logfileSyncRetainedSize > 0) ? logfileSyncRetainedSize * 2 : LOG_SYNC_RETAINED_INITIAL;
+        newRetained = realloc(logfileSyncRetained, sizeof(int) * newSize);
+        if (!newRetained) {
+            outOfMemoryQueued(TEXT("RLSF"), 1);
+            /* Nowhere to keep it, so the only choice left is to sync it here. */
+#ifdef LOG_URING_SUPPORTED
+            wrapperUringWaitMark(wrapperUringMark());
 #endif
-
-void setConsoleFatalToStdErr(int toStdErr) {
-    consoleFatalToStdErr = toStdErr;
+            LOG_SYNC_FD(fd);
+            LOG_SYNC_CLOSE(fd);
+            return;
+        }
+        logfileSyncRetained = newRetained;
+        logfileSyncRetainedSize = newSize;
+        if (logfileSyncRetainedCount > 0) {
+            /* Do not let them pile up until the end of the interval. */
+            wakeLogfileSyncThread();
+        }
+    }
+    logfileSyncRetained[logfileSyncRetainedCount++] = fd;
 }
 
-void setConsoleErrorToStdErr(int toStdErr) {
-    consoleErrorToStdErr = toStdErr;
+/**
+ * Closes the log file.  If the group commit is enabled and the file has data which was not yet
+ *  synced, a duplicate of its descriptor is kept so the sync thread can still sync it.
+ *
+ * Must be called while locked.
+ */
+static void closeLogfileFP() {
+    int fd;
+    
+#ifdef LINUX
+    closeLogRawFile();
+#endif
+    if (logfileSyncDirty && logfileSyncThreadStarted) {
+        fflush(logfileFP);
+        fd = dupLogSyncFD(getLogfileFD(logfileFP));
+        if (fd >= 0) {
+            retainLogSyncFD(fd);
+        }
+        logfileSyncDirty = FALSE;
+        logfileSyncPendingBytes = 0;
+    }
+    
+    fclose(logfileFP);
+    logfileFP = NULL;
 }
 
-void setConsoleWarnToStdErr(int toStdErr) {
-    consoleWarnToStdErr = toStdErr;
+/**
+ * Notes that data was written to the log file so it gets synced.
+ *
+ * Must be called while locked.
+ */
+static void requestLogfileSync(int level, size_t bytes) {
+    if (!logfileSyncThreadStarted || (logfileSyncInterval <= 0)) {
+        return;
+    }
+    
+    logfileSyncDirty = TRUE;
+    logfileSyncPendingBytes += bytes;
+    if ((level >= logfileSyncLevel) || ((logfileSyncBytes > 0) && (logfileSyncPendingBytes >= (size_t)logfileSyncBytes))) {
+        wakeLogfileSyncThread();
+    }
 }
 
-/* Syslog/eventlog functions */
-void setSyslogLevelInt( int loginfo_level ) {
-    currentLoginfoLevel = loginfo_level;
+/**
+ * Collects the descriptors which need to be synced.  The current log file is flushed and its
+ *  descriptor duplicated so that it remains valid even if the file is closed while it is synced.
+ *  The descriptors of closed files are handed over as a whole so the caller owns the array.
+ *
+ * When the log file is written through io_uring, flushing only queues the data to the ring.
+ *  The queued requests are marked so the caller can wait for them to be written before syncing,
+ *  otherwise the sync could miss data which is still in flight.
+ *
+ * @param currentFD Set to the duplicated descriptor of the current log file, or -1.
+ * @param retained Set to the descriptors of closed log files, or NULL.  Must be freed.
+ * @param retainedCount Set to the number of descriptors in retained.
+ * @param uringMark Set to the mark to wait for, or 0.
+ *
+ * @return TRUE if the mutex could not be locked.
+ */
+static int collectLogfileSync(int *currentFD, int **retained, int *retainedCount, unsigned long *uringMark) {
+    *currentFD = -1;
+    *retained = NULL;
+    *retainedCount = 0;
+    *uringMark = 0;
+    if (lockLoggingMutex()) {
+        return TRUE;
+    }
+    
+    if (logfileSyncDirty && (logfileFP != NULL)) {
+        fflush(logfileFP);
+        *currentFD = dupLogSyncFD(getLogfileFD(logfileFP));
+    }
+#ifdef LOG_URING_SUPPORTED
+    /* Also covers the writes to the retained files, which were all queued earlier. */
+    *uringMark = wrapperUringMark();
+#endif
+    logfileSyncDirty = FALSE;
+    logfileSyncPendingBytes = 0;
+    *retained = logfileSyncRetained;
+    *retainedCount = logfileSyncRetainedCount;
+    logfileSyncRetained = NULL;
+    logfileSyncRetainedSize = 0;
+    logfileSyncRetainedCount = 0;
+    
+    if (releaseLoggingMutex()) {
+        if (*currentFD >= 0) {
+            LOG_SYNC_CLOSE(*currentFD);
+        }
+        while (--(*retainedCount) >= 0) {
+            LOG_SYNC_CLOSE((*retained)[*retainedCount]);
+        }
+        free(*retained);
+        return TRUE;
+    }
+    return FALSE;
 }
 
-int getSyslogLevelInt() {
-    return currentLoginfoLevel;
+/**
+ * Syncs a descriptor collected by collectLogfileSync and closes it.
+ *
+ * @return TRUE if there were any problems.
+ */
+static int syncLogfileFD(int fd) {
+    int result;
+    
+    result = LOG_SYNC_FD(fd) ? TRUE : FALSE;
+    LOG_SYNC_CLOSE(fd);
+    return result;
 }
 
-void setSyslogLevel( const TCHAR *loginfo_level ) {
-    setSyslogLevelInt(getLogLevelForName(loginfo_level));
+/**
+ * Syncs any log file data not yet on the disk.  Called without being locked.
+ *
+ * @return TRUE if there were any problems.
+ */
+static int syncLogfiles() {
+    int currentFD;
+    int *retained;
+    int retainedCount;
+    int i;
+    int result = FALSE;
+    unsigned long uringMark;
+    
+    if (collectLogfileSync(&currentFD, &retained, &retainedCount, &uringMark)) {
+        return TRUE;
+    }
+#ifdef LOG_URING_SUPPORTED
+    if ((currentFD >= 0) || (retainedCount > 0)) {
+        /* Waited for without being locked so logging is not blocked by the file system. */
+        wrapperUringWaitMark(uringMark);
+    }
+#endif
+    for (i = 0; i < retainedCount; i++) {
+        if (syncLogfileFD(retained[i])) {
+            result = TRUE;
+        }
+    }
+    free(retained);
+    if ((currentFD >= 0) && syncLogfileFD(currentFD)) {
+        result = TRUE;
+    }
+    return result;
+}
+
+/**
+ * Main function of the sync thread.
+ */
+#ifdef WIN32
+DWORD WINAPI logfileSyncRunner(LPVOID parameter) {
+#else
+void *logfileSyncRunner(void *arg) {
+    sigset_t signal_mask;
+    struct timeval now;
+    struct timespec deadline;
+#endif
+    int failed = FALSE;
+    
+    logRegisterThread(WRAPPER_THREAD_LOGSYNC);
+    
+#ifndef WIN32
+    /* Signals are handled by the main thread. */
+    sigfillset(&signal_mask);
+    pthread_sigmask(SIG_BLOCK, &signal_mask, NULL);
+#endif
+
+    while (!logfileSyncStop) {
+        /* Wait until the interval has passed or a sync is requested.  If the group commit was
+         *  disabled by a reload, nothing new is written to be synced so just wait to be woken up. */
+#ifdef WIN32
+        WaitForSingleObject(logfileSyncEvent, (logfileSyncInterval > 0) ? (DWORD)logfileSyncInterval : INFINITE);
+        logfileSyncRequested = FALSE;
+#else
+        pthread_mutex_lock(&logfileSyncMutex);
+        while (!logfileSyncRequested && !logfileSyncStop && (logfileSyncInterval <= 0)) {
+            pthread_cond_wait(&logfileSyncCond, &logfileSyncMutex);
+        }
+        if (!logfileSyncRequested && !logfileSyncStop) {
+            gettimeofday(&now, NULL);
+            deadline.tv_sec = now.tv_sec + logfileSyncInterval / 1000;
+            deadline.tv_nsec = (now.tv_usec + (logfileSyncInterval % 1000) * 1000L) * 1000L;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&logfileSyncCond, &logfileSyncMutex, &deadline);
+        }
+        logfileSyncRequested = FALSE;
+        pthread_mutex_unlock(&logfileSyncMutex);
+#endif
+        
+        if (syncLogfiles()) {
+            /* Only report the first failure in a row. */
+            if (!failed) {
+                log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN, TEXT("Unable to sync the log file to the disk: %s"), getLastErrorText());
+                failed = TRUE;
+            }
+        } else {
+            failed = FALSE;
+        }
+    }
+    
+#ifdef WIN32
+    return 0;
+#else
+    return NULL;
+#endif
+}
+
+/**
+ * Starts the sync thread if the group commit is enabled and it is not already running.
+ *
+ * @return TRUE if the sync thread could not be started.
+ */
+static int startLogfileSyncThread() {
+#ifdef WIN32
+    DWORD threadId;
+#endif
+
+    if ((logfileSyncInterval <= 0) || logfileSyncThreadStarted) {
+        return FALSE;
+    }
+    
+    logfileSyncStop = FALSE;
+#ifdef WIN32
+    logfileSyncEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (!logfileSyncEvent) {
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_ERROR, TEXT("Unable to create the log file sync event: %s"), getLastErrorText());
+        return TRUE;
+    }
+    logfileSyncThreadHandle = CreateThread(NULL, 0, logfileSyncRunner, NULL, 0, &threadId);
+    if (!logfileSyncThreadHandle) {
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_ERROR, TEXT("Unable to create the log file sync thread: %s"), getLastErrorText());
+        CloseHandle(logfileSyncEvent);
+        logfileSyncEvent = NULL;
+        return TRUE;
+    }
+#else
+    if (pthread_create(&logfileSyncThreadId, NULL, logfileSyncRunner, NULL)) {
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_ERROR, TEXT("Unable to create the log file sync thread: %s"), getLastErrorText());
+        return TRUE;
+    }
+#endif
+    logfileSyncThreadStarted = TRUE;
+    return FALSE;
+}
+
+/**
+ * Sets the group commit of the log file.
+ *
+ * @param interval Maximum number of milliseconds before written data is synced.  0 disables it.
+ * @param bytes Number of bytes after which the data is synced without waiting.  0 for no limit.
+ * @param level Log level at or above which the data is synced without waiting.
+ */
+void setLogfileSync(int interval, int bytes, int level) {
+    logfileSyncInterval = interval;
+    logfileSyncBytes = bytes;
+    logfileSyncLevel = level;
+    
+    if (logfileSyncThreadStarted) {
+        /* Let the running thread pick up the new interval, syncing anything still pending. */
+        wakeLogfileSyncThread();
+    } else if (logfileSyncStartable) {
+        /* Enabled by a reload of the configuration. */
+        startLogfileSyncThread();
+    }
+}
+
+/**
+ * Starts the group commit of the log file if enabled.  Must not be called before the process is
+ *  daemonized as the sync thread would not survive the fork.
+ *
+ * @return TRUE if the sync thread could not be started.
+ */
+int startLogfileSync() {
+    logfileSyncStartable = TRUE;
+    return startLogfileSyncThread();
+}
+
+/**
+ * Sets up io_uring if it was configured.  Log files opened from now on are written through it,
+ *  so the current log file is closed to be reopened by the next message.  This can only be done
+ *  once the Wrapper is daemonized as the ring can not be shared with a forked process.
+ *
+ * @return TRUE if io_uring was configured but is not available.
+ */
+int startLogfileUring() {
+    if (!logfileUring) {
+        return FALSE;
+    }
+#ifdef LOG_URING_SUPPORTED
+    if (wrapperUringIsAvailable()) {
+        return FALSE;
+    }
+    if (wrapperUringInit()) {
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO,
+            TEXT("io_uring is not available.  Files will be written synchronously. (%s)"), getLastErrorText());
+        return TRUE;
+    }
+    closeLogfile();
+    return FALSE;
+#else
+    log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO,
+        TEXT("io_uring is not supported on this platform.  Files will be written synchronously."));
+    return TRUE;
+#endif
+}
+
+/**
+ * Stops the sync thread, if running, and syncs anything which has not yet been synced.
+ */
+static void stopLogfileSync() {
+#ifdef WRAPPER_URING_SUPPORTED
+    /* Writes still in flight would not be synced. */
+    wrapperUringDrain();
+#endif
+    if (!logfileSyncThreadStarted) {
+        return;
+    }
+    
+    logfileSyncStop = TRUE;
+    wakeLogfileSyncThread();
+#ifdef WIN32
+    WaitForSingleObject(logfileSyncThreadHandle, INFINITE);
+    CloseHandle(logfileSyncThreadHandle);
+    logfileSyncThreadHandle = NULL;
+    CloseHandle(logfileSyncEvent);
+    logfileSyncEvent = NULL;
+#else
+    pthread_join(logfileSyncThreadId, NULL);
+#endif
+    
+    syncLogfiles();
+    logfileSyncThreadStarted = FALSE;
+}
+
+/* Console functions */
+void setConsoleLogFormat( const TCHAR *console_log_format ) {
+    if ( console_log_format != NULL ) {
+        _tcsncpy( consoleFormat, console_log_format, 32 );
+        
+        /* We only want to time logging if it is needed. */
+        if ((logPrintfWarnThreshold <= 0) && (_tcschr(console_log_format, TEXT('G')))) {
+            logPrintfWarnThreshold = 99999999;
+        }
+    }
+}
+
+void setConsoleLogLevelInt( int console_log_level ) {
+    currentConsoleLevel = console_log_level;
+}
+
+int getConsoleLogLevelInt() {
+    return currentConsoleLevel;
+}
+
+void setConsoleLogLevel( const TCHAR *console_log_level ) {
+    setConsoleLogLevelInt(getLogLevelForName(console_log_level));
+}
+
+void setConsoleFlush( int flush ) {
+    consoleFlush = flush;
+}
+    
+#ifdef WIN32
+void setConsoleDirect( int direct ) {
+    consoleDirect = direct;
+}
+#endif
+
+void setConsoleFatalToStdErr(int toStdErr) {
+    consoleFatalToStdErr = toStdErr;
+}
+
+void setConsoleErrorToStdErr(int toStdErr) {
+    consoleErrorToStdErr = toStdErr;
+}
+
+void setConsoleWarnToStdErr(int toStdErr) {
+    consoleWarnToStdErr = toStdErr;
+}
+
+/* Syslog/eventlog functions */
+void setSyslogLevelInt( int loginfo_level ) {
+    currentLoginfoLevel = loginfo_level;
+}
+
+int getSyslogLevelInt() {
+    return currentLoginfoLevel;
+}
+
+void setSyslogLevel( const TCHAR *loginfo_level ) {
+    setSyslogLevelInt(getLogLevelForName(loginfo_level));
 }
 
 void setSyslogSplitMessages(int splitMessages) {
@@ -1544,6 +2359,7 @@ void resetDuration() {
 int getLowLogLevel() {
     int lowLogLevel = (currentLogfileLevel < currentConsoleLevel ? currentLogfileLevel : currentConsoleLevel);
     lowLogLevel =  (currentLoginfoLevel < lowLogLevel ? currentLoginfoLevel : lowLogLevel);
+    lowLogLevel =  (logRoutesLowLevel < lowLogLevel ? logRoutesLowLevel : lowLogLevel);
     return lowLogLevel;
 }
 
@@ -1575,6 +2391,47 @@ TCHAR* preparePrintBuffer(size_t reqSize) {
     return threadPrintBuffer;
 }
 
+/**
+ * Returns the name of a thread as displayed in the log.
+ *
+ * @param threadId Id of the thread.
+ *
+ * @return The name of the thread.
+ */
+static const TCHAR* getLogThreadName(int threadId) {
+    switch ( threadId )
+    {
+    case WRAPPER_THREAD_SIGNAL:
+        return TEXT("signal");
+
+    case WRAPPER_THREAD_MAIN:
+        return TEXT("main");
+
+    case WRAPPER_THREAD_SRVMAIN:
+        return TEXT("srvmain");
+
+    case WRAPPER_THREAD_TIMER:
+        return TEXT("timer");
+        
+#ifdef WIN32
+    case WRAPPER_THREAD_MESSAGE:
+        return TEXT("message");
+#endif
+
+    case WRAPPER_THREAD_JAVAIO:
+        return TEXT("javaio");
+
+    case WRAPPER_THREAD_STARTUP:
+        return TEXT("startup");
+
+    case WRAPPER_THREAD_LOGSYNC:
+        return TEXT("logsync");
+
+    default:
+        return TEXT("unknown");
+    }
+}
+
 /* Returns the number of columns and come up with a required length for the printBuffer. */
 int GetColumnsAndReqSizeForPrintBuffer(const TCHAR *format, const TCHAR *message, size_t *reqSize) {
     int i;
@@ -1731,7 +2588,11 @@ TCHAR* buildPrintBuffer( int source_id, int level, int threadId, int queued, str
                 break;
 
             default:
-                temp = _sntprintf( pos, reqSize - len, TEXT("jvm %-4d"), source_id );
+                if (source_id & WRAPPER_SOURCE_STDERR_FLAG) {
+                    temp = _sntprintf( pos, reqSize - len, TEXT("jerr %-3d"), source_id & ~WRAPPER_SOURCE_STDERR_FLAG );
+                } else {
+                    temp = _sntprintf( pos, reqSize - len, TEXT("jvm %-4d"), source_id );
+                }
                 break;
             }
             currentColumn++;
@@ -1745,42 +2606,12 @@ TCHAR* buildPrintBuffer( int source_id, int level, int threadId, int queued, str
 
         case TEXT('D'):
         case TEXT('d'):
-            switch ( threadId )
-            {
-            case WRAPPER_THREAD_SIGNAL:
-                temp = _sntprintf( pos, reqSize - len, TEXT("signal ") );
-                break;
-
-            case WRAPPER_THREAD_MAIN:
-                temp = _sntprintf( pos, reqSize - len, TEXT("main   ") );
-                break;
-
-            case WRAPPER_THREAD_SRVMAIN:
-                temp = _sntprintf( pos, reqSize - len, TEXT("srvmain") );
-                break;
-
-            case WRAPPER_THREAD_TIMER:
-                temp = _sntprintf( pos, reqSize - len, TEXT("timer  ") );
-                break;
-                
-#ifdef WIN32
-            case WRAPPER_THREAD_MESSAGE:
-                temp = _sntprintf( pos, reqSize - len, TEXT("message") );
-                break;
-#endif
-
-            case WRAPPER_THREAD_JAVAIO:
-                temp = _sntprintf( pos, reqSize - len, TEXT("javaio ") );
-                break;
-
-            case WRAPPER_THREAD_STARTUP:
-                temp = _sntprintf( pos, reqSize - len, TEXT("startup") );
-                break;
-
-            default:
-                temp = _sntprintf( pos, reqSize - len, TEXT("unknown") );
-                break;
+            temp = _sntprintf( pos, reqSize - len, TEXT("%s"), getLogThreadName(threadId) );
+            /* Pad to the width of the column. */
+            while (temp < 7) {
+                pos[temp++] = TEXT(' ');
             }
+            pos[temp] = TEXT('\0');
             currentColumn++;
             break;
 
@@ -1866,73 +2697,361 @@ TCHAR* buildPrintBuffer( int source_id, int level, int threadId, int queued, str
 }
 
 /**
- * Generates a log file name given.
+ * Writes a string as a quoted JSON string.  Runs of characters which do not
+ *  need to be escaped are copied at once.
  *
- * buffer - Buffer into which to _sntprintf the generated name.
- * bufferSize - Size of the buffer.
- * template - Template from which the name is generated.
- * nowDate - Optional date used to replace any YYYYMMDD tokens.
- * rollNum - Optional roll number used to replace any ROLLNUM tokens.
+ * @param pos Buffer to write to.  Must have room for 6 characters for each
+ *            character of str plus the quotes.
+ * @param str The string to write.
+ *
+ * @return The number of characters written.
  */
-void generateLogFileName(TCHAR *buffer, size_t bufferSize, const TCHAR *template, const TCHAR *nowDate, const TCHAR *rollNum ) {
-    size_t bufferLen;
-    
-    /* Copy the template to the buffer to get started. */
-    _tcsncpy(buffer, template, _tcslen(template) + 1);
+static size_t printJSONString(TCHAR *pos, const TCHAR *str) {
+    TCHAR *start = pos;
+    const TCHAR *run;
+
+    *(pos++) = TEXT('"');
+    while (*str) {
+        run = str;
+        while (*str && (*str != TEXT('"')) && (*str != TEXT('\\')) && ((*str < 0) || (*str >= 0x20))) {
+            str++;
+        }
+        if (str > run) {
+            memcpy(pos, run, sizeof(TCHAR) * (str - run));
+            pos += str - run;
+        }
+        if (!*str) {
+            break;
+        }
+        *(pos++) = TEXT('\\');
+        switch (*str) {
+        case TEXT('"'):
+        case TEXT('\\'):
+            *(pos++) = *str;
+            break;
 
-    /* Handle the date token. */
-    if (_tcsstr(buffer, TEXT("YYYYMMDD"))) {
-        /* The token needs to be replaced. */
-        replaceStringLongWithShort(buffer, TEXT("YYYYMMDD"), nowDate);
-    }
+        case TEXT('\n'):
+            *(pos++) = TEXT('n');
+            break;
 
-    /* Handle the roll number token. */
-    if (_tcsstr(buffer, TEXT("ROLLNUM"))) {
-        if (rollNum == NULL ) {
-            /* The token needs to be removed. */
-            replaceStringLongWithShort(buffer, TEXT("-ROLLNUM"), NULL);
-            replaceStringLongWithShort(buffer, TEXT("_ROLLNUM"), NULL);
-            replaceStringLongWithShort(buffer, TEXT(".ROLLNUM"), NULL);
-            replaceStringLongWithShort(buffer, TEXT("ROLLNUM"), NULL);
-        } else {
-            /* The token needs to be replaced. */
-            replaceStringLongWithShort(buffer, TEXT("ROLLNUM"), rollNum);
-        }
-    } else {
-        /* The name did not contain a ROLLNUM token. */
-        if (rollNum != NULL ) {
-            bufferLen = _tcslen(buffer);
-            if (_tcscmp(rollNum, TEXT("*")) == 0) {
-                /* Append the '*' at the end. */
-                _sntprintf(buffer + bufferLen, bufferSize - bufferLen, TEXT("%s"), rollNum);
-            } else {
-                /* Generate the name as if ".ROLLNUM" was appended to the template. */
-                _sntprintf(buffer + bufferLen, bufferSize - bufferLen, TEXT(".%s"), rollNum);
-            }
-            buffer[bufferSize - 1] = TEXT('\0');
+        case TEXT('\r'):
+            *(pos++) = TEXT('r');
+            break;
+
+        case TEXT('\t'):
+            *(pos++) = TEXT('t');
+            break;
+
+        default:
+            pos += _sntprintf(pos, 6, TEXT("u%04x"), (int)*str);
+            break;
         }
+        str++;
     }
-}
-
-void generateLogFilePattern(TCHAR *buffer, size_t bufferSize) {
-    generateLogFileName(buffer, bufferSize, logFilePath, TEXT("????????"), TEXT("*"));
+    *(pos++) = TEXT('"');
+    return pos - start;
 }
 
 /**
- * Prints the contents of a buffer to the sysLog target.  The log level is
- *  tested prior to this function being called.
- *
- * Must be called while locked.
+ * Returns the name of a source as used by the JSON format and the log routes.
  */
-void log_printf_message_sysLogInner(int source_id, int level, TCHAR *message, struct tm *nowTM) {
+static const TCHAR* getLogSourceName(int source_id) {
+    switch ( source_id ) {
+    case WRAPPER_SOURCE_WRAPPER:
 #ifdef WIN32
-        sendEventlogMessage(source_id, level, message);
+        return launcherSource ? TEXT("wrapperm") : TEXT("wrapper");
 #else
-        sendLoginfoMessage(source_id, level, message);
+        return TEXT("wrapper");
 #endif
-}
-/**
- * @param invertLogLevelCheck There is a special case where we want to log to
+
+    case WRAPPER_SOURCE_PROTOCOL:
+        return TEXT("protocol");
+
+    case WRAPPER_SOURCE_JVM_VERSION:
+        return TEXT("jvm_version");
+
+    default:
+        return (source_id & WRAPPER_SOURCE_STDERR_FLAG) ? TEXT("jvm_stderr") : TEXT("jvm");
+    }
+}
+
+/* Room for the fields of a JSON log entry other than the message, including the quotes and escapes of
+ *  the message.  This is well above the longest possible names and numbers. */
+#define LOG_JSON_FIXED_SIZE 256
+
+/* Writes a log entry as a JSON object to and then returns a buffer that is reused by the current thread.
+ *  It should not be released. */
+TCHAR* buildJSONPrintBuffer( int source_id, int level, int threadId, time_t durationMillis, const TCHAR *message) {
+    size_t    reqSize;
+    size_t    len = 0;
+    int       temp;
+    TCHAR     *pos;
+    int       i;
+
+    /* Fixed fields plus the worst case where every character of the message must be escaped. */
+    reqSize = LOG_JSON_FIXED_SIZE + _tcslen(message) * 6 + 1;
+    if ( !preparePrintBuffer(reqSize)) {
+        return NULL;
+    }
+    pos = threadPrintBuffer;
+
+    temp = _sntprintf( pos, reqSize - len, TEXT("{\"time\":%ld%06d,\"level\":\""), (long)currentNow, currentNowMicros );
+    if (temp > 0) {
+        pos += temp;
+        len += temp;
+    }
+    /* The level names are padded for the column format. */
+    for (i = 0; logLevelNames[level][i] && (logLevelNames[level][i] != TEXT(' ')); i++) {
+        *(pos++) = logLevelNames[level][i];
+        len++;
+    }
+
+    temp = _sntprintf( pos, reqSize - len, TEXT("\",\"source\":\"%s\""), getLogSourceName(source_id) );
+    if (temp > 0) {
+        pos += temp;
+        len += temp;
+    }
+    if (source_id > 0) {
+        temp = _sntprintf( pos, reqSize - len, TEXT(",\"jvm\":%d"), source_id & ~WRAPPER_SOURCE_STDERR_FLAG );
+        if (temp > 0) {
+            pos += temp;
+            len += temp;
+        }
+    }
+    temp = _sntprintf( pos, reqSize - len, TEXT(",\"thread\":\"%s\""), getLogThreadName(threadId) );
+    if (temp > 0) {
+        pos += temp;
+        len += temp;
+    }
+    if (durationMillis != (time_t)-1) {
+        temp = _sntprintf( pos, reqSize - len, TEXT(",\"duration\":%ld"), (long)durationMillis );
+        if (temp > 0) {
+            pos += temp;
+            len += temp;
+        }
+    }
+    temp = _sntprintf( pos, reqSize - len, TEXT(",\"message\":") );
+    if (temp > 0) {
+        pos += temp;
+        len += temp;
+    }
+    pos += printJSONString( pos, message );
+    *(pos++) = TEXT('}');
+    *pos = TEXT('\0');
+
+    return threadPrintBuffer;
+}
+
+/* Space reserved at the start of the binary record buffer for the fixed fields. */
+#define LOG_BINARY_HEADER_MAX 64
+
+static size_t putBinaryVarint(unsigned char *pos, unsigned long value) {
+    size_t len = 0;
+
+    while (value >= 0x80) {
+        pos[len++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    pos[len++] = (unsigned char)value;
+    return len;
+}
+
+/* Maps signed values to unsigned ones so that small negative values also result in short varints. */
+static unsigned long zigzagBinary(long value) {
+    if (value < 0) {
+        return (((unsigned long)(-(value + 1))) << 1) | 1;
+    } else {
+        return ((unsigned long)value) << 1;
+    }
+}
+
+/* Encodes a string as UTF-8.  The buffer must have room for 4 bytes per character. */
+static size_t putBinaryString(unsigned char *pos, const TCHAR *str) {
+#ifdef UNICODE
+    unsigned char *start = pos;
+    unsigned long c;
+
+    while (*str) {
+        c = (unsigned long)*(str++);
+ #ifdef WIN32
+        /* Combine surrogate pairs. */
+        if ((c >= 0xD800) && (c <= 0xDBFF) && (*str >= 0xDC00) && (*str <= 0xDFFF)) {
+            c = 0x10000 + ((c - 0xD800) << 10) + ((unsigned long)*(str++) - 0xDC00);
+        }
+ #endif
+        if (c < 0x80) {
+            *(pos++) = (unsigned char)c;
+        } else if (c < 0x800) {
+            *(pos++) = (unsigned char)(0xC0 | (c >> 6));
+            *(pos++) = (unsigned char)(0x80 | (c & 0x3F));
+        } else if ((c < 0x10000) || (c > 0x10FFFF)) {
+            if (c > 0x10FFFF) {
+                c = 0xFFFD;
+            }
+            *(pos++) = (unsigned char)(0xE0 | (c >> 12));
+            *(pos++) = (unsigned char)(0x80 | ((c >> 6) & 0x3F));
+            *(pos++) = (unsigned char)(0x80 | (c & 0x3F));
+        } else {
+            *(pos++) = (unsigned char)(0xF0 | (c >> 18));
+            *(pos++) = (unsigned char)(0x80 | ((c >> 12) & 0x3F));
+            *(pos++) = (unsigned char)(0x80 | ((c >> 6) & 0x3F));
+            *(pos++) = (unsigned char)(0x80 | (c & 0x3F));
+        }
+    }
+    return pos - start;
+#else
+    size_t len = strlen(str);
+
+    memcpy(pos, str, len);
+    return len;
+#endif
+}
+
+/**
+ * Called whenever a binary log file was (re)opened.  A new file gets the signature.  The first
+ *  record always stores an absolute time as the file may have been written to in the meantime.
+ *
+ * Must be called while locked.
+ */
+static void startBinaryLogFile() {
+#ifdef WIN32
+    struct _stat64i32 fileStat;
+
+    if ((_fstat(_fileno(logfileFP), &fileStat) == 0) && (fileStat.st_size == 0)) {
+#else
+    struct stat fileStat;
+
+    if ((fstat(fileno(logfileFP), &fileStat) == 0) && (fileStat.st_size == 0)) {
+#endif
+        fwrite(LOG_BINARY_SIGNATURE, 1, LOG_BINARY_SIGNATURE_LEN, logfileFP);
+    }
+    logfileBinaryHasBase = FALSE;
+}
+
+/**
+ * Writes a log entry to the log file as a binary record.  See logger.h for the layout.
+ *
+ * Must be called while locked.
+ *
+ * @return The number of bytes written, 0 if the record could not be written.
+ */
+static size_t writeBinaryLogRecord(int source_id, int level, int threadId, int queued, time_t durationMillis, const TCHAR *message) {
+    size_t reqSize;
+    size_t messageLen;
+    unsigned char *pos;
+    long diff;
+
+    reqSize = LOG_BINARY_HEADER_MAX + _tcslen(message) * 4;
+    if (logfileBinaryBufferSize < reqSize) {
+        if (logfileBinaryBuffer) {
+            free(logfileBinaryBuffer);
+        }
+        logfileBinaryBuffer = malloc(reqSize);
+        if (!logfileBinaryBuffer) {
+            _tprintf(TEXT("Out of memory in logging code (%s)\n"), TEXT("WBLR1"));
+            logfileBinaryBufferSize = 0;
+            return 0;
+        }
+        logfileBinaryBufferSize = reqSize;
+    }
+    /* The message is encoded first so its length is known when the fixed fields are written in front of it. */
+    messageLen = putBinaryString(logfileBinaryBuffer + LOG_BINARY_HEADER_MAX, message);
+
+    pos = logfileBinaryBuffer;
+    *pos = (unsigned char)((level & LOG_BINARY_LEVEL_MASK) | (queued ? LOG_BINARY_FLAG_QUEUED : 0));
+    diff = (long)(currentNow - logfileBinaryLastNow);
+    if (logfileBinaryHasBase && (diff > -2000) && (diff < 2000)) {
+        /* Fits in 32 bits. */
+        pos++;
+        pos += putBinaryVarint(pos, zigzagBinary(diff * 1000000L + (currentNowMicros - logfileBinaryLastMicros)));
+    } else {
+        *(pos++) |= LOG_BINARY_FLAG_ABSOLUTE;
+        pos += putBinaryVarint(pos, (unsigned long)currentNow);
+        pos += putBinaryVarint(pos, (unsigned long)currentNowMicros);
+        logfileBinaryHasBase = TRUE;
+    }
+    logfileBinaryLastNow = currentNow;
+    logfileBinaryLastMicros = currentNowMicros;
+
+    pos += putBinaryVarint(pos, zigzagBinary(source_id));
+    pos += putBinaryVarint(pos, zigzagBinary(threadId));
+    pos += putBinaryVarint(pos, (durationMillis == (time_t)-1) ? 0 : (unsigned long)durationMillis + 1);
+    pos += putBinaryVarint(pos, uptimeFlipped ? 0 : (unsigned long)uptimeSeconds + 1);
+    pos += putBinaryVarint(pos, (unsigned long)messageLen);
+
+    fwrite(logfileBinaryBuffer, 1, pos - logfileBinaryBuffer, logfileFP);
+    fwrite(logfileBinaryBuffer + LOG_BINARY_HEADER_MAX, 1, messageLen, logfileFP);
+    return (pos - logfileBinaryBuffer) + messageLen;
+}
+
+/**
+ * Generates a log file name given.
+ *
+ * buffer - Buffer into which to _sntprintf the generated name.
+ * bufferSize - Size of the buffer.
+ * template - Template from which the name is generated.
+ * nowDate - Optional date used to replace any YYYYMMDD tokens.
+ * rollNum - Optional roll number used to replace any ROLLNUM tokens.
+ */
+void generateLogFileName(TCHAR *buffer, size_t bufferSize, const TCHAR *template, const TCHAR *nowDate, const TCHAR *rollNum ) {
+    size_t bufferLen;
+    
+    /* Copy the template to the buffer to get started. */
+    _tcsncpy(buffer, template, _tcslen(template) + 1);
+
+    /* Handle the date token. */
+    if (_tcsstr(buffer, TEXT("YYYYMMDD"))) {
+        /* The token needs to be replaced. */
+        replaceStringLongWithShort(buffer, TEXT("YYYYMMDD"), nowDate);
+    }
+
+    /* Handle the roll number token. */
+    if (_tcsstr(buffer, TEXT("ROLLNUM"))) {
+        if (rollNum == NULL ) {
+            /* The token needs to be removed. */
+            replaceStringLongWithShort(buffer, TEXT("-ROLLNUM"), NULL);
+            replaceStringLongWithShort(buffer, TEXT("_ROLLNUM"), NULL);
+            replaceStringLongWithShort(buffer, TEXT(".ROLLNUM"), NULL);
+            replaceStringLongWithShort(buffer, TEXT("ROLLNUM"), NULL);
+        } else {
+            /* The token needs to be replaced. */
+            replaceStringLongWithShort(buffer, TEXT("ROLLNUM"), rollNum);
+        }
+    } else {
+        /* The name did not contain a ROLLNUM token. */
+        if (rollNum != NULL ) {
+            bufferLen = _tcslen(buffer);
+            if (_tcscmp(rollNum, TEXT("*")) == 0) {
+                /* Append the '*' at the end. */
+                _sntprintf(buffer + bufferLen, bufferSize - bufferLen, TEXT("%s"), rollNum);
+            } else {
+                /* Generate the name as if ".ROLLNUM" was appended to the template. */
+                _sntprintf(buffer + bufferLen, bufferSize - bufferLen, TEXT(".%s"), rollNum);
+            }
+            buffer[bufferSize - 1] = TEXT('\0');
+        }
+    }
+}
+
+void generateLogFilePattern(TCHAR *buffer, size_t bufferSize) {
+    generateLogFileName(buffer, bufferSize, logFilePath, TEXT("????????"), TEXT("*"));
+}
+
+/**
+ * Prints the contents of a buffer to the sysLog target.  The log level is
+ *  tested prior to this function being called.
+ *
+ * Must be called while locked.
+ */
+void log_printf_message_sysLogInner(int source_id, int level, TCHAR *message, struct tm *nowTM) {
+#ifdef WIN32
+        sendEventlogMessage(source_id, level, message);
+#else
+        sendLoginfoMessage(source_id, level, message);
+#endif
+}
+/**
+ * @param invertLogLevelCheck There is a special case where we want to log to
  *                            the syslog IF and only if the normal log output
  *                            would not go to the syslog.  This flag makes it
  *                            possible to log it if we normally would not.
@@ -1971,7 +3090,465 @@ static void restoreConfiguredRolling() {
     logFileMaxLogFiles = confLogFileMaxLogFiles;
 }
 
+/* Binary log files must not be opened in text mode as Windows would translate line feeds. */
+static const TCHAR* getLogfileOpenMode() {
+    return logfileFormatBinary ? TEXT("ab") : TEXT("a");
+}
+
+#ifdef LOG_MMAP_SUPPORTED
+/**
+ * Grows the mapping of a log file so it can hold at least the required number of bytes.
+ *
+ * @return TRUE if there were any problems.
+ */
+static int growLogMmap(LogMmapFile *file, size_t required) {
+    size_t newSize = required + LOG_MMAP_GROW_SIZE;
+    char *data;
+    
+    /* The space must really be allocated, as writing to the mapping of a sparse file on a full disk would raise SIGBUS. */
+    errno = posix_fallocate(file->fd, 0, (off_t)newSize);
+    if (errno) {
+        return TRUE;
+    }
+    data = mremap(file->data, file->size, newSize, MREMAP_MAYMOVE);
+    if (data == MAP_FAILED) {
+        return TRUE;
+    }
+    file->data = data;
+    file->size = newSize;
+    return FALSE;
+}
+
+static ssize_t logMmapWrite(void *cookie, const char *buf, size_t size) {
+    LogMmapFile *file = (LogMmapFile *)cookie;
+    
+    if ((file->length + size > file->size) && growLogMmap(file, file->length + size)) {
+        return -1;
+    }
+    memcpy(file->data + file->length, buf, size);
+    file->length += size;
+    return (ssize_t)size;
+}
+
+/* Only used to get the current position, for example by ftell(). */
+static int logMmapSeek(void *cookie, off64_t *offset, int whence) {
+    LogMmapFile *file = (LogMmapFile *)cookie;
+    
+    if ((*offset != 0) || (whence == SEEK_SET)) {
+        errno = EINVAL;
+        return -1;
+    }
+    *offset = (off64_t)file->length;
+    return 0;
+}
+
+static int logMmapClose(void *cookie) {
+    LogMmapFile *file = (LogMmapFile *)cookie;
+    LogMmapFile **link;
+    int result = 0;
+    
+    for (link = &logMmapFiles; *link; link = &((*link)->next)) {
+        if (*link == file) {
+            *link = file->next;
+            break;
+        }
+    }
+    
+    munmap(file->data, file->size);
+    /* Give back the preallocated space which was not used. */
+    if (ftruncate(file->fd, (off_t)file->length)) {
+        result = -1;
+    }
+    if (close(file->fd)) {
+        result = -1;
+    }
+    free(file);
+    return result;
+}
+
+/**
+ * Releases a log file which could not be mapped.
+ */
+static void abortLogMmapFile(LogMmapFile *file) {
+    /* Restore the original length in case the file was already extended. */
+    if (ftruncate(file->fd, (off_t)file->length)) {
+        /* Nothing more can be done.  The unused space will be dropped the next time the file is mapped. */
+    }
+    close(file->fd);
+    free(file);
+}
+
+/**
+ * Opens a log file so it is written through a memory mapping.  The file is preallocated up to
+ *  the maximum log file size.  If the Wrapper was stopped without closing the file properly,
+ *  the file still contains the zero filled preallocated space, which is dropped here.
+ *
+ * Must be called while locked.
+ *
+ * @return The file, or NULL if it could not be mapped.
+ */
+static FILE* openLogfileMmap(const TCHAR *path) {
+    LogMmapFile *file;
+    struct stat fileStat;
+    cookie_io_functions_t functions;
+    size_t recoveredLength;
+    
+    file = malloc(sizeof(LogMmapFile));
+    if (!file) {
+        _tprintf(TEXT("Out of memory in logging code (%s)\n"), TEXT("OLM1"));
+        return NULL;
+    }
+    memset(file, 0, sizeof(LogMmapFile));
+    
+    /* A JVM launched while the file is open must not inherit the descriptor. */
+    file->fd = _topen(path, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+    if (file->fd < 0) {
+        free(file);
+        return NULL;
+    }
+    if (fstat(file->fd, &fileStat)) {
+        close(file->fd);
+        free(file);
+        return NULL;
+    }
+    file->length = (size_t)fileStat.st_size;
+    file->size = __max((size_t)logFileMaxSize, file->length) + LOG_MMAP_SLACK;
+    
+    errno = posix_fallocate(file->fd, 0, (off_t)file->size);
+    if (errno) {
+        abortLogMmapFile(file);
+        return NULL;
+    }
+    file->data = mmap(NULL, file->size, PROT_READ | PROT_WRITE, MAP_SHARED, file->fd, 0);
+    if (file->data == MAP_FAILED) {
+        abortLogMmapFile(file);
+        return NULL;
+    }
+    
+    /* Text log files never contain null characters. */
+    recoveredLength = file->length;
+    while ((file->length > 0) && (file->data[file->length - 1] == '\0')) {
+        file->length--;
+    }
+    if (file->length != recoveredLength) {
+        log_printf_queue(TRUE, WRAPPER_SOURCE_WRAPPER, LEVEL_INFO,
+            TEXT("Log file %s was not closed properly.  Dropped %ld bytes of unused preallocated space."), path, (long)(recoveredLength - file->length));
+    }
+    
+    functions.read = NULL;
+    functions.write = logMmapWrite;
+    functions.seek = logMmapSeek;
+    functions.close = logMmapClose;
+    file->fp = fopencookie(file, "a", functions);
+    if (!file->fp) {
+        logMmapClose(file);
+        return NULL;
+    }
+    file->next = logMmapFiles;
+    logMmapFiles = file;
+    return file->fp;
+}
+#endif
+
+#ifdef LOG_URING_SUPPORTED
+static ssize_t logUringWrite(void *cookie, const char *buf, size_t size) {
+    LogUringFile *file = (LogUringFile *)cookie;
+    
+    if (wrapperUringWrite(file->fd, buf, size)) {
+        errno = ENOMEM;
+        return -1;
+    }
+    file->length += (off64_t)size;
+    return (ssize_t)size;
+}
+
+/* Only used to get the current position, for example by ftell(). */
+static int logUringSeek(void *cookie, off64_t *offset, int whence) {
+    LogUringFile *file = (LogUringFile *)cookie;
+    
+    if ((*offset != 0) || (whence == SEEK_SET)) {
+        errno = EINVAL;
+        return -1;
+    }
+    *offset = file->length;
+    return 0;
+}
+
+static int logUringClose(void *cookie) {
+    LogUringFile *file = (LogUringFile *)cookie;
+    LogUringFile **link;
+    int result;
+    
+    for (link = &logUringFiles; *link; link = &((*link)->next)) {
+        if (*link == file) {
+            *link = file->next;
+            break;
+        }
+    }
+    
+    /* The file is closed once the queued writes are complete. */
+    result = wrapperUringClose(file->fd) ? -1 : 0;
+    free(file);
+    return result;
+}
+
+/**
+ * Opens a log file so its writes are submitted to the io_uring ring rather than blocking the
+ *  logging thread.
+ *
+ * Must be called while locked.
+ *
+ * @return The file, or NULL if it could not be opened.
+ */
+static FILE* openLogfileUring(const TCHAR *path) {
+    LogUringFile *file;
+    struct stat fileStat;
+    cookie_io_functions_t functions;
+    
+    file = malloc(sizeof(LogUringFile));
+    if (!file) {
+        _tprintf(TEXT("Out of memory in logging code (%s)\n"), TEXT("OLU1"));
+        return NULL;
+    }
+    memset(file, 0, sizeof(LogUringFile));
+    
+    /* Queued closes may complete after a JVM was forked, so the descriptor must not be inherited. */
+    file->fd = _topen(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0666);
+    if (file->fd < 0) {
+        free(file);
+        return NULL;
+    }
+    if (fstat(file->fd, &fileStat)) {
+        close(file->fd);
+        free(file);
+        return NULL;
+    }
+    file->length = (off64_t)fileStat.st_size;
+    
+    functions.read = NULL;
+    functions.write = logUringWrite;
+    functions.seek = logUringSeek;
+    functions.close = logUringClose;
+    file->fp = fopencookie(file, "a", functions);
+    if (!file->fp) {
+        close(file->fd);
+        free(file);
+        return NULL;
+    }
+    file->next = logUringFiles;
+    logUringFiles = file;
+    return file->fp;
+}
+#endif
+
+/**
+ * Returns TRUE if log files are written through a memory mapping.  This is only possible on
+ *  Linux, for text log files rolled by size.
+ */
+static int isLogfileMmap() {
+#ifdef LOG_MMAP_SUPPORTED
+    /* ftell() is needed to know when to roll the file. */
+    return logfileMmap && !logfileFormatBinary && (logFileRollMode & ROLL_MODE_SIZE) && (logFileMaxSize > 0) && !doesFtellCauseMemoryLeak();
+#else
+    return FALSE;
+#endif
+}
+
+/**
+ * Returns TRUE if log files are written asynchronously through io_uring.
+ */
+static int isLogfileUring() {
+#ifdef LOG_URING_SUPPORTED
+    return logfileUring && wrapperUringIsAvailable();
+#else
+    return FALSE;
+#endif
+}
+
+/**
+ * Opens a log file for appending.
+ *
+ * Must be called while locked.
+ *
+ * @param path Path of the file.
+ * @param allowMmap TRUE if the file may be written through a memory mapping or io_uring.
+ */
+static FILE* openLogfileFP(const TCHAR *path, int allowMmap) {
+#ifdef LOG_MMAP_SUPPORTED
+    FILE *fp;
+    
+    if (allowMmap && isLogfileMmap()) {
+        fp = openLogfileMmap(path);
+        if (fp) {
+            return fp;
+        }
+        /* Fall back to normal file access, for example if the file system does not support preallocation. */
+    }
+#endif
+#ifdef LOG_URING_SUPPORTED
+    if (allowMmap && isLogfileUring()) {
+        fp = openLogfileUring(path);
+        if (fp) {
+            return fp;
+        }
+    }
+#endif
+    return _tfopen(path, getLogfileOpenMode());
+}
+
+#ifdef LOG_MMAP_SUPPORTED
+/**
+ * Returns the mapping of a log file, or NULL if the file is not mapped.
+ */
+static LogMmapFile* getLogMmapFile(FILE *fp) {
+    LogMmapFile *file;
+    
+    for (file = logMmapFiles; file; file = file->next) {
+        if (file->fp == fp) {
+            return file;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Appends a line to a mapped log file.  Wide character output is not possible on the stream of a
+ *  mapped file, so the line is converted here.  Characters which can not be represented in the
+ *  encoding of the current locale are written as '?'.
+ *
+ * @return The number of bytes written, 0 if the mapping could not be grown.
+ */
+static size_t writeLogMmapLine(LogMmapFile *file, const TCHAR *line) {
+    char mb[MB_LEN_MAX];
+    mbstate_t state;
+    size_t start = file->length;
+    size_t len;
+    
+    memset(&state, 0, sizeof(state));
+    for (; ; line++) {
+        if (*line == TEXT('\0')) {
+            mb[0] = '\n';
+            len = 1;
+        } else if ((len = wcrtomb(mb, *line, &state)) == (size_t)-1) {
+            memset(&state, 0, sizeof(state));
+            mb[0] = '?';
+            len = 1;
+        }
+        if ((file->length + len > file->size) && growLogMmap(file, file->length + len)) {
+            return 0;
+        }
+        memcpy(file->data + file->length, mb, len);
+        file->length += len;
+        if (*line == TEXT('\0')) {
+            break;
+        }
+    }
+    return file->length - start;
+}
+#endif
+
+#ifdef LOG_URING_SUPPORTED
+/**
+ * Returns the io_uring log file of a stream, or NULL if the file is written normally.
+ */
+static LogUringFile* getLogUringFile(FILE *fp) {
+    LogUringFile *file;
+    
+    for (file = logUringFiles; file; file = file->next) {
+        if (file->fp == fp) {
+            return file;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Writes a line to a log file written through io_uring.  As for mapped files, the stream does
+ *  not support wide character output so the line is converted here.
+ *
+ * @return The number of bytes written.
+ */
+static size_t writeLogUringLine(FILE *fp, const TCHAR *line) {
+    char buffer[1024];
+    mbstate_t state;
+    size_t pos = 0;
+    size_t total = 0;
+    size_t len;
+    
+    memset(&state, 0, sizeof(state));
+    for (; *line != TEXT('\0'); line++) {
+        if (pos + MB_LEN_MAX > sizeof(buffer)) {
+            fwrite(buffer, 1, pos, fp);
+            total += pos;
+            pos = 0;
+        }
+        if ((len = wcrtomb(buffer + pos, *line, &state)) == (size_t)-1) {
+            memset(&state, 0, sizeof(state));
+            buffer[pos] = '?';
+            len = 1;
+        }
+        pos += len;
+    }
+    buffer[pos++] = '\n';
+    fwrite(buffer, 1, pos, fp);
+    return total + pos;
+}
+#endif
+
+/**
+ * Returns the descriptor of an open log file.
+ */
+static int getLogfileFD(FILE *fp) {
+#ifdef LOG_MMAP_SUPPORTED
+    LogMmapFile *file = getLogMmapFile(fp);
+#endif
+#ifdef LOG_URING_SUPPORTED
+    LogUringFile *uringFile = getLogUringFile(fp);
+#endif
+    
+#ifdef LOG_MMAP_SUPPORTED
+    if (file) {
+        return file->fd;
+    }
+#endif
+#ifdef LOG_URING_SUPPORTED
+    if (uringFile) {
+        return uringFile->fd;
+    }
+#endif
+    return fileno(fp);
+}
+
+/**
+ * Writes a line of text to the log file.
+ *
+ * Must be called while locked.
+ *
+ * @return The number of characters written, bytes for a mapped or io_uring file.  This is only used to
+ *         decide when to sync the file so it does not need to be exact.
+ */
+static size_t writeLogfileLine(const TCHAR *line) {
+#ifdef LOG_MMAP_SUPPORTED
+    LogMmapFile *file = getLogMmapFile(logfileFP);
+    
+    if (file) {
+        return writeLogMmapLine(file, line);
+    }
+#endif
+#ifdef LOG_URING_SUPPORTED
+    if (getLogUringFile(logfileFP)) {
+        return writeLogUringLine(logfileFP, line);
+    }
+#endif
+    _ftprintf(logfileFP, TEXT("%s\n"), line);
+    return _tcslen(line) + 1;
+}
+
 static void printFailoverFileHeader(TCHAR* confFileName) {
+    if (logfileFormatBinary) {
+        /* A binary log file must start with its signature. */
+        return;
+    }
     _ftprintf(logfileFP, TEXT("********************************************************************************\n"));
     _ftprintf(logfileFP, TEXT("* This is a Java Service Wrapper failover log file.\n*  Was unable to write to %s.\n"), confFileName);
     _ftprintf(logfileFP, TEXT("********************************************************************************\n\n"));
@@ -2060,7 +3637,7 @@ int openLogFile(struct tm *nowTM, TCHAR *message) {
                     } else {
                         old_umask = umask( logFileUmask );
                         generateLogFileName(workConfLogFileName, confLogFileNameSize, confLogFileName, nowDate, NULL);
-                        if ((tempLogfileFP = _tfopen(workConfLogFileName, TEXT("a"))) == NULL) {
+                        if ((tempLogfileFP = openLogfileFP(workConfLogFileName, TRUE)) == NULL) {
                             /* The configured log file has changed but is not accessible. Reset the file opening
                              *  system in its original state to clearly show that the new file is not accessible. */
                             dummyReset = TRUE;
@@ -2076,8 +3653,7 @@ int openLogFile(struct tm *nowTM, TCHAR *message) {
                         /* Now actually reset the file opening system */
                         if (logfileFP != NULL) {
                             /* Close the previous log file. We can do this safely because we are already locked. */
-                            fclose(logfileFP);
-                            logfileFP = NULL;
+                            closeLogfileFP();
                         }
                         if (whichLogFile == LOG_FILE_DISABLED) {
                             /* We previously disabled file logging. Reactivate it. */
@@ -2103,7 +3679,7 @@ int openLogFile(struct tm *nowTM, TCHAR *message) {
                 if (workConfLogFileName[0] == TEXT('\0')) {
                     generateLogFileName(workConfLogFileName, confLogFileNameSize, confLogFileName, nowDate, NULL);
                 }
-                tempLogfileFP = _tfopen(workConfLogFileName, TEXT("a"));
+                tempLogfileFP = openLogfileFP(workConfLogFileName, TRUE);
                 if (!tempLogfileFP) {
                     _tcsncpy(tempBufferLastErrorText1, getLastErrorText(), 1023);
                     tempBufferLastErrorText1[1023] = 0;
@@ -2116,8 +3692,7 @@ int openLogFile(struct tm *nowTM, TCHAR *message) {
                     if (logfileFP != NULL) {
                         /* Make sure to close the default log file (we have not set logfileFP yet). */
                         /* We are already locked. */
-                        fclose(logfileFP);
-                        logfileFP = NULL;
+                        closeLogfileFP();
                     }
                     if (whichLogFile == LOG_FILE_DISABLED) {
                         /* We previously disabled file logging. Reactivate it. */
@@ -2170,7 +3745,8 @@ int openLogFile(struct tm *nowTM, TCHAR *message) {
                     logFileChanged = TRUE;
                 }
 
-                logfileFP = _tfopen(currentLogFileName, TEXT("a"));
+                /* The default log file is not mapped as its size is checked to know whether it is new. */
+                logfileFP = openLogfileFP(currentLogFileName, whichLogFile != LOG_FILE_DEFAULT);
                 if (!logfileFP) {
                     if (whichLogFile == LOG_FILE_DEFAULT) {
                         _tcsncpy(tempBufferLastErrorText2, getLastErrorText(), 1023);
@@ -2198,7 +3774,7 @@ int openLogFile(struct tm *nowTM, TCHAR *message) {
                 }
             } else {
                 if (whichLogFile != LOG_FILE_DEFAULT) {
-                    logfileFP = _tfopen(defaultLogFile, TEXT("a"));
+                    logfileFP = openLogfileFP(defaultLogFile, FALSE);
                     if (!logfileFP) {
                         _tcsncpy(tempBufferLastErrorText2, getLastErrorText(), 1023);
                         tempBufferLastErrorText2[1023] = 0;
@@ -2287,26 +3863,440 @@ int openLogFile(struct tm *nowTM, TCHAR *message) {
             }
             umask(old_umask);
 
-#ifdef _DEBUG
-            if (logfileFP != NULL) {
-                _tprintf(TEXT("Opened logfile\n"));
-            }
+#ifdef _DEBUG
+            if (logfileFP != NULL) {
+                _tprintf(TEXT("Opened logfile\n"));
+            }
+#endif
+        }
+
+        if (logfileFP == NULL) {
+            currentLogFileName[0] = TEXT('\0');
+            /* Failure to write to logfile already reported. */
+        } else if (whichLogFile == LOG_FILE_CONFIGURED) {
+            /* Store the time at which the configured file was opened.
+             *  The default log file is not rolled by date and doesn't need this info. */
+            _tcsncpy(logFileLastNowDate, nowDate, 9);
+        }
+    }
+    
+    confLogFilePathChanged = FALSE;
+    logFilePathChanged = FALSE;
+    return logFileChanged;
+}
+
+/**
+ * Builds the line written to the log file and the log routes.  Log routes use the default
+ *  columns if the log file is binary.
+ */
+static TCHAR* buildLogfilePrintBuffer(int source_id, int level, int threadId, int queued, TCHAR *message, struct tm *nowTM, int nowMillis, time_t durationMillis) {
+    if (logfileFormatJSON) {
+        return buildJSONPrintBuffer(source_id, level, threadId, durationMillis, message);
+    } else if (logfileFormatBinary) {
+        return buildPrintBuffer(source_id, level, threadId, queued, nowTM, nowMillis, durationMillis, LOG_FORMAT_LOGFILE_DEFAULT, LOG_FORMAT_LOGFILE_DEFAULT, message);
+    } else {
+        return buildPrintBuffer(source_id, level, threadId, queued, nowTM, nowMillis, durationMillis, logfileFormat, LOG_FORMAT_LOGFILE_DEFAULT, message);
+    }
+}
+
+/**
+ * Matches text against a pattern which can contain '*' and '?' wildcards, ignoring the case.
+ */
+static int matchLogRoutePattern(const TCHAR *text, const TCHAR *pattern) {
+    for (; *pattern != TEXT('\0'); pattern++, text++) {
+        if (*pattern == TEXT('*')) {
+            while (pattern[1] == TEXT('*')) {
+                pattern++;
+            }
+            /* Try to match the rest of the pattern at every remaining position. */
+            do {
+                if (matchLogRoutePattern(text, pattern + 1)) {
+                    return TRUE;
+                }
+            } while (*(text++) != TEXT('\0'));
+            return FALSE;
+        }
+        if (*text == TEXT('\0')) {
+            return FALSE;
+        }
+        if ((*pattern != TEXT('?')) && (_totlower(*pattern) != _totlower(*text))) {
+            return FALSE;
+        }
+    }
+    return (*text == TEXT('\0'));
+}
+
+/**
+ * Removes leading and trailing white space by modifying the string.
+ */
+static TCHAR* trimLogRouteToken(TCHAR *str) {
+    size_t len;
+
+    while (_istspace(*str)) {
+        str++;
+    }
+    len = _tcslen(str);
+    while ((len > 0) && _istspace(str[len - 1])) {
+        str[--len] = TEXT('\0');
+    }
+    return str;
+}
+
+/**
+ * Parses the filters of a log route rule.  The string is modified.
+ *
+ * @return TRUE if the filters are invalid.
+ */
+static int parseLogRouteFilters(TCHAR *filters, LogRoute *route) {
+    TCHAR *token;
+    TCHAR *next;
+    TCHAR *op;
+    TCHAR *value;
+    TCHAR opChar;
+    int orEqual;
+    int level;
+
+    for (token = filters; token; token = next) {
+        next = _tcschr(token, TEXT(','));
+        if (next) {
+            *(next++) = TEXT('\0');
+        }
+        token = trimLogRouteToken(token);
+        if (token[0] == TEXT('\0')) {
+            continue;
+        }
+
+        value = _tcschr(token, TEXT(':'));
+        if (value) {
+            /* source:<pattern> */
+            *(value++) = TEXT('\0');
+            value = trimLogRouteToken(value);
+            if ((strcmpIgnoreCase(trimLogRouteToken(token), TEXT("source")) != 0) || (value[0] == TEXT('\0')) || route->sourcePattern) {
+                return TRUE;
+            }
+            route->sourcePattern = malloc(sizeof(TCHAR) * (_tcslen(value) + 1));
+            if (!route->sourcePattern) {
+                outOfMemoryQueued(TEXT("PLRF"), 1);
+                return TRUE;
+            }
+            _tcsncpy(route->sourcePattern, value, _tcslen(value) + 1);
+        } else {
+            /* level<op><level> */
+            op = _tcspbrk(token, TEXT("<>="));
+            if (!op) {
+                return TRUE;
+            }
+            opChar = *op;
+            *op = TEXT('\0');
+            value = op + 1;
+            orEqual = FALSE;
+            if ((opChar != TEXT('=')) && (*value == TEXT('='))) {
+                orEqual = TRUE;
+                value++;
+            }
+            if (strcmpIgnoreCase(trimLogRouteToken(token), TEXT("level")) != 0) {
+                return TRUE;
+            }
+            level = getLogLevelForName(trimLogRouteToken(value));
+            if ((level == LEVEL_UNKNOWN) || (level == LEVEL_NONE)) {
+                return TRUE;
+            }
+            if (opChar == TEXT('>')) {
+                route->minLevel = __max(route->minLevel, orEqual ? level : level + 1);
+            } else if (opChar == TEXT('<')) {
+                route->maxLevel = __min(route->maxLevel, orEqual ? level : level - 1);
+            } else {
+                route->minLevel = __max(route->minLevel, level);
+                route->maxLevel = __min(route->maxLevel, level);
+            }
+        }
+    }
+    /* A route which can never match is certainly a mistake. */
+    return (route->minLevel > route->maxLevel);
+}
+
+static void freeLogRoute(LogRoute *route) {
+    if (route->fp) {
+        fclose(route->fp);
+    }
+    if (route->sourcePattern) {
+        free(route->sourcePattern);
+    }
+    if (route->path) {
+        free(route->path);
+    }
+    free(route);
+}
+
+/**
+ * Adds a log route.  The rule has the form "<filter>[,<filter>...] -> <file>" where each filter
+ *  is either "source:<pattern>" or "level<op><level>", with <op> being one of >=, >, <=, < or =.
+ *  The pattern is matched against the source names used by the JSON format (wrapper, protocol,
+ *  jvm_version, jvm and jvm_stderr), and can contain '*' and '?' wildcards.  A rule without any
+ *  filter accepts all messages.
+ *
+ * @param rule The rule.
+ * @param maxSize Size at which the file is rolled, as with wrapper.logfile.maxsize.
+ * @param maxFiles Number of rolled files to keep.  0 to keep them all.
+ *
+ * @return TRUE if the rule is invalid.
+ */
+int addLogfileRoute(const TCHAR *rule, const TCHAR *maxSize, int maxFiles) {
+    LogRoute *route;
+    TCHAR *work;
+    TCHAR *arrow;
+    TCHAR *path;
+    int result;
+
+    route = malloc(sizeof(LogRoute));
+    if (!route) {
+        outOfMemoryQueued(TEXT("ALR"), 1);
+        return TRUE;
+    }
+    memset(route, 0, sizeof(LogRoute));
+    route->minLevel = LEVEL_DEBUG;
+    route->maxLevel = LEVEL_NONE - 1;
+    route->maxFiles = maxFiles;
+
+    work = malloc(sizeof(TCHAR) * (_tcslen(rule) + 1));
+    if (!work) {
+        outOfMemoryQueued(TEXT("ALR"), 2);
+        freeLogRoute(route);
+        return TRUE;
+    }
+    _tcsncpy(work, rule, _tcslen(rule) + 1);
+
+    arrow = _tcsstr(work, TEXT("->"));
+    if (!arrow) {
+        result = TRUE;
+    } else {
+        *arrow = TEXT('\0');
+        path = trimLogRouteToken(arrow + 2);
+        result = (path[0] == TEXT('\0')) || parseLogRouteFilters(work, route);
+        if (!result) {
+            /* Fix the separators and resolve the path as for wrapper.logfile, so a relative path
+             *  does not depend on the working directory at the time the file is first opened. */
+#ifdef WIN32
+            wrapperCorrectWindowsPath(path);
+#else
+            wrapperCorrectNixPath(path);
+#endif
+            route->path = getAbsolutePathOfFile(path, TEXT("log file path"), getLoggingIsPreload() ? LEVEL_NONE : LEVEL_DEBUG, FALSE);
+            if (!route->path) {
+                /* Continue with the relative path.  Opening the file will report any problem. */
+                route->path = malloc(sizeof(TCHAR) * (_tcslen(path) + 1));
+                if (!route->path) {
+                    outOfMemoryQueued(TEXT("ALR"), 3);
+                    result = TRUE;
+                } else {
+                    _tcsncpy(route->path, path, _tcslen(path) + 1);
+                }
+            }
+        }
+    }
+    free(work);
+    if (!result && parseLogfileSize(maxSize, &(route->maxSize))) {
+        outOfMemoryQueued(TEXT("ALR"), 4);
+        result = TRUE;
+    }
+    if (result) {
+        freeLogRoute(route);
+        return TRUE;
+    }
+    if ((route->maxSize > 0) && (route->maxSize < 1024)) {
+        route->maxSize = 1024;
+    }
+
+    if (lockLoggingMutex()) {
+        freeLogRoute(route);
+        return TRUE;
+    }
+    if (logRoutesLast) {
+        logRoutesLast->next = route;
+    } else {
+        logRoutes = route;
+    }
+    logRoutesLast = route;
+    logRoutesLowLevel = __min(logRoutesLowLevel, route->minLevel);
+    releaseLoggingMutex();
+    return FALSE;
+}
+
+/**
+ * Frees all log routes.
+ *
+ * Must be called while locked.
+ */
+static void freeLogRoutes() {
+    LogRoute *route;
+
+    while (logRoutes) {
+        route = logRoutes;
+        logRoutes = route->next;
+        freeLogRoute(route);
+    }
+    logRoutesLast = NULL;
+    logRoutesLowLevel = LEVEL_NONE;
+}
+
+/**
+ * Removes all log routes.  Called before the configuration is (re)loaded.
+ */
+void clearLogfileRoutes() {
+    if (lockLoggingMutex()) {
+        return;
+    }
+    freeLogRoutes();
+    releaseLoggingMutex();
+}
+
+/**
+ * Closes the files of all log routes.  They are reopened by the next message.
+ *
+ * Must be called while locked.
+ */
+static void closeLogRoutes() {
+    LogRoute *route;
+
+    for (route = logRoutes; route; route = route->next) {
+        if (route->fp) {
+            fclose(route->fp);
+            route->fp = NULL;
+        }
+    }
+}
+
+/**
+ * Must be called while locked.
+ */
+static void flushLogRoutes() {
+    LogRoute *route;
+
+    for (route = logRoutes; route; route = route->next) {
+        if (route->fp) {
+            fflush(route->fp);
+        }
+    }
+}
+
+/**
+ * Rolls the file of a log route.  The file is renamed to <file>.1 after the older files were
+ *  renamed up by one index.  Files beyond the maximum number are deleted.
+ *
+ * Must be called while locked.
+ */
+static void rollLogRoute(LogRoute *route) {
+#if defined(WIN32) && !defined(WIN64)
+    struct _stat64i32 fileStat;
+#else
+    struct stat fileStat;
 #endif
+    size_t len = _tcslen(route->path) + 12;
+    TCHAR *from;
+    TCHAR *to;
+    int i;
+
+    if (route->fp) {
+        fclose(route->fp);
+        route->fp = NULL;
+    }
+
+    from = malloc(sizeof(TCHAR) * len);
+    to = malloc(sizeof(TCHAR) * len);
+    if (!from || !to) {
+        outOfMemoryQueued(TEXT("RLR"), 1);
+        if (from) {
+            free(from);
         }
+        if (to) {
+            free(to);
+        }
+        return;
+    }
 
-        if (logfileFP == NULL) {
-            currentLogFileName[0] = TEXT('\0');
-            /* Failure to write to logfile already reported. */
-        } else if (whichLogFile == LOG_FILE_CONFIGURED) {
-            /* Store the time at which the configured file was opened.
-             *  The default log file is not rolled by date and doesn't need this info. */
-            _tcsncpy(logFileLastNowDate, nowDate, 9);
+    /* Look for the highest rolled file. */
+    i = 0;
+    do {
+        i++;
+        _sntprintf(from, len, TEXT("%s.%d"), route->path, i);
+    } while (_tstat(from, &fileStat) == 0);
+
+    for (; i > 1; i--) {
+        _sntprintf(from, len, TEXT("%s.%d"), route->path, i - 1);
+        _sntprintf(to, len, TEXT("%s.%d"), route->path, i);
+        if ((route->maxFiles > 0) && (i > route->maxFiles)) {
+            if (_tremove(from)) {
+                log_printf_queue(TRUE, WRAPPER_SOURCE_WRAPPER, LEVEL_WARN, TEXT("Unable to delete old log file: %s (%s)"), from, getLastErrorText());
+            }
+        } else if (_trename(from, to)) {
+            log_printf_queue(TRUE, WRAPPER_SOURCE_WRAPPER, LEVEL_WARN, TEXT("Unable to rename log file %s to %s. (%s)"), from, to, getLastErrorText());
         }
     }
+    _sntprintf(to, len, TEXT("%s.1"), route->path);
+    if (_trename(route->path, to)) {
+        log_printf_queue(TRUE, WRAPPER_SOURCE_WRAPPER, LEVEL_WARN, TEXT("Unable to rename log file %s to %s. (%s)"), route->path, to, getLastErrorText());
+    }
+    free(from);
+    free(to);
+}
+
+/**
+ * Writes a message to every log route which accepts it.  The line is only built once, unless
+ *  it was already built for the log file.
+ *
+ * Must be called while locked.
+ *
+ * @param printBuffer The line written to the log file, or NULL if it was not built.
+ */
+static void writeLogRoutes(int source_id, int level, int threadId, int queued, TCHAR *message, struct tm *nowTM, int nowMillis, time_t durationMillis, TCHAR *printBuffer) {
+    LogRoute *route;
+    const TCHAR *sourceName = getLogSourceName(source_id);
+    int old_umask;
     
-    confLogFilePathChanged = FALSE;
-    logFilePathChanged = FALSE;
-    return logFileChanged;
+    for (route = logRoutes; route; route = route->next) {
+        if ((level < route->minLevel) || (level > route->maxLevel)) {
+            continue;
+        }
+        if (route->sourcePattern && !matchLogRoutePattern(sourceName, route->sourcePattern)) {
+            continue;
+        }
+        if (!printBuffer) {
+            printBuffer = buildLogfilePrintBuffer(source_id, level, threadId, queued, message, nowTM, nowMillis, durationMillis);
+            if (!printBuffer) {
+                return;
+            }
+        }
+        if (!route->fp) {
+            /* The routed files may contain the same output as the log file, so they are created with the same umask. */
+            old_umask = umask( logFileUmask );
+            route->fp = _tfopen(route->path, TEXT("a"));
+            umask( old_umask );
+            if (!route->fp) {
+                if (!route->openFailed) {
+                    log_printf_queue(TRUE, WRAPPER_SOURCE_WRAPPER, LEVEL_WARN, TEXT("Unable to write to the log file: %s (%s)"), route->path, getLastErrorText());
+                    route->openFailed = TRUE;
+                }
+                continue;
+            }
+            route->openFailed = FALSE;
+#ifndef WIN32
+            if (logFileGroup != -1) {
+                changeLogFileGroup(route->path);
+            }
+#endif
+        }
+        _ftprintf(route->fp, TEXT("%s\n"), printBuffer);
+        logfileActivityCount++;
+        
+        if ((route->maxSize > 0) && (ftell(route->fp) >= route->maxSize)) {
+            rollLogRoute(route);
+        } else if (autoCloseLogfile) {
+            fclose(route->fp);
+            route->fp = NULL;
+        } else if (autoFlushLogfile) {
+            fflush(route->fp);
+        }
+    }
 }
 
 /**
@@ -2314,19 +4304,34 @@ int openLogFile(struct tm *nowTM, TCHAR *message) {
  *  tested prior to this function being called.
  *
  * Must be called while locked.
+ *
+ * @return The line written, or NULL if it was not built.  It can be reused for the log routes.
  */
-void log_printf_message_logFileInner(int source_id, int level, int threadId, int queued, TCHAR *message, struct tm *nowTM, int nowMillis, time_t durationMillis) {
-    TCHAR *printBuffer;
+static TCHAR* log_printf_message_logFileInner(int source_id, int level, int threadId, int queued, TCHAR *message, struct tm *nowTM, int nowMillis, time_t durationMillis) {
+    TCHAR *printBuffer = NULL;
+    size_t written = 0;
 
     if (logfileFP != NULL) {
-        /* Build up the printBuffer. */
-        printBuffer = buildPrintBuffer(source_id, level, threadId, queued, nowTM, nowMillis, durationMillis, logfileFormat, LOG_FORMAT_LOGFILE_DEFAULT, message);
-        if (printBuffer) {
-            _ftprintf(logfileFP, TEXT("%s\n"), printBuffer);
+        if (logfileFormatBinary) {
+            written = writeBinaryLogRecord(source_id, level, threadId, queued, durationMillis, message);
+        } else {
+            /* Build up the printBuffer. */
+            printBuffer = buildLogfilePrintBuffer(source_id, level, threadId, queued, message, nowTM, nowMillis, durationMillis);
+            if (printBuffer) {
+#ifdef LINUX
+                terminateLogRawLine(source_id);
+#endif
+                written = writeLogfileLine(printBuffer);
+            }
+        }
+        if (written > 0) {
             logFileAccessed = TRUE;
 
             /* Increment the activity counter. */
             logfileActivityCount++;
+            countLogfileBytes(written);
+            
+            requestLogfileSync(level, written);
 
             /* Decide whether we want to close or flush the log file immediately after each line.
              *  If not then flushing and closing will be handled externally by calling flushLogfile() or closeLogfile(). */
@@ -2336,8 +4341,7 @@ void log_printf_message_logFileInner(int source_id, int level, int threadId, int
                 _tprintf(TEXT("Closing logfile immediately...\n"));
 #endif
 
-                fclose(logfileFP);
-                logfileFP = NULL;
+                closeLogfileFP();
                 /* Do not clear the currentLogFileName here as we are not changing its name. */
             } else if (autoFlushLogfile) {
                 /* Flush the log file immediately. */
@@ -2351,17 +4355,29 @@ void log_printf_message_logFileInner(int source_id, int level, int threadId, int
             /* Leave the file open.  It will be closed later after a period of inactivity. */
         }
     }
+    return printBuffer;
 }
 int log_printf_message_logFile(int source_id, int level, int threadId, int queued, TCHAR *message, struct tm *nowTM, int nowMillis, time_t durationMillis) {
     int logFileChanged = FALSE;
+    FILE *previousFP;
+    TCHAR *printBuffer = NULL;
 
     if ((level >= currentLogfileLevel) || (whichLogFile == LOG_FILE_DISABLED)) {
+        previousFP = logfileFP;
         logFileChanged = openLogFile(nowTM, message);
+        if (logfileFormatBinary && (logfileFP != NULL) && (logFileChanged || (logfileFP != previousFP))) {
+            startBinaryLogFile();
+        }
         if (level >= currentLogfileLevel) {
-            log_printf_message_logFileInner(source_id, level, threadId, queued, message, nowTM, nowMillis, durationMillis);
+            printBuffer = log_printf_message_logFileInner(source_id, level, threadId, queued, message, nowTM, nowMillis, durationMillis);
         }
     }
     
+    /* Each message is written to every matching route in the same pass. */
+    if (logRoutes && (level >= logRoutesLowLevel)) {
+        writeLogRoutes(source_id, level, threadId, queued, message, nowTM, nowMillis, durationMillis, printBuffer);
+    }
+    
     return logFileChanged;
 }
 
@@ -2480,7 +4496,8 @@ void log_printf_message_console(int source_id, int level, int threadId, int queu
  * Must be called while locked.
  *
  * @param message The message to log.  This is not a message format, but may contain format characters.
- *                The content of the message buffer may be modified by this call if it contains line feeds.
+ *                The content of the message buffer is modified while logging if it contains line feeds,
+ *                but restored before this call returns.
  * @param sysLogEnabled A flag that is used to help with recursion to control
  *                      whether or not the syslog should be considered as a log
  *                      target for this call.  It is always disabled when we
@@ -2496,6 +4513,7 @@ int log_printf_message(int source_id, int level, int threadId, int queued, TCHAR
     int         logFileChanged = FALSE;
     TCHAR       *subMessage;
     TCHAR       *nextLF;
+    int         skipLines = FALSE;
 #ifdef WIN32
     struct _timeb timebNow;
 #else
@@ -2551,6 +4569,12 @@ int log_printf_message(int source_id, int level, int threadId, int queued, TCHAR
     nowMillis = timevalNow.tv_usec / 1000;
 #endif
     nowTM = localtime( &now );
+    currentNow = now;
+#ifdef WIN32
+    currentNowMicros = nowMillis * 1000;
+#else
+    currentNowMicros = (int)timevalNow.tv_usec;
+#endif
     
     /* Calculate the number of milliseconds which have passed since the previous log entry.
      * We only need to display up to 8 digits, so if the result is going to be larger than
@@ -2595,10 +4619,23 @@ int log_printf_message(int source_id, int level, int threadId, int queued, TCHAR
     subMessage = message;
     nextLF = _tcschr(subMessage, TEXT('\n'));
     if (nextLF) {
-        /* This string contains more than one line.   Loop over the strings.  It is Ok to corrupt this string because it is only used once. */
+        if ((logfileFormatJSON || logfileFormatBinary) && (!logfileSkipLines)
+#ifndef WIN32
+                && (_tcsstr(message, LOG_FORK_MARKER) != message)
+#endif
+                ) {
+            /* A multi-line message is written to the log file as a single JSON object or binary record.  Only the other targets get the individual lines. */
+            logFileChanged |= log_printf_message_logFile(source_id, level, (threadId < 0) ? getThreadId() : threadId, queued, message, nowTM, nowMillis, durationMillis);
+            logfileSkipLines = TRUE;
+            skipLines = TRUE;
+        }
+
+        /* This string contains more than one line.   Loop over the strings.
+         *  Each LF is restored once its line is logged as JVM output is passed in directly and is still used by the caller. */
         while (nextLF) {
             nextLF[0] = TEXT('\0');
             logFileChanged |= log_printf_message(source_id, level, threadId, queued, subMessage, FALSE);
+            nextLF[0] = TEXT('\n');
             
             /* Locate the next one. */
             subMessage = &(nextLF[1]);
@@ -2608,6 +4645,9 @@ int log_printf_message(int source_id, int level, int threadId, int queued, TCHAR
         /* The rest of the buffer will be the final line. */
         logFileChanged |= log_printf_message(source_id, level, threadId, queued, subMessage, FALSE);
         
+        if (skipLines) {
+            logfileSkipLines = FALSE;
+        }
         return logFileChanged;
     }
     
@@ -2621,86 +4661,364 @@ int log_printf_message(int source_id, int level, int threadId, int queued, TCHAR
         if (!(printBuffer = preparePrintBuffer(reqSize))) {
             return FALSE;
         }
-        _sntprintf(printBuffer, reqSize, TEXT("%s|%02d|%02d|%02d|%s"), LOG_SPECIAL_MARKER, source_id, level, threadId, message + _tcslen(LOG_FORK_MARKER));
-        
-        /* Decide where to send the output. */
-        switch (level) {
-        case LEVEL_FATAL:
-            if (consoleFatalToStdErr) {
-                target = stderr;
-            } else {
-                target = stdout;
-            }
-            break;
-            
-        case LEVEL_ERROR:
-            if (consoleErrorToStdErr) {
-                target = stderr;
-            } else {
-                target = stdout;
-            }
-            break;
-            
-        case LEVEL_WARN:
-            if (consoleWarnToStdErr) {
-                target = stderr;
-            } else {
-                target = stdout;
-            }
-            break;
-            
-        default:
-            target = stdout;
-            break;
+        _sntprintf(printBuffer, reqSize, TEXT("%s|%02d|%02d|%02d|%s"), LOG_SPECIAL_MARKER, source_id, level, threadId, message + _tcslen(LOG_FORK_MARKER));
+        
+        /* Decide where to send the output. */
+        switch (level) {
+        case LEVEL_FATAL:
+            if (consoleFatalToStdErr) {
+                target = stderr;
+            } else {
+                target = stdout;
+            }
+            break;
+            
+        case LEVEL_ERROR:
+            if (consoleErrorToStdErr) {
+                target = stderr;
+            } else {
+                target = stdout;
+            }
+            break;
+            
+        case LEVEL_WARN:
+            if (consoleWarnToStdErr) {
+                target = stderr;
+            } else {
+                target = stdout;
+            }
+            break;
+            
+        default:
+            target = stdout;
+            break;
+        }
+        
+        _ftprintf(target, TEXT("%s\n"), printBuffer);
+        if (consoleFlush) {
+            fflush(target);
+        }
+        return FALSE;
+    }
+#endif
+
+    /* Get the current threadId. */
+    if ( threadId < 0 )
+    {
+        /* The current thread was specified.  Resolve what thread this actually is. */
+        threadId = getThreadId();
+    }
+    
+    /* Syslog outbut by format (If messages splitting is enabled.  Otherwise done above.) */
+    if (currentLogSplitMessages) {
+        log_printf_message_sysLog(source_id, level, message, nowTM, FALSE);
+    }
+
+    /* Console output by format */
+    log_printf_message_console(source_id, level, threadId, queued, message, nowTM, nowMillis, durationMillis);
+
+    /* Logfile output by format */
+    if (!logfileSkipLines) {
+        logFileChanged = log_printf_message_logFile(source_id, level, threadId, queued, message, nowTM, nowMillis, durationMillis);
+    }
+
+    /* Crash buffer */
+    if ((crashBufferSize > 0) && (level >= currentCrashBufferLevel)) {
+        addCrashBufferRecord(source_id, level, threadId, queued, message, now, nowMillis, durationMillis);
+        if (level == LEVEL_FATAL) {
+            requestCrashBufferDump(TEXT("FATAL log entry"));
+        }
+    }
+
+    return logFileChanged;
+}
+
+/**
+ * Used for testing to pause the current thread for the specified number of seconds.
+ *  This can only be called when logging is locked.
+ *
+ * @param pauseTime Number of seconds to pause, 0 pauses indefinitely.
+ */
+void pauseThread(int pauseTime) {
+    int i;
+    
+    if (pauseTime > 0) {
+        for (i = 0; i < pauseTime; i++) {
+            logSleep(1000);
+        }
+    } else {
+        while (TRUE) {
+            logSleep(1000);
+        }
+    }
+}
+
+/**
+ * Enqueues a notification that the log file name was changed.
+ *  We can NOT directly send the notification from the logging code as that could cause
+ *  a deadlock, depending on where exactly it was called from. (See Wrapper protocol mutex.)
+ *
+ * Must be called while locked.
+ */
+static void queueLogFileChange() {
+    TCHAR *logFileCopy;
+
+    logFileCopy = malloc(sizeof(TCHAR) * (_tcslen(currentLogFileName) + 1));
+    if (!logFileCopy) {
+        _tprintf(TEXT("Out of memory in logging code (%s)\n"), TEXT("P4"));
+    } else {
+        _tcsncpy(logFileCopy, currentLogFileName, _tcslen(currentLogFileName) + 1);
+        /* Now after we have 100% prepared the log file name.  Put into the queue variable
+         *  so the maintainLogging() function can safely grab it at any time.
+         * The reading code is also in a semaphore so we can do a quick test here safely as well. */
+        if (pendingLogFileChange) {
+            /* The previous file was still in the queue.  Free it up to avoid a memory leak.
+             *  This can happen if the log file size is 1k or something like that.  We will always
+             *  keep the most recent file however, so this should not be that big a problem. */
+#ifdef _DEBUG
+            _tprintf(TEXT("Log file name change was overwritten in queue: %s\n"), pendingLogFileChange);
+#endif
+            free(pendingLogFileChange);
+        }
+        pendingLogFileChange = logFileCopy;
+    }
+}
+
+/**
+ * Sets the number of full sized messages which can be queued for each thread.  Other threads and
+ *  signal handlers write to their queues without locking, so the queues can only be reallocated
+ *  while the calling thread is the only one registered, that is on startup.  Later changes are
+ *  ignored.
+ *
+ * @return TRUE if there was not enough memory.
+ */
+int setLogQueueSize(int size) {
+    int threadId;
+    int currentThreadId;
+    int result;
+    
+    if (size == logQueueSize) {
+        return FALSE;
+    }
+    
+    currentThreadId = getThreadId();
+    for (threadId = 0; threadId < WRAPPER_THREAD_COUNT; threadId++) {
+        if ((threadId != currentThreadId) && threadSets[threadId]) {
+            return FALSE;
+        }
+    }
+    
+    /* Log anything still queued so the queues are empty. */
+    maintainLogger();
+    
+    if (lockLoggingMutex()) {
+        return TRUE;
+    }
+    for (threadId = 0; threadId < WRAPPER_THREAD_COUNT; threadId++) {
+        if (logQueues[threadId].head != logQueues[threadId].tail) {
+            /* A record is still being written.  Keep the current queues. */
+            releaseLoggingMutex();
+            return FALSE;
+        }
+    }
+    result = allocateLogQueues(size);
+    if (releaseLoggingMutex()) {
+        return TRUE;
+    }
+    
+    if (result) {
+        outOfMemory(TEXT("SLQS"), 1);
+    }
+    return result;
+}
+
+/**
+ * Sets whether queued messages only use the space they need.  Otherwise each one uses a full
+ *  sized slot and the queues hold a fixed number of messages.
+ */
+void setLogQueueVariableRecords(int variableRecords) {
+    logQueueVariableRecords = variableRecords;
+}
+
+/**
+ * Sets the number of log entries kept in the crash buffer.  The buffer is allocated here so
+ *  logging never needs to allocate memory for it.  0 disables the crash buffer.
+ *
+ * @return TRUE if there were any problems.
+ */
+int setCrashBufferSize(int size) {
+    CrashBufferRecord *newBuffer = NULL;
+    int result = FALSE;
+
+    if (size < 0) {
+        size = 0;
+    }
+    if (size > 0) {
+        newBuffer = malloc(sizeof(CrashBufferRecord) * size);
+        if (!newBuffer) {
+            outOfMemory(TEXT("SCBS"), 1);
+            size = 0;
+            result = TRUE;
+        }
+    }
+
+    if (lockLoggingMutex()) {
+        if (newBuffer) {
+            free(newBuffer);
         }
-        
-        _ftprintf(target, TEXT("%s\n"), printBuffer);
-        if (consoleFlush) {
-            fflush(target);
+        return TRUE;
+    }
+    if (size != crashBufferSize) {
+        if (crashBuffer) {
+            free(crashBuffer);
         }
-        return FALSE;
+        crashBuffer = newBuffer;
+        crashBufferSize = size;
+        crashBufferNext = 0;
+        crashBufferCount = 0;
+        newBuffer = NULL;
     }
-#endif
+    releaseLoggingMutex();
 
-    /* Get the current threadId. */
-    if ( threadId < 0 )
-    {
-        /* The current thread was specified.  Resolve what thread this actually is. */
-        threadId = getThreadId();
+    if (newBuffer) {
+        /* The size did not change. */
+        free(newBuffer);
     }
-    
-    /* Syslog outbut by format (If messages splitting is enabled.  Otherwise done above.) */
-    if (currentLogSplitMessages) {
-        log_printf_message_sysLog(source_id, level, message, nowTM, FALSE);
+    return result;
+}
+
+void setCrashBufferLevelInt(int level) {
+    currentCrashBufferLevel = level;
+}
+
+void setCrashBufferLevel(const TCHAR *level) {
+    setCrashBufferLevelInt(getLogLevelForName(level));
+}
+
+/**
+ * Returns the lowest level kept in the crash buffer, or LEVEL_NONE if it is disabled.
+ */
+int getCrashBufferLevelInt() {
+    return (crashBufferSize > 0) ? currentCrashBufferLevel : LEVEL_NONE;
+}
+
+/**
+ * Sets the file to which the crash buffer is dumped.
+ *
+ * @return TRUE if there were any problems.
+ */
+int setCrashBufferFile(const TCHAR *file) {
+    TCHAR *newFile;
+
+    newFile = malloc(sizeof(TCHAR) * (_tcslen(file) + 1));
+    if (!newFile) {
+        outOfMemory(TEXT("SCBF"), 1);
+        return TRUE;
     }
+    _tcsncpy(newFile, file, _tcslen(file) + 1);
 
-    /* Console output by format */
-    log_printf_message_console(source_id, level, threadId, queued, message, nowTM, nowMillis, durationMillis);
+    if (lockLoggingMutex()) {
+        free(newFile);
+        return TRUE;
+    }
+    if (crashBufferFile) {
+        free(crashBufferFile);
+    }
+    crashBufferFile = newFile;
+    releaseLoggingMutex();
+    return FALSE;
+}
 
-    /* Logfile output by format */
-    logFileChanged = log_printf_message_logFile(source_id, level, threadId, queued, message, nowTM, nowMillis, durationMillis);
+/**
+ * Stores a log entry in the crash buffer, replacing the oldest one if full.
+ *  Long messages are truncated.
+ *
+ * Must be called while locked.
+ */
+static void addCrashBufferRecord(int source_id, int level, int threadId, int queued, const TCHAR *message, time_t now, int nowMillis, time_t durationMillis) {
+    CrashBufferRecord *record = &(crashBuffer[crashBufferNext]);
+
+    record->now = now;
+    record->nowMillis = nowMillis;
+    record->durationMillis = durationMillis;
+    record->source_id = source_id;
+    record->level = level;
+    record->threadId = threadId;
+    record->queued = queued;
+    _tcsncpy(record->message, message, CRASH_BUFFER_MESSAGE_MAX - 1);
+    record->message[CRASH_BUFFER_MESSAGE_MAX - 1] = TEXT('\0');
+
+    crashBufferNext = (crashBufferNext + 1) % crashBufferSize;
+    if (crashBufferCount < crashBufferSize) {
+        crashBufferCount++;
+    }
+}
 
-    return logFileChanged;
+/**
+ * Requests that the contents of the crash buffer be written to the crash file.  The dump is
+ *  done by the next call to maintainLogger() so that entries logged at the same time, like the
+ *  lines of a FATAL message, end up in the same dump.  This function does not lock and is safe
+ *  to call from anywhere.
+ *
+ * @param reason Static string describing the event, included in the dump header.
+ */
+void requestCrashBufferDump(const TCHAR *reason) {
+    if ((crashBufferSize > 0) && (!pendingCrashBufferDump)) {
+        pendingCrashBufferDump = reason;
+    }
 }
 
 /**
- * Used for testing to pause the current thread for the specified number of seconds.
- *  This can only be called when logging is locked.
+ * Appends the entries of the crash buffer to the crash file, oldest first, and empties it.
  *
- * @param pauseTime Number of seconds to pause, 0 pauses indefinitely.
+ * Must be called while locked.
  */
-void pauseThread(int pauseTime) {
+static void dumpCrashBuffer(const TCHAR *reason) {
+    FILE *fp;
+    CrashBufferRecord *record;
+    TCHAR *printBuffer;
+    const TCHAR *format;
+    struct tm *nowTM;
+    time_t now;
     int i;
-    
-    if (pauseTime > 0) {
-        for (i = 0; i < pauseTime; i++) {
-            logSleep(1000);
-        }
-    } else {
-        while (TRUE) {
-            logSleep(1000);
+
+    if ((crashBufferCount <= 0) || (!crashBufferFile)) {
+        return;
+    }
+
+    fp = _tfopen(crashBufferFile, TEXT("a"));
+    if (!fp) {
+        log_printf_queue(TRUE, WRAPPER_SOURCE_WRAPPER, LEVEL_WARN, TEXT("Unable to write the crash buffer to %s: %s"), crashBufferFile, getLastErrorText());
+        return;
+    }
+
+    /* Binary and JSON log files have no columns. */
+    format = (logfileFormatJSON || logfileFormatBinary) ? LOG_FORMAT_LOGFILE_DEFAULT : logfileFormat;
+
+    now = time(NULL);
+    nowTM = localtime(&now);
+    _ftprintf(fp, TEXT("--> Crash buffer dump: %s (%04d/%02d/%02d %02d:%02d:%02d, %d entries)\n"), reason,
+        nowTM->tm_year + 1900, nowTM->tm_mon + 1, nowTM->tm_mday, nowTM->tm_hour, nowTM->tm_min, nowTM->tm_sec, crashBufferCount);
+    for (i = 0; i < crashBufferCount; i++) {
+        record = &(crashBuffer[(crashBufferNext - crashBufferCount + i + crashBufferSize) % crashBufferSize]);
+        nowTM = localtime(&(record->now));
+        printBuffer = buildPrintBuffer(record->source_id, record->level, record->threadId, record->queued, nowTM, record->nowMillis, record->durationMillis, format, LOG_FORMAT_LOGFILE_DEFAULT, record->message);
+        if (printBuffer) {
+            _ftprintf(fp, TEXT("%s\n"), printBuffer);
         }
     }
+    fclose(fp);
+
+    crashBufferCount = 0;
+}
+
+/**
+ * Returns TRUE if no target would accept a log entry at the given level, in which case there is
+ *  no need to lock or format it.  The levels are read without locking.  A level being changed by
+ *  another thread at the same time may or may not already apply to the entry.
+ */
+static int isLogLevelIgnored(int level) {
+    return (level < getLowLogLevel()) && (level < getCrashBufferLevelInt());
 }
 
 /**
@@ -2716,11 +5034,10 @@ void log_printf( int source_id, int level, const TCHAR *lpszFmt, ... ) {
     int         count;
     int         threadId;
     int         logFileChanged;
-    TCHAR       *logFileCopy;
 #if defined(UNICODE) && !defined(WIN32)
     TCHAR       *msg = NULL;
-    int         i;
-    int         msgMalloced;
+    TCHAR       msgBuffer[WIDE_FORMAT_BUFFER_SIZE];
+    int         msgAllocated = FALSE;
 #endif
 #ifdef WIN32
     struct _timeb timebNow;
@@ -2737,6 +5054,11 @@ void log_printf( int source_id, int level, const TCHAR *lpszFmt, ... ) {
         return;
     }
     
+    if (isLogLevelIgnored(level)) {
+        /* No target would accept the message, so avoid locking and formatting it. */
+        return;
+    }
+    
     /* If we are checking on the log time then store the start time. */
     if (logPrintfWarnThreshold > 0) {
 #ifdef WIN32
@@ -2767,27 +5089,16 @@ void log_printf( int source_id, int level, const TCHAR *lpszFmt, ... ) {
     }
     
 #if defined(UNICODE) && !defined(WIN32)
-    if ((source_id <= 0) && (wcsstr(lpszFmt, TEXT("%s")) != NULL)) {
-        msg = malloc(sizeof(wchar_t) * (wcslen(lpszFmt) + 1));
-        if (msg) {
-            /* Loop over the format and convert all '%s' patterns to %S' so the UNICODE displays correctly. */
-            if (wcslen(lpszFmt) > 0) {
-                for (i = 0; i < _tcslen(lpszFmt); i++){
-                    msg[i] = lpszFmt[i];
-                    if ((lpszFmt[i] == TEXT('%')) && (i  < _tcslen(lpszFmt)) && (lpszFmt[i + 1] == TEXT('s')) && ((i == 0) || (lpszFmt[i - 1] != TEXT('%')))){
-                        msg[i+1] = TEXT('S'); i++;
-                    }
-                }
-            }
-            msg[wcslen(lpszFmt)] = TEXT('\0');
-        } else {
+    if (source_id <= 0) {
+        /* Converted the same way as by _sntprintf(), without allocating unless the format is very long. */
+        msgAllocated = createWideFormat(lpszFmt, msgBuffer, &msg);
+        if (!msg) {
             _tprintf(TEXT("Out of memory in logging code (%s)\n"), TEXT("P1"));
+            releaseLoggingMutex();
             return;
         }
-        msgMalloced = TRUE;
     } else {
         msg = (TCHAR*) lpszFmt;
-        msgMalloced = FALSE;
     }
 #endif
     threadId = getThreadId();
@@ -2809,10 +5120,11 @@ void log_printf( int source_id, int level, const TCHAR *lpszFmt, ... ) {
                     _tprintf(TEXT("Out of memory in logging code (%s)\n"), TEXT("P2"));
                     threadMessageBufferSize = 0;
 #if defined(UNICODE) && !defined(WIN32)
-                    if (msgMalloced) {
+                    if (msgAllocated) {
                         free(msg);
                     }
 #endif
+                    releaseLoggingMutex();
                     return;
                 }
             }
@@ -2834,105 +5146,441 @@ void log_printf( int source_id, int level, const TCHAR *lpszFmt, ... ) {
                  *  exact however, we still need to expand it to have room for the null.
                  * UNIX will return the required size. */
 
-                /* Free the old buffer for starters. */
-                free( threadMessageBuffer );
+                /* Free the old buffer for starters. */
+                free( threadMessageBuffer );
+
+                /* Decide on a new buffer size.
+                 * We can't tell how long the resulting string will be without expanding because the
+                 *  results are stored in the vargs.
+                 * Most messages will be short, but there is a possibility that some will be very
+                 *  long.  To minimize the number of times that we need to loop, while at the same
+                 *  time trying to avoid using too much memory, increase the size by the maximum of
+                 *  1024 or 10% of the current length.
+                 * Some platforms will return the required size as count.  Use that if available. */
+                threadMessageBufferSize = __max(threadMessageBufferSize + 1024, __max(threadMessageBufferSize + threadMessageBufferSize / 10, (size_t)count + 1));
+#if defined(HPUX)
+                /* Due to a bug in the HPUX libc (version < 1403), the buffer passed to _vsntprintf must have a length of 1 + N, where N is a multiple of 8.  Adjust it as necessary. */
+                threadMessageBufferSize = threadMessageBufferSize + (((threadMessageBufferSize - 1) % 8) == 0 ? 0 : 8 - ((threadMessageBufferSize - 1) % 8));
+#endif
+
+                threadMessageBuffer = malloc(sizeof(TCHAR) * threadMessageBufferSize);
+                if (!threadMessageBuffer) {
+                    _tprintf(TEXT("Out of memory in logging code (%s)\n"), TEXT("P3"));
+                    threadMessageBufferSize = 0;
+#if defined(UNICODE) && !defined(WIN32)
+                    if (msgAllocated) {
+                        free(msg);
+                    }
+#endif
+                    releaseLoggingMutex();
+                    return;
+                }
+
+                /* Always set the count to -1 so we will loop again. */
+                count = -1;
+            }
+        } while ( count < 0 );
+#if defined(UNICODE) && !defined(WIN32)
+        if (msgAllocated) {
+            free(msg);
+        }
+#endif
+    }
+    if (source_id > 0) {
+        /* As this is content from the JVM, the msg or lpszFmt is direct message, not a message format. */
+#if defined(UNICODE) && !defined(WIN32)
+        logFileChanged = log_printf_message(source_id, level, threadId, FALSE, msg, TRUE);
+#else
+        logFileChanged = log_printf_message(source_id, level, threadId, FALSE, (TCHAR*)lpszFmt, TRUE);
+#endif
+    } else {
+        /* The lpszFmt parameter was treated as a message format, and was expanded into the threadMessageBuffer buffer. */
+        logFileChanged = log_printf_message(source_id, level, threadId, FALSE, threadMessageBuffer, TRUE);
+    }
+    if (logFileChanged) {
+        queueLogFileChange();
+    }
+
+    /* Release the lock we have on this function so that other threads can get in. */
+    if (releaseLoggingMutex()) {
+        return;
+    }
+
+    /* If we are checking on the log time then store the stop time.
+     *  It is Ok that some of the error paths don't make it this far. */
+    if (logPrintfWarnThreshold > 0) {
+#ifdef WIN32
+        _ftime(&timebNow);
+        endNow = (time_t)timebNow.time;
+        endNowMillis = timebNow.millitm;
+#else
+        gettimeofday(&timevalNow, NULL);
+        endNow = (time_t)timevalNow.tv_sec;
+        endNowMillis = timevalNow.tv_usec / 1000;
+#endif
+        previousLogLag = __min(endNow - startNow, 3600) * 1000 + endNowMillis - startNowMillis;
+        if (previousLogLag >= logPrintfWarnThreshold) {
+            log_printf_queue(TRUE, WRAPPER_SOURCE_WRAPPER, LEVEL_WARN, TEXT("Write to log took %d milliseconds."), previousLogLag);
+        }
+    }
+}
+
+#ifdef LINUX
+/* Maximum number of bytes moved by a single call to splice(). */
+#define LOG_RAW_SPLICE_SIZE 65536
+/* Number of bytes before the maximum log file size at which raw output stops so the file can be rolled on a line boundary. */
+#define LOG_RAW_ROLL_MARGIN 65536
+
+/* Set if splice() failed in a way that means it will never work with the current log file. */
+static int logRawDisabled = FALSE;
+
+/* Pipe into which the output is duplicated with tee() to find the line boundaries before it is moved. */
+static int logRawPeekPipe[2] = { -1, -1 };
+static char logRawPeekBuffer[LOG_RAW_SPLICE_SIZE];
+
+/* The log file opened a second time without O_APPEND, as splice() refuses to write to a file opened in
+ *  append mode.  Every write to the log file is made while holding the logging mutex so it is safe to
+ *  write at the end of the file through it. */
+static int logRawFD = -1;
+
+/* TRUE if output was moved into the log file since the Wrapper last wrote to it.  The file may then end
+ *  in the middle of a line. */
+static int logRawSpliced = FALSE;
+
+static void disposeLogSplice() {
+    if (logRawPeekPipe[0] != -1) {
+        close(logRawPeekPipe[0]);
+        close(logRawPeekPipe[1]);
+        logRawPeekPipe[0] = -1;
+        logRawPeekPipe[1] = -1;
+    }
+}
+
+static void closeLogRawFile() {
+    if (logRawFD != -1) {
+        close(logRawFD);
+        logRawFD = -1;
+    }
+}
+
+/**
+ * Opens the current log file again without O_APPEND, if not already done.
+ *
+ * Must be called while locked.
+ *
+ * @return The descriptor, or -1 if the file could not be opened.
+ */
+static int openLogRawFile() {
+    char path[32];
+
+    if (logRawFD == -1) {
+        snprintf(path, sizeof(path), "/proc/self/fd/%d", getLogfileFD(logfileFP));
+        logRawFD = open(path, O_RDWR | O_CLOEXEC);
+    }
+    return logRawFD;
+}
+
+/**
+ * Ends the line which output moved into the log file may have left open, so that an entry of the
+ *  Wrapper does not start in the middle of it.  More output of the JVM continues the line.
+ *
+ * Must be called while locked, before writing to the log file.
+ *
+ * @param source_id The source of the entry about to be written.
+ */
+static void terminateLogRawLine(int source_id) {
+    off_t end;
+    char last;
+
+    if (!logRawSpliced) {
+        return;
+    }
+    logRawSpliced = FALSE;
+
+    if ((source_id > 0) && !(source_id & WRAPPER_SOURCE_STDERR_FLAG)) {
+        /* The rest of a line of output which was logged normally. */
+        return;
+    }
+    if (openLogRawFile() != -1) {
+        end = lseek(logRawFD, 0, SEEK_END);
+        if ((end > 0) && (pread(logRawFD, &last, 1, end - 1) == 1) && (last != '\n')) {
+            _ftprintf(logfileFP, TEXT("\n"));
+        }
+    }
+}
+
+/**
+ * Copies the data available in a pipe into logRawPeekBuffer without consuming it.
+ *
+ * Must be called while locked.
+ *
+ * @param fd The read end of the pipe.
+ * @param len The maximum number of bytes to copy.
+ * @param eof Set to TRUE if the pipe is empty and its write end has been closed.
+ *
+ * @return The number of bytes copied, 0 if there was no data available, or -1 if
+ *         the pipe can not be peeked.
+ */
+static ssize_t peekLogSplice(int fd, size_t len, int *eof) {
+    ssize_t teed;
+    ssize_t readLen;
+    ssize_t total = 0;
+
+    if ((logRawPeekPipe[0] == -1) && (pipe2(logRawPeekPipe, O_NONBLOCK | O_CLOEXEC) != 0)) {
+        logRawPeekPipe[0] = -1;
+        teed = -1;
+    } else {
+        teed = tee(fd, logRawPeekPipe[1], __min(len, sizeof(logRawPeekBuffer)), SPLICE_F_NONBLOCK);
+        if (teed == 0) {
+            *eof = TRUE;
+            return 0;
+        } else if ((teed < 0) && (errno == EAGAIN)) {
+            return 0;
+        }
+        /* The copy must be read completely so the scratch pipe is empty for the next call. */
+        while ((teed > 0) && (total < teed)) {
+            readLen = read(logRawPeekPipe[0], logRawPeekBuffer + total, (size_t)(teed - total));
+            if (readLen <= 0) {
+                disposeLogSplice();
+                teed = -1;
+                break;
+            }
+            total += readLen;
+        }
+    }
+    if (teed < 0) {
+        logRawDisabled = TRUE;
+        log_printf_queue(TRUE, WRAPPER_SOURCE_WRAPPER, LEVEL_WARN,
+            TEXT("Unable to write JVM output directly to the log file: %s  Falling back to normal logging."), getLastErrorText());
+        return -1;
+    }
+    return total;
+}
+
+/**
+ * Returns the length of the first line in a pipe, including its line feed, without
+ *  consuming it.  Used to read the rest of a partial line without reading past its end,
+ *  so that the following output can be moved with logSpliceToLogfile() again.
+ *
+ * @param fd The read end of the pipe.
+ *
+ * @return The length of the line, or 0 if there is no complete line in the pipe.
+ */
+int logPeekLineLength(int fd) {
+    ssize_t peeked;
+    char *lf;
+    int eof = FALSE;
+    int result = 0;
+
+    if (logRawDisabled) {
+        return 0;
+    }
+    if (lockLoggingMutex()) {
+        return 0;
+    }
+    peeked = peekLogSplice(fd, sizeof(logRawPeekBuffer), &eof);
+    if (peeked > 0) {
+        lf = memchr(logRawPeekBuffer, '\n', (size_t)peeked);
+        if (lf) {
+            result = (int)(lf - logRawPeekBuffer) + 1;
+        }
+    }
+    if (releaseLoggingMutex()) {
+        return 0;
+    }
+    return result;
+}
+
+/**
+ * Returns TRUE if output logged at the specified level would only be written
+ *  to the log file, without any decoration.
+ *
+ * Must be called while locked as the log routes are checked.
+ */
+static int isLogfileRawCapable(int source_id, int level) {
+    LogRoute *route;
+    const TCHAR *sourceName;
 
-                /* Decide on a new buffer size.
-                 * We can't tell how long the resulting string will be without expanding because the
-                 *  results are stored in the vargs.
-                 * Most messages will be short, but there is a possibility that some will be very
-                 *  long.  To minimize the number of times that we need to loop, while at the same
-                 *  time trying to avoid using too much memory, increase the size by the maximum of
-                 *  1024 or 10% of the current length.
-                 * Some platforms will return the required size as count.  Use that if available. */
-                threadMessageBufferSize = __max(threadMessageBufferSize + 1024, __max(threadMessageBufferSize + threadMessageBufferSize / 10, (size_t)count + 1));
-#if defined(HPUX)
-                /* Due to a bug in the HPUX libc (version < 1403), the buffer passed to _vsntprintf must have a length of 1 + N, where N is a multiple of 8.  Adjust it as necessary. */
-                threadMessageBufferSize = threadMessageBufferSize + (((threadMessageBufferSize - 1) % 8) == 0 ? 0 : 8 - ((threadMessageBufferSize - 1) % 8));
-#endif
+    if (logRawDisabled || (whichLogFile == LOG_FILE_DISABLED) || isLogfileMmap() || isLogfileUring()) {
+        return FALSE;
+    }
+    if ((_tcslen(logfileFormat) != 1) || ((logfileFormat[0] != TEXT('M')) && (logfileFormat[0] != TEXT('m')))) {
+        return FALSE;
+    }
+    if ((level < currentLogfileLevel) || (level >= currentConsoleLevel) || (level >= currentLoginfoLevel)) {
+        return FALSE;
+    }
+    /* The crash buffer and any route accepting the output need to see every line. */
+    if ((crashBufferSize > 0) && (level >= currentCrashBufferLevel)) {
+        return FALSE;
+    }
+    if (logRoutes && (level >= logRoutesLowLevel)) {
+        sourceName = getLogSourceName(source_id);
+        for (route = logRoutes; route; route = route->next) {
+            if ((level >= route->minLevel) && (level <= route->maxLevel)
+                    && ((!route->sourcePattern) || matchLogRoutePattern(sourceName, route->sourcePattern))) {
+                return FALSE;
+            }
+        }
+    }
+    return TRUE;
+}
 
-                threadMessageBuffer = malloc(sizeof(TCHAR) * threadMessageBufferSize);
-                if (!threadMessageBuffer) {
-                    _tprintf(TEXT("Out of memory in logging code (%s)\n"), TEXT("P3"));
-                    threadMessageBufferSize = 0;
-#if defined(UNICODE) && !defined(WIN32)
-                    if (msgMalloced) {
-                        free(msg);
-                    }
-#endif
-                    return;
-                }
+/**
+ * Moves output directly from a pipe into the log file with splice() so the data is
+ *  never written through user space.  This is only possible when the output would
+ *  be written to the log file and nowhere else, using the 'M' format.  This excludes
+ *  the crash buffer and any log route accepting the output.
+ *
+ * Whatever is available is moved, so the file may be left in the middle of a line.
+ *  The line is ended before the Wrapper writes one of its own messages to the file,
+ *  or continued by the rest of the output if that is logged normally.
+ *
+ * When the log file is rolled by size and its maximum size approaches, the pipe is
+ *  first peeked with tee() and only complete lines are moved, keeping the file
+ *  LOG_RAW_ROLL_MARGIN bytes short of its maximum size.  From that point, or if
+ *  there is no complete line available, -1 is returned and the caller is expected
+ *  to log the output line by line, reading a partial line only up to its end as
+ *  given by logPeekLineLength().  The file is then rolled on a line boundary.
+ *
+ * @param fd The read end of the pipe.
+ * @param source_id The source of the output, which is the JVM number.
+ * @param level The level at which the output would normally be logged.
+ * @param eof Set to TRUE if the write end of the pipe has been closed.
+ *
+ * @return The number of bytes moved, 0 if there was no data available, or -1 if
+ *         the output must be logged normally.
+ */
+int logSpliceToLogfile(int fd, int source_id, int level, int *eof) {
+    struct timeval timevalNow;
+    time_t      now;
+    struct tm   *nowTM;
+    int         logFileChanged;
+    off_t       end;
+    size_t      len;
+    int         peek = FALSE;
+    ssize_t     lineLen = 0;
+    ssize_t     moved;
+    ssize_t     total = 0;
+    int         result = -1;
 
-                /* Always set the count to -1 so we will loop again. */
-                count = -1;
-            }
-        } while ( count < 0 );
+    *eof = FALSE;
+
+    if (logRawDisabled) {
+        return -1;
     }
-#if defined(UNICODE) && !defined(WIN32)
-    if (msgMalloced) {
-        free(msg);
+
+    if (lockLoggingMutex()) {
+        return -1;
     }
-#endif
-    logFileCopy = NULL;
-    if (source_id > 0) {
-        /* As this is content from the JVM, the msg or lpszFmt is direct message, not a message format. */
-#if defined(UNICODE) && !defined(WIN32)
-        logFileChanged = log_printf_message(source_id, level, threadId, FALSE, msg, TRUE);
-#else
-        logFileChanged = log_printf_message(source_id, level, threadId, FALSE, (TCHAR*)lpszFmt, TRUE);
-#endif
-    } else {
-        /* The lpszFmt parameter was treated as a message format, and was expanded into the threadMessageBuffer buffer. */
-        logFileChanged = log_printf_message(source_id, level, threadId, FALSE, threadMessageBuffer, TRUE);
+
+    if (!isLogfileRawCapable(source_id, level)) {
+        releaseLoggingMutex();
+        return -1;
     }
-    if (logFileChanged) {
-        /* We need to enqueue a notification that the log file name was changed.
-         *  We can NOT directly send the notification here as that could cause a deadlock,
-         *  depending on where exactly this function was called from. (See Wrapper protocol mutex.) */
-        logFileCopy = malloc(sizeof(TCHAR) * (_tcslen(currentLogFileName) + 1));
-        if (!logFileCopy) {
-            _tprintf(TEXT("Out of memory in logging code (%s)\n"), TEXT("P4"));
+
+    gettimeofday(&timevalNow, NULL);
+    now = (time_t)timevalNow.tv_sec;
+    nowTM = localtime(&now);
+
+    /* Open the log file if needed.  This also takes care of rolling by date or if the file is already too large. */
+    logFileChanged = openLogFile(nowTM, TEXT(""));
+
+    if (logfileFP != NULL) {
+        /* Make sure that anything already logged by the Wrapper ends up before the output. */
+        fflush(logfileFP);
+
+        if ((openLogRawFile() == -1) || ((end = lseek(logRawFD, 0, SEEK_END)) == (off_t)-1)) {
+            logRawDisabled = TRUE;
+            log_printf_queue(TRUE, WRAPPER_SOURCE_WRAPPER, LEVEL_WARN,
+                TEXT("Unable to write JVM output directly to the log file: %s  Falling back to normal logging."), getLastErrorText());
+            len = 0;
         } else {
-            _tcsncpy(logFileCopy, currentLogFileName, _tcslen(currentLogFileName) + 1);
-            /* Now after we have 100% prepared the log file name.  Put into the queue variable
-             *  so the maintainLogging() function can safely grab it at any time.
-             * The reading code is also in a semaphore so we can do a quick test here safely as well. */
-            if (pendingLogFileChange) {
-                /* The previous file was still in the queue.  Free it up to avoid a memory leak.
-                 *  This can happen if the log file size is 1k or something like that.  We will always
-                 *  keep the most recent file however, so this should not be that big a problem. */
-#ifdef _DEBUG
-                _tprintf(TEXT("Log file name change was overwritten in queue: %s\n"), pendingLogFileChange);
-#endif
-                free(pendingLogFileChange);
+            len = LOG_RAW_SPLICE_SIZE;
+            if ((logFileRollMode & ROLL_MODE_SIZE) && (logFileMaxSize > 0)) {
+                if ((off_t)logFileMaxSize - end <= LOG_RAW_ROLL_MARGIN) {
+                    /* A roll is due soon. */
+                    len = 0;
+                } else if ((off_t)logFileMaxSize - end - LOG_RAW_ROLL_MARGIN < (off_t)len) {
+                    len = (size_t)(logFileMaxSize - end - LOG_RAW_ROLL_MARGIN);
+                    peek = TRUE;
+                }
+            }
+        }
+
+        if ((len > 0) && peek) {
+            lineLen = peekLogSplice(fd, len, eof);
+            if (lineLen == 0) {
+                /* Normal, there is no data available, or the other end of the pipe was closed. */
+                result = 0;
+            }
+            /* Only move complete lines.  A partial line is read normally. */
+            while ((lineLen > 0) && (logRawPeekBuffer[lineLen - 1] != '\n')) {
+                lineLen--;
+            }
+            /* The lines are already in the pipe so they can all be moved without waiting. */
+            while (total < lineLen) {
+                moved = splice(fd, NULL, logRawFD, NULL, (size_t)(lineLen - total), SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+                if ((moved < 0) && (errno == EINTR)) {
+                    continue;
+                } else if (moved <= 0) {
+                    /* Only possible if the pipe is read by someone else. */
+                    logRawDisabled = TRUE;
+                    log_printf_queue(TRUE, WRAPPER_SOURCE_WRAPPER, LEVEL_WARN,
+                        TEXT("Unable to write JVM output directly to the log file: %s  Falling back to normal logging."), getLastErrorText());
+                    break;
+                }
+                total += moved;
+            }
+            if (total > 0) {
+                /* The file now ends with a complete line. */
+                logRawSpliced = FALSE;
+            }
+        } else if (len > 0) {
+            do {
+                moved = splice(fd, NULL, logRawFD, NULL, len, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            } while ((moved < 0) && (errno == EINTR));
+            if (moved == 0) {
+                /* The other end of the pipe was closed. */
+                *eof = TRUE;
+                result = 0;
+            } else if (moved > 0) {
+                total = moved;
+                logRawSpliced = TRUE;
+            } else if (errno == EAGAIN) {
+                /* Normal, there is no data available. */
+                result = 0;
+            } else {
+                logRawDisabled = TRUE;
+                log_printf_queue(TRUE, WRAPPER_SOURCE_WRAPPER, LEVEL_WARN,
+                    TEXT("Unable to write JVM output directly to the log file: %s  Falling back to normal logging."), getLastErrorText());
+            }
+        }
+
+        if (total > 0) {
+            result = (int)total;
+            logFileAccessed = TRUE;
+            logfileActivityCount++;
+            countLogfileBytes((size_t)total);
+            requestLogfileSync(LEVEL_INFO, (size_t)total);
+            if (autoCloseLogfile) {
+                closeLogfileFP();
             }
-            pendingLogFileChange = logFileCopy;
         }
     }
 
+    if (logFileChanged) {
+        queueLogFileChange();
+    }
+
     /* Release the lock we have on this function so that other threads can get in. */
     if (releaseLoggingMutex()) {
-        return;
+        return -1;
     }
 
-    /* If we are checking on the log time then store the stop time.
-     *  It is Ok that some of the error paths don't make it this far. */
-    if (logPrintfWarnThreshold > 0) {
-#ifdef WIN32
-        _ftime(&timebNow);
-        endNow = (time_t)timebNow.time;
-        endNowMillis = timebNow.millitm;
-#else
-        gettimeofday(&timevalNow, NULL);
-        endNow = (time_t)timevalNow.tv_sec;
-        endNowMillis = timevalNow.tv_usec / 1000;
-#endif
-        previousLogLag = __min(endNow - startNow, 3600) * 1000 + endNowMillis - startNowMillis;
-        if (previousLogLag >= logPrintfWarnThreshold) {
-            log_printf_queue(TRUE, WRAPPER_SOURCE_WRAPPER, LEVEL_WARN, TEXT("Write to log took %d milliseconds."), previousLogLag);
-        }
-    }
+    return result;
 }
+#endif
 
 /* Internal functions */
 #ifdef WIN32
@@ -3304,7 +5952,7 @@ void sendEventlogMessage( int source_id, int level, const TCHAR *szBuff ) {
         break;
 
     default:
-        _sntprintf( header, 16, TEXT("jvm %d"), source_id );
+        _sntprintf( header, 16, TEXT("jvm %d"), source_id & ~WRAPPER_SOURCE_STDERR_FLAG );
         header[15] = TEXT('\0'); /* Just in case we get lots of restarts. */
         break;
     }
@@ -3762,8 +6410,7 @@ void rollLogs(const TCHAR *nowStr) {
         _tprintf(TEXT("Closing logfile so it can be rolled...\n"));
 #endif
 
-        fclose(logfileFP);
-        logfileFP = NULL;
+        closeLogfileFP();
         currentLogFileName[0] = TEXT('\0');
     }
 
@@ -4120,8 +6767,7 @@ void checkAndRollLogs(const TCHAR *nowDate, size_t printBufferSize) {
             _tprintf(TEXT("Closing logfile because the date changed...\n"));
 #endif
 
-            fclose(logfileFP);
-            logfileFP = NULL;
+            closeLogfileFP();
         }
         /* Always reset the name so the the log file name will be regenerated correctly. */
         currentLogFileName[0] = TEXT('\0');
@@ -4149,17 +6795,15 @@ void checkAndRollLogs(const TCHAR *nowDate, size_t printBufferSize) {
 }
 
 void log_printf_queue( int useQueue, int source_id, int level, const TCHAR *lpszFmt, ... ) {
-    int threadId;
-    int localWriteIndex;
-    int localReadIndex;
     va_list     vargs;
     int         count;
 #if defined(UNICODE) && !defined(WIN32)
-    TCHAR       *format;
+    TCHAR       format[QUEUED_BUFFER_SIZE];
     size_t      i;
     size_t      len;
 #endif
-    TCHAR       *buffer;
+    /* The message is built on the stack as we can not use malloc if the call originated from a signal handler. */
+    TCHAR       buffer[QUEUED_BUFFER_SIZE];
 
     /* Start by processing any arguments so that we can store a simple string. */
 #ifdef _DEBUG_QUEUE
@@ -4170,16 +6814,13 @@ void log_printf_queue( int useQueue, int source_id, int level, const TCHAR *lpsz
     if (wcsstr(lpszFmt, TEXT("%s")) != NULL) {
         /* On UNIX platforms string tokens must always use "%S" variables and not "%s".  We can
          *  not safely use malloc here as the call may have originated from a signal handler.
-         *  Copy the template into the formatMessages string reserved for this thread, replace
-         *  the tokens and then continue using that.  This is a bit of overhead, but these async
-         *  messages are fairly rare and this greatly simplifies the code throughout the rest of
-         *  the application by making it possible to always use the "%s" syntax. */
-        threadId = getThreadId();
-        _tcsncpy(formatMessages[threadId], lpszFmt, QUEUED_BUFFER_SIZE);
+         *  Copy the template into a local buffer, replace the tokens and then continue using
+         *  that.  This is a bit of overhead, but these async messages are fairly rare and this
+         *  greatly simplifies the code throughout the rest of the application by making it
+         *  possible to always use the "%s" syntax. */
+        _tcsncpy(format, lpszFmt, QUEUED_BUFFER_SIZE);
         /* Terminate just in case the format was too long. */
-        formatMessages[threadId][QUEUED_BUFFER_SIZE - 1] = TEXT('\0');
-        
-        format = formatMessages[threadId];
+        format[QUEUED_BUFFER_SIZE - 1] = TEXT('\0');
         
         /* Replace the tokens. */
  #ifdef _DEBUG_QUEUE
@@ -4211,38 +6852,6 @@ void log_printf_queue( int useQueue, int source_id, int level, const TCHAR *lpsz
         useQueue = FALSE;
     }
     
-    /** For queued logging, we have a fixed length buffer to work with.  Just to make it easy to catch
-     *   problems, always use the same sized fixed buffer even if we will be using the non-queued logging. */
-    if (useQueue) {
-        /* Care needs to be taken both with this code and the code below to get done as quick as possible.
-         *  It is generally safe because each thread has its own queue.  The only danger is if a message is
-         *  being queued while that thread is interrupted by a signal.  If things are setup correctly however
-         *  then non-signal threads should not be here in the first place. */
-        threadId = getThreadId();
-        
-        localWriteIndex = queueWriteIndex[threadId];
-        localReadIndex = queueReadIndex[threadId];
-        
-        if ((localWriteIndex == localReadIndex - 1) || ((localWriteIndex == QUEUE_SIZE - 1) && (localReadIndex == 0))) {
-            _tprintf(TEXT("WARNING log queue overflow for thread[%d]:%d:%d dropping entry: %s\n"), threadId, localWriteIndex, localReadIndex, lpszFmt);
-            return;
-        }
-        
-        /* Get a reference to the message buffer we will use. */
-        buffer = queueMessages[threadId][queueWriteIndex[threadId]];
-    } else {
-        /* This will not be queued so we can use malloc to create a new buffer. */
-        buffer = malloc(sizeof(TCHAR) * QUEUED_BUFFER_SIZE);
-        if (!buffer) {
-            _tprintf(TEXT("Out of memory in logging code (%s)\n"), TEXT("PQ1"));
-            return;
-        }
-        
-        /* For compiler */
-        threadId = -1;
-        localWriteIndex = -1;
-    }
-    
     /* Now actually generate our buffer. */
     va_start(vargs, lpszFmt);
     count = _vsntprintf(buffer, QUEUED_BUFFER_SIZE_USABLE, lpszFmt, vargs);
@@ -4265,41 +6874,26 @@ void log_printf_queue( int useQueue, int source_id, int level, const TCHAR *lpsz
     }
     
     if (useQueue) {
-#ifdef _DEBUG_QUEUE
-        _tprintf(TEXT("LOG ENQUEUE[%d] Thread[%d]: %s\n"), localWriteIndex, threadId, buffer);
-#endif
-        /* Store additional information about the call. */
-        queueSourceIds[threadId][localWriteIndex] = source_id;
-        queueLevels[threadId][localWriteIndex] = level;
-    
-        /* Lastly increment and wrap the write index. */
-        queueWriteIndex[threadId]++;
-        if (queueWriteIndex[threadId] >= QUEUE_SIZE) {
-            queueWriteIndex[threadId] = 0;
-            queueWrapped[threadId] = 1;
-        }
-    } else {
-        if (isLogInitialized()) {
-            /* Make a normal logging call with our new buffer.  Parameters are already expanded. */
-            log_printf(source_id, level,
+        /* Each thread has its own queue.  See enqueueLogMessage for how this is made safe for signal handlers. */
+        enqueueLogMessage(getThreadId(), source_id, level, buffer);
+    } else if (isLogInitialized()) {
+        /* Make a normal logging call with our new buffer.  Parameters are already expanded. */
+        log_printf(source_id, level,
 #if defined(UNICODE) && !defined(WIN32)
-                TEXT("%S"),
+            TEXT("%S"),
 #else
-                TEXT("%s"),
+            TEXT("%s"),
 #endif
-                buffer);
-        } else {
-            /* The best we can do is print something on the screen. */
-            _tprintf(
+            buffer);
+    } else {
+        /* The best we can do is print something on the screen. */
+        _tprintf(
 #if defined(UNICODE) && !defined(WIN32)
-                TEXT("%S\n"),
+            TEXT("%S\n"),
 #else
-                TEXT("%s\n"),
+            TEXT("%s\n"),
 #endif
-                buffer);
-        }
-        
-        free(buffer);
+            buffer);
     }
 }
 
@@ -4311,14 +6905,31 @@ void log_printf_queue( int useQueue, int source_id, int level, const TCHAR *lpsz
  *  any time as this function is being executed.
  */
 void maintainLogger() {
-    int localWriteIndex;
-    int source_id;
-    int level;
     int threadId;
-    TCHAR *buffer;
+    LogQueue *queue;
+    LogQueueRecord *record;
+    long localHead;
+    long size;
+    long dropped;
     int logFileChanged;
     TCHAR *logFileCopy;
+    const TCHAR *crashReason;
+        
+    /* Dump the crash buffer if requested. */
+    if (pendingCrashBufferDump) {
+        if (lockLoggingMutex()) {
+            return;
+        }
+        
+        crashReason = pendingCrashBufferDump;
+        pendingCrashBufferDump = NULL;
+        dumpCrashBuffer(crashReason);
         
+        if (releaseLoggingMutex()) {
+            return;
+        }
+    }
+    
     /* Check to see if there is a pending log file change notification. Do this first as we could
      *  generate our own here as well.  It is important that we do our best to keep them in order.
      *  Grab it and clear the reference quick in case another is set.  This order is thread safe. */
@@ -4350,10 +6961,8 @@ void maintainLogger() {
     }
     
     for (threadId = 0; threadId < WRAPPER_THREAD_COUNT; threadId++) {
-        /* NOTE - The queue variables are not synchronized so we need to access them
-         *        carefully and assume that data could possibly be corrupted. */
-        localWriteIndex = queueWriteIndex[threadId]; /* Snapshot the value to maintain a constant reference. */
-        if ( queueReadIndex[threadId] != localWriteIndex ) {
+        queue = &logQueues[threadId];
+        if (queue->buffer && (queue->tail != queue->head)) {
             logFileCopy = NULL;
 
             /* Lock the logging mutex. */
@@ -4361,45 +6970,46 @@ void maintainLogger() {
                 return;
             }
         
-            /* Empty the queue of any logged messages. */
-            localWriteIndex = queueWriteIndex[threadId]; /* Snapshot the value to maintain a constant reference. */
-            while (queueReadIndex[threadId] != localWriteIndex) {
-                /* Snapshot the values in the queue at that index. */
-                source_id = queueSourceIds[threadId][queueReadIndex[threadId]];
-                level = queueLevels[threadId][queueReadIndex[threadId]];
-                buffer = queueMessages[threadId][queueReadIndex[threadId]];
-
-                /* The buffer is static in the queue and will be reused. */
+            /* Empty the queue of any logged messages.  Snapshot the head to maintain a constant reference
+             *  as messages logged below may be queued on this same thread. */
+            localHead = queue->head;
+            while (queue->tail != localHead) {
+                record = (LogQueueRecord *)(queue->buffer + getLogQueueOffset(queue, queue->tail));
+                if (record->state == LOG_QUEUE_RECORD_FREE) {
+                    /* Reserved but the message is still being written.  It will be logged next time. */
+                    break;
+                }
+                /* Make sure the content of the record is read after its state. */
+                LOG_QUEUE_BARRIER();
+                size = record->size;
+                
+                if (record->state == LOG_QUEUE_RECORD_READY) {
 #ifdef _DEBUG_QUEUE
-                _tprintf(TEXT("LOG QUEUED[%d]: %s\n"), queueReadIndex[threadId], buffer );
+                    _tprintf(TEXT("LOG QUEUED[%ld]: %s\n"), queue->tail, (TCHAR *)(record + 1));
 #endif
-
-                logFileChanged = log_printf_message(source_id, level, threadId, TRUE, buffer, TRUE);
-                if (logFileChanged) {
-                    if (logFileCopy) {
-                        /* This can happen if there are multiple changes while printing the queued messages
-                         *  (for example if the files are rolled with a very low size limit).
-                         *  To keep it simple, we will reuse logFileCopy and report only the last change. */
-                        free(logFileCopy);
-                    }
-                    /* We need to make a copy of currentLogFileName because we will call logFileChangedCallback() outside of the semaphore. */
-                    logFileCopy = malloc(sizeof(TCHAR) * (_tcslen(currentLogFileName) + 1));
-                    if (!logFileCopy) {
-                        _tprintf(TEXT("Out of memory in logging code (%s)\n"), TEXT("ML1"));
-                    } else {
-                        _tcsncpy(logFileCopy, currentLogFileName, _tcslen(currentLogFileName) + 1);
+                    logFileChanged = log_printf_message(record->source_id, record->level, threadId, TRUE, (TCHAR *)(record + 1), TRUE);
+                    if (logFileChanged) {
+                        if (logFileCopy) {
+                            /* This can happen if there are multiple changes while printing the queued messages
+                             *  (for example if the files are rolled with a very low size limit).
+                             *  To keep it simple, we will reuse logFileCopy and report only the last change. */
+                            free(logFileCopy);
+                        }
+                        /* We need to make a copy of currentLogFileName because we will call logFileChangedCallback() outside of the semaphore. */
+                        logFileCopy = malloc(sizeof(TCHAR) * (_tcslen(currentLogFileName) + 1));
+                        if (!logFileCopy) {
+                            _tprintf(TEXT("Out of memory in logging code (%s)\n"), TEXT("ML1"));
+                        } else {
+                            _tcsncpy(logFileCopy, currentLogFileName, _tcslen(currentLogFileName) + 1);
+                        }
                     }
                 }
-#ifdef _DEBUG_QUEUE
-                _tprintf(TEXT("  Queue lw=%d, qw=%d, qr=%d\n"), localWriteIndex, queueWriteIndex[threadId], queueReadIndex[threadId]);
-#endif
-                /* Clear the string we just wrote. */
-                buffer[0] = TEXT('\0');
                 
-                queueReadIndex[threadId]++;
-                if ( queueReadIndex[threadId] >= QUEUE_SIZE ) {
-                    queueReadIndex[threadId] = 0;
-                }
+                /* Clear the whole record so that any header later written in this space starts out FREE.
+                 *  The space must be cleared before it is released to the writer. */
+                memset(record, 0, size);
+                LOG_QUEUE_BARRIER();
+                queue->tail = advanceLogQueuePosition(queue, queue->tail, size);
             }
 
             /* Release the lock we have on the logging mutex so that other threads can get in. */
@@ -4418,6 +7028,328 @@ void maintainLogger() {
                 free(logFileCopy);
             }
         }
+        
+        /* Report any messages which were dropped because the queue was full. */
+        dropped = queue->dropped;
+        if (dropped > 0) {
+            while (!LOG_QUEUE_CAS(&queue->dropped, dropped, 0)) {
+                dropped = queue->dropped;
+            }
+            logQueueDroppedTotal += (unsigned int)dropped;
+            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN,
+                TEXT("%ld queued log messages of thread %d were dropped as its log queue was full.  Consider increasing wrapper.log.queue.size."),
+                dropped, threadId);
+        }
+    }
+}
+
+#ifdef CUNIT
+/**
+ * Removes the oldest message from a queue the same way as maintainLogger, without logging it.
+ *
+ * @return TRUE if a message was copied into buffer.
+ */
+static int tsLOG_dequeueLogMessage(LogQueue *queue, TCHAR *buffer, size_t bufferLen, int *pads) {
+    LogQueueRecord *record;
+    long size;
+    int state;
+
+    while (queue->tail != queue->head) {
+        record = (LogQueueRecord *)(queue->buffer + getLogQueueOffset(queue, queue->tail));
+        state = record->state;
+        if (state == LOG_QUEUE_RECORD_FREE) {
+            return FALSE;
+        }
+        size = record->size;
+        if (state == LOG_QUEUE_RECORD_READY) {
+            _tcsncpy(buffer, (TCHAR *)(record + 1), bufferLen);
+            buffer[bufferLen - 1] = TEXT('\0');
+        } else {
+            (*pads)++;
+        }
+        memset(record, 0, size);
+        queue->tail = advanceLogQueuePosition(queue, queue->tail, size);
+        if (state == LOG_QUEUE_RECORD_READY) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+void tsLOG_testLogQueue(void) {
+    const TCHAR *small = TEXT("abc");
+    const TCHAR *large = TEXT("abcdefghijklmnopqrstuvwxyz");
+    int threadId = WRAPPER_THREAD_TIMER;
+    LogQueue savedQueue = logQueues[threadId];
+    int savedVariableRecords = logQueueVariableRecords;
+    LogQueue *queue = &logQueues[threadId];
+    LogQueueRecord *record;
+    TCHAR buffer[64];
+    long smallSize = getLogQueueRecordSize(_tcslen(small));
+    long largeSize = getLogQueueRecordSize(_tcslen(large));
+    int pads = 0;
+    int i;
+
+    CU_ASSERT_EQUAL(smallSize % (long)sizeof(LogQueueRecord), 0);
+    CU_ASSERT_FATAL(smallSize < largeSize);
+
+    /* A queue with room for two large messages. */
+    memset(queue, 0, sizeof(LogQueue));
+    queue->capacity = largeSize * 2;
+    queue->buffer = calloc(queue->capacity, 1);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(queue->buffer);
+    logQueueVariableRecords = TRUE;
+
+    enqueueLogMessage(threadId, WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, small);
+    CU_ASSERT_EQUAL(queue->head, smallSize);
+    CU_ASSERT_TRUE(tsLOG_dequeueLogMessage(queue, buffer, 64, &pads));
+    CU_ASSERT(_tcscmp(buffer, small) == 0);
+
+    enqueueLogMessage(threadId, WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, large);
+    CU_ASSERT_EQUAL(queue->head, smallSize + largeSize);
+    CU_ASSERT_TRUE(tsLOG_dequeueLogMessage(queue, buffer, 64, &pads));
+    CU_ASSERT(_tcscmp(buffer, large) == 0);
+
+    /* The next large message does not fit at the end, so the end is padded and it starts over. */
+    enqueueLogMessage(threadId, WRAPPER_SOURCE_WRAPPER, LEVEL_WARN, large);
+    record = (LogQueueRecord *)(queue->buffer + smallSize + largeSize);
+    CU_ASSERT_EQUAL(record->state, LOG_QUEUE_RECORD_PAD);
+    CU_ASSERT_EQUAL(record->size, largeSize - smallSize);
+    record = (LogQueueRecord *)queue->buffer;
+    CU_ASSERT_EQUAL(record->state, LOG_QUEUE_RECORD_READY);
+    CU_ASSERT_EQUAL(record->level, LEVEL_WARN);
+    CU_ASSERT_EQUAL(queue->head, largeSize * 3);
+    CU_ASSERT_TRUE(tsLOG_dequeueLogMessage(queue, buffer, 64, &pads));
+    CU_ASSERT(_tcscmp(buffer, large) == 0);
+    CU_ASSERT_EQUAL(pads, 1);
+    CU_ASSERT_EQUAL(queue->tail, queue->head);
+
+    /* The positions wrap at twice the capacity.  A full queue drops the message. */
+    enqueueLogMessage(threadId, WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, large);
+    CU_ASSERT_EQUAL(queue->head, 0);
+    enqueueLogMessage(threadId, WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, large);
+    CU_ASSERT_EQUAL(queue->head, largeSize);
+    enqueueLogMessage(threadId, WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, small);
+    CU_ASSERT_EQUAL(queue->head, largeSize);
+    CU_ASSERT_EQUAL(queue->dropped, 1);
+    CU_ASSERT_TRUE(tsLOG_dequeueLogMessage(queue, buffer, 64, &pads));
+    CU_ASSERT_TRUE(tsLOG_dequeueLogMessage(queue, buffer, 64, &pads));
+    CU_ASSERT_FALSE(tsLOG_dequeueLogMessage(queue, buffer, 64, &pads));
+
+    /* Go around many times. */
+    for (i = 0; i < 50; i++) {
+        enqueueLogMessage(threadId, WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, (i % 3) ? small : large);
+        CU_ASSERT((queue->head >= 0) && (queue->head < queue->capacity * 2));
+        CU_ASSERT_TRUE(tsLOG_dequeueLogMessage(queue, buffer, 64, &pads));
+        CU_ASSERT(_tcscmp(buffer, (i % 3) ? small : large) == 0);
+        CU_ASSERT_EQUAL(queue->tail, queue->head);
+    }
+    CU_ASSERT_EQUAL(queue->dropped, 1);
+
+    free(queue->buffer);
+    logQueues[threadId] = savedQueue;
+    logQueueVariableRecords = savedVariableRecords;
+}
+
+static void tsLOG_subTestLogRouteFilters(const TCHAR *filters, int expectedResult, int expectedMin, int expectedMax, const TCHAR *expectedPattern) {
+    LogRoute route;
+    TCHAR work[256];
+    int result;
+
+    memset(&route, 0, sizeof(LogRoute));
+    route.minLevel = LEVEL_DEBUG;
+    route.maxLevel = LEVEL_NONE - 1;
+    _tcsncpy(work, filters, 256);
+    work[255] = TEXT('\0');
+
+    result = parseLogRouteFilters(work, &route);
+    if (expectedResult) {
+        CU_ASSERT_TRUE(result);
+    } else {
+        CU_ASSERT_FALSE(result);
+        CU_ASSERT_EQUAL(route.minLevel, expectedMin);
+        CU_ASSERT_EQUAL(route.maxLevel, expectedMax);
+        if (expectedPattern) {
+            CU_ASSERT_PTR_NOT_NULL(route.sourcePattern);
+            if (route.sourcePattern) {
+                CU_ASSERT(_tcscmp(route.sourcePattern, expectedPattern) == 0);
+            }
+        } else {
+            CU_ASSERT_PTR_NULL(route.sourcePattern);
+        }
     }
+    if (route.sourcePattern) {
+        free(route.sourcePattern);
+    }
+}
+
+void tsLOG_testLogRouteFilters(void) {
+    tsLOG_subTestLogRouteFilters(TEXT(""), FALSE, LEVEL_DEBUG, LEVEL_NONE - 1, NULL);
+    tsLOG_subTestLogRouteFilters(TEXT("level>=WARN"), FALSE, LEVEL_WARN, LEVEL_NONE - 1, NULL);
+    tsLOG_subTestLogRouteFilters(TEXT("level>INFO"), FALSE, LEVEL_INFO + 1, LEVEL_NONE - 1, NULL);
+    tsLOG_subTestLogRouteFilters(TEXT("level<=INFO, source:jvm*"), FALSE, LEVEL_DEBUG, LEVEL_INFO, TEXT("jvm*"));
+    tsLOG_subTestLogRouteFilters(TEXT("level<WARN"), FALSE, LEVEL_DEBUG, LEVEL_WARN - 1, NULL);
+    tsLOG_subTestLogRouteFilters(TEXT(" Level = error , "), FALSE, LEVEL_ERROR, LEVEL_ERROR, NULL);
+    tsLOG_subTestLogRouteFilters(TEXT("level>=INFO,level<=WARN"), FALSE, LEVEL_INFO, LEVEL_WARN, NULL);
+    tsLOG_subTestLogRouteFilters(TEXT("SOURCE: wrapper "), FALSE, LEVEL_DEBUG, LEVEL_NONE - 1, TEXT("wrapper"));
+
+    tsLOG_subTestLogRouteFilters(TEXT("level>=BOGUS"), TRUE, 0, 0, NULL);
+    tsLOG_subTestLogRouteFilters(TEXT("level>=NONE"), TRUE, 0, 0, NULL);
+    tsLOG_subTestLogRouteFilters(TEXT("severity>=WARN"), TRUE, 0, 0, NULL);
+    tsLOG_subTestLogRouteFilters(TEXT("levelWARN"), TRUE, 0, 0, NULL);
+    tsLOG_subTestLogRouteFilters(TEXT("source:"), TRUE, 0, 0, NULL);
+    tsLOG_subTestLogRouteFilters(TEXT("source:jvm,source:wrapper"), TRUE, 0, 0, NULL);
+    tsLOG_subTestLogRouteFilters(TEXT("origin:jvm"), TRUE, 0, 0, NULL);
+    /* Can never match. */
+    tsLOG_subTestLogRouteFilters(TEXT("level>ERROR,level<WARN"), TRUE, 0, 0, NULL);
+}
+
+void tsLOG_testMatchLogRoutePattern(void) {
+    CU_ASSERT_TRUE(matchLogRoutePattern(TEXT("jvm"), TEXT("jvm")));
+    CU_ASSERT_TRUE(matchLogRoutePattern(TEXT("JVM"), TEXT("jvm")));
+    CU_ASSERT_TRUE(matchLogRoutePattern(TEXT("jvm"), TEXT("jvm*")));
+    CU_ASSERT_TRUE(matchLogRoutePattern(TEXT("jvm_stderr"), TEXT("jvm*")));
+    CU_ASSERT_TRUE(matchLogRoutePattern(TEXT("jvm_stderr"), TEXT("*err")));
+    CU_ASSERT_TRUE(matchLogRoutePattern(TEXT("jvm_stderr"), TEXT("j**_*r")));
+    CU_ASSERT_TRUE(matchLogRoutePattern(TEXT("jvm"), TEXT("j?m")));
+    CU_ASSERT_TRUE(matchLogRoutePattern(TEXT(""), TEXT("*")));
+    CU_ASSERT_TRUE(matchLogRoutePattern(TEXT(""), TEXT("")));
+
+    CU_ASSERT_FALSE(matchLogRoutePattern(TEXT("jvm_version"), TEXT("jvm")));
+    CU_ASSERT_FALSE(matchLogRoutePattern(TEXT("wrapper"), TEXT("jvm*")));
+    CU_ASSERT_FALSE(matchLogRoutePattern(TEXT("jm"), TEXT("j?m")));
+    CU_ASSERT_FALSE(matchLogRoutePattern(TEXT("jvm"), TEXT("")));
+    CU_ASSERT_FALSE(matchLogRoutePattern(TEXT(""), TEXT("?")));
+    CU_ASSERT_FALSE(matchLogRoutePattern(TEXT("jvm_stderr"), TEXT("*out")));
+}
+
+static void tsLOG_subTestJSONString(const TCHAR *str, const TCHAR *expected) {
+    TCHAR buffer[256];
+    size_t len;
+
+    len = printJSONString(buffer, str);
+    buffer[len] = TEXT('\0');
+    CU_ASSERT_EQUAL(len, _tcslen(expected));
+    CU_ASSERT(_tcscmp(buffer, expected) == 0);
+}
+
+void tsLOG_testJSONString(void) {
+    tsLOG_subTestJSONString(TEXT(""), TEXT("\"\""));
+    tsLOG_subTestJSONString(TEXT("plain text"), TEXT("\"plain text\""));
+    tsLOG_subTestJSONString(TEXT("say \"hi\""), TEXT("\"say \\\"hi\\\"\""));
+    tsLOG_subTestJSONString(TEXT("C:\\temp\\"), TEXT("\"C:\\\\temp\\\\\""));
+    tsLOG_subTestJSONString(TEXT("a\nb\rc\td"), TEXT("\"a\\nb\\rc\\td\""));
+    tsLOG_subTestJSONString(TEXT("\x01\x1f "), TEXT("\"\\u0001\\u001f \""));
+    tsLOG_subTestJSONString(TEXT("\x1b[0m"), TEXT("\"\\u001b[0m\""));
+    /* Characters outside of ASCII are copied as is. */
+    tsLOG_subTestJSONString(TEXT("caf\xe9 \x7f"), TEXT("\"caf\xe9 \x7f\""));
+}
+
+static void tsLOG_subTestJSONPrintBuffer(int source_id, int threadId, time_t durationMillis, const TCHAR *message, const TCHAR *expected) {
+    TCHAR *buffer;
+
+    currentNow = 1600000000;
+    currentNowMicros = 123;
+    buffer = buildJSONPrintBuffer(source_id, LEVEL_WARN, threadId, durationMillis, message);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(buffer);
+    CU_ASSERT(_tcscmp(buffer, expected) == 0);
+}
+
+void tsLOG_testJSONPrintBuffer(void) {
+    tsLOG_subTestJSONPrintBuffer(WRAPPER_SOURCE_WRAPPER, WRAPPER_THREAD_MAIN, (time_t)-1, TEXT("started"),
+        TEXT("{\"time\":1600000000000123,\"level\":\"WARN\",\"source\":\"wrapper\",\"thread\":\"main\",\"message\":\"started\"}"));
+    tsLOG_subTestJSONPrintBuffer(3 | WRAPPER_SOURCE_STDERR_FLAG, WRAPPER_THREAD_JAVAIO, 0, TEXT(""),
+        TEXT("{\"time\":1600000000000123,\"level\":\"WARN\",\"source\":\"jvm_stderr\",\"jvm\":3,\"thread\":\"javaio\",\"duration\":0,\"message\":\"\"}"));
+    /* The longest names and a duration after a long silence. */
+    tsLOG_subTestJSONPrintBuffer(WRAPPER_SOURCE_JVM_VERSION, WRAPPER_THREAD_STARTUP, 100000000, TEXT("x"),
+        TEXT("{\"time\":1600000000000123,\"level\":\"WARN\",\"source\":\"jvm_version\",\"thread\":\"startup\",\"duration\":100000000,\"message\":\"x\"}"));
+    tsLOG_subTestJSONPrintBuffer(WRAPPER_SOURCE_STDERR_FLAG - 1, WRAPPER_THREAD_SRVMAIN, 999999999, TEXT("\"\n"),
+        TEXT("{\"time\":1600000000000123,\"level\":\"WARN\",\"source\":\"jvm\",\"jvm\":1073741823,\"thread\":\"srvmain\",\"duration\":999999999,\"message\":\"\\\"\\n\"}"));
+}
+
+/* Access to the binary encoders for the round trip tests of wrapper-logcat. */
+size_t tsLOG_putBinaryVarint(unsigned char *pos, unsigned long value) {
+    return putBinaryVarint(pos, value);
+}
+
+unsigned long tsLOG_zigzagBinary(long value) {
+    return zigzagBinary(value);
+}
+
+size_t tsLOG_putBinaryString(unsigned char *pos, const TCHAR *str) {
+    return putBinaryString(pos, str);
+}
+
+static void tsLOG_subTestBinaryVarint(unsigned long value, const char *expected, size_t expectedLen) {
+    unsigned char buffer[16];
+    size_t len;
+
+    len = putBinaryVarint(buffer, value);
+    CU_ASSERT_EQUAL(len, expectedLen);
+    CU_ASSERT(memcmp(buffer, expected, expectedLen) == 0);
+}
+
+void tsLOG_testBinaryVarint(void) {
+    unsigned long maxValue = (unsigned long)-1;
+    long maxLong = (long)(maxValue >> 1);
+    unsigned char buffer[16];
+    size_t len;
+    size_t i;
+
+    /* 7 bits per byte, the high bit being set on all but the last byte. */
+    tsLOG_subTestBinaryVarint(0, "\x00", 1);
+    tsLOG_subTestBinaryVarint(1, "\x01", 1);
+    tsLOG_subTestBinaryVarint(0x7F, "\x7f", 1);
+    tsLOG_subTestBinaryVarint(0x80, "\x80\x01", 2);
+    tsLOG_subTestBinaryVarint(300, "\xac\x02", 2);
+    tsLOG_subTestBinaryVarint(0x3FFF, "\xff\x7f", 2);
+    tsLOG_subTestBinaryVarint(0x4000, "\x80\x80\x01", 3);
+    tsLOG_subTestBinaryVarint(0xFFFFFFFF, "\xff\xff\xff\xff\x0f", 5);
+
+    len = putBinaryVarint(buffer, maxValue);
+    CU_ASSERT_EQUAL(len, (sizeof(unsigned long) * 8 + 6) / 7);
+    for (i = 0; i + 1 < len; i++) {
+        CU_ASSERT_EQUAL(buffer[i], 0xFF);
+    }
+    CU_ASSERT(buffer[len - 1] < 0x80);
+
+    /* Small values of either sign stay small. */
+    CU_ASSERT_EQUAL(zigzagBinary(0), 0);
+    CU_ASSERT_EQUAL(zigzagBinary(-1), 1);
+    CU_ASSERT_EQUAL(zigzagBinary(1), 2);
+    CU_ASSERT_EQUAL(zigzagBinary(-2), 3);
+    CU_ASSERT_EQUAL(zigzagBinary(63), 126);
+    CU_ASSERT_EQUAL(zigzagBinary(-64), 127);
+    CU_ASSERT_EQUAL(zigzagBinary(64), 128);
+    CU_ASSERT_EQUAL(zigzagBinary(-65), 129);
+    CU_ASSERT_EQUAL(zigzagBinary(maxLong), maxValue - 1);
+    CU_ASSERT_EQUAL(zigzagBinary(-maxLong - 1), maxValue);
 }
 
+static void tsLOG_subTestBinaryString(const TCHAR *str, const char *expected, size_t expectedLen) {
+    unsigned char buffer[64];
+    size_t len;
+
+    len = putBinaryString(buffer, str);
+    CU_ASSERT_EQUAL(len, expectedLen);
+    CU_ASSERT(memcmp(buffer, expected, expectedLen) == 0);
+}
+
+void tsLOG_testBinaryString(void) {
+    tsLOG_subTestBinaryString(TEXT(""), "", 0);
+    tsLOG_subTestBinaryString(TEXT("abc\n"), "abc\n", 4);
+#ifdef UNICODE
+    /* The boundaries of the 1, 2 and 3 byte sequences. */
+    tsLOG_subTestBinaryString(TEXT("\x7f\x80"), "\x7f\xc2\x80", 3);
+    tsLOG_subTestBinaryString(TEXT("\x7ff\x800"), "\xdf\xbf\xe0\xa0\x80", 5);
+    tsLOG_subTestBinaryString(TEXT("\x20ac\xffff"), "\xe2\x82\xac\xef\xbf\xbf", 6);
+ #ifndef WIN32
+    tsLOG_subTestBinaryString(TEXT("\x10000\x10ffff"), "\xf0\x90\x80\x80\xf4\x8f\xbf\xbf", 8);
+    /* Not a character. */
+    tsLOG_subTestBinaryString(TEXT("\x110000"), "\xef\xbf\xbd", 3);
+ #else
+    tsLOG_subTestBinaryString(TEXT("\xd800\xdc00\xdbff\xdfff"), "\xf0\x90\x80\x80\xf4\x8f\xbf\xbf", 8);
+ #endif
+#endif
+}
+#endif /* CUNIT */
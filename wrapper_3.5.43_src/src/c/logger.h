@@ -69,6 +69,7 @@
 #ifndef ERROR_MUI_FILE_NOT_LOADED
  #define ERROR_MUI_FILE_NOT_LOADED                  0x3B01
 #endif
+#include <time.h>
 #include "logger_base.h"
 
 /* * * Log source constants * * */
@@ -78,6 +79,9 @@
 #define WRAPPER_SOURCE_JVM          -3
 #define WRAPPER_SOURCE_JVM_VERSION  -4
 
+/* OR'ed into the JVM number for output read from a separate stderr pipe. */
+#define WRAPPER_SOURCE_STDERR_FLAG  0x40000000
+
 /* * * Log thread constants * * */
 /* These are indexes in an array so they must be sequential, start
  *  with zero and be one less than the final WRAPPER_THREAD_COUNT */
@@ -93,7 +97,8 @@
  #define WRAPPER_THREAD_JAVAIO   4
 #endif
 #define WRAPPER_THREAD_STARTUP  (WRAPPER_THREAD_JAVAIO+1)
-#define WRAPPER_THREAD_COUNT    (WRAPPER_THREAD_STARTUP+1)
+#define WRAPPER_THREAD_LOGSYNC  (WRAPPER_THREAD_STARTUP+1)
+#define WRAPPER_THREAD_COUNT    (WRAPPER_THREAD_LOGSYNC+1)
 
 #define MAX_LOG_SIZE 4096
 
@@ -109,6 +114,24 @@
 #define LOG_FORMAT_LOGFILE_DEFAULT TEXT("LPTM")
 #define LOG_FORMAT_CONSOLE_DEFAULT TEXT("PM")
 
+/* * * Binary log file format (wrapper.logfile.format=BINARY) * * */
+/* A binary log file starts with the signature and is followed by one record per log entry:
+ *   byte    level, or'd with the LOG_BINARY_FLAG_* flags
+ *   varint  LOG_BINARY_FLAG_ABSOLUTE: seconds since the epoch, then microseconds.
+ *           Otherwise: zigzag encoded microseconds since the previous record.
+ *   varint  zigzag encoded source id
+ *   varint  zigzag encoded thread id
+ *   varint  duration in milliseconds + 1, or 0 if not set
+ *   varint  uptime in seconds + 1, or 0 once the uptime has flipped
+ *   varint  length in bytes of the message which follows as UTF-8
+ * Varints are unsigned and stored 7 bits per byte, least significant first.  The high bit is set
+ *  on all but the last byte. */
+#define LOG_BINARY_SIGNATURE        "WRAPBLG1"
+#define LOG_BINARY_SIGNATURE_LEN    8
+#define LOG_BINARY_LEVEL_MASK       0x0f
+#define LOG_BINARY_FLAG_QUEUED      0x10
+#define LOG_BINARY_FLAG_ABSOLUTE    0x20
+
 /* * * Log file roll mode constants * * */
 #define ROLL_MODE_UNKNOWN         0
 #define ROLL_MODE_NONE            1
@@ -124,14 +147,19 @@
 
 /* Any log messages generated within signal handlers must be stored until we
  *  have left the signal handler to avoid deadlocks in the logging code.
- *  Messages are stored in a round robin buffer of log messages until
- *  maintainLogger is next called.
- * When we are inside of a signal, and thus when calling log_printf_queue,
- *  we know that it is safe to modify the queue as needed.  But it is possible
- *  that a signal could be fired while we are in maintainLogger, so case is
- *  taken to make sure that volatile changes are only made in log_printf_queue.
+ *  Messages are stored in a ring buffer for each thread until maintainLogger
+ *  is next called.
+ * Each ring has a single reader, maintainLogger while locked, and is only
+ *  written by its own thread.  As that thread may be interrupted by a signal
+ *  while it is queuing a message, space is reserved with an atomic compare
+ *  and swap and each record is flagged as ready once it is complete.  Nothing
+ *  in the queuing code allocates memory or takes a lock.
+ * Messages which do not fit are dropped and counted.  maintainLogger reports
+ *  how many were dropped.
  */
-#define QUEUE_SIZE 20
+/* Default number of full sized messages which can be queued for each thread. */
+#define LOG_QUEUE_SIZE_DEFAULT 20
+#define LOG_QUEUE_SIZE_MAX 1000
 /* The size of QUEUED_BUFFER_SIZE_USABLE is arbitrary as the largest size which can be logged in full,
  *  but to avoid crashes due to a bug in the HPUX libc (version < 1403), the length of the buffer passed to _vsntprintf must have a length of 1 + N, where N is a multiple of 8. */
 #define QUEUED_BUFFER_SIZE_USABLE (512 + 1)
@@ -259,10 +287,19 @@ extern void setLogfileMaxFileSize( const TCHAR *max_file_size );
 extern void setLogfileMaxLogFiles(int max_log_files);
 extern void setLogfilePurgePattern(const TCHAR *pattern, int* outIsGenerated);
 extern void setLogfilePurgeSortMode(int sortMode);
+extern int addLogfileRoute(const TCHAR *rule, const TCHAR *maxSize, int maxFiles);
+extern void clearLogfileRoutes();
 extern DWORD getLogfileActivity();
+extern void getLogfileBytesWritten(unsigned int *low, unsigned int *high);
+extern unsigned int getLogQueueDropped();
 
 /** Sets the auto flush log file flag. */
 extern void setLogfileAutoFlush(int autoFlush);
+extern void setLogfileMmap(int mmap);
+extern void setLogfileUring(int uring);
+extern int startLogfileUring();
+extern void setLogfileSync(int interval, int bytes, int level);
+extern int startLogfileSync();
 
 /** Sets the auto close log file flag. */
 extern void setLogfileAutoClose(int autoClose);
@@ -273,6 +310,31 @@ extern void closeLogfile();
 /** Flushes any buffered logfile output to the disk. */
 extern void flushLogfile();
 
+#ifdef LINUX
+/**
+ * Moves output directly from a pipe into the log file with splice().
+ *
+ * @param fd The read end of the pipe.
+ * @param source_id The source of the output, which is the JVM number.
+ * @param level The level at which the output would normally be logged.
+ * @param eof Set to TRUE if the write end of the pipe has been closed.
+ *
+ * @return The number of bytes moved, 0 if there was no data available, or -1 if
+ *         the output must be logged normally.
+ */
+extern int logSpliceToLogfile(int fd, int source_id, int level, int *eof);
+
+/**
+ * Returns the length of the first line in a pipe, including its line feed, without
+ *  consuming it.
+ *
+ * @param fd The read end of the pipe.
+ *
+ * @return The length of the line, or 0 if there is no complete line in the pipe.
+ */
+extern int logPeekLineLength(int fd);
+#endif
+
 /* * Console functions * */
 extern void setConsoleLogFormat( const TCHAR *console_log_format );
 extern void setConsoleLogLevelInt(int console_log_level);
@@ -286,6 +348,18 @@ extern void setConsoleFatalToStdErr(int toStdErr);
 extern void setConsoleErrorToStdErr(int toStdErr);
 extern void setConsoleWarnToStdErr(int toStdErr);
 
+/* * Crash buffer functions * */
+extern int setCrashBufferSize(int size);
+extern void setCrashBufferLevelInt(int level);
+extern void setCrashBufferLevel( const TCHAR *level );
+extern int getCrashBufferLevelInt();
+extern int setCrashBufferFile( const TCHAR *file );
+extern void requestCrashBufferDump(const TCHAR *reason);
+
+/* * Log queue functions * */
+extern int setLogQueueSize(int size);
+extern void setLogQueueVariableRecords(int variableRecords);
+
 /* * Syslog/eventlog functions * */
 extern void setSyslogLevelInt(int loginfo_level);
 extern int getSyslogLevelInt();
@@ -315,6 +389,7 @@ extern int isLogInitialized();
 extern int initLogging(void (*logFileChanged)(const TCHAR *logFile));
 extern int disposeLogging();
 extern void setUptime(int uptime, int flipped);
+extern TCHAR* buildPrintBuffer( int source_id, int level, int threadId, int queued, struct tm *nowTM, int nowMillis, time_t durationMillis, const TCHAR *format, const TCHAR *defaultFormat, const TCHAR *message);
 extern void rollLogs(const TCHAR *nowStr);
 extern int getLogLevelForName( const TCHAR *logLevelName );
 #ifndef WIN32
@@ -355,4 +430,19 @@ extern void invalidMultiByteSequence(const TCHAR *context, int id);
 #ifdef WIN32
 extern void setLogSysLangId(int id);
 #endif
+
+#ifdef CUNIT
+extern void tsLOG_testLogQueue(void);
+extern void tsLOG_testLogRouteFilters(void);
+extern void tsLOG_testMatchLogRoutePattern(void);
+extern void tsLOG_testJSONString(void);
+extern void tsLOG_testJSONPrintBuffer(void);
+extern void tsLOG_testBinaryVarint(void);
+extern void tsLOG_testBinaryString(void);
+extern size_t tsLOG_putBinaryVarint(unsigned char *pos, unsigned long value);
+extern unsigned long tsLOG_zigzagBinary(long value);
+extern size_t tsLOG_putBinaryString(unsigned char *pos, const TCHAR *str);
+extern void tsLCAT_testVarint(void);
+extern void tsLCAT_testDecodeMessage(void);
+#endif /* CUNIT */
 #endif
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 1999, 2020 Tanuki Software, Ltd.
+ * http://www.tanukisoftware.com
+ * All rights reserved.
+ *
+ * This software is the proprietary information of Tanuki Software.
+ * You shall use it only in accordance with the terms of the
+ * license agreement you entered into with Tanuki Software.
+ * http://wrapper.tanukisoftware.com/doc/english/licenseOverview.html
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "CUnit/Basic.h"
+#include "testsuite.h"
+#include "logger.h"
+#include "property.h"
+#include "wrapper.h"
+
+/********************************************************************
+ * Child Output Tests
+ *******************************************************************/
+
+/* The sources of the tests are in wrapper.c as they test static functions. */
+
+static int tsCO_allocatedWrapperData = FALSE;
+
+int tsCO_init_wrapper(void) {
+    tsInitLogging();
+
+    if (!wrapperData) {
+        wrapperData = malloc(sizeof(WrapperConfig));
+        if (!wrapperData) {
+            return 1;
+        }
+        memset(wrapperData, 0, sizeof(WrapperConfig));
+        tsCO_allocatedWrapperData = TRUE;
+    }
+    return 0;
+}
+
+int tsCO_clean_wrapper(void) {
+    tsCleanLogging();
+
+    if (tsCO_allocatedWrapperData) {
+        free(wrapperData);
+        wrapperData = NULL;
+        tsCO_allocatedWrapperData = FALSE;
+    }
+    return 0;
+}
+
+int tsCO_suiteChildOutput() {
+    CU_pSuite childOutputSuite;
+
+    childOutputSuite = CU_add_suite("Child Output Suite", tsCO_init_wrapper, tsCO_clean_wrapper);
+    if (NULL == childOutputSuite) {
+        return CU_get_error();
+    }
+
+    CU_add_test(childOutputSuite, "wrapperShedChildOutput()", tsCO_testShedChildOutput);
+    CU_add_test(childOutputSuite, "wrapperDedupChildOutput()", tsCO_testDedupChildOutput);
+    CU_add_test(childOutputSuite, "isChildOutputContinuation()", tsCO_testChildOutputContinuation);
+
+    return FALSE;
+}
@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 1999, 2020 Tanuki Software, Ltd.
+ * http://www.tanukisoftware.com
+ * All rights reserved.
+ *
+ * This software is the proprietary information of Tanuki Software.
+ * You shall use it only in accordance with the terms of the
+ * license agreement you entered into with Tanuki Software.
+ * http://wrapper.tanukisoftware.com/doc/english/licenseOverview.html
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "CUnit/Basic.h"
+#include "logger.h"
+#include "wrapper.h"
+
+/********************************************************************
+ * Event Loop Tests
+ *******************************************************************/
+
+/* The sources of the tests are in wrappereventloop.c as they test static functions. */
+
+int tsLOOP_suiteEventLoop() {
+    CU_pSuite eventLoopSuite;
+
+    eventLoopSuite = CU_add_suite("Event Loop Suite", NULL, NULL);
+    if (NULL == eventLoopSuite) {
+        return CU_get_error();
+    }
+
+    CU_add_test(eventLoopSuite, "Loop deadlines", tsLOOP_testDeadlineHeap);
+    CU_add_test(eventLoopSuite, "Histogram percentiles", tsLOOP_testHistogram);
+    CU_add_test(eventLoopSuite, "Ping round trip times", tsLOOP_testPingRTT);
+
+    return FALSE;
+}
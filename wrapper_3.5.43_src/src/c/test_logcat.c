@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 1999, 2020 Tanuki Software, Ltd.
+ * http://www.tanukisoftware.com
+ * All rights reserved.
+ *
+ * This software is the proprietary information of Tanuki Software.
+ * You shall use it only in accordance with the terms of the
+ * license agreement you entered into with Tanuki Software.
+ * http://wrapper.tanukisoftware.com/doc/english/licenseOverview.html
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "CUnit/Basic.h"
+#include "testsuite.h"
+#include "logger.h"
+
+/********************************************************************
+ * Logcat Tests
+ *******************************************************************/
+
+/* The sources of the tests are in wrapper_logcat.c as they test static functions. */
+
+int tsLCAT_suiteLogcat() {
+    CU_pSuite logcatSuite;
+
+    logcatSuite = CU_add_suite("Logcat Suite", NULL, NULL);
+    if (NULL == logcatSuite) {
+        return CU_get_error();
+    }
+
+    CU_add_test(logcatSuite, "readVarint()", tsLCAT_testVarint);
+    CU_add_test(logcatSuite, "decodeMessage()", tsLCAT_testDecodeMessage);
+
+    return FALSE;
+}
@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 1999, 2020 Tanuki Software, Ltd.
+ * http://www.tanukisoftware.com
+ * All rights reserved.
+ *
+ * This software is the proprietary information of Tanuki Software.
+ * You shall use it only in accordance with the terms of the
+ * license agreement you entered into with Tanuki Software.
+ * http://wrapper.tanukisoftware.com/doc/english/licenseOverview.html
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "CUnit/Basic.h"
+#include "testsuite.h"
+#include "logger.h"
+
+/********************************************************************
+ * Logger Tests
+ *******************************************************************/
+
+/* The sources of the tests are in logger.c as they test static functions. */
+
+int tsLOG_suiteLogger() {
+    CU_pSuite loggerSuite;
+
+    loggerSuite = CU_add_suite("Logger Suite", tsInitLogging, tsCleanLogging);
+    if (NULL == loggerSuite) {
+        return CU_get_error();
+    }
+
+    CU_add_test(loggerSuite, "enqueueLogMessage()", tsLOG_testLogQueue);
+    CU_add_test(loggerSuite, "parseLogRouteFilters()", tsLOG_testLogRouteFilters);
+    CU_add_test(loggerSuite, "matchLogRoutePattern()", tsLOG_testMatchLogRoutePattern);
+    CU_add_test(loggerSuite, "printJSONString()", tsLOG_testJSONString);
+    CU_add_test(loggerSuite, "buildJSONPrintBuffer()", tsLOG_testJSONPrintBuffer);
+    CU_add_test(loggerSuite, "putBinaryVarint()", tsLOG_testBinaryVarint);
+    CU_add_test(loggerSuite, "putBinaryString()", tsLOG_testBinaryString);
+
+    return FALSE;
+}
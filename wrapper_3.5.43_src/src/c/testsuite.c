@@ -24,6 +24,31 @@
 #include "testsuite.h"
 #include "logger.h"
 
+/********************************************************************
+ * Shared Fixtures
+ *******************************************************************/
+static void tsDummyLogFileChanged(const TCHAR *logFile) {
+}
+
+/**
+ * Sets up logging to the console only, for suites which do not need anything else.
+ */
+int tsInitLogging(void) {
+    initLogging(tsDummyLogFileChanged);
+    logRegisterThread(WRAPPER_THREAD_MAIN);
+    setLogfileLevelInt(LEVEL_NONE);
+    setConsoleLogFormat(TEXT("LPM"));
+    setConsoleLogLevelInt(LEVEL_DEBUG);
+    setConsoleFlush(TRUE);
+    setSyslogLevelInt(LEVEL_NONE);
+    return 0;
+}
+
+int tsCleanLogging(void) {
+    disposeLogging();
+    return 0;
+}
+
 /********************************************************************
  * Main
  *******************************************************************/
@@ -113,6 +138,30 @@ int main(int argc, char **cargv) {
         goto error;
     }
 
+    if (tsCO_suiteChildOutput()) {
+        CU_cleanup_registry();
+        errorCode = CU_get_error();
+        goto error;
+    }
+
+    if (tsLOG_suiteLogger()) {
+        CU_cleanup_registry();
+        errorCode = CU_get_error();
+        goto error;
+    }
+
+    if (tsLOOP_suiteEventLoop()) {
+        CU_cleanup_registry();
+        errorCode = CU_get_error();
+        goto error;
+    }
+
+    if (tsLCAT_suiteLogcat()) {
+        CU_cleanup_registry();
+        errorCode = CU_get_error();
+        goto error;
+    }
+
     if (argc < 2) {
         showHelp(argv[0]);
         errorCode = 1;
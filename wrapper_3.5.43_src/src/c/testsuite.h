@@ -19,5 +19,12 @@ extern int tsEX_suiteExample();
 extern int tsFLTR_suiteFilter();
 extern int tsJAP_suiteJavaAdditionalParam();
 extern int tsHASH_suiteHashMap();
+extern int tsCO_suiteChildOutput();
+extern int tsLOG_suiteLogger();
+extern int tsLOOP_suiteEventLoop();
+extern int tsLCAT_suiteLogcat();
+
+extern int tsInitLogging(void);
+extern int tsCleanLogging(void);
 
 #endif
@@ -169,12 +169,55 @@ int disposed = FALSE;
 int loadConfiguration();
 
 #define READ_BUFFER_BLOCK_SIZE 1024
-static char *wrapperChildWorkBuffer = NULL;
-static size_t wrapperChildWorkBufferSize = 0;
-static size_t wrapperChildWorkBufferLen = 0;
-static time_t wrapperChildWorkLastDataTime = 0;
-static int wrapperChildWorkLastDataTimeMillis = 0;
-static int wrapperChildWorkIsNewLine = TRUE;
+
+/* Results of reading a block from one of the JVM pipes. */
+#define CHILD_OUTPUT_NONE    0
+#define CHILD_OUTPUT_READ    1
+#define CHILD_OUTPUT_TIMEOUT 2
+#define CHILD_OUTPUT_ERROR   3
+
+/* A recent line of JVM output, remembered to detect repeats. */
+typedef struct ChildOutputDedupEntry ChildOutputDedupEntry;
+struct ChildOutputDedupEntry {
+    unsigned int hash;
+    char *line;                     /* Copy of the line, or NULL if the entry is not used. */
+    int count;                      /* Number of times the line was seen since the last report. */
+    int suppressed;                 /* Number of times the line was seen but not logged since the last report. */
+};
+
+/* State of an output stream of the JVM which is read and logged line by line. */
+typedef struct ChildOutputStream ChildOutputStream;
+struct ChildOutputStream {
+    int (*readBlock)(char *blockBuffer, int blockSize, int *readCount); /* Function used to read a block from the pipe of the stream. */
+    int isStderr;                   /* TRUE if the stream is the stderr of the JVM, FALSE if it is the stdout, or both when they share the same pipe. */
+    char *workBuffer;               /* Buffer holding the output that has been read but not yet logged. */
+    size_t workBufferSize;
+    size_t workBufferLen;
+    time_t lastDataTime;            /* Time at which the first data of the current line was read. */
+    int lastDataTimeMillis;
+    int isNewLine;                  /* TRUE if the next data read will start a new line. */
+    int readThisPass;               /* TRUE if data was read during the current call to wrapperReadChildOutput(). */
+    ChildOutputDedupEntry *dedupEntries; /* Window of recent distinct lines, or NULL if repeats are not being collapsed. */
+    int dedupWindow;                /* Number of entries in dedupEntries. */
+    int dedupNext;                  /* Index of the entry to replace when a new line is seen. */
+    char *record;                   /* Multi-line record waiting for more continuation lines. */
+    size_t recordSize;
+    size_t recordLen;
+    int recordLines;                /* Number of lines in the pending record.  0 if there is none. */
+    time_t lastReadTime;            /* Time at which data was last read from the pipe. */
+    int lastReadTimeMillis;
+};
+static ChildOutputStream wrapperChildStdout = { wrapperReadChildOutputBlock, FALSE, NULL, 0, 0, 0, 0, TRUE, FALSE, NULL, 0, 0, NULL, 0, 0, 0, 0, 0 };
+#ifndef WIN32
+static ChildOutputStream wrapperChildStderr = { wrapperReadChildErrorBlock, TRUE, NULL, 0, 0, 0, 0, TRUE, FALSE, NULL, 0, 0, NULL, 0, 0, 0, 0, 0 };
+#endif
+static int wrapperChildWorkDroppedLines = 0;
+static unsigned int wrapperChildWorkDroppedTotal = 0;
+static int wrapperChildWorkSampleCount = 0;
+static time_t wrapperChildWorkLastDropReport = 0;
+static time_t wrapperChildWorkLastDedupReport = 0;
+static void wrapperDisposeChildOutputDedup(ChildOutputStream *stream);
+static void wrapperDisposeChildOutputRecord(ChildOutputStream *stream);
 
 //  Task ExecTime
 static TICKS LASTTASKEXECTicks=0;
@@ -562,6 +605,37 @@ void updateStringValue(TCHAR **ptr, const TCHAR *value) {
     }
 }
 
+int getJavaIOOverflowPolicy(const TCHAR *policyName, int defaultPolicy) {
+    if (!policyName) {
+        return defaultPolicy;
+    }
+
+    if (strcmpIgnoreCase(policyName, TEXT("BLOCK")) == 0) {
+        return WRAPPER_JAVAIO_OVERFLOW_BLOCK;
+    } else if (strcmpIgnoreCase(policyName, TEXT("DROP_OLDEST")) == 0) {
+        return WRAPPER_JAVAIO_OVERFLOW_DROP_OLDEST;
+    } else if (strcmpIgnoreCase(policyName, TEXT("DROP_NEWEST")) == 0) {
+        return WRAPPER_JAVAIO_OVERFLOW_DROP_NEWEST;
+    } else if (strcmpIgnoreCase(policyName, TEXT("SAMPLE")) == 0) {
+        return WRAPPER_JAVAIO_OVERFLOW_SAMPLE;
+    } else {
+        return defaultPolicy;
+    }
+}
+
+const TCHAR *getJavaIOOverflowPolicyName(int policy) {
+    switch (policy) {
+    case WRAPPER_JAVAIO_OVERFLOW_DROP_OLDEST:
+        return TEXT("DROP_OLDEST");
+    case WRAPPER_JAVAIO_OVERFLOW_DROP_NEWEST:
+        return TEXT("DROP_NEWEST");
+    case WRAPPER_JAVAIO_OVERFLOW_SAMPLE:
+        return TEXT("SAMPLE");
+    default:
+        return TEXT("BLOCK");
+    }
+}
+
 #ifndef WIN32 /* UNIX */
 int getSignalMode(const TCHAR *modeName, int defaultMode) {
     if (!modeName) {
@@ -699,6 +773,42 @@ int isPromptCall() {
     return isPromptCallCommand(wrapperData->argCommand);
 }
 
+/**
+ * Loads the wrapper.logfile.route.<n> properties.
+ *
+ * @return TRUE if there were any problems.
+ */
+static int loadLogfileRoutes(int preload) {
+    TCHAR **propertyNames;
+    TCHAR **propertyValues;
+    long unsigned int *propertyIndices;
+    TCHAR propName[256];
+    const TCHAR *maxSize;
+    int maxFiles;
+    int i;
+
+    clearLogfileRoutes();
+    /* wrapperData->ignoreSequenceGaps is not loaded yet. */
+    if (getStringProperties(properties, TEXT("wrapper.logfile.route."), TEXT(""), getBooleanProperty(properties, TEXT("wrapper.ignore_sequence_gaps"), FALSE), FALSE, &propertyNames, &propertyValues, &propertyIndices)) {
+        /* Failed */
+        return TRUE;
+    }
+
+    for (i = 0; propertyNames[i]; i++) {
+        _sntprintf(propName, 256, TEXT("wrapper.logfile.route.%lu.maxsize"), propertyIndices[i]);
+        maxSize = getStringProperty(properties, propName, TEXT("0"));
+        _sntprintf(propName, 256, TEXT("wrapper.logfile.route.%lu.maxfiles"), propertyIndices[i]);
+        maxFiles = propIntMax(getIntProperty(properties, propName, 0), 0);
+        if (addLogfileRoute(propertyValues[i], maxSize, maxFiles) && !preload) {
+            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN,
+                TEXT("Encountered an invalid value for configuration property %s=%s.  The route will be ignored."), propertyNames[i], propertyValues[i]);
+        }
+    }
+
+    freeStringProperties(propertyNames, propertyValues, propertyIndices);
+    return FALSE;
+}
+
 int wrapperLoadLoggingProperties(int preload) {
     const TCHAR *logfilePath;
     int logfileRollMode;
@@ -762,6 +872,12 @@ int wrapperLoadLoggingProperties(int preload) {
         setLogfileLevel(getStringProperty(properties, TEXT("wrapper.logfile.loglevel"), TEXT("INFO")));
     }
 
+    /* Load whether log files rolled by size are preallocated and written through a memory mapping. */
+    setLogfileMmap(getBooleanProperty(properties, TEXT("wrapper.logfile.mmap"), FALSE));
+
+    /* Load whether the log file and status files are written asynchronously through io_uring. */
+    setLogfileUring(getBooleanProperty(properties, TEXT("wrapper.io_uring"), FALSE));
+
     /* Load max log filesize log level */
     setLogfileMaxFileSize(getStringProperty(properties, TEXT("wrapper.logfile.maxsize"), TEXT("0")));
 
@@ -775,6 +891,33 @@ int wrapperLoadLoggingProperties(int preload) {
     confPurgePattern = getFileSafeStringProperty(properties, TEXT("wrapper.logfile.purge.pattern"), TEXT(""));
     setLogfilePurgePattern(confPurgePattern, &isPurgePatternGenerated);
 
+    /* Load the log routes, which write the messages selected by their rule to additional log files. */
+    if (loadLogfileRoutes(preload)) {
+        return TRUE;
+    }
+
+    /* Load the crash buffer.  It keeps the most recent log entries, including those filtered out
+     *  of the log file, and dumps them to a separate file when the JVM crashes or hangs. */
+    setCrashBufferLevel(getStringProperty(properties, TEXT("wrapper.crash_buffer.loglevel"), TEXT("DEBUG")));
+    if (setCrashBufferFile(getFileSafeStringProperty(properties, TEXT("wrapper.crash_buffer.file"), TEXT("wrapper_crash.log")))) {
+        return TRUE;
+    }
+    if (setCrashBufferSize(propIntMax(propIntMin(getIntProperty(properties, TEXT("wrapper.crash_buffer.size"), 0), 100000), 0))) {
+        return TRUE;
+    }
+
+    /* Load the queues used to log from signal handlers and other places where direct logging is not possible.
+     *  The size can only be set on startup as the queues are used without any locking. */
+    setLogQueueVariableRecords(getBooleanProperty(properties, TEXT("wrapper.log.queue.variable_records"), FALSE));
+    if (setLogQueueSize(propIntMax(propIntMin(getIntProperty(properties, TEXT("wrapper.log.queue.size"), LOG_QUEUE_SIZE_DEFAULT), LOG_QUEUE_SIZE_MAX), 1))) {
+        return TRUE;
+    }
+
+    /* Load the group commit of the log file. */
+    setLogfileSync(propIntMax(propIntMin(getIntProperty(properties, TEXT("wrapper.logfile.sync.interval"), 0), 3600000), 0),
+                   propIntMax(getIntProperty(properties, TEXT("wrapper.logfile.sync.bytes"), 0), 0),
+                   getLogLevelForName(getStringProperty(properties, TEXT("wrapper.logfile.sync.loglevel"), TEXT("WARN"))));
+
     /* Get the close timeout. */
     wrapperData->logfileCloseTimeout = propIntMax(propIntMin(getIntProperty(properties, TEXT("wrapper.logfile.close.timeout"), getIntProperty(properties, TEXT("wrapper.logfile.inactivity.timeout"), 1)), 3600), -1);
     setLogfileAutoClose(wrapperData->logfileCloseTimeout == 0);
@@ -846,6 +989,13 @@ int wrapperLoadLoggingProperties(int preload) {
         wrapperData->isAdviserEnabled = TRUE;
     }
 
+    /* Debug messages must also be generated if the crash buffer keeps them, but the JVM is only
+     *  launched in debug mode if its debug output will actually be logged. */
+    wrapperData->isJVMDebugging = wrapperData->isDebugging;
+    if ((!isPromptCall()) && (getCrashBufferLevelInt() <= LEVEL_DEBUG)) {
+        wrapperData->isDebugging = TRUE;
+    }
+
     /* Load syslog log level (stay in silent mode on a translate call) */
     if (!isPromptCall()) {
         setSyslogLevel(getStringProperty(properties, TEXT("wrapper.syslog.loglevel"), TEXT("NONE")));
@@ -1617,6 +1767,10 @@ int wrapperLoadConfigurationProperties(int preload) {
     wrapperData->anchorFileUmask = getIntProperty(properties, TEXT("wrapper.anchorfile.umask"), wrapperData->umask);
     setLogfileUmask(getIntProperty(properties, TEXT("wrapper.logfile.umask"), wrapperData->umask));
 #ifndef WIN32
+    /* Anyone able to connect to the control socket can stop the Wrapper, so it is only accessible by its owner by default. */
+    wrapperData->controlSocketUmask = getIntProperty(properties, TEXT("wrapper.control.socket.umask"), 0077);
+    wrapperData->statusPageUmask = getIntProperty(properties, TEXT("wrapper.statuspage.umask"), wrapperData->umask);
+
     /** Get the group value for the various files. */
     wrapperData->groupStrict = getBooleanProperty(properties, TEXT("wrapper.group.strict"), FALSE);
     
@@ -3468,6 +3622,7 @@ int wrapperInitialize(int silent) {
     wrapperData->jvmVersionCommand = NULL;
     wrapperData->jvmCommand = NULL;
     wrapperData->jvmDefaultLogLevel = LEVEL_INFO;
+    wrapperData->jvmStderrLogLevel = LEVEL_INFO;
     wrapperData->jvmSource = WRAPPER_SOURCE_JVM;
     wrapperData->exitRequested = FALSE;
     wrapperData->restartRequested = WRAPPER_RESTART_REQUESTED_INITIAL; /* The first JVM needs to be started. */
@@ -3581,6 +3736,10 @@ void wrapperDataDispose() {
         free(wrapperData->pingActionList);
         wrapperData->pingActionList = NULL;
     }
+    if (wrapperData->pingTrendActionList) {
+        free(wrapperData->pingTrendActionList);
+        wrapperData->pingTrendActionList = NULL;
+    }
     if (wrapperData->workingDir) {
         free(wrapperData->workingDir);
         wrapperData->workingDir = NULL;
@@ -3729,6 +3888,16 @@ void wrapperDataDispose() {
         free(wrapperData->commandFilename);
         wrapperData->commandFilename = NULL;
     }
+#ifndef WIN32
+    if (wrapperData->controlSocketFilename) {
+        free(wrapperData->controlSocketFilename);
+        wrapperData->controlSocketFilename = NULL;
+    }
+    if (wrapperData->statusPageFilename) {
+        free(wrapperData->statusPageFilename);
+        wrapperData->statusPageFilename = NULL;
+    }
+#endif
     if (wrapperData->consoleTitle) {
         free(wrapperData->consoleTitle);
         wrapperData->consoleTitle = NULL;
@@ -3813,10 +3982,22 @@ void wrapperDispose() {
     properties = NULL;
 
     disposeEnvironment();
-    if (wrapperChildWorkBuffer) {
-        free(wrapperChildWorkBuffer);
-        wrapperChildWorkBuffer = NULL;
+    wrapperDisposeChildOutputRecord(&wrapperChildStdout);
+    wrapperDisposeChildOutputDedup(&wrapperChildStdout);
+#ifndef WIN32
+    wrapperDisposeChildOutputRecord(&wrapperChildStderr);
+    wrapperDisposeChildOutputDedup(&wrapperChildStderr);
+#endif
+    if (wrapperChildStdout.workBuffer) {
+        free(wrapperChildStdout.workBuffer);
+        wrapperChildStdout.workBuffer = NULL;
     }
+#ifndef WIN32
+    if (wrapperChildStderr.workBuffer) {
+        free(wrapperChildStderr.workBuffer);
+        wrapperChildStderr.workBuffer = NULL;
+    }
+#endif
     if (protocolSendBuffer) {
         free(protocolSendBuffer);
         protocolSendBuffer = NULL;
@@ -4159,6 +4340,9 @@ void wrapperProcessActionList(int *actionList, const TCHAR *triggerMsg, int acti
                     case WRAPPER_ACTION_SOURCE_CODE_PING_TIMEOUT:
                         _sntprintf(propertyName, 32, TEXT("wrapper.ping.timeout.action"));
                         break;
+                    case WRAPPER_ACTION_SOURCE_CODE_PING_TREND:
+                        _sntprintf(propertyName, 32, TEXT("wrapper.ping.trend.action"));
+                        break;
                     default:
                         _sntprintf(propertyName, 32, TEXT(""));
                     }
@@ -4749,10 +4933,14 @@ void printBytes(const char * s) {
 #endif
 
 /**
- * Logs a single line of child output allowing any filtering
- *  to be done in a common location.
+ * Converts and logs a single line of child output.
+ *
+ * @param stream The stream from which the line was read.
+ * @param log The line to log.
+ * @param isReport TRUE if the line is a report generated by the Wrapper rather
+ *                 than actual output, in which case it is not filtered.
  */
-void logChildOutput(const char* log) {
+static void logChildOutputLine(ChildOutputStream *stream, const char* log, int isReport) {
     TCHAR* tlog = NULL;
 #ifdef UNICODE
  #ifdef WIN32
@@ -4795,19 +4983,290 @@ void logChildOutput(const char* log) {
 #else
     tlog = (TCHAR*)log;
 #endif
-    log_printf(wrapperData->jvmSource == WRAPPER_SOURCE_JVM ? wrapperData->jvmRestarts : wrapperData->jvmSource, wrapperData->jvmDefaultLogLevel, tlog);
-    
-    /* Look for output filters in the output.  Only match the first. */
-    logApplyFilters(tlog);
+    if (stream->isStderr && (wrapperData->jvmSource == WRAPPER_SOURCE_JVM)) {
+        log_printf(wrapperData->jvmRestarts | WRAPPER_SOURCE_STDERR_FLAG, wrapperData->jvmStderrLogLevel, tlog);
+    } else {
+        log_printf(wrapperData->jvmSource == WRAPPER_SOURCE_JVM ? wrapperData->jvmRestarts : wrapperData->jvmSource, wrapperData->jvmDefaultLogLevel, tlog);
+    }
     
-    /* tlog will be modified by this call. Make sure it will not be used after that. */
-    logParseJavaVersionOutput(tlog);
+    if (!isReport) {
+        /* Look for output filters in the output.  Only match the first. */
+        logApplyFilters(tlog);
+        
+        /* tlog will be modified by this call. Make sure it will not be used after that. */
+        logParseJavaVersionOutput(tlog);
+    }
 
 #ifdef UNICODE
     free(tlog);
 #endif
 }
 
+/**
+ * Logs the number of times that a remembered line was repeated without being
+ *  logged, and starts counting it again.
+ *
+ * @param stream The stream to which the entry belongs.
+ * @param entry The entry to report.
+ */
+static void wrapperReportChildOutputRepeats(ChildOutputStream *stream, ChildOutputDedupEntry *entry) {
+    char *report;
+
+    if (entry->suppressed > 0) {
+        report = malloc(sizeof(char) * (strlen(entry->line) + 64));
+        if (!report) {
+            outOfMemory(TEXT("WRCOR"), 1);
+        } else {
+            sprintf(report, "Line repeated %d more times: ", entry->suppressed);
+            strcat(report, entry->line);
+            logChildOutputLine(stream, report, TRUE);
+            free(report);
+        }
+    }
+    entry->count = 0;
+    entry->suppressed = 0;
+}
+
+/**
+ * Reports the repeats of all remembered lines of a stream.
+ *
+ * @param stream The stream to report.
+ */
+static void wrapperReportChildOutputStreamRepeats(ChildOutputStream *stream) {
+    int i;
+
+    for (i = 0; i < stream->dedupWindow; i++) {
+        if (stream->dedupEntries[i].line) {
+            wrapperReportChildOutputRepeats(stream, &(stream->dedupEntries[i]));
+        }
+    }
+}
+
+/**
+ * Reports and frees the window of remembered lines of a stream.
+ *
+ * @param stream The stream whose window should be disposed.
+ */
+static void wrapperDisposeChildOutputDedup(ChildOutputStream *stream) {
+    int i;
+
+    if (stream->dedupEntries) {
+        wrapperReportChildOutputStreamRepeats(stream);
+        for (i = 0; i < stream->dedupWindow; i++) {
+            if (stream->dedupEntries[i].line) {
+                free(stream->dedupEntries[i].line);
+            }
+        }
+        free(stream->dedupEntries);
+        stream->dedupEntries = NULL;
+    }
+    stream->dedupWindow = 0;
+    stream->dedupNext = 0;
+}
+
+/**
+ * Checks whether a line of output was already seen recently and should not be
+ *  logged again.  The first occurrences of a line, up to the configured threshold,
+ *  are always logged so that output filters get to see them.
+ *
+ * @param stream The stream from which the line was read.
+ * @param log The line.
+ *
+ * @return TRUE if the line is a repeat which should not be logged.
+ */
+static int wrapperDedupChildOutput(ChildOutputStream *stream, const char *log) {
+    ChildOutputDedupEntry *entry;
+    unsigned int hash = 2166136261u;
+    const unsigned char *c;
+    size_t len;
+    int i;
+
+    if ((!stream->dedupEntries) || (wrapperData->jvmSource != WRAPPER_SOURCE_JVM)) {
+        return FALSE;
+    }
+
+    /* FNV-1a hash, so most lines can be rejected without comparing them. */
+    for (c = (const unsigned char *)log; *c; c++) {
+        hash = (hash ^ *c) * 16777619u;
+    }
+    len = (size_t)((const char *)c - log);
+
+    for (i = 0; i < stream->dedupWindow; i++) {
+        entry = &(stream->dedupEntries[i]);
+        if (entry->line && (entry->hash == hash) && (strcmp(entry->line, log) == 0)) {
+            entry->count++;
+            if (entry->count <= (stream->isStderr ? wrapperData->javaIODedupThresholdStderr : wrapperData->javaIODedupThreshold)) {
+                return FALSE;
+            }
+            entry->suppressed++;
+            return TRUE;
+        }
+    }
+
+    /* A new line.  Replace the oldest entry in the window. */
+    entry = &(stream->dedupEntries[stream->dedupNext]);
+    if (entry->line) {
+        wrapperReportChildOutputRepeats(stream, entry);
+        free(entry->line);
+    }
+    entry->line = malloc(sizeof(char) * (len + 1));
+    if (!entry->line) {
+        outOfMemory(TEXT("WDCO"), 1);
+        return FALSE;
+    }
+    memcpy(entry->line, log, len + 1);
+    entry->hash = hash;
+    entry->count = 1;
+    entry->suppressed = 0;
+    stream->dedupNext = (stream->dedupNext + 1) % stream->dedupWindow;
+    return FALSE;
+}
+
+/**
+ * Logs a record of child output, which may contain several lines, unless it
+ *  is a repeat which should be collapsed.
+ *
+ * @param stream The stream from which the record was read.
+ * @param log The record to log.
+ */
+static void logChildOutputRecord(ChildOutputStream *stream, const char* log) {
+    if (wrapperDedupChildOutput(stream, log)) {
+        return;
+    }
+    logChildOutputLine(stream, log, FALSE);
+}
+
+/**
+ * Checks whether a line continues the record started by a previous line.
+ *  This matches the lines of a Java stack trace following the exception:
+ *  indented 'at ' frames, indented '... N more' (or '... N common frames
+ *  omitted') lines, and 'Caused by:' and 'Suppressed:' lines, which may be
+ *  indented for nested exceptions.  Other indented output is not matched so
+ *  that it is still logged as separate records.
+ *
+ * @param log The line to check.
+ *
+ * @return TRUE if the line is a continuation line.
+ */
+static int isChildOutputContinuation(const char *log) {
+    const char *text = log;
+
+    while ((*text == ' ') || (*text == '\t')) {
+        text++;
+    }
+    if (text > log) {
+        if (strncmp(text, "at ", 3) == 0) {
+            return TRUE;
+        }
+        if ((strncmp(text, "... ", 4) == 0) && (text[4] >= '0') && (text[4] <= '9')) {
+            return TRUE;
+        }
+    }
+    return (strncmp(text, "Caused by:", 10) == 0) || (strncmp(text, "Suppressed:", 11) == 0);
+}
+
+/**
+ * Logs the pending multi-line record of a stream, if any.
+ *
+ * @param stream The stream whose record should be logged.
+ */
+static void wrapperFlushChildOutputRecord(ChildOutputStream *stream) {
+    if (stream->recordLines > 0) {
+        logChildOutputRecord(stream, stream->record);
+        stream->record[0] = '\0';
+        stream->recordLen = 0;
+        stream->recordLines = 0;
+    }
+}
+
+/**
+ * Frees the pending multi-line record of a stream after logging it.
+ *
+ * @param stream The stream whose record should be disposed.
+ */
+static void wrapperDisposeChildOutputRecord(ChildOutputStream *stream) {
+    wrapperFlushChildOutputRecord(stream);
+    if (stream->record) {
+        free(stream->record);
+        stream->record = NULL;
+    }
+    stream->recordSize = 0;
+}
+
+/**
+ * Adds a line to the pending multi-line record of a stream.
+ *
+ * @param stream The stream whose record should be extended.
+ * @param log The line to add.
+ *
+ * @return TRUE if there were any problems.
+ */
+static int wrapperAppendChildOutputRecord(ChildOutputStream *stream, const char *log) {
+    size_t len = strlen(log);
+    size_t needed = stream->recordLen + 1 + len + 1;
+    char *tempBuffer;
+
+    if (needed > stream->recordSize) {
+        /* Grow by at least a block to avoid reallocating for every line. */
+        needed = __max(needed, stream->recordSize + READ_BUFFER_BLOCK_SIZE);
+        tempBuffer = malloc(sizeof(char) * needed);
+        if (!tempBuffer) {
+            outOfMemory(TEXT("WACO"), 1);
+            return TRUE;
+        }
+        if (stream->record) {
+            memcpy(tempBuffer, stream->record, stream->recordLen + 1);
+            free(stream->record);
+        }
+        stream->record = tempBuffer;
+        stream->recordSize = needed;
+    }
+    if (stream->recordLines > 0) {
+        stream->record[stream->recordLen++] = '\n';
+    }
+    memcpy(stream->record + stream->recordLen, log, len + 1);
+    stream->recordLen += len;
+    stream->recordLines++;
+    return FALSE;
+}
+
+/**
+ * Groups continuation lines with the line they follow so that a stack trace is
+ *  logged as a single record.  The record is logged once a line which is not a
+ *  continuation is found, or when it reaches its maximum size.
+ *
+ * @param stream The stream from which the line was read.
+ * @param log The line.
+ */
+static void wrapperAggregateChildOutput(ChildOutputStream *stream, const char *log) {
+    if ((stream->recordLines == 0) || (!isChildOutputContinuation(log))) {
+        /* This line starts a new record. */
+        wrapperFlushChildOutputRecord(stream);
+    }
+    if (wrapperAppendChildOutputRecord(stream, log)) {
+        wrapperFlushChildOutputRecord(stream);
+        logChildOutputRecord(stream, log);
+    } else if (stream->recordLines >= wrapperData->javaIOMultilineMaxLines) {
+        wrapperFlushChildOutputRecord(stream);
+    }
+}
+
+/**
+ * Logs a single line of child output allowing any filtering
+ *  to be done in a common location.
+ *
+ * @param stream The stream from which the line was read.
+ * @param log The line to log.
+ */
+void logChildOutput(ChildOutputStream *stream, const char* log) {
+    if (wrapperData->javaIOMultiline && (wrapperData->jvmSource == WRAPPER_SOURCE_JVM)) {
+        wrapperAggregateChildOutput(stream, log);
+    } else {
+        wrapperFlushChildOutputRecord(stream);
+        logChildOutputRecord(stream, log);
+    }
+}
+
 /**
  * This function is for moving a buffer inside itself.
  *
@@ -4825,270 +5284,585 @@ void safeMemCpy(char *buffer, size_t target, size_t src, size_t nbyte) {
 #define CHAR_LF 0x0a
 
 /**
- * Read and process any output from the child JVM Process.
+ * Makes sure that there is enough space in the work buffer to read in a full block.
  *
- * When maxTimeMS is non-zero this function will only be allowed to run for that maximum
- *  amount of time.  This is done to make sure the calling function is allowed CPU for
- *  other activities.   When timing out for this reason when there is more data in the
- *  pipe, this function will return TRUE to let the calling code know that it should
- *  not to any unnecessary sleeps.  Otherwise FALSE will be returned.
- *
- * @param maxTimeMS The maximum number of milliseconds that this function will be allowed
- *                  to run without returning.  In reality no new reads will happen after
- *                  this time, but actual processing may take longer.
+ * @param stream The stream whose work buffer should be expanded.
  *
- * @return TRUE if the calling code should call this function again as soon as possible.
+ * @return TRUE if there were any problems.
  */
-int wrapperReadChildOutput(int maxTimeMS) {
-    struct timeb timeBuffer;
-    time_t startTime;
-    int startTimeMillis;
-    time_t now;
-    int nowMillis;
-    time_t durr;
+static int wrapperExpandChildWorkBuffer(ChildOutputStream *stream) {
     char *tempBuffer;
-    char *cLF;
-    int currentBlockRead;
-    size_t loggedOffset;
-    int defer = FALSE;
-    int readThisPass = FALSE;
+
+    if (stream->workBufferLen + READ_BUFFER_BLOCK_SIZE > stream->workBufferSize) {
+#ifdef DEBUG_CHILD_OUTPUT
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, TEXT("Expand buffer."));
+#endif
+        /* Increase the buffer quickly, but try not to get too big.  Increase to a size that is the
+         *  greater of size + 1024 or size * 1.1.
+         * Also make sure the new buffer is larger than the buffer len.  This should not be necessary
+         *  but is safer. */
+        stream->workBufferSize = __max(stream->workBufferLen + 1, __max(stream->workBufferSize + READ_BUFFER_BLOCK_SIZE, stream->workBufferSize + stream->workBufferSize / 10));
+        
+        tempBuffer = malloc(stream->workBufferSize + 1);
+        if (!tempBuffer) {
+            outOfMemory(TEXT("WRCO"), 2);
+            return TRUE;
+        }
+        memcpy(tempBuffer, stream->workBuffer, stream->workBufferLen);
+        tempBuffer[stream->workBufferLen] = '\0';
+        free(stream->workBuffer);
+        stream->workBuffer = tempBuffer;
+#ifdef DEBUG_CHILD_OUTPUT
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, TEXT("buffer now %d bytes"), stream->workBufferSize);
+#endif
+    }
+    return FALSE;
+}
+
+/**
+ * Removes complete lines from the work buffer until it is no larger than the
+ *  maximum buffer size, according to the configured overflow policy.  A partial
+ *  line at the end of the buffer is never removed as the rest of the line is
+ *  still to be read.
+ *
+ * @param stream The stream whose work buffer should be reduced.
+ */
+static void wrapperShedChildOutput(ChildOutputStream *stream) {
+    size_t maxLen = (size_t)wrapperData->javaIOMaxBufferSize;
+    size_t lastLineEnd = 0;
+    size_t lineStart;
+    size_t lineEnd;
+    size_t target;
     size_t i;
 
-    if (!wrapperChildWorkBuffer) {
-        /* Initialize the wrapperChildWorkBuffer.  Set its initial size to the block size + 1.
+    if ((maxLen == 0) || (stream->workBufferLen <= maxLen)) {
+        return;
+    }
+
+    /* Find the end of the last complete line. */
+    for (i = stream->workBufferLen; i > 0; i--) {
+        if (stream->workBuffer[i - 1] == (char)CHAR_LF) {
+            lastLineEnd = i;
+            break;
+        }
+    }
+    if (lastLineEnd == 0) {
+        /* Only a partial line.  It will be logged once it reaches the maximum size. */
+        return;
+    }
+
+    if (wrapperData->javaIOOverflowPolicy == WRAPPER_JAVAIO_OVERFLOW_SAMPLE) {
+        /* Keep one of every N complete lines. */
+        target = 0;
+        lineStart = 0;
+        while (lineStart < lastLineEnd) {
+            lineEnd = lineStart;
+            while (stream->workBuffer[lineEnd++] != (char)CHAR_LF) {
+            }
+            if (wrapperChildWorkSampleCount == 0) {
+                if (target < lineStart) {
+                    safeMemCpy(stream->workBuffer, target, lineStart, lineEnd - lineStart);
+                }
+                target += lineEnd - lineStart;
+            } else {
+                wrapperChildWorkDroppedLines++;
+            }
+            wrapperChildWorkSampleCount = (wrapperChildWorkSampleCount + 1) % wrapperData->javaIOOverflowSampleRate;
+            lineStart = lineEnd;
+        }
+        safeMemCpy(stream->workBuffer, target, lastLineEnd, stream->workBufferLen - lastLineEnd);
+        stream->workBufferLen -= lastLineEnd - target;
+        lastLineEnd = target;
+    }
+
+    if (stream->workBufferLen > maxLen) {
+        if (wrapperData->javaIOOverflowPolicy == WRAPPER_JAVAIO_OVERFLOW_DROP_NEWEST) {
+            /* Drop the most recent complete lines. */
+            lineStart = lastLineEnd;
+            while ((lineStart > 0) && (stream->workBufferLen - (lastLineEnd - lineStart) > maxLen)) {
+                /* Move back to the beginning of the previous line. */
+                lineStart--;
+                while ((lineStart > 0) && (stream->workBuffer[lineStart - 1] != (char)CHAR_LF)) {
+                    lineStart--;
+                }
+                wrapperChildWorkDroppedLines++;
+            }
+            safeMemCpy(stream->workBuffer, lineStart, lastLineEnd, stream->workBufferLen - lastLineEnd);
+            stream->workBufferLen -= lastLineEnd - lineStart;
+        } else {
+            /* Drop the oldest lines.  This is also the fallback when sampling was not enough. */
+            lineStart = 0;
+            while ((lineStart < lastLineEnd) && (stream->workBufferLen - lineStart > maxLen)) {
+                while (stream->workBuffer[lineStart++] != (char)CHAR_LF) {
+                }
+                wrapperChildWorkDroppedLines++;
+            }
+            safeMemCpy(stream->workBuffer, 0, lineStart, stream->workBufferLen - lineStart);
+            stream->workBufferLen -= lineStart;
+        }
+    }
+    stream->workBuffer[stream->workBufferLen] = '\0';
+}
+
+/**
+ * Called when the Wrapper is unable to log the JVM output as fast as it is being
+ *  produced.  Rather than leaving the output in the pipe, which would eventually
+ *  block the JVM, read it into the work buffer and apply the overflow policy.
+ *
+ * @param stream The stream to drain.
+ * @param now The current time.
+ * @param nowMillis The millisecond part of the current time.
+ */
+static void wrapperDrainChildOutput(ChildOutputStream *stream, time_t now, int nowMillis) {
+    int currentBlockRead;
+    int blocks;
+
+    /* Limit the number of reads so a JVM writing continuously can't keep us here. */
+    for (blocks = 0; blocks < WRAPPER_JAVAIO_DRAIN_MAX_READS; blocks++) {
+        if (wrapperExpandChildWorkBuffer(stream)) {
+            return;
+        }
+        if (stream->readBlock(stream->workBuffer + (stream->workBufferLen), (int)(stream->workBufferSize - stream->workBufferLen), &currentBlockRead)) {
+            /* Error already reported. */
+            return;
+        }
+        if (currentBlockRead <= 0) {
+            return;
+        }
+        stream->workBufferLen += currentBlockRead;
+        if (stream->isNewLine) {
+            stream->lastDataTime = now;
+            stream->lastDataTimeMillis = nowMillis;
+            stream->isNewLine = FALSE;
+        }
+        stream->workBuffer[stream->workBufferLen] = '\0';
+
+        wrapperShedChildOutput(stream);
+    }
+}
+
+/**
+ * Allocates the work buffer of a stream if it does not yet exist.
+ *
+ * @param stream The stream to initialize.
+ *
+ * @return TRUE if there were any problems.
+ */
+static int wrapperInitChildOutputStream(ChildOutputStream *stream) {
+    if (!stream->workBuffer) {
+        /* Initialize the work buffer.  Set its initial size to the block size + 1.
          *  This is so that we can always add a \0 to the end of it. */
-        wrapperChildWorkBuffer = malloc(sizeof(char) * ((READ_BUFFER_BLOCK_SIZE * 2) + 1));
-        if (!wrapperChildWorkBuffer) {
+        stream->workBuffer = malloc(sizeof(char) * ((READ_BUFFER_BLOCK_SIZE * 2) + 1));
+        if (!stream->workBuffer) {
             outOfMemory(TEXT("WRCO"), 1);
-            return FALSE;
+            return TRUE;
         }
-        wrapperChildWorkBufferSize = READ_BUFFER_BLOCK_SIZE * 2;
-        wrapperChildWorkBufferLen = 0;
+        stream->workBufferSize = READ_BUFFER_BLOCK_SIZE * 2;
+        stream->workBufferLen = 0;
     }
 
-    wrapperGetCurrentTime(&timeBuffer);
-    startTime = now = timeBuffer.time;
-    startTimeMillis = nowMillis = timeBuffer.millitm;
+    if (stream->dedupWindow != wrapperData->javaIODedupWindow) {
+        /* The window size was changed by a configuration reload. */
+        wrapperDisposeChildOutputDedup(stream);
+        if (wrapperData->javaIODedupWindow > 0) {
+            stream->dedupEntries = calloc(wrapperData->javaIODedupWindow, sizeof(ChildOutputDedupEntry));
+            if (!stream->dedupEntries) {
+                outOfMemory(TEXT("WRCO"), 3);
+                return TRUE;
+            }
+            stream->dedupWindow = wrapperData->javaIODedupWindow;
+        }
+    }
+    return FALSE;
+}
 
-#ifdef DEBUG_CHILD_OUTPUT
-    log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, TEXT("wrapperReadChildOutput() BEGIN"));
-    log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, TEXT("now=%ld, nowMillis=%d"), now, nowMillis);
+/**
+ * Reads a single block of output from one of the JVM pipes and logs as many
+ *  complete lines from the stream's work buffer as possible.
+ *
+ * @param stream The stream to read.
+ * @param maxTimeMS The maximum number of milliseconds that the calling function is allowed to run.
+ * @param startTime The time at which the calling function started.
+ * @param startTimeMillis The millisecond part of startTime.
+ * @param now The current time.
+ * @param nowMillis The millisecond part of the current time.
+ * @param linesThisPass Pointer to the number of lines logged since the calling function started.
+ *
+ * @return CHILD_OUTPUT_READ if a block was read, CHILD_OUTPUT_NONE if there was nothing to read,
+ *         CHILD_OUTPUT_TIMEOUT if lines were left in the buffer because the time ran out, or
+ *         CHILD_OUTPUT_ERROR if there were any problems.
+ */
+static int wrapperReadChildOutputStream(ChildOutputStream *stream, int maxTimeMS, time_t startTime, int startTimeMillis, time_t now, int nowMillis, int *linesThisPass) {
+    struct timeb timeBuffer;
+    char *cLF;
+    int currentBlockRead;
+    int readSize;
+#ifdef LINUX
+    int lineLen;
 #endif
+    size_t loggedOffset;
+    int defer = FALSE;
+    int timedOut = FALSE;
+    size_t i;
 
-    /* Loop and read in CHILD_BLOCK_SIZE characters at a time.
-     *
-     * To keep a JVM outputting lots of content from freezing the Wrapper, we force a return every 250ms. */
-    while ((maxTimeMS <= 0) || ((durr = (now - startTime) * 1000 + (nowMillis - startTimeMillis)) < maxTimeMS)) {
-#ifdef DEBUG_CHILD_OUTPUT
-        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, TEXT("durr=%ld"), durr);
+#ifdef LINUX
+    /* When possible, move the output directly into the log file without reading it.  This is only done when there
+     *  is no partial line in the work buffer, and never for the output of 'java -version' as it needs to be parsed. */
+    if (wrapperData->useJavaIORawPassthrough && (stream == &wrapperChildStdout) && (stream->workBufferLen == 0) && (wrapperData->jvmSource == WRAPPER_SOURCE_JVM)
+            && (!wrapperReadChildOutputRaw(&currentBlockRead))) {
+        if (currentBlockRead <= 0) {
+            /* All done for now. */
+            return CHILD_OUTPUT_NONE;
+        }
+        stream->readThisPass = TRUE;
+        return CHILD_OUTPUT_READ;
+    }
 #endif
 
-        /* If there is not enough space in the work buffer to read in a full block then it needs to be extended. */
-        if (wrapperChildWorkBufferLen + READ_BUFFER_BLOCK_SIZE > wrapperChildWorkBufferSize) {
-#ifdef DEBUG_CHILD_OUTPUT
-            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, TEXT("Expand buffer."));
-#endif
-            /* Increase the buffer quickly, but try not to get too big.  Increase to a size that is the
-             *  greater of size + 1024 or size * 1.1.
-             * Also make sure the new buffer is larger than the buffer len.  This should not be necessary
-             *  but is safer. */
-            wrapperChildWorkBufferSize = __max(wrapperChildWorkBufferLen + 1, __max(wrapperChildWorkBufferSize + READ_BUFFER_BLOCK_SIZE, wrapperChildWorkBufferSize + wrapperChildWorkBufferSize / 10));
-            
-            tempBuffer = malloc(wrapperChildWorkBufferSize + 1);
-            if (!tempBuffer) {
-                outOfMemory(TEXT("WRCO"), 2);
-                return FALSE;
+    if ((wrapperData->javaIOMaxBufferSize > 0) && (stream->workBufferLen >= (size_t)wrapperData->javaIOMaxBufferSize)
+            && (!memchr(stream->workBuffer, CHAR_LF, stream->workBufferLen))) {
+        /* A single line is larger than the maximum buffer size.  Log what we have so far to keep the memory bounded.
+         *  The rest of the line will be logged separately. */
+        for (i = 0; i < stream->workBufferLen; i++) {
+            if (stream->workBuffer[i] == 0) {
+                stream->workBuffer[i] = '?';
             }
-            memcpy(tempBuffer, wrapperChildWorkBuffer, wrapperChildWorkBufferLen);
-            tempBuffer[wrapperChildWorkBufferLen] = '\0';
-            free(wrapperChildWorkBuffer);
-            wrapperChildWorkBuffer = tempBuffer;
-#ifdef DEBUG_CHILD_OUTPUT
-            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, TEXT("buffer now %d bytes"), wrapperChildWorkBufferSize);
-#endif
         }
+        logChildOutput(stream, stream->workBuffer);
+        stream->workBuffer[0] = '\0';
+        stream->workBufferLen = 0;
+    }
 
-#ifdef DEBUG_CHILD_OUTPUT
-        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, TEXT("Try reading from pipe.  totalBuffLen=%d, buffSize=%d"), wrapperChildWorkBufferLen, wrapperChildWorkBufferSize);
-#endif
-        if (wrapperReadChildOutputBlock(wrapperChildWorkBuffer + (wrapperChildWorkBufferLen), (int)(wrapperChildWorkBufferSize - wrapperChildWorkBufferLen), &currentBlockRead)) {
-            /* Error already reported. */
-            return FALSE;
+    /* If there is not enough space in the work buffer to read in a full block then it needs to be extended. */
+    if (wrapperExpandChildWorkBuffer(stream)) {
+        return CHILD_OUTPUT_ERROR;
+    }
+
+    readSize = (int)(stream->workBufferSize - stream->workBufferLen);
+#ifdef LINUX
+    if (wrapperData->useJavaIORawPassthrough && (stream == &wrapperChildStdout) && (stream->workBufferLen > 0) && (wrapperData->jvmSource == WRAPPER_SOURCE_JVM)) {
+        /* Only read the rest of the partial line so the following lines can be moved directly again. */
+        lineLen = wrapperPeekChildOutputLine();
+        if (lineLen > 0) {
+            readSize = __min(readSize, lineLen);
         }
+    }
+#endif
 
-        if (currentBlockRead > 0) {
-            /* We read in a block, so increase the length. */
-            wrapperChildWorkBufferLen += currentBlockRead;
-            if (wrapperChildWorkIsNewLine) {
-                wrapperChildWorkLastDataTime = now;
-                wrapperChildWorkLastDataTimeMillis = nowMillis;
-                wrapperChildWorkIsNewLine = FALSE;
-            }
-            readThisPass = TRUE;
 #ifdef DEBUG_CHILD_OUTPUT
-            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, TEXT("  Read %d bytes of new output.  totalBuffLen=%d, buffSize=%d"), currentBlockRead, wrapperChildWorkBufferLen, wrapperChildWorkBufferSize);
+    log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, TEXT("Try reading from pipe.  totalBuffLen=%d, buffSize=%d"), stream->workBufferLen, stream->workBufferSize);
 #endif
+    if (stream->readBlock(stream->workBuffer + (stream->workBufferLen), readSize, &currentBlockRead)) {
+        /* Error already reported. */
+        return CHILD_OUTPUT_ERROR;
+    }
+
+    if (currentBlockRead > 0) {
+        /* We read in a block, so increase the length. */
+        stream->workBufferLen += currentBlockRead;
+        if (stream->isNewLine) {
+            stream->lastDataTime = now;
+            stream->lastDataTimeMillis = nowMillis;
+            stream->isNewLine = FALSE;
         }
+        stream->lastReadTime = now;
+        stream->lastReadTimeMillis = nowMillis;
+        stream->readThisPass = TRUE;
+#ifdef DEBUG_CHILD_OUTPUT
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, TEXT("  Read %d bytes of new output.  totalBuffLen=%d, buffSize=%d"), currentBlockRead, stream->workBufferLen, stream->workBufferSize);
+#endif
+    }
 
-        /* Terminate the string just to avoid errors.  The buffer has an extra character to handle this. */
-        wrapperChildWorkBuffer[wrapperChildWorkBufferLen] = '\0';
-        
-        /* Loop over the contents of the buffer and try and extract as many lines as possible.
-         *  Keep track of where we are to avoid unnecessary memory copies.
-         *  At this point, the entire buffer will always be unlogged. */
-        loggedOffset = 0;
-        defer = FALSE;
-        while ((wrapperChildWorkBufferLen > loggedOffset) && (!defer)) {
+    /* Terminate the string just to avoid errors.  The buffer has an extra character to handle this. */
+    stream->workBuffer[stream->workBufferLen] = '\0';
+    
+    /* Loop over the contents of the buffer and try and extract as many lines as possible.
+     *  Keep track of where we are to avoid unnecessary memory copies.
+     *  At this point, the entire buffer will always be unlogged. */
+    loggedOffset = 0;
+    defer = FALSE;
+    while ((stream->workBufferLen > loggedOffset) && (!defer)) {
 #ifdef DEBUG_CHILD_OUTPUT
-            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, TEXT("Inner loop.  totalBuffLen=%d, loggedOffset=%d, unloggedBuffLen=%d, buffSize=%d"), wrapperChildWorkBufferLen, loggedOffset, wrapperChildWorkBufferLen - loggedOffset, wrapperChildWorkBufferSize);
-#endif
-            /* We have something in the buffer.  Loop and see if we have a complete line to log.
-             * We will always find a LF at the end of the line.  On Windows there may be a CR immediately before it. */
-            cLF = NULL;
-            for (i = loggedOffset; i < wrapperChildWorkBufferLen; i++) {
-                /* If there is a null character, replace it with a question mark (\0 is not a termination character in Java). */
-                if (wrapperChildWorkBuffer[i] == 0) {
-                    wrapperChildWorkBuffer[i] = '?';
-                } else if (wrapperChildWorkBuffer[i] == (char)CHAR_LF) {
-                    cLF = &wrapperChildWorkBuffer[i];
-                    break;
-                }
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, TEXT("Inner loop.  totalBuffLen=%d, loggedOffset=%d, unloggedBuffLen=%d, buffSize=%d"), stream->workBufferLen, loggedOffset, stream->workBufferLen - loggedOffset, stream->workBufferSize);
+#endif
+        /* We have something in the buffer.  Loop and see if we have a complete line to log.
+         * We will always find a LF at the end of the line.  On Windows there may be a CR immediately before it. */
+        cLF = NULL;
+        for (i = loggedOffset; i < stream->workBufferLen; i++) {
+            /* If there is a null character, replace it with a question mark (\0 is not a termination character in Java). */
+            if (stream->workBuffer[i] == 0) {
+                stream->workBuffer[i] = '?';
+            } else if (stream->workBuffer[i] == (char)CHAR_LF) {
+                cLF = &stream->workBuffer[i];
+                break;
             }
-            
-            if (cLF != NULL) {
-                /* We found a valid LF so we know that a full line is ready to be logged. */
+        }
+        
+        if (cLF != NULL) {
+            /* We found a valid LF so we know that a full line is ready to be logged. */
 #ifdef WIN32
-                if ((cLF > wrapperChildWorkBuffer) && ((cLF - sizeof(char))[0] == 0x0d)) {
+            if ((cLF > stream->workBuffer) && ((cLF - sizeof(char))[0] == 0x0d)) {
  #ifdef DEBUG_CHILD_OUTPUT
-                    log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, TEXT("Found CR+LF"));
+                log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, TEXT("Found CR+LF"));
  #endif
-                    /* Replace the CR with a NULL */
-                    (cLF - sizeof(char))[0] = 0;
-                } else {
+                /* Replace the CR with a NULL */
+                (cLF - sizeof(char))[0] = 0;
+            } else {
 #endif
 #ifdef DEBUG_CHILD_OUTPUT
-                    log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, TEXT("Found LF"));
+                log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, TEXT("Found LF"));
 #endif
 #ifdef WIN32
-                }
+            }
 #endif
-                /* Replace the LF with a NULL */
-                cLF[0] = '\0';
+            /* Replace the LF with a NULL */
+            cLF[0] = '\0';
 
-                /* We have a string to log. */
+            /* We have a string to log. */
 #ifdef DEBUG_CHILD_OUTPUT
  #ifdef UNICODE
-                /* It is not easy to log the string as is because they are not wide chars. Send it only to stdout. */
-                log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, TEXT("Log: (see stdout)"));
+            /* It is not easy to log the string as is because they are not wide chars. Send it only to stdout. */
+            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, TEXT("Log: (see stdout)"));
   #ifdef WIN32
-                wprintf(TEXT("Log: [%S]\n"), wrapperChildWorkBuffer + loggedOffset);
+            wprintf(TEXT("Log: [%S]\n"), stream->workBuffer + loggedOffset);
   #else
-                wprintf(TEXT("Log: [%s]\n"), wrapperChildWorkBuffer + loggedOffset);
+            wprintf(TEXT("Log: [%s]\n"), stream->workBuffer + loggedOffset);
   #endif
  #else
-                log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, TEXT("Log: [%s]"), wrapperChildWorkBuffer + loggedOffset);
+            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, TEXT("Log: [%s]"), stream->workBuffer + loggedOffset);
  #endif
 #endif
-                /* Actually log the individual line of output. */
-                logChildOutput(wrapperChildWorkBuffer + loggedOffset);
-                
-                /* Update the offset so we know how far we've logged. */
-                loggedOffset = cLF - wrapperChildWorkBuffer + 1;
-                wrapperChildWorkIsNewLine = TRUE;
+            /* Actually log the individual line of output. */
+            logChildOutput(stream, stream->workBuffer + loggedOffset);
+            
+            /* Update the offset so we know how far we've logged. */
+            loggedOffset = cLF - stream->workBuffer + 1;
+            stream->isNewLine = TRUE;
+            
+            /* The buffer can hold a large backlog when an overflow policy is used.  Make sure that logging it does not exceed the allowed time. */
+            if ((wrapperData->javaIOOverflowPolicy != WRAPPER_JAVAIO_OVERFLOW_BLOCK) && (maxTimeMS > 0) && ((++(*linesThisPass) % 100) == 0)) {
+                wrapperGetCurrentTime(&timeBuffer);
+                if ((timeBuffer.time - startTime) * 1000 + (timeBuffer.millitm - startTimeMillis) >= maxTimeMS) {
+                    /* Leave the remaining lines in the buffer for the next call. */
+                    timedOut = TRUE;
+                    defer = TRUE;
+                }
+            }
 #ifdef DEBUG_CHILD_OUTPUT
-                log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, TEXT("loggedOffset: %d"), loggedOffset);
+            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, TEXT("loggedOffset: %d"), loggedOffset);
 #endif
-            } else {
-                /* If we read this pass or if the last character is a CR on Windows then we always want to defer. */
-                if (readThisPass
+        } else {
+            /* If we read this pass or if the last character is a CR on Windows then we always want to defer. */
+            if (stream->readThisPass
 #ifdef WIN32
-                        || (wrapperChildWorkBuffer[wrapperChildWorkBufferLen - 1] == 0x0d)
+                    || (stream->workBuffer[stream->workBufferLen - 1] == 0x0d)
 #endif
-                        /* Avoid dumping partial lines because we call this funtion too quickly more than once.
-                         *  Never let the line be partial unless more than the LF-Delay threshold has expired. */
-                        || (wrapperData->logLFDelayThreshold == 0)
-                        || (((now - wrapperChildWorkLastDataTime) * 1000 + (nowMillis - wrapperChildWorkLastDataTimeMillis)) < wrapperData->logLFDelayThreshold)
-                    ) {
+                    /* Avoid dumping partial lines because we call this funtion too quickly more than once.
+                     *  Never let the line be partial unless more than the LF-Delay threshold has expired. */
+                    || (wrapperData->logLFDelayThreshold == 0)
+                    || (((now - stream->lastDataTime) * 1000 + (nowMillis - stream->lastDataTimeMillis)) < wrapperData->logLFDelayThreshold)
+                ) {
 #ifdef DEBUG_CHILD_OUTPUT
  #ifdef UNICODE
-                    /* It is not easy to log the string as is because they are not wide chars. Send it only to stdout. */
-                    log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, TEXT("Incomplete line.  Defer: (see stdout)  Age: %d"),
-                        (now - wrapperChildWorkLastDataTime) * 1000 + (nowMillis - wrapperChildWorkLastDataTimeMillis));
+                /* It is not easy to log the string as is because they are not wide chars. Send it only to stdout. */
+                log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, TEXT("Incomplete line.  Defer: (see stdout)  Age: %d"),
+                    (now - stream->lastDataTime) * 1000 + (nowMillis - stream->lastDataTimeMillis));
   #ifdef WIN32
-                    wprintf(TEXT("Defer Log: [%S]\n"), wrapperChildWorkBuffer + loggedOffset);
+                wprintf(TEXT("Defer Log: [%S]\n"), stream->workBuffer + loggedOffset);
   #else
-                    wprintf(TEXT("Defer Log: [%s]\n"), wrapperChildWorkBuffer + loggedOffset);
+                wprintf(TEXT("Defer Log: [%s]\n"), stream->workBuffer + loggedOffset);
   #endif
  #else
-                    log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, TEXT("Incomplete line.  Defer: [%s]  Age: %d"), wrapperChildWorkBuffer,
-                        (now - wrapperChildWorkLastDataTime) * 1000 + (nowMillis - wrapperChildWorkLastDataTimeMillis));
+                log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, TEXT("Incomplete line.  Defer: [%s]  Age: %d"), stream->workBuffer,
+                    (now - stream->lastDataTime) * 1000 + (nowMillis - stream->lastDataTimeMillis));
  #endif
 #endif
-                    defer = TRUE;
-                } else {
-                    /* We have an incomplete line, but it was from a previous pass and is old enough, so we want to log it as it may be a prompt.
-                     *  This will always be the complete buffer. */
+                defer = TRUE;
+            } else {
+                /* We have an incomplete line, but it was from a previous pass and is old enough, so we want to log it as it may be a prompt.
+                 *  This will always be the complete buffer. */
 #ifdef DEBUG_CHILD_OUTPUT
  #ifdef UNICODE
-                    /* It is not easy to log the string as is because they are not wide chars. Send it only to stdout. */
-                    log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, TEXT("Incomplete line, but log now: (see stdout)  Age: %d"),
-                        (now - wrapperChildWorkLastDataTime) * 1000 + (nowMillis - wrapperChildWorkLastDataTimeMillis));
+                /* It is not easy to log the string as is because they are not wide chars. Send it only to stdout. */
+                log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, TEXT("Incomplete line, but log now: (see stdout)  Age: %d"),
+                    (now - stream->lastDataTime) * 1000 + (nowMillis - stream->lastDataTimeMillis));
   #ifdef WIN32
-                    wprintf(TEXT("Log: [%S]\n"), wrapperChildWorkBuffer + loggedOffset);
+                wprintf(TEXT("Log: [%S]\n"), stream->workBuffer + loggedOffset);
   #else
-                    wprintf(TEXT("Log: [%s]\n"), wrapperChildWorkBuffer + loggedOffset);
+                wprintf(TEXT("Log: [%s]\n"), stream->workBuffer + loggedOffset);
   #endif
  #else
-                    log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, TEXT("Incomplete line, but log now: [%s]  Age: %d"), wrapperChildWorkBuffer,
-                        (now - wrapperChildWorkLastDataTime) * 1000 + (nowMillis - wrapperChildWorkLastDataTimeMillis));
+                log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, TEXT("Incomplete line, but log now: [%s]  Age: %d"), stream->workBuffer,
+                    (now - stream->lastDataTime) * 1000 + (nowMillis - stream->lastDataTimeMillis));
  #endif
 #endif
-                    logChildOutput(wrapperChildWorkBuffer + loggedOffset);
-                    
-                    /* We know we read everything so we can safely reset the loggedOffset and clear the buffer. */
-                    wrapperChildWorkBuffer[0] = '\0';
-                    wrapperChildWorkBufferLen = 0;
-                    loggedOffset = 0;
-                    wrapperChildWorkIsNewLine = TRUE;
-                }
+                logChildOutput(stream, stream->workBuffer + loggedOffset);
+                
+                /* We know we read everything so we can safely reset the loggedOffset and clear the buffer. */
+                stream->workBuffer[0] = '\0';
+                stream->workBufferLen = 0;
+                loggedOffset = 0;
+                stream->isNewLine = TRUE;
             }
         }
-        
-        /* We have read as many lines from the buffered output as possible.
-         *  If we still have any partial lines, then we need to make sure they are moved to the beginning of the buffer so we can read in another block. */
-        if (loggedOffset > 0) {
-            if (loggedOffset >= wrapperChildWorkBufferLen) {
-                /* We know we have read everything in.  So we can efficiently clear the buffer. */
+    }
+    
+    /* We have read as many lines from the buffered output as possible.
+     *  If we still have any partial lines, then we need to make sure they are moved to the beginning of the buffer so we can read in another block. */
+    if (loggedOffset > 0) {
+        if (loggedOffset >= stream->workBufferLen) {
+            /* We know we have read everything in.  So we can efficiently clear the buffer. */
 #ifdef DEBUG_CHILD_OUTPUT
-                log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, TEXT("Cleared Buffer as everything was logged."));
+            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, TEXT("Cleared Buffer as everything was logged."));
 #endif
-                wrapperChildWorkBuffer[0] = '\0';
-                wrapperChildWorkBufferLen = 0;
-                /* loggedOffset = 0; Not needed. */
-            } else {
-                /* We have logged one or more lines from the buffer, but unlogged content still exists.  It needs to be moved to the head of the buffer. */
+            stream->workBuffer[0] = '\0';
+            stream->workBufferLen = 0;
+            /* loggedOffset = 0; Not needed. */
+        } else {
+            /* We have logged one or more lines from the buffer, but unlogged content still exists.  It needs to be moved to the head of the buffer. */
 #ifdef DEBUG_CHILD_OUTPUT
-                log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, TEXT("Moving %d bytes in buffer for next cycle."), wrapperChildWorkBufferLen - loggedOffset);
+            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, TEXT("Moving %d bytes in buffer for next cycle."), stream->workBufferLen - loggedOffset);
+#endif
+            /* NOTE - This line intentionally does the copy within the same memory space.  It is safe the way it is working however. */
+            stream->workBufferLen = stream->workBufferLen - loggedOffset;
+            safeMemCpy(stream->workBuffer, 0, loggedOffset, stream->workBufferLen);
+            /* Shouldn't be needed, but just to make sure the buffer has been ended properly */
+            stream->workBuffer[stream->workBufferLen] = 0;
+            /* loggedOffset = 0; Not needed. */
+        }
+    } else {
+    }
+
+    if (timedOut) {
+        return CHILD_OUTPUT_TIMEOUT;
+    }
+
+    if (currentBlockRead <= 0) {
+        /* All done for now. */
+        if ((stream->recordLines > 0) &&
+                (((now - stream->lastReadTime) * 1000 + (nowMillis - stream->lastReadTimeMillis)) >= wrapperData->javaIOMultilineTimeout)) {
+            /* No more continuation lines arrived in time. */
+            wrapperFlushChildOutputRecord(stream);
+        }
+        if (stream->workBufferLen > 0) {
+#ifdef DEBUG_CHILD_OUTPUT
+            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, TEXT("wrapperReadChildOutput() END (Incomplete)"));
 #endif
-                /* NOTE - This line intentionally does the copy within the same memory space.  It is safe the way it is working however. */
-                wrapperChildWorkBufferLen = wrapperChildWorkBufferLen - loggedOffset;
-                safeMemCpy(wrapperChildWorkBuffer, 0, loggedOffset, wrapperChildWorkBufferLen);
-                /* Shouldn't be needed, but just to make sure the buffer has been ended properly */
-                wrapperChildWorkBuffer[wrapperChildWorkBufferLen] = 0;
-                /* loggedOffset = 0; Not needed. */
-            }
         } else {
+#ifdef DEBUG_CHILD_OUTPUT
+            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, TEXT("wrapperReadChildOutput() END"));
+#endif
         }
+        return CHILD_OUTPUT_NONE;
+    }
+    
+    return CHILD_OUTPUT_READ;
+}
+
+/**
+ * Returns the number of lines of JVM output which were dropped since the Wrapper was started.
+ */
+unsigned int wrapperGetDroppedJavaOutputLines() {
+    return wrapperChildWorkDroppedTotal + (unsigned int)wrapperChildWorkDroppedLines;
+}
+
+/**
+ * Read and process any output from the child JVM Process.
+ *
+ * When maxTimeMS is non-zero this function will only be allowed to run for that maximum
+ *  amount of time.  This is done to make sure the calling function is allowed CPU for
+ *  other activities.   When timing out for this reason when there is more data in the
+ *  pipe, this function will return TRUE to let the calling code know that it should
+ *  not to any unnecessary sleeps.  Otherwise FALSE will be returned.
+ *
+ * @param maxTimeMS The maximum number of milliseconds that this function will be allowed
+ *                  to run without returning.  In reality no new reads will happen after
+ *                  this time, but actual processing may take longer.
+ *
+ * @return TRUE if the calling code should call this function again as soon as possible.
+ */
+int wrapperReadChildOutput(int maxTimeMS) {
+    struct timeb timeBuffer;
+    time_t startTime;
+    int startTimeMillis;
+    time_t now;
+    int nowMillis;
+    time_t durr;
+    int linesThisPass = 0;
+    int result;
+#ifndef WIN32
+    int resultErr;
+#endif
+
+    if (wrapperInitChildOutputStream(&wrapperChildStdout)) {
+        return FALSE;
+    }
+#ifndef WIN32
+    if (wrapperInitChildOutputStream(&wrapperChildStderr)) {
+        return FALSE;
+    }
+#endif
+
+    wrapperGetCurrentTime(&timeBuffer);
+    startTime = now = timeBuffer.time;
+    startTimeMillis = nowMillis = timeBuffer.millitm;
+
+    if ((wrapperChildWorkDroppedLines > 0) && (now - wrapperChildWorkLastDropReport >= wrapperData->javaIOOverflowReportInterval)) {
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN,
+            TEXT("%d lines of JVM output were dropped because the Wrapper was unable to log them as fast as they were produced.  (%s=%s)"),
+            wrapperChildWorkDroppedLines, TEXT("wrapper.javaio.overflow_policy"), getJavaIOOverflowPolicyName(wrapperData->javaIOOverflowPolicy));
+        wrapperChildWorkDroppedTotal += wrapperChildWorkDroppedLines;
+        wrapperChildWorkDroppedLines = 0;
+        wrapperChildWorkLastDropReport = now;
+    }
+
+    if ((wrapperData->javaIODedupWindow > 0) && (now - wrapperChildWorkLastDedupReport >= wrapperData->javaIODedupInterval)) {
+        wrapperReportChildOutputStreamRepeats(&wrapperChildStdout);
+#ifndef WIN32
+        wrapperReportChildOutputStreamRepeats(&wrapperChildStderr);
+#endif
+        wrapperChildWorkLastDedupReport = now;
+    }
 
-        if (currentBlockRead <= 0) {
-            /* All done for now. */
-            if (wrapperChildWorkBufferLen > 0) {
 #ifdef DEBUG_CHILD_OUTPUT
-                log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, TEXT("wrapperReadChildOutput() END (Incomplete)"));
+    log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, TEXT("wrapperReadChildOutput() BEGIN"));
+    log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, TEXT("now=%ld, nowMillis=%d"), now, nowMillis);
 #endif
-            } else {
+
+    wrapperChildStdout.readThisPass = FALSE;
+#ifndef WIN32
+    wrapperChildStderr.readThisPass = FALSE;
+#endif
+
+    /* Loop and read in CHILD_BLOCK_SIZE characters at a time.  When stderr has its own pipe, a block is read from each pipe in turn.
+     *
+     * To keep a JVM outputting lots of content from freezing the Wrapper, we force a return every 250ms. */
+    while ((maxTimeMS <= 0) || ((durr = (now - startTime) * 1000 + (nowMillis - startTimeMillis)) < maxTimeMS)) {
 #ifdef DEBUG_CHILD_OUTPUT
-                log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, TEXT("wrapperReadChildOutput() END"));
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, TEXT("durr=%ld"), durr);
+#endif
+        result = wrapperReadChildOutputStream(&wrapperChildStdout, maxTimeMS, startTime, startTimeMillis, now, nowMillis, &linesThisPass);
+#ifndef WIN32
+        if ((result == CHILD_OUTPUT_NONE) || (result == CHILD_OUTPUT_READ)) {
+            resultErr = wrapperReadChildOutputStream(&wrapperChildStderr, maxTimeMS, startTime, startTimeMillis, now, nowMillis, &linesThisPass);
+            if ((resultErr == CHILD_OUTPUT_ERROR) || (resultErr == CHILD_OUTPUT_TIMEOUT) || (result == CHILD_OUTPUT_NONE)) {
+                result = resultErr;
+            }
+        }
+#endif
+        if (result == CHILD_OUTPUT_ERROR) {
+            return FALSE;
+        } else if (result == CHILD_OUTPUT_TIMEOUT) {
+            break;
+        } else if (result == CHILD_OUTPUT_NONE) {
+            /* All done for now. */
+            if ((wrapperData->jState == WRAPPER_JSTATE_DOWN_CHECK) || (wrapperData->jState == WRAPPER_JSTATE_DOWN_FLUSH) || (wrapperData->jState == WRAPPER_JSTATE_DOWN_CLEAN)) {
+                /* The JVM is gone so log anything still pending rather than waiting for more output or the next report. */
+                wrapperFlushChildOutputRecord(&wrapperChildStdout);
+                wrapperReportChildOutputStreamRepeats(&wrapperChildStdout);
+#ifndef WIN32
+                wrapperFlushChildOutputRecord(&wrapperChildStderr);
+                wrapperReportChildOutputStreamRepeats(&wrapperChildStderr);
 #endif
             }
             return FALSE;
@@ -5101,6 +5875,12 @@ int wrapperReadChildOutput(int maxTimeMS) {
     }
 
     /* If we got here then we timed out. */
+    if (wrapperData->javaIOOverflowPolicy != WRAPPER_JAVAIO_OVERFLOW_BLOCK) {
+        wrapperDrainChildOutput(&wrapperChildStdout, now, nowMillis);
+#ifndef WIN32
+        wrapperDrainChildOutput(&wrapperChildStderr, now, nowMillis);
+#endif
+    }
 #ifdef DEBUG_CHILD_OUTPUT
     log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO, TEXT("wrapperReadChildOutput() END TIMEOUT"));
 #endif
@@ -5286,6 +6066,8 @@ void wrapperKillProcess(int silent) {
         return;
     }
 
+    requestCrashBufferDump(TEXT("JVM killed"));
+
     /* Check to make sure that the JVM process is still running */
 #ifdef WIN32
     ret = WaitForSingleObject(wrapperData->javaProcess, 0);
@@ -5800,6 +6582,10 @@ int wrapperRunCommonInner() {
 #endif
                 if (wrapperData->useSystemTime) {
                     log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_DEBUG, TEXT("Using system timer."));
+#ifndef WIN32
+                } else if (wrapperData->useMonotonicTime) {
+                    log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_DEBUG, TEXT("Using monotonic clock timer."));
+#endif
                 } else {
                     log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_DEBUG, TEXT("Using tick timer."));
                 }
@@ -8200,7 +8986,7 @@ int wrapperBuildJavaCommandArrayInner(TCHAR **strings, int addQuotes, const TCHA
         index++;
     }
     /* Store the Wrapper debug flag */
-    if (wrapperData->isDebugging) {
+    if (wrapperData->isJVMDebugging) {
         if (strings) {
             strings[index] = malloc(sizeof(TCHAR) * (22 + 1));
             if (!strings[index]) {
@@ -8760,6 +9546,7 @@ void wrapperJVMProcessExited(TICKS nowTicks, int exitCode) {
         wrapperData->restartRequested = WRAPPER_RESTART_REQUESTED_AUTOMATIC;
         log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_ERROR,
             TEXT("JVM exited while loading the application."));
+        requestCrashBufferDump(TEXT("JVM exited unexpectedly"));
         break;
 
     case WRAPPER_JSTATE_LAUNCHED:
@@ -8767,24 +9554,28 @@ void wrapperJVMProcessExited(TICKS nowTicks, int exitCode) {
         wrapperData->restartRequested = WRAPPER_RESTART_REQUESTED_AUTOMATIC;
         log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_ERROR,
            TEXT("JVM exited before starting the application."));
+        requestCrashBufferDump(TEXT("JVM exited unexpectedly"));
         break;
 
     case WRAPPER_JSTATE_STARTING:
         wrapperData->restartRequested = WRAPPER_RESTART_REQUESTED_AUTOMATIC;
         log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_ERROR,
             TEXT("JVM exited while starting the application."));
+        requestCrashBufferDump(TEXT("JVM exited unexpectedly"));
         break;
 
     case WRAPPER_JSTATE_STARTED:
         wrapperData->restartRequested = WRAPPER_RESTART_REQUESTED_AUTOMATIC;
         log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_ERROR,
             TEXT("JVM exited unexpectedly."));
+        requestCrashBufferDump(TEXT("JVM exited unexpectedly"));
         break;
 
     case WRAPPER_JSTATE_STOP:
     case WRAPPER_JSTATE_STOPPING:
         log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN,
             TEXT("JVM exited unexpectedly while stopping the application."));
+        requestCrashBufferDump(TEXT("JVM exited unexpectedly"));
         break;
 
     case WRAPPER_JSTATE_STOPPED:
@@ -9605,6 +10396,19 @@ int loadConfiguration() {
         /* Should never be possible to completely disable the java command as this would make it very difficult to support. */
         wrapperData->commandLogLevel = LEVEL_DEBUG;
     }
+
+#ifndef WIN32
+    /* Should the stderr of the JVM be read from its own pipe. */
+    wrapperData->javaStderrSeparate = getBooleanProperty(properties, TEXT("wrapper.java.stderr.separate"), FALSE);
+    /* Should the JVM be launched without copying the address space of the Wrapper. */
+    wrapperData->javaLaunchVfork = getBooleanProperty(properties, TEXT("wrapper.java.launch.vfork"), FALSE);
+#endif
+    /* Get the log level of output read from the stderr pipe. */
+    wrapperData->jvmStderrLogLevel = getLogLevelForName(
+        getStringProperty(properties, TEXT("wrapper.java.stderr.loglevel"), TEXT("INFO")));
+    if (wrapperData->jvmStderrLogLevel == LEVEL_UNKNOWN) {
+        wrapperData->jvmStderrLogLevel = LEVEL_INFO;
+    }
     
     /* Should we detach the JVM on startup. */
     if (wrapperData->isConsole) {
@@ -9614,6 +10418,9 @@ int loadConfiguration() {
     /* Get the use system time flag. */
     if (!wrapperData->configured) {
         wrapperData->useSystemTime = getBooleanProperty(properties, TEXT("wrapper.use_system_time"), FALSE);
+#ifndef WIN32
+        wrapperData->useMonotonicTime = getBooleanProperty(properties, TEXT("wrapper.use_monotonic_time"), TRUE);
+#endif
     }
     
     if (!wrapperData->configured) {
@@ -9644,6 +10451,36 @@ int loadConfiguration() {
         wrapperData->useJavaIOThread = getBooleanProperty(properties, TEXT("wrapper.javaio.use_thread"), getBooleanProperty(properties, TEXT("wrapper.use_javaio_thread"), FALSE));
     }
     
+    /* Get the policy to apply when the JVM output can not be logged as fast as it is produced. */
+    wrapperData->javaIOOverflowPolicy = getJavaIOOverflowPolicy(getStringProperty(properties, TEXT("wrapper.javaio.overflow_policy"), NULL), WRAPPER_JAVAIO_OVERFLOW_BLOCK);
+    wrapperData->javaIOMaxBufferSize = getIntProperty(properties, TEXT("wrapper.javaio.max_buffer_size"),
+        (wrapperData->javaIOOverflowPolicy == WRAPPER_JAVAIO_OVERFLOW_BLOCK) ? 0 : WRAPPER_JAVAIO_MAX_BUFFER_SIZE_DEFAULT);
+    if ((wrapperData->javaIOMaxBufferSize == 0) && (wrapperData->javaIOOverflowPolicy != WRAPPER_JAVAIO_OVERFLOW_BLOCK)) {
+        wrapperData->javaIOMaxBufferSize = WRAPPER_JAVAIO_MAX_BUFFER_SIZE_DEFAULT;
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN,
+            TEXT("%s can not be unlimited when %s is set to %s.  Changing to %d."), TEXT("wrapper.javaio.max_buffer_size"), TEXT("wrapper.javaio.overflow_policy"),
+            getJavaIOOverflowPolicyName(wrapperData->javaIOOverflowPolicy), wrapperData->javaIOMaxBufferSize);
+    } else if (wrapperData->javaIOMaxBufferSize == 0) {
+        /* Ok. No limit. */
+    } else if ((wrapperData->javaIOMaxBufferSize < WRAPPER_JAVAIO_MAX_BUFFER_SIZE_MIN) || (wrapperData->javaIOMaxBufferSize > WRAPPER_JAVAIO_MAX_BUFFER_SIZE_MAX)) {
+        wrapperData->javaIOMaxBufferSize = propIntMax(propIntMin(wrapperData->javaIOMaxBufferSize, WRAPPER_JAVAIO_MAX_BUFFER_SIZE_MAX), WRAPPER_JAVAIO_MAX_BUFFER_SIZE_MIN);
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN,
+            TEXT("%s must be in the range %d to %d or %d.  Changing to %d."), TEXT("wrapper.javaio.max_buffer_size"), WRAPPER_JAVAIO_MAX_BUFFER_SIZE_MIN, WRAPPER_JAVAIO_MAX_BUFFER_SIZE_MAX, 0, wrapperData->javaIOMaxBufferSize);
+    }
+    wrapperData->javaIOOverflowSampleRate = propIntMax(propIntMin(getIntProperty(properties, TEXT("wrapper.javaio.overflow_sample_rate"), 10), 1000), 2);
+    wrapperData->javaIOOverflowReportInterval = propIntMax(propIntMin(getIntProperty(properties, TEXT("wrapper.javaio.overflow_report_interval"), 60), 3600), 1);
+
+    /* Get the settings used to collapse repeated lines of JVM output. */
+    wrapperData->javaIODedupWindow = propIntMax(propIntMin(getIntProperty(properties, TEXT("wrapper.javaio.dedup.window"), 0), WRAPPER_JAVAIO_DEDUP_WINDOW_MAX), 0);
+    wrapperData->javaIODedupThreshold = propIntMax(propIntMin(getIntProperty(properties, TEXT("wrapper.javaio.dedup.threshold"), 1), 1000), 1);
+    wrapperData->javaIODedupThresholdStderr = propIntMax(propIntMin(getIntProperty(properties, TEXT("wrapper.javaio.dedup.threshold.stderr"), wrapperData->javaIODedupThreshold), 1000), 1);
+    wrapperData->javaIODedupInterval = propIntMax(propIntMin(getIntProperty(properties, TEXT("wrapper.javaio.dedup.interval"), 5), 3600), 1);
+
+    /* Get the settings used to group stack traces into a single record. */
+    wrapperData->javaIOMultiline = getBooleanProperty(properties, TEXT("wrapper.javaio.multiline"), FALSE);
+    wrapperData->javaIOMultilineMaxLines = propIntMax(propIntMin(getIntProperty(properties, TEXT("wrapper.javaio.multiline.max_lines"), WRAPPER_JAVAIO_MULTILINE_MAX_LINES_DEFAULT), 10000), 2);
+    wrapperData->javaIOMultilineTimeout = propIntMax(propIntMin(getIntProperty(properties, TEXT("wrapper.javaio.multiline.timeout"), 100), 10000), 0);
+    
     /* Decide whether or not a mutex should be used to protect the tick timer. */
     if (!wrapperData->configured) {
         wrapperData->useTickMutex = getBooleanProperty(properties, TEXT("wrapper.use_tick_mutex"), FALSE);
@@ -9687,6 +10524,12 @@ int loadConfiguration() {
     wrapperData->isCPUOutputEnabled = getBooleanProperty(properties, TEXT("wrapper.cpu_output"), FALSE);
     wrapperData->cpuOutputInterval = getIntProperty(properties, TEXT("wrapper.cpu_output.interval"), 1);
 
+    /* Get the main loop statistics output status. */
+    wrapperData->isLoopStatsOutputEnabled = getBooleanProperty(properties, TEXT("wrapper.loop_stats_output"), FALSE);
+    wrapperData->loopStatsOutputInterval = propIntMin(propIntMax(getIntProperty(properties, TEXT("wrapper.loop_stats_output.interval"), wrapperData->cpuOutputInterval), 1), 3600);
+    wrapperData->isPingStatsOutputEnabled = getBooleanProperty(properties, TEXT("wrapper.ping.stats_output"), FALSE);
+    wrapperData->pingStatsOutputInterval = propIntMin(propIntMax(getIntProperty(properties, TEXT("wrapper.ping.stats_output.interval"), 60), 1), 3600);
+
     /* Get the pageFault output status. */
     if (!wrapperData->configured) {
         wrapperData->isPageFaultOutputEnabled = getBooleanProperty(properties, TEXT("wrapper.pagefault_output"), FALSE);
@@ -9742,6 +10585,13 @@ int loadConfiguration() {
     wrapperData->pingAlertLogLevel = getLogLevelForName(getStringProperty(properties, TEXT("wrapper.ping.alert.loglevel"), TEXT("STATUS")));
     wrapperData->pingInterval = getIntProperty(properties, TEXT("wrapper.ping.interval"), 5);
     wrapperData->pingIntervalLogged = getIntProperty(properties, TEXT("wrapper.ping.interval.logged"), 1);
+    wrapperData->pingIntervalAdaptive = getBooleanProperty(properties, TEXT("wrapper.ping.interval.adaptive"), FALSE);
+    wrapperData->pingIntervalMin = getIntProperty(properties, TEXT("wrapper.ping.interval.min"), 1);
+    wrapperData->pingTrendThreshold = propIntMin(propIntMax(getIntProperty(properties, TEXT("wrapper.ping.trend.threshold"), 0), 0), 99);
+    if (wrapperData->pingTrendActionList) {
+        free(wrapperData->pingTrendActionList);
+    }
+    wrapperData->pingTrendActionList = wrapperGetActionListForNames(getStringProperty(properties, TEXT("wrapper.ping.trend.action"), TEXT("NONE")), TEXT("wrapper.ping.trend.action"));
     wrapperData->shutdownTimeout = getIntProperty(properties, TEXT("wrapper.shutdown.timeout"), 30);
     wrapperData->jvmExitTimeout = getIntProperty(properties, TEXT("wrapper.jvm_exit.timeout"), 15);
     wrapperData->jvmCleanupTimeout = getIntProperty(properties, TEXT("wrapper.jvm_cleanup.timeout"), 10);
@@ -9773,6 +10623,9 @@ int loadConfiguration() {
         log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN,
             TEXT("wrapper.ping.interval.logged must be less than or equal to 1 day (86400 seconds).  Changing to 86400."));
     }
+    wrapperData->pingIntervalMin = propIntMin(propIntMax(wrapperData->pingIntervalMin, 1), wrapperData->pingInterval);
+    /* An adaptive interval starts again from wrapper.ping.interval whenever the configuration is reloaded. */
+    wrapperData->pingIntervalCurrent = wrapperData->pingInterval;
 
     if ((wrapperData->pingTimeout > 0) && (wrapperData->pingTimeout < wrapperData->pingInterval + 5)) {
         wrapperData->pingTimeout = wrapperData->pingInterval + 5;
@@ -9833,6 +10686,22 @@ int loadConfiguration() {
         return TRUE;
     }
 
+#ifdef LINUX
+    /* Get the javaio raw passthrough flag. */
+    wrapperData->useJavaIORawPassthrough = getBooleanProperty(properties, TEXT("wrapper.javaio.raw_passthrough"), FALSE);
+    if (wrapperData->useJavaIORawPassthrough && (wrapperData->outputFilterCount > 0)) {
+        /* Filters need to see every line of output. */
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN,
+            TEXT("%s can not be used together with output filters.  Disabling."), TEXT("wrapper.javaio.raw_passthrough"));
+        wrapperData->useJavaIORawPassthrough = FALSE;
+    } else if (wrapperData->useJavaIORawPassthrough && (wrapperData->javaIODedupWindow > 0)) {
+        /* Repeated lines can only be detected when the output is read line by line. */
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN,
+            TEXT("%s can not be used together with %s.  Disabling."), TEXT("wrapper.javaio.raw_passthrough"), TEXT("wrapper.javaio.dedup.window"));
+        wrapperData->useJavaIORawPassthrough = FALSE;
+    }
+#endif
+
     /** Get the pid files if any.  May be NULL */
     if (!wrapperData->configured) {
         updateStringValue(&wrapperData->pidFilename, getFileSafeStringProperty(properties, TEXT("wrapper.pidfile"), NULL));
@@ -9878,6 +10747,23 @@ int loadConfiguration() {
     /** Get the interval at which the anchor file will be polled. */
     wrapperData->anchorPollInterval = propIntMin(propIntMax(getIntProperty(properties, TEXT("wrapper.anchorfile.poll_interval"), getIntProperty(properties, TEXT("wrapper.anchor.poll_interval"), 5)), 1), 3600);
 
+#ifndef WIN32
+    /** Get whether the command and anchor files are watched rather than polled.  Only read on startup as the watches are set up once. */
+    if (!wrapperData->configured) {
+        wrapperData->watchFiles = getBooleanProperty(properties, TEXT("wrapper.filewatch"), FALSE);
+    }
+
+    /** Get the control socket if any.  May be NULL.  Only read on startup as the socket is created once. */
+    if (!wrapperData->configured) {
+        updateStringValue(&wrapperData->controlSocketFilename, getFileSafeStringProperty(properties, TEXT("wrapper.control.socket"), NULL));
+    }
+
+    /** Get the status page if any.  May be NULL.  Only read on startup as the page is created once. */
+    if (!wrapperData->configured) {
+        updateStringValue(&wrapperData->statusPageFilename, getFileSafeStringProperty(properties, TEXT("wrapper.statuspage"), NULL));
+    }
+#endif
+
     /** Flag controlling whether or not system signals should be ignored. */
     val = getStringProperty(properties, TEXT("wrapper.ignore_signals"), TEXT("FALSE"));
     if ( ( strcmpIgnoreCase( val, TEXT("TRUE") ) == 0 ) || ( strcmpIgnoreCase( val, TEXT("BOTH") ) == 0 ) ) {
@@ -10387,14 +11273,17 @@ void wrapperPingResponded(TICKS pingSendTicks, int queueWarnings) {
     int tickAge;
     PPendingPing pendingPing;
     int pingSearchDone;
+    int answered = FALSE;
     
 #ifdef DEBUG_PING_QUEUE
     log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("    PING QUEUE Ping Response (tick %08x)"), pingSendTicks);
 #endif
-    /* We want to purge the ping from the PendingPing list. */
+    /* We want to purge the ping from the PendingPing ring.  Responses arrive in the order the
+     *  pings were sent, so the expected one is normally the oldest.  Older pings which were
+     *  lost are skipped once each. */
     do {
-        pendingPing = wrapperData->firstPendingPing;
-        if (pendingPing != NULL) {
+        if (wrapperData->pendingPingCount > 0) {
+            pendingPing = &(wrapperData->pendingPings[wrapperData->pendingPingFirst]);
             tickAge = wrapperGetTickAgeTicks(pingSendTicks, pendingPing->sentTicks);
 #ifdef DEBUG_PING_QUEUE
             log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("    PING QUEUE First Queued Ping (tick %08x, age %d)"), pendingPing->sentTicks, tickAge);
@@ -10412,11 +11301,10 @@ void wrapperPingResponded(TICKS pingSendTicks, int queueWarnings) {
 #endif
                     }
                 }
-                pendingPing = NULL;
                 pingSearchDone = TRUE;
             } else {
                 if (tickAge < 0) {
-                    /* This PendingPing object was sent before the PING that we received.  This means that we somehow lost a ping. */
+                    /* This PendingPing was sent before the PING that we received.  This means that we somehow lost a ping. */
                     if (queueWarnings) {
                         if ((!wrapperData->pendingPingQueueOverflow) && (!wrapperData->pendingPingQueueOverflowEmptied)) {
                             log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_ERROR, TEXT("Lost a ping response, sent at tick %08x."), pendingPing->sentTicks);
@@ -10428,10 +11316,17 @@ void wrapperPingResponded(TICKS pingSendTicks, int queueWarnings) {
                     }
                     pingSearchDone = FALSE;
                 } else {
-                    /* This PendingPing object is for this PING event. */
+                    /* This PendingPing is for this PING event. */
                     pingSearchDone = TRUE;
+                    answered = TRUE;
+                    pendingPing->receivedMicros = wrapperGetMicroTime();
+                    wrapperData->lastPingRTT = pendingPing->receivedMicros - pendingPing->sentMicros;
+                    if (wrapperData->lastPingRTT == 0) {
+                        /* 0 means that no ping was answered yet. */
+                        wrapperData->lastPingRTT = 1;
+                    }
 #ifdef DEBUG_PING_QUEUE
-                    log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("    PING QUEUE Expected Ping Response. (tick %08x)"), pendingPing->sentTicks);
+                    log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("    PING QUEUE Expected Ping Response. (tick %08x, %uus)"), pendingPing->sentTicks, wrapperData->lastPingRTT);
 #endif
                     
                     /* When the emptied flag is set, we know that we are recovering from an overflow.
@@ -10444,24 +11339,17 @@ void wrapperPingResponded(TICKS pingSendTicks, int queueWarnings) {
                     }
                 }
                 
-                /* Detach the PendingPing from the queue. */
-                if (pendingPing->nextPendingPing != NULL) {
-                    /* This was the first PendingPing of several in the queue. */
-                    wrapperData->pendingPingCount--;
-                    if (wrapperData->firstUnwarnedPendingPing == wrapperData->firstPendingPing) {
-                        wrapperData->firstUnwarnedPendingPing = pendingPing->nextPendingPing;
-                    }
-                    wrapperData->firstPendingPing = pendingPing->nextPendingPing;
-                    pendingPing->nextPendingPing = NULL;
+                /* Detach the PendingPing from the queue.  Its slot is reused by a later ping. */
+                wrapperData->pendingPingFirst = (wrapperData->pendingPingFirst + 1) % WRAPPER_MAX_PENDING_PINGS;
+                wrapperData->pendingPingCount--;
+                if (wrapperData->pendingPingWarnedCount > 0) {
+                    wrapperData->pendingPingWarnedCount--;
+                }
+                if (wrapperData->pendingPingCount > 0) {
 #ifdef DEBUG_PING_QUEUE
                     log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("--- PING QUEUE Size: %d"), wrapperData->pendingPingCount);
 #endif
                 } else {
-                    /* This was the only PendingPing in the queue. */
-                    wrapperData->pendingPingCount = 0;
-                    wrapperData->firstUnwarnedPendingPing = NULL;
-                    wrapperData->firstPendingPing = NULL;
-                    wrapperData->lastPendingPing = NULL;
 #ifdef DEBUG_PING_QUEUE
                     log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("--- PING QUEUE Empty.") );
 #endif
@@ -10473,12 +11361,6 @@ void wrapperPingResponded(TICKS pingSendTicks, int queueWarnings) {
 #endif
                     }
                 }
-                
-                /* Free up the pendingPing object. */
-                if (pendingPing != NULL) {
-                    free(pendingPing);
-                    pendingPing = NULL;
-                }
             }
         } else {
             /* Got a ping response when the queue was empty. */
@@ -10509,6 +11391,11 @@ void wrapperPingResponded(TICKS pingSendTicks, int queueWarnings) {
             wrapperPingRespondedSlow(tickAge);
         }
         
+        /* Only pings matched in the queue have a reliable round trip time. */
+        if (answered) {
+            wrapperRecordPingRTT(wrapperData->lastPingRTT);
+        }
+        
         /* Allow 5 + <pingTimeout> more seconds before the JVM is considered to be dead. */
         if (wrapperData->pingTimeout > 0) {
             wrapperUpdateJavaStateTimeout(nowTicks, 5 + wrapperData->pingTimeout);
@@ -10525,6 +11412,7 @@ void wrapperPingResponded(TICKS pingSendTicks, int queueWarnings) {
 }
 
 void wrapperPingTimeoutResponded() {
+    requestCrashBufferDump(TEXT("JVM ping timeout"));
     wrapperProcessActionList(wrapperData->pingActionList, TEXT("JVM appears hung: Timed out waiting for signal from JVM."),
                              WRAPPER_ACTION_SOURCE_CODE_PING_TIMEOUT, 0, TRUE, wrapperData->errorExitCode);
 }
@@ -11014,4 +11902,130 @@ void tsJAP_testJavaAdditionalParamSuite(void) {
         }
     }
 }
+
+/**
+ * Applies an overflow policy to a work buffer and checks what is left.
+ */
+static void tsCO_subTestShedChildOutput(int policy, int maxSize, int sampleRate, const char *input, const char *expected, int expectedDropped) {
+    ChildOutputStream stream;
+
+    memset(&stream, 0, sizeof(ChildOutputStream));
+    stream.workBufferLen = strlen(input);
+    stream.workBufferSize = stream.workBufferLen + 1;
+    stream.workBuffer = malloc(stream.workBufferSize);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(stream.workBuffer);
+    memcpy(stream.workBuffer, input, stream.workBufferLen + 1);
+
+    wrapperData->javaIOOverflowPolicy = policy;
+    wrapperData->javaIOMaxBufferSize = maxSize;
+    wrapperData->javaIOOverflowSampleRate = sampleRate;
+    wrapperChildWorkDroppedLines = 0;
+    wrapperChildWorkSampleCount = 0;
+
+    wrapperShedChildOutput(&stream);
+
+    CU_ASSERT_STRING_EQUAL(stream.workBuffer, expected);
+    CU_ASSERT_EQUAL(stream.workBufferLen, strlen(expected));
+    CU_ASSERT_EQUAL(wrapperChildWorkDroppedLines, expectedDropped);
+
+    free(stream.workBuffer);
+    wrapperChildWorkDroppedLines = 0;
+    wrapperChildWorkSampleCount = 0;
+}
+
+void tsCO_testShedChildOutput(void) {
+    /* Nothing to do while the buffer fits, or when there is no complete line. */
+    tsCO_subTestShedChildOutput(WRAPPER_JAVAIO_OVERFLOW_DROP_OLDEST, 16, 1, "a1\nb2\nc3\nd4\npart", "a1\nb2\nc3\nd4\npart", 0);
+    tsCO_subTestShedChildOutput(WRAPPER_JAVAIO_OVERFLOW_DROP_OLDEST, 0, 1, "a1\nb2\nc3\nd4\npart", "a1\nb2\nc3\nd4\npart", 0);
+    tsCO_subTestShedChildOutput(WRAPPER_JAVAIO_OVERFLOW_DROP_OLDEST, 5, 1, "abcdefghijklm", "abcdefghijklm", 0);
+
+    /* The partial line at the end is always kept. */
+    tsCO_subTestShedChildOutput(WRAPPER_JAVAIO_OVERFLOW_DROP_OLDEST, 10, 1, "a1\nb2\nc3\nd4\npart", "c3\nd4\npart", 2);
+    tsCO_subTestShedChildOutput(WRAPPER_JAVAIO_OVERFLOW_DROP_OLDEST, 4, 1, "a1\nb2\nc3\nd4\npart", "part", 4);
+    tsCO_subTestShedChildOutput(WRAPPER_JAVAIO_OVERFLOW_DROP_NEWEST, 10, 1, "a1\nb2\nc3\nd4\npart", "a1\nb2\npart", 2);
+    tsCO_subTestShedChildOutput(WRAPPER_JAVAIO_OVERFLOW_DROP_NEWEST, 4, 1, "a1\nb2\nc3\nd4\npart", "part", 4);
+    tsCO_subTestShedChildOutput(WRAPPER_JAVAIO_OVERFLOW_SAMPLE, 10, 2, "a1\nb2\nc3\nd4\npart", "a1\nc3\npart", 2);
+    tsCO_subTestShedChildOutput(WRAPPER_JAVAIO_OVERFLOW_SAMPLE, 10, 3, "a1\nb2\nc3\nd4\npart", "a1\nd4\npart", 2);
+
+    /* Falls back to dropping the oldest lines when sampling is not enough. */
+    tsCO_subTestShedChildOutput(WRAPPER_JAVAIO_OVERFLOW_SAMPLE, 6, 2, "a1\nb2\nc3\nd4\npart", "part", 4);
+}
+
+void tsCO_testDedupChildOutput(void) {
+    ChildOutputStream stream;
+    ChildOutputStream stderrStream;
+    int i;
+
+    wrapperData->jvmSource = WRAPPER_SOURCE_JVM;
+    wrapperData->jvmDefaultLogLevel = LEVEL_INFO;
+    wrapperData->jvmStderrLogLevel = LEVEL_INFO;
+    wrapperData->javaIODedupThreshold = 1;
+    wrapperData->javaIODedupThresholdStderr = 2;
+
+    memset(&stream, 0, sizeof(ChildOutputStream));
+    stream.dedupWindow = 2;
+    stream.dedupEntries = calloc(stream.dedupWindow, sizeof(ChildOutputDedupEntry));
+    CU_ASSERT_PTR_NOT_NULL_FATAL(stream.dedupEntries);
+
+    /* Lines are logged up to the threshold, then counted. */
+    CU_ASSERT_FALSE(wrapperDedupChildOutput(&stream, "a"));
+    CU_ASSERT_TRUE(wrapperDedupChildOutput(&stream, "a"));
+    CU_ASSERT_TRUE(wrapperDedupChildOutput(&stream, "a"));
+    CU_ASSERT_EQUAL(stream.dedupEntries[0].suppressed, 2);
+    /* FNV-1a of "a". */
+    CU_ASSERT_EQUAL(stream.dedupEntries[0].hash, 0xE40C292Cu);
+
+    /* A second line fills the window.  The first one is still remembered. */
+    CU_ASSERT_FALSE(wrapperDedupChildOutput(&stream, "b"));
+    CU_ASSERT_TRUE(wrapperDedupChildOutput(&stream, "a"));
+
+    /* A third line replaces the oldest entry, which is then seen as new again. */
+    CU_ASSERT_FALSE(wrapperDedupChildOutput(&stream, "c"));
+    CU_ASSERT_FALSE(wrapperDedupChildOutput(&stream, "a"));
+    CU_ASSERT_TRUE(wrapperDedupChildOutput(&stream, "c"));
+    for (i = 0; i < stream.dedupWindow; i++) {
+        CU_ASSERT_PTR_NOT_NULL(stream.dedupEntries[i].line);
+        if (stream.dedupEntries[i].line) {
+            CU_ASSERT(strcmp(stream.dedupEntries[i].line, "b") != 0);
+        }
+    }
+
+    /* Nothing is collapsed for output other than that of the JVM. */
+    wrapperData->jvmSource = WRAPPER_SOURCE_JVM_VERSION;
+    CU_ASSERT_FALSE(wrapperDedupChildOutput(&stream, "c"));
+    wrapperData->jvmSource = WRAPPER_SOURCE_JVM;
+
+    wrapperDisposeChildOutputDedup(&stream);
+    CU_ASSERT_PTR_NULL(stream.dedupEntries);
+
+    /* Separate threshold for stderr. */
+    memset(&stderrStream, 0, sizeof(ChildOutputStream));
+    stderrStream.isStderr = TRUE;
+    stderrStream.dedupWindow = 4;
+    stderrStream.dedupEntries = calloc(stderrStream.dedupWindow, sizeof(ChildOutputDedupEntry));
+    CU_ASSERT_PTR_NOT_NULL_FATAL(stderrStream.dedupEntries);
+    CU_ASSERT_FALSE(wrapperDedupChildOutput(&stderrStream, "e"));
+    CU_ASSERT_FALSE(wrapperDedupChildOutput(&stderrStream, "e"));
+    CU_ASSERT_TRUE(wrapperDedupChildOutput(&stderrStream, "e"));
+    wrapperDisposeChildOutputDedup(&stderrStream);
+}
+
+void tsCO_testChildOutputContinuation(void) {
+    CU_ASSERT_TRUE(isChildOutputContinuation("\tat com.example.Main.main(Main.java:10)"));
+    CU_ASSERT_TRUE(isChildOutputContinuation("    at com.example.Main.main(Main.java:10)"));
+    CU_ASSERT_TRUE(isChildOutputContinuation("\t\tat com.example.Main.run(Main.java:20)"));
+    CU_ASSERT_TRUE(isChildOutputContinuation("\t... 12 more"));
+    CU_ASSERT_TRUE(isChildOutputContinuation("\t... 3 common frames omitted"));
+    CU_ASSERT_TRUE(isChildOutputContinuation("Caused by: java.io.IOException: failed"));
+    CU_ASSERT_TRUE(isChildOutputContinuation("\tCaused by: java.io.IOException: failed"));
+    CU_ASSERT_TRUE(isChildOutputContinuation("\tSuppressed: java.lang.IllegalStateException"));
+
+    CU_ASSERT_FALSE(isChildOutputContinuation(""));
+    CU_ASSERT_FALSE(isChildOutputContinuation("Exception in thread \"main\" java.lang.RuntimeException"));
+    CU_ASSERT_FALSE(isChildOutputContinuation("at the top level"));
+    CU_ASSERT_FALSE(isChildOutputContinuation("  key = value"));
+    CU_ASSERT_FALSE(isChildOutputContinuation("\tattribute"));
+    CU_ASSERT_FALSE(isChildOutputContinuation("\t... done"));
+    CU_ASSERT_FALSE(isChildOutputContinuation("    "));
+}
 #endif /* CUNIT */
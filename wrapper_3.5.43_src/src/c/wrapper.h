@@ -186,6 +186,7 @@ extern char** environ;
 #define WRAPPER_ACTION_SOURCE_CODE_ON_EXIT                 4  /* Action originated from an on_exit configuration. */
 #define WRAPPER_ACTION_SOURCE_CODE_SIGNAL                  5  /* Action originated from a signal. */
 #define WRAPPER_ACTION_SOURCE_CODE_PING_TIMEOUT            11 /* Action originated from a timeout. */
+#define WRAPPER_ACTION_SOURCE_CODE_PING_TREND              12 /* Action originated from slow ping responses. */
 
 /* Required services access rights per action
  * ATTENTION: Any change in the definitions below should be reported to the functions & variables in wrapper_service_permission_win.c  */
@@ -234,13 +235,31 @@ typedef unsigned long TICKS;
 #define WRAPPER_JAVAIO_BUFFER_SIZE_MAX (10 * 1024 * 1024)
 #define WRAPPER_JAVAIO_BUFFER_SIZE_DEFAULT (64 * 1024)
 
+#define WRAPPER_JAVAIO_OVERFLOW_BLOCK       0
+#define WRAPPER_JAVAIO_OVERFLOW_DROP_OLDEST 1
+#define WRAPPER_JAVAIO_OVERFLOW_DROP_NEWEST 2
+#define WRAPPER_JAVAIO_OVERFLOW_SAMPLE      3
+
+#define WRAPPER_JAVAIO_MAX_BUFFER_SIZE_MIN (8 * 1024)
+#define WRAPPER_JAVAIO_MAX_BUFFER_SIZE_MAX (256 * 1024 * 1024)
+#define WRAPPER_JAVAIO_MAX_BUFFER_SIZE_DEFAULT (1024 * 1024)
+
+#define WRAPPER_JAVAIO_DEDUP_WINDOW_MAX 64
+
+#define WRAPPER_JAVAIO_MULTILINE_MAX_LINES_DEFAULT 512
+
+/* Maximum number of blocks read from the JVM pipe at once when the output is overflowing. */
+#define WRAPPER_JAVAIO_DRAIN_MAX_READS 64
+
 /*#define DEBUG_PING_QUEUE*/
+/* Capacity of the ring of pending pings.  The queue overflows when it is full. */
 #define WRAPPER_MAX_PENDING_PINGS 10
 typedef struct PendingPing PendingPing, *PPendingPing;
 struct PendingPing {
     TICKS sentTicks;
     TICKS slowTicks;
-    PPendingPing nextPendingPing;
+    unsigned int sentMicros;        /* Time the ping was sent, from wrapperGetMicroTime(). */
+    unsigned int receivedMicros;    /* Time the response was received, 0 until it is. */
 };
 
 /* Type definitions */
@@ -272,6 +291,7 @@ struct WrapperConfig {
     int     timerFastThreshold;     /* If the difference between the system time based tick count and the timer tick count ever falls by more than this value then a warning will be displayed. */
     int     timerSlowThreshold;     /* If the difference between the system time based tick count and the timer tick count ever grows by more than this value then a warning will be displayed. */
     int     useTickMutex;           /* TRUE if access to the tick count should be protected by a mutex. */
+    int     useMonotonicTime;       /* TRUE if the tick count should be based on the monotonic clock rather than incremented by a timer thread. Ignored if useSystemTime is set. */
     int     uptimeFlipped;          /* TRUE when the maximum uptime has been flipped. (Overflown) */
 
     int     ignoreSequenceGaps;     /* TRUE if all sequence properties should be used. */
@@ -295,6 +315,7 @@ struct WrapperConfig {
     int     jvmBits;                /* JVM bits of the current or next JVM instance to be launched. */
     int     jvmVendor;              /* JVM implementation (Oracle, IBM, etc.) of the current or next JVM instance to be launched. */
     int     jvmDefaultLogLevel;     /* The default log level used for JVM outputs. */
+    int     jvmStderrLogLevel;      /* The log level used for JVM output read from a separate stderr pipe. */
     int     jvmSource;              /* The source used for JVM outputs. */
 #ifdef WIN32
     TCHAR   *registry_java_home;    /* Path to the Java Home when the command is located to the registry, or NULL otherwise. */
@@ -319,6 +340,11 @@ struct WrapperConfig {
     int     pingInterval;           /* Number of seconds between pinging the JVM */
     int     pingIntervalLogged;     /* Number of seconds between pings which can be logged to debug output. */
     int     *pingActionList;        /* The action list to take when a ping timeout is detected. */
+    int     pingIntervalAdaptive;   /* TRUE if the ping interval should be shortened while the ping round trip times are rising. */
+    int     pingIntervalMin;        /* Shortest interval in seconds to which an adaptive ping interval can be shortened. */
+    int     pingIntervalCurrent;    /* Number of seconds currently between pings.  Equal to pingInterval unless the interval is adaptive. */
+    int     pingTrendThreshold;     /* Percentage of pingTimeout which the 99th percentile of the recent ping round trip times must reach to trigger pingTrendActionList.  0 if disabled. */
+    int     *pingTrendActionList;   /* The action list to take when the ping round trip times approach the ping timeout. */
     int     pingTimedOut;
     int     shutdownTimeout;        /* Number of seconds the wrapper will wait for a JVM to shutdown */
     int     jvmExitTimeout;         /* Number of seconds the wrapper will wait for a JVM to process to terminate */
@@ -329,6 +355,24 @@ struct WrapperConfig {
     int     javaIOBufferSize;       /* Size of the pipe buffer to use for java I/O. */
 #endif
     int     useJavaIOThread;        /* If TRUE then a dedicated thread will be used to process console output form the JVM. */
+    int     javaIOOverflowPolicy;   /* What to do with JVM output which can not be logged as fast as it is produced. */
+    int     javaIOMaxBufferSize;    /* Maximum size in bytes of the buffer holding JVM output which has not yet been logged.  0 for no limit. */
+    int     javaIOOverflowSampleRate; /* One of every this many lines is kept when the SAMPLE overflow policy is used. */
+    int     javaIOOverflowReportInterval; /* Minimum number of seconds between reports of dropped JVM output. */
+    int     javaIODedupWindow;      /* Number of recent distinct lines of JVM output remembered to detect repeats.  0 to disable. */
+    int     javaIODedupThreshold;   /* Number of times a repeated line of JVM output is logged before further repeats are counted instead. */
+    int     javaIODedupThresholdStderr; /* Same as javaIODedupThreshold for output read from a separate stderr pipe. */
+    int     javaIODedupInterval;    /* Number of seconds between reports of repeated JVM output. */
+    int     javaIOMultiline;        /* If TRUE then stack traces and other continuation lines are logged together with the line they follow. */
+    int     javaIOMultilineMaxLines; /* Maximum number of lines in a single multi-line record. */
+    int     javaIOMultilineTimeout; /* Number of milliseconds without new output after which a pending multi-line record is logged. */
+#ifndef WIN32
+    int     javaStderrSeparate;     /* If TRUE then the stderr of the JVM will be read from its own pipe. */
+    int     javaLaunchVfork;        /* If TRUE then the JVM is launched with vfork() rather than fork(). */
+#endif
+#ifdef LINUX
+    int     useJavaIORawPassthrough; /* If TRUE then console output from the JVM will be moved directly into the log file whenever possible. */
+#endif
     int     pauseThreadMain;        /* Number of seconds to pause the main thread on its next loop.  Only used for testing. */
     int     pauseThreadTimer;       /* Number of seconds to pause the timer thread on its next loop.  Only used for testing. */
     int     pauseThreadJavaIO;      /* Number of seconds to pause the javaio thread on its next loop.  Only used for testing. */
@@ -351,8 +395,10 @@ struct WrapperConfig {
     int     jStateTimeoutTicksSet;  /* 1 if the current jStateTimeoutTicks is set. */
     TICKS   lastPingTicks;          /* Time that the last ping was sent */
     TICKS   lastLoggedPingTicks;    /* Time that the last logged ping was sent */
+    unsigned int lastPingRTT;       /* Round trip time in microseconds of the last ping which was answered.  0 until one is. */
     int     environmentLogLevel;    /* Log Level at which the environment variables should be logged. */
     int     isDebugging;            /* TRUE if set in the configuration file */
+    int     isJVMDebugging;         /* TRUE if the JVM should be launched in debug mode.  Same as isDebugging unless only the crash buffer keeps debug messages. */
     int     isAdviserEnabled;       /* TRUE if advice messages should be output. */
     const TCHAR *nativeLibrary;     /* The base name of the native library loaded by the WrapperManager. */
     int     libraryPathAppendPath;  /* TRUE if the PATH environment variable should be appended to the java library path. */
@@ -367,19 +413,16 @@ struct WrapperConfig {
     int     isSleepOutputEnabled;   /* TRUE if detailed sleep output should be included in debug output. */
     int     isMemoryOutputEnabled;  /* TRUE if detailed memory output should be included in status output. */
     int     memoryOutputInterval;   /* Interval in seconds at which memory usage is logged. */
-    TICKS   memoryOutputTimeoutTicks; /* Tick count at which memory will next be logged. */
     int     isCPUOutputEnabled;     /* TRUE if detailed CPU output should be included in status output. */
     int     cpuOutputInterval;      /* Interval in seconds at which CPU usage is logged. */
-    TICKS   cpuOutputTimeoutTicks;  /* Tick count at which CPU will next be logged. */
+    int     isLoopStatsOutputEnabled;/* TRUE if the durations of the main loop phases should be recorded and included in status output. */
+    int     loopStatsOutputInterval;/* Interval in seconds at which the main loop statistics are logged. */
+    int     isPingStatsOutputEnabled;/* TRUE if the ping round trip time statistics should be included in status output. */
+    int     pingStatsOutputInterval;/* Interval in seconds at which the ping statistics are logged. */
     int     isPageFaultOutputEnabled;/* TRUE if detailed PageFault output should be included in status output. */
     int     pageFaultOutputInterval;/* Interval in seconds at which PageFault usage is logged. */
-    TICKS   pageFaultOutputTimeoutTicks; /* Tick count at which PageFault will next be logged. */
     int     logfileFlushTimeout;    /* The number of seconds before the logfile will be flushed. */
-    TICKS   logfileFlushTimeoutTicks; /* Tick count at which the logfile will be flushed. */
-    int     logfileFlushTimeoutTicksSet; /* TRUE if logfileFlushTimeoutTicks is set. */
     int     logfileCloseTimeout;    /* The number of seconds of inactivity before the logfile will be closed. */
-    TICKS   logfileCloseTimeoutTicks; /* Tick count at which the logfile will be considered inactive and closed. */
-    int     logfileCloseTimeoutTicksSet; /* TRUE if logfileCloseTimeoutTicks is set. */
     int     isTestsDisabled;        /* TRUE if the use of tests in the WrapperManager class should be disabled. */
     int     isShutdownHookDisabled; /* TRUE if the use of a shutdown hook by the WrapperManager class should be disabled. */
     int     isForcedShutdownDisabled; /* TRUE if forced shutdowns are disabled. */
@@ -424,10 +467,13 @@ struct WrapperConfig {
     TCHAR   *commandFilename;       /* Name of a command file used to send commands to the Wrapper. */
     int     commandFileTests;       /* True if test commands will be accepted via the command file. */
     int     commandPollInterval;    /* Interval in seconds at which the existence of the command file is polled. */
-    TICKS   commandTimeoutTicks;    /* Tick count at which the command file will be checked next. */
     TCHAR   *anchorFilename;        /* Name of an anchor file used to control when the Wrapper should quit. */
     int     anchorPollInterval;     /* Interval in seconds at which the existence of the anchor file is polled. */
-    TICKS   anchorTimeoutTicks;     /* Tick count at which the anchor file will be checked next. */
+#ifndef WIN32
+    int     watchFiles;             /* TRUE if the command and anchor files should be watched for changes rather than polled. */
+    TCHAR   *controlSocketFilename; /* Path of a Unix socket on which the command file commands are also accepted.  May be NULL. */
+    TCHAR   *statusPageFilename;    /* Path of a memory mapped file in which the main loop publishes the status of the Wrapper.  May be NULL. */
+#endif
     int     umask;                  /* Default umask for all files. */
     int     javaUmask;              /* Default umask for the java process. */
     int     pidFileUmask;           /* Umask to use when creating the pid file. */
@@ -438,6 +484,8 @@ struct WrapperConfig {
     int     javaStatusFileUmask;    /* Umask to use when creating the java status file. */
     int     anchorFileUmask;        /* Umask to use when creating the anchor file. */
 #ifndef WIN32
+    int     controlSocketUmask;     /* Umask to use when creating the control socket. */
+    int     statusPageUmask;        /* Umask to use when creating the status page. */
     int     groupStrict;            /* Whether the Wrapper should stop or not when it detects invalid values for the wrapper.*.group properties while loading the configuration. */
     gid_t   group;                  /* Default group for all files (Unlike umask, I don't think there is a way to automatically specify a default group for each file created by the process because the underlying function needs the filepath. So this member only specifies the default value for the files below). */
  /* gid_t   javaGroup; */           /* Default group for the java process. *//* TODO: can this exist? */
@@ -504,10 +552,10 @@ struct WrapperConfig {
     
     int pendingPingQueueOverflow;   /* Flag which is set to true if the PendingPingQueue overflows the limit of WRAPPER_MAX_PENDING_PINGS. */
     int pendingPingQueueOverflowEmptied; /* Flag which is set when the queue size is reduced to 0 after having overflowed. */
-    int pendingPingCount;           /* Number of PendingPing events in the list. */
-    PPendingPing firstPendingPing;  /* Pointer to the first PendingPing in the list. */
-    PPendingPing firstUnwarnedPendingPing; /* Pointer to the first PendingPing in the list for which a slow warning has not been logged. */
-    PPendingPing lastPendingPing;   /* Pointer to the last PendingPing in the list. */
+    PendingPing pendingPings[WRAPPER_MAX_PENDING_PINGS]; /* Ring of the pings sent to the JVM, in the order of their send ticks.  Answered pings keep their timestamps until the slot is reused. */
+    int pendingPingFirst;           /* Index in pendingPings of the oldest ping which has not been answered. */
+    int pendingPingCount;           /* Number of pings in pendingPings which have not been answered. */
+    int pendingPingWarnedCount;     /* Number of pings from the oldest one for which a slow warning has been logged. */
 
 #ifdef WIN32
     int     ctrlEventCTRLCTrapped;  /* CTRL_C_EVENT trapped. */
@@ -938,6 +986,61 @@ extern int wrapperInitializeRun();
  */
 extern int wrapperSleep(int ms);
 
+/**
+ * Returns a time in microseconds from a monotonic clock, for measuring short durations.  The
+ *  value wraps, so only the difference between two values is meaningful.
+ */
+extern unsigned int wrapperGetMicroTime();
+
+#ifndef WIN32
+/* Maximum number of additional descriptors which can be passed to wrapperSleepUntilEvent(). */
+#define WRAPPER_SLEEP_MAX_FDS       16
+
+/**
+ * Sleeps for up to the specified number of milliseconds, returning as soon as the JVM process
+ *  exits, a watched file changes or one of the specified descriptors has input.  Behaves as
+ *  wrapperSleep() if there is nothing to wait for.
+ *
+ * @param ms Number of milliseconds to wait for.
+ * @param fds Additional descriptors to wait for input on.  May be NULL if fdCount is 0.
+ * @param fdCount Number of descriptors in fds, at most WRAPPER_SLEEP_MAX_FDS.
+ *
+ * @return TRUE if the sleep was interrupted, the JVM exited, a watched file changed or a descriptor has input, FALSE otherwise.  Neither is an error.
+ */
+extern int wrapperSleepUntilEvent(int ms, const int *fds, int fdCount);
+
+#define WRAPPER_FILE_WATCH_ANCHOR   1
+#define WRAPPER_FILE_WATCH_COMMAND  2
+
+/**
+ * Starts watching the command and anchor files if they are configured.  Files which can not
+ *  be watched are polled as before.
+ */
+extern void wrapperStartFileWatch();
+
+/**
+ * Returns TRUE if changes to the specified file are currently watched, in which case it does
+ *  not need to be polled.
+ *
+ * @param watch WRAPPER_FILE_WATCH_ANCHOR or WRAPPER_FILE_WATCH_COMMAND.
+ * @param path The currently configured path of the file.
+ */
+extern int wrapperIsFileWatched(int watch, const TCHAR *path);
+
+/**
+ * Reads any pending file watch events without waiting.
+ *
+ * @return A combination of WRAPPER_FILE_WATCH_ANCHOR and WRAPPER_FILE_WATCH_COMMAND for the
+ *         files which need to be checked.
+ */
+extern int wrapperReadFileWatchEvents();
+
+/**
+ * Stops watching the command and anchor files.
+ */
+extern void wrapperStopFileWatch();
+#endif
+
 /**
  * Reports the status of the wrapper to the service manager
  * Possible status values:
@@ -960,6 +1063,40 @@ extern void wrapperReportStatus(int useLoggerQueue, int status, int errorCode, i
  */
 extern int wrapperReadChildOutputBlock(char *blockBuffer, int blockSize, int *readCount);
 
+#ifndef WIN32
+/**
+ * Reads a single block of data from the child stderr pipe.  Only used when
+ *  wrapper.java.stderr.separate is set.
+ *
+ * @param blockBuffer Pointer to the buffer where the block will be read.
+ * @param blockSize Maximum number of bytes to read.
+ * @param readCount Pointer to an int which will hold the number of bytes
+ *                  actually read by the call.
+ *
+ * Returns TRUE if there were any problems, FALSE otherwise.
+ */
+extern int wrapperReadChildErrorBlock(char *blockBuffer, int blockSize, int *readCount);
+#endif
+
+#ifdef LINUX
+/**
+ * Moves any output available in the child pipe directly into the log file
+ *  without processing it.
+ *
+ * @param readCount Pointer to an int which will hold the number of bytes
+ *                  actually moved by the call.
+ *
+ * Returns TRUE if the output could not be moved and must be read normally, FALSE otherwise.
+ */
+extern int wrapperReadChildOutputRaw(int *readCount);
+
+/**
+ * Returns the length of the first line waiting in the child pipe, including its
+ *  line feed, or 0 if there is no complete line.  The pipe is not read.
+ */
+extern int wrapperPeekChildOutputLine();
+#endif
+
 /**
  * Checks on the status of the JVM Process.
  * Returns WRAPPER_PROCESS_UP or WRAPPER_PROCESS_DOWN
@@ -1018,6 +1155,11 @@ extern void wrapperDumpMemory();
  */
 extern void wrapperDumpCPUUsage();
 
+/**
+ * Returns the number of lines of JVM output which were dropped since the Wrapper was started.
+ */
+extern unsigned int wrapperGetDroppedJavaOutputLines();
+
 /******************************************************************************
  * Wrapper inner methods.
  *****************************************************************************/
@@ -1149,6 +1291,15 @@ extern int getStateOutputModeForName(const TCHAR *name);
  */
 extern void wrapperEventLoop();
 
+/**
+ * Records the round trip time of a ping answered by a started JVM.  This updates the ping
+ *  statistics, adapts the ping interval if wrapper.ping.interval.adaptive is set, and checks
+ *  whether the round trip times are approaching wrapper.ping.timeout.
+ *
+ * @param micros The round trip time in microseconds.
+ */
+extern void wrapperRecordPingRTT(unsigned int micros);
+
 extern void wrapperBuildKey();
 
 /**
@@ -1294,5 +1445,11 @@ struct LoadParameterFileCallbackParam {
 
 #ifdef CUNIT
 extern void tsJAP_testJavaAdditionalParamSuite(void);
+extern void tsCO_testShedChildOutput(void);
+extern void tsCO_testDedupChildOutput(void);
+extern void tsCO_testChildOutputContinuation(void);
+extern void tsLOOP_testDeadlineHeap(void);
+extern void tsLOOP_testHistogram(void);
+extern void tsLOOP_testPingRTT(void);
 #endif /* CUNIT */
 #endif
@@ -507,22 +507,29 @@ TCHAR *_tsetlocale(int category, const TCHAR *locale) {
     return NULL;
 }
 
-int createWideFormat(const wchar_t *fmt, wchar_t **wFmt) {
-    int i, result;
+int createWideFormat(const wchar_t *fmt, wchar_t *buffer, wchar_t **wFmt) {
+    size_t i, len;
+    int result;
     
     if (wcsstr(fmt, TEXT("%s")) != NULL) {
-        *wFmt = malloc(sizeof(wchar_t) * (wcslen(fmt) + 1));
+        len = wcslen(fmt);
+        if (len < WIDE_FORMAT_BUFFER_SIZE) {
+            *wFmt = buffer;
+            result = FALSE;
+        } else {
+            *wFmt = malloc(sizeof(wchar_t) * (len + 1));
+            result = TRUE;
+        }
         if (*wFmt) {
-            wcsncpy(*wFmt, fmt, wcslen(fmt) + 1);
-            for (i = 0; i < wcslen(fmt); i++){
-                if (fmt[i] == TEXT('%') && i  < wcslen(fmt) && fmt[i + 1] == TEXT('s') && (i == 0 || fmt[i - 1] != TEXT('%'))) {
+            for (i = 0; i < len; i++) {
+                (*wFmt)[i] = fmt[i];
+                if ((fmt[i] == TEXT('%')) && (fmt[i + 1] == TEXT('s')) && ((i == 0) || (fmt[i - 1] != TEXT('%')))) {
                     (*wFmt)[i + 1] = TEXT('S');
                     i++;
                 }
             }
-            (*wFmt)[wcslen(fmt)] = TEXT('\0');
+            (*wFmt)[len] = TEXT('\0');
         }
-        result = TRUE;
     } else {
         *wFmt = (wchar_t*)fmt;
         result = FALSE;
@@ -532,10 +539,11 @@ int createWideFormat(const wchar_t *fmt, wchar_t **wFmt) {
 
 int _tprintf(const wchar_t *fmt,...) {
     int i, flag;
+    wchar_t buffer[WIDE_FORMAT_BUFFER_SIZE];
     wchar_t *wFmt = NULL;
     va_list args;
 
-    flag = createWideFormat(fmt, &wFmt);
+    flag = createWideFormat(fmt, buffer, &wFmt);
     if (wFmt) {
         va_start(args, fmt);
         i = vwprintf(wFmt, args);
@@ -550,10 +558,11 @@ int _tprintf(const wchar_t *fmt,...) {
 
 int _ftprintf(FILE *stream, const wchar_t *fmt, ...) {
     int i, flag;
+    wchar_t buffer[WIDE_FORMAT_BUFFER_SIZE];
     wchar_t *wFmt = NULL;
     va_list args;
 
-    flag = createWideFormat(fmt, &wFmt);
+    flag = createWideFormat(fmt, buffer, &wFmt);
     if (wFmt) {
         va_start(args, fmt);
         i = vfwprintf(stream, wFmt, args);
@@ -568,10 +577,11 @@ int _ftprintf(FILE *stream, const wchar_t *fmt, ...) {
 
 int _sntprintf(TCHAR *str, size_t size, const TCHAR *fmt, ...) {
     int i, flag;
+    wchar_t buffer[WIDE_FORMAT_BUFFER_SIZE];
     wchar_t *wFmt = NULL;
     va_list args;
 
-    flag = createWideFormat(fmt, &wFmt);
+    flag = createWideFormat(fmt, buffer, &wFmt);
     if (wFmt) {
         va_start(args, fmt);
         i = vswprintf(str, size, wFmt, args);
@@ -58,6 +58,21 @@ typedef wchar_t TCHAR;
 typedef wchar_t _TUCHAR;
 
 extern int _tprintf(const wchar_t *fmt,...) ;
+
+/* Formats which are shorter than this are converted on the stack by createWideFormat(). */
+#define WIDE_FORMAT_BUFFER_SIZE 256
+
+/**
+ * Converts all '%s' patterns of a format to '%S' so that wide strings are displayed correctly.
+ *
+ * @param fmt The format to convert.
+ * @param buffer A buffer of WIDE_FORMAT_BUFFER_SIZE characters to hold the converted format if it fits.
+ * @param wFmt Set to the format to use.  This is fmt itself if there was nothing to convert, buffer,
+ *             or a copy which must be freed if TRUE is returned.  NULL if out of memory.
+ *
+ * @return TRUE if *wFmt was allocated.
+ */
+extern int createWideFormat(const wchar_t *fmt, wchar_t *buffer, wchar_t **wFmt);
 extern int multiByteToWideChar(const char *multiByteChars, const char *multiByteEncoding, char *interumEncoding, wchar_t **outputBuffer, int localizeErrorMessage);
 extern int converterMBToWide(const char *multiByteChars, const char *multiByteEncoding, wchar_t **outputBufferW, int localizeErrorMessage);
 
@@ -0,0 +1,517 @@
+/*
+ * Copyright (c) 1999, 2020 Tanuki Software, Ltd.
+ * http://www.tanukisoftware.com
+ * All rights reserved.
+ *
+ * This software is the proprietary information of Tanuki Software.
+ * You shall use it only in accordance with the terms of the
+ * license agreement you entered into with Tanuki Software.
+ * http://wrapper.tanukisoftware.com/doc/english/licenseOverview.html
+ */
+
+/**
+ * Author:
+ *   Tanuki Software Development Team <support@tanukisoftware.com>
+ */
+
+/**
+ * wrapper-logcat prints log files written with wrapper.logfile.format=BINARY
+ *  as text, using the same columns as the text log file formats.
+ *
+ * Usage: wrapper-logcat [-f <format>] [file ...]
+ *  Standard input is read if no file is specified.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <locale.h>
+#include <time.h>
+
+#include "logger.h"
+#include "wrapper_i18n.h"
+#ifdef CUNIT
+#include "CUnit/Basic.h"
+#endif
+
+#ifndef TRUE
+#define TRUE -1
+#endif
+
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+/* Buffers reused for each record. */
+#ifndef CUNIT
+static unsigned char *recordBuffer = NULL;
+static size_t recordBufferSize = 0;
+#endif
+static TCHAR *messageBuffer = NULL;
+static size_t messageBufferSize = 0;
+
+#ifndef CUNIT
+static void usage() {
+    _tprintf(TEXT("Usage: wrapper-logcat [-f <format>] [file ...]\n"));
+    _tprintf(TEXT("\n"));
+    _tprintf(TEXT("Prints log files written with wrapper.logfile.format=BINARY as text.\n"));
+    _tprintf(TEXT("  -f <format>  Columns to print, as with wrapper.logfile.format.  (Default: %s)\n"), LOG_FORMAT_LOGFILE_DEFAULT);
+    _tprintf(TEXT("Standard input is read if no file is specified.\n"));
+}
+#endif
+
+/**
+ * Reads a varint.
+ *
+ * @return TRUE if the end of the file was reached or the value is invalid.
+ */
+static int readVarint(FILE *in, unsigned long *value) {
+    int c;
+    int shift = 0;
+
+    *value = 0;
+    do {
+        if ((c = getc(in)) == EOF) {
+            return TRUE;
+        }
+        if (shift >= (int)(sizeof(unsigned long) * 8)) {
+            return TRUE;
+        }
+        *value |= ((unsigned long)(c & 0x7F)) << shift;
+        shift += 7;
+    } while (c & 0x80);
+
+    return FALSE;
+}
+
+static long unzigzag(unsigned long value) {
+    if (value & 1) {
+        return -(long)(value >> 1) - 1;
+    } else {
+        return (long)(value >> 1);
+    }
+}
+
+/**
+ * Decodes UTF-8 into messageBuffer.  Invalid sequences are replaced with U+FFFD.
+ *
+ * @return TRUE if there was not enough memory.
+ */
+static int decodeMessage(const unsigned char *str, size_t len) {
+    size_t i = 0;
+    size_t count;
+    unsigned long c;
+    unsigned long minValue;
+    TCHAR *pos;
+
+    /* Never more characters than bytes. */
+    if (messageBufferSize < len + 1) {
+        if (messageBuffer) {
+            free(messageBuffer);
+        }
+        messageBuffer = malloc(sizeof(TCHAR) * (len + 1));
+        if (!messageBuffer) {
+            messageBufferSize = 0;
+            return TRUE;
+        }
+        messageBufferSize = len + 1;
+    }
+    pos = messageBuffer;
+
+    while (i < len) {
+#ifdef UNICODE
+        c = str[i++];
+        if (c < 0x80) {
+            count = 0;
+            minValue = 0;
+        } else if ((c & 0xE0) == 0xC0) {
+            c &= 0x1F;
+            count = 1;
+            minValue = 0x80;
+        } else if ((c & 0xF0) == 0xE0) {
+            c &= 0x0F;
+            count = 2;
+            minValue = 0x800;
+        } else if ((c & 0xF8) == 0xF0) {
+            c &= 0x07;
+            count = 3;
+            minValue = 0x10000;
+        } else {
+            *(pos++) = (TCHAR)0xFFFD;
+            continue;
+        }
+        while ((count > 0) && (i < len) && ((str[i] & 0xC0) == 0x80)) {
+            c = (c << 6) | (str[i++] & 0x3F);
+            count--;
+        }
+        if ((count > 0) || (c < minValue) || (c > 0x10FFFF)) {
+            /* Truncated, overlong or out of range. */
+            c = 0xFFFD;
+        }
+ #ifdef WIN32
+        if (c >= 0x10000) {
+            /* The buffer is large enough as such a character used 4 bytes. */
+            c -= 0x10000;
+            *(pos++) = (TCHAR)(0xD800 + (c >> 10));
+            c = 0xDC00 + (c & 0x3FF);
+        }
+ #endif
+        *(pos++) = (TCHAR)c;
+#else
+        *(pos++) = (TCHAR)str[i++];
+#endif
+    }
+    *pos = TEXT('\0');
+
+    return FALSE;
+}
+
+#ifndef CUNIT
+/**
+ * Prints all records of a binary log file.
+ *
+ * @return TRUE if the file is not a binary log file or is corrupted.
+ */
+static int printLogFile(FILE *in, const TCHAR *name, const TCHAR *format) {
+    char signature[LOG_BINARY_SIGNATURE_LEN];
+    int flags;
+    unsigned long value;
+    time_t now = 0;
+    long micros = 0;
+    long delta;
+    int level;
+    int sourceId;
+    int threadId;
+    time_t durationMillis;
+    unsigned long uptime;
+    unsigned long len;
+    struct tm *nowTM;
+    TCHAR *line;
+    TCHAR *nextLF;
+    TCHAR *printBuffer;
+
+    if ((fread(signature, 1, LOG_BINARY_SIGNATURE_LEN, in) != LOG_BINARY_SIGNATURE_LEN) || (memcmp(signature, LOG_BINARY_SIGNATURE, LOG_BINARY_SIGNATURE_LEN) != 0)) {
+        _ftprintf(stderr, TEXT("%s: Not a binary log file.\n"), name);
+        return TRUE;
+    }
+
+    while ((flags = getc(in)) != EOF) {
+        level = flags & LOG_BINARY_LEVEL_MASK;
+        if ((level > LEVEL_NONE) || (flags & ~(LOG_BINARY_FLAG_ABSOLUTE | LOG_BINARY_FLAG_QUEUED | LOG_BINARY_LEVEL_MASK))) {
+            _ftprintf(stderr, TEXT("%s: Corrupted record.\n"), name);
+            return TRUE;
+        }
+        if (flags & LOG_BINARY_FLAG_ABSOLUTE) {
+            if (readVarint(in, &value)) {
+                break;
+            }
+            now = (time_t)value;
+            if (readVarint(in, &value)) {
+                break;
+            }
+            micros = (long)value;
+        } else {
+            if (readVarint(in, &value)) {
+                break;
+            }
+            delta = unzigzag(value) + micros;
+            /* Normalize so the microseconds are in the range 0..999999. */
+            now += delta / 1000000;
+            micros = delta % 1000000;
+            if (micros < 0) {
+                now--;
+                micros += 1000000;
+            }
+        }
+        if (readVarint(in, &value)) {
+            break;
+        }
+        sourceId = (int)unzigzag(value);
+        if (readVarint(in, &value)) {
+            break;
+        }
+        threadId = (int)unzigzag(value);
+        if (readVarint(in, &value)) {
+            break;
+        }
+        durationMillis = (value == 0) ? (time_t)-1 : (time_t)(value - 1);
+        if (readVarint(in, &uptime)) {
+            break;
+        }
+        if (readVarint(in, &len)) {
+            break;
+        }
+
+        if (recordBufferSize < len) {
+            if (recordBuffer) {
+                free(recordBuffer);
+            }
+            recordBuffer = malloc(len);
+            if (!recordBuffer) {
+                recordBufferSize = 0;
+                _ftprintf(stderr, TEXT("Out of memory (%s)\n"), TEXT("PLF1"));
+                return TRUE;
+            }
+            recordBufferSize = len;
+        }
+        if (fread(recordBuffer, 1, len, in) != len) {
+            break;
+        }
+        if (decodeMessage(recordBuffer, len)) {
+            _ftprintf(stderr, TEXT("Out of memory (%s)\n"), TEXT("PLF2"));
+            return TRUE;
+        }
+
+        setUptime((uptime == 0) ? 0 : (int)(uptime - 1), (uptime == 0) ? TRUE : FALSE);
+        nowTM = localtime(&now);
+        /* Multi-line messages are stored as a single record.  Print each line with its own columns as in the text formats. */
+        line = messageBuffer;
+        do {
+            nextLF = _tcschr(line, TEXT('\n'));
+            if (nextLF) {
+                nextLF[0] = TEXT('\0');
+            }
+            printBuffer = buildPrintBuffer(sourceId, level, threadId, (flags & LOG_BINARY_FLAG_QUEUED) ? TRUE : FALSE, nowTM, (int)(micros / 1000), durationMillis, format, LOG_FORMAT_LOGFILE_DEFAULT, line);
+            if (!printBuffer) {
+                return TRUE;
+            }
+            _tprintf(TEXT("%s\n"), printBuffer);
+            if (nextLF) {
+                line = &(nextLF[1]);
+            }
+        } while (nextLF);
+    }
+
+    if (!feof(in)) {
+        _ftprintf(stderr, TEXT("%s: Unable to read the file or corrupted record.\n"), name);
+        return TRUE;
+    } else if (flags != EOF) {
+        _ftprintf(stderr, TEXT("%s: Truncated record.\n"), name);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/**
+ * Converts a native string for use with the TCHAR functions.  The returned string must be freed.
+ */
+static TCHAR* toTString(const char *str) {
+    TCHAR *result;
+#ifdef UNICODE
+    size_t req;
+
+    req = mbstowcs(NULL, str, MBSTOWCS_QUERY_LENGTH);
+    if (req == (size_t)-1) {
+        return NULL;
+    }
+    result = malloc(sizeof(TCHAR) * (req + 1));
+    if (result) {
+        mbstowcs(result, str, req + 1);
+        result[req] = TEXT('\0');
+    }
+#else
+    result = malloc(strlen(str) + 1);
+    if (result) {
+        strcpy(result, str);
+    }
+#endif
+    return result;
+}
+
+int main(int argc, char **argv) {
+    TCHAR *format = NULL;
+    TCHAR *name;
+    FILE *in;
+    int i = 1;
+    int files = 0;
+    int result = 0;
+
+#ifdef FREEBSD
+    /* iconv is loaded dynamically on FreeBSD. */
+    if (loadIconvLibrary()) {
+        return 1;
+    }
+#endif
+    setlocale(LC_ALL, "");
+
+    if ((i < argc) && ((strcmp(argv[i], "-?") == 0) || (strcmp(argv[i], "--help") == 0))) {
+        usage();
+        return 0;
+    }
+    if ((i < argc) && (strcmp(argv[i], "-f") == 0)) {
+        if (i + 1 >= argc) {
+            usage();
+            return 1;
+        }
+        format = toTString(argv[i + 1]);
+        if (!format) {
+            _ftprintf(stderr, TEXT("Invalid format.\n"));
+            return 1;
+        }
+        i += 2;
+    }
+
+    for (; i < argc; i++) {
+        files++;
+        name = toTString(argv[i]);
+        if (!name) {
+            _ftprintf(stderr, TEXT("Encoding problem with arguments.\n"));
+            result = 1;
+            continue;
+        }
+        if ((in = fopen(argv[i], "rb")) == NULL) {
+            _ftprintf(stderr, TEXT("%s: Unable to open file.\n"), name);
+            result = 1;
+        } else {
+            if (printLogFile(in, name, format ? format : LOG_FORMAT_LOGFILE_DEFAULT)) {
+                result = 1;
+            }
+            fclose(in);
+        }
+        free(name);
+    }
+    if (files == 0) {
+        if (printLogFile(stdin, TEXT("<stdin>"), format ? format : LOG_FORMAT_LOGFILE_DEFAULT)) {
+            result = 1;
+        }
+    }
+
+    if (format) {
+        free(format);
+    }
+    if (recordBuffer) {
+        free(recordBuffer);
+    }
+    if (messageBuffer) {
+        free(messageBuffer);
+    }
+    return result;
+}
+#endif
+
+#ifdef CUNIT
+static void tsLCAT_subTestReadVarint(const char *bytes, size_t len, int expectedResult, unsigned long expected) {
+    FILE *in;
+    unsigned long value;
+    int result;
+
+    in = tmpfile();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(in);
+    fwrite(bytes, 1, len, in);
+    rewind(in);
+
+    result = readVarint(in, &value);
+    if (expectedResult) {
+        CU_ASSERT_TRUE(result);
+    } else {
+        CU_ASSERT_FALSE(result);
+        CU_ASSERT_EQUAL(value, expected);
+        CU_ASSERT_EQUAL(getc(in), EOF);
+    }
+    fclose(in);
+}
+
+void tsLCAT_testVarint(void) {
+    unsigned long maxValue = (unsigned long)-1;
+    long maxLong = (long)(maxValue >> 1);
+    long signedValues[] = { 0, 1, -1, 2, -2, 63, -64, 64, -65, 8191, -8192, 8192, -8193 };
+    unsigned char buffer[16];
+    char tooLong[16];
+    unsigned long value;
+    unsigned long expected;
+    size_t len;
+    size_t i;
+    int bit;
+    FILE *in;
+
+    tsLCAT_subTestReadVarint("\x00", 1, FALSE, 0);
+    tsLCAT_subTestReadVarint("\x7f", 1, FALSE, 0x7F);
+    tsLCAT_subTestReadVarint("\x80\x01", 2, FALSE, 0x80);
+    tsLCAT_subTestReadVarint("\xff\x7f", 2, FALSE, 0x3FFF);
+    tsLCAT_subTestReadVarint("\x80\x80\x01", 3, FALSE, 0x4000);
+
+    /* Truncated, and longer than an unsigned long. */
+    tsLCAT_subTestReadVarint("", 0, TRUE, 0);
+    tsLCAT_subTestReadVarint("\x80", 1, TRUE, 0);
+    tsLCAT_subTestReadVarint("\xff\xff", 2, TRUE, 0);
+    len = (sizeof(unsigned long) * 8 + 6) / 7 + 1;
+    memset(tooLong, 0x80, len - 1);
+    tooLong[len - 1] = 0x01;
+    tsLCAT_subTestReadVarint(tooLong, len, TRUE, 0);
+
+    /* Round trip of the values around each 7 bit boundary, written one after the other. */
+    in = tmpfile();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(in);
+    for (bit = 0; bit < (int)(sizeof(unsigned long) * 8); bit += 7) {
+        for (value = (1UL << bit) - 1; value <= (1UL << bit) + 1; value++) {
+            len = tsLOG_putBinaryVarint(buffer, value);
+            fwrite(buffer, 1, len, in);
+        }
+    }
+    len = tsLOG_putBinaryVarint(buffer, maxValue);
+    fwrite(buffer, 1, len, in);
+    rewind(in);
+    for (bit = 0; bit < (int)(sizeof(unsigned long) * 8); bit += 7) {
+        for (expected = (1UL << bit) - 1; expected <= (1UL << bit) + 1; expected++) {
+            CU_ASSERT_FALSE(readVarint(in, &value));
+            CU_ASSERT_EQUAL(value, expected);
+        }
+    }
+    CU_ASSERT_FALSE(readVarint(in, &value));
+    CU_ASSERT_EQUAL(value, maxValue);
+    CU_ASSERT_TRUE(readVarint(in, &value));
+    fclose(in);
+
+    /* Round trip of signed values. */
+    for (i = 0; i < sizeof(signedValues) / sizeof(long); i++) {
+        CU_ASSERT_EQUAL(unzigzag(tsLOG_zigzagBinary(signedValues[i])), signedValues[i]);
+    }
+    CU_ASSERT_EQUAL(unzigzag(tsLOG_zigzagBinary(maxLong)), maxLong);
+    CU_ASSERT_EQUAL(unzigzag(tsLOG_zigzagBinary(-maxLong - 1)), -maxLong - 1);
+}
+
+static void tsLCAT_subTestDecodeMessage(const char *bytes, const TCHAR *expected) {
+    CU_ASSERT_FALSE_FATAL(decodeMessage((const unsigned char *)bytes, strlen(bytes)));
+    CU_ASSERT(_tcscmp(messageBuffer, expected) == 0);
+}
+
+static void tsLCAT_subTestMessageRoundTrip(const TCHAR *str) {
+    unsigned char buffer[256];
+    size_t len;
+
+    len = tsLOG_putBinaryString(buffer, str);
+    CU_ASSERT_FALSE_FATAL(decodeMessage(buffer, len));
+    CU_ASSERT(_tcscmp(messageBuffer, str) == 0);
+}
+
+void tsLCAT_testDecodeMessage(void) {
+    tsLCAT_subTestMessageRoundTrip(TEXT(""));
+    tsLCAT_subTestMessageRoundTrip(TEXT("Exception in thread \"main\"\n\tat Main.main(Main.java:1)"));
+#ifdef UNICODE
+    tsLCAT_subTestMessageRoundTrip(TEXT("\x7f\x80\x7ff\x800\x20ac\xfffd\xffff"));
+ #ifndef WIN32
+    tsLCAT_subTestMessageRoundTrip(TEXT("\x10000\x1f600\x10ffff"));
+ #else
+    tsLCAT_subTestMessageRoundTrip(TEXT("\xd800\xdc00\xd83d\xde00\xdbff\xdfff"));
+ #endif
+
+    /* Invalid sequences are replaced, without losing the characters which follow. */
+    tsLCAT_subTestDecodeMessage("\x80", TEXT("\xfffd"));
+    tsLCAT_subTestDecodeMessage("a\xff" "b", TEXT("a\xfffd") TEXT("b"));
+    tsLCAT_subTestDecodeMessage("\xf8\x88\x80\x80\x80", TEXT("\xfffd\xfffd\xfffd\xfffd\xfffd"));
+    /* Truncated. */
+    tsLCAT_subTestDecodeMessage("\xe2\x82", TEXT("\xfffd"));
+    tsLCAT_subTestDecodeMessage("\xe2\x82" "A", TEXT("\xfffd") TEXT("A"));
+    tsLCAT_subTestDecodeMessage("\xf0\x9f\x98", TEXT("\xfffd"));
+    tsLCAT_subTestDecodeMessage("\xc3", TEXT("\xfffd"));
+    /* Overlong, and above U+10FFFF. */
+    tsLCAT_subTestDecodeMessage("\xc0\x80" "A", TEXT("\xfffd") TEXT("A"));
+    tsLCAT_subTestDecodeMessage("\xe0\x80\xaf", TEXT("\xfffd"));
+    tsLCAT_subTestDecodeMessage("\xf4\x90\x80\x80", TEXT("\xfffd"));
+#endif
+
+    free(messageBuffer);
+    messageBuffer = NULL;
+    messageBufferSize = 0;
+}
+#endif /* CUNIT */
@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 1999, 2020 Tanuki Software, Ltd.
+ * http://www.tanukisoftware.com
+ * All rights reserved.
+ *
+ * This software is the proprietary information of Tanuki Software.
+ * You shall use it only in accordance with the terms of the
+ * license agreement you entered into with Tanuki Software.
+ * http://wrapper.tanukisoftware.com/doc/english/licenseOverview.html
+ */
+
+/**
+ * Author:
+ *   Tanuki Software Development Team <support@tanukisoftware.com>
+ */
+
+/**
+ * wrapper-status prints the status pages published with wrapper.statuspage
+ *  as name=value lines, one block per page.
+ *
+ * Usage: wrapper-status file ...
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "wrapper.h"
+#include "wrapper_statuspage.h"
+
+static const char *wStateNames[] = {
+    "STARTING", "STARTED", "PAUSING", "PAUSED", "RESUMING", "STOPPING", "STOPPED"
+};
+
+static const char *jStateNames[] = {
+    "DOWN_CHECK", "DOWN_FLUSH", "DOWN_CLEAN", "LAUNCH(DELAY)", "RESTART", "LAUNCH", "LAUNCHING", "LAUNCHED",
+    "STARTING", "STARTED", "STOP", "STOPPING", "STOPPED", "KILLING", "KILL", "KILLED"
+};
+
+static void usage() {
+    printf("Usage: wrapper-status file ...\n");
+    printf("\n");
+    printf("Prints the status pages published with wrapper.statuspage.\n");
+}
+
+static const char *getStateName(unsigned int state, unsigned int first, const char **names, unsigned int count) {
+    if ((state < first) || (state - first >= count)) {
+        return "UNKNOWN";
+    }
+    return names[state - first];
+}
+
+/**
+ * Prints a status page.
+ *
+ * @return TRUE if the file is not a status page or no consistent copy could be taken.
+ */
+static int printStatusPage(const char *path) {
+    WrapperStatusPage *page;
+    WrapperStatusPage copy;
+    struct stat fileStat;
+    size_t mappedSize;
+    int fd;
+    int result;
+
+    if ((fd = open(path, O_RDONLY)) == -1) {
+        fprintf(stderr, "%s: Unable to open file.\n", path);
+        return TRUE;
+    }
+    /* Pages written by older Wrappers are shorter.  Only map what the file contains. */
+    if ((fstat(fd, &fileStat) == -1) || (fileStat.st_size < (off_t)WRAPPER_STATUS_PAGE_SIZE_V1)) {
+        fprintf(stderr, "%s: Not a status page.\n", path);
+        close(fd);
+        return TRUE;
+    }
+    mappedSize = (fileStat.st_size < (off_t)sizeof(WrapperStatusPage)) ? (size_t)fileStat.st_size : sizeof(WrapperStatusPage);
+    page = (WrapperStatusPage *)mmap(NULL, mappedSize, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (page == (WrapperStatusPage *)MAP_FAILED) {
+        fprintf(stderr, "%s: Unable to map file.\n", path);
+        return TRUE;
+    }
+
+    result = readStatusPage(page, mappedSize, &copy);
+    munmap((void *)page, mappedSize);
+    if (result) {
+        fprintf(stderr, "%s: Not a status page, or it is being updated too often.\n", path);
+        return TRUE;
+    }
+
+    printf("file=%s\n", path);
+    printf("version=%u\n", copy.version);
+    printf("wrapper.pid=%u\n", copy.wrapperPID);
+    printf("wrapper.state=%s\n", getStateName(copy.wState, WRAPPER_WSTATE_STARTING, wStateNames, sizeof(wStateNames) / sizeof(wStateNames[0])));
+    printf("java.state=%s\n", getStateName(copy.jState, WRAPPER_JSTATE_DOWN_CHECK, jStateNames, sizeof(jStateNames) / sizeof(jStateNames[0])));
+    printf("java.pid=%u\n", copy.javaPID);
+    printf("java.restarts=%u\n", copy.jvmRestarts);
+    printf("uptime=%u\n", copy.uptimeSeconds);
+    printf("ping.rtt_us=%u\n", copy.lastPingRTT);
+    printf("log.bytes=%.0f\n", (double)copy.logBytesHigh * 4294967296.0 + (double)copy.logBytesLow);
+    printf("log.dropped=%u\n", copy.logMessagesDropped);
+    printf("java.dropped_lines=%u\n", copy.javaLinesDropped);
+    /* Version 2 fields.  Each one is only printed if the page contains it. */
+    if (WRAPPER_STATUS_PAGE_HAS_FIELD(&copy, pingRTTSmoothed)) {
+        printf("ping.rtt_smoothed_us=%u\n", copy.pingRTTSmoothed);
+    }
+    if (WRAPPER_STATUS_PAGE_HAS_FIELD(&copy, pingRTTJitter)) {
+        printf("ping.rtt_jitter_us=%u\n", copy.pingRTTJitter);
+    }
+    if (WRAPPER_STATUS_PAGE_HAS_FIELD(&copy, pingRTTRecentP99)) {
+        printf("ping.rtt_p99_us=%u\n", copy.pingRTTRecentP99);
+    }
+    if (WRAPPER_STATUS_PAGE_HAS_FIELD(&copy, pingInterval)) {
+        printf("ping.interval=%u\n", copy.pingInterval);
+    }
+    /* A page which is no longer updated was left behind by a Wrapper which was killed. */
+    printf("updated=%lds\n", (long)(time(NULL) - (time_t)copy.updateTime));
+    return FALSE;
+}
+
+int main(int argc, char **argv) {
+    int i;
+    int result = 0;
+
+    if ((argc < 2) || (strcmp(argv[1], "-?") == 0) || (strcmp(argv[1], "--help") == 0)) {
+        usage();
+        return (argc < 2) ? 1 : 0;
+    }
+
+    for (i = 1; i < argc; i++) {
+        if (i > 1) {
+            printf("\n");
+        }
+        if (printStatusPage(argv[i])) {
+            result = 1;
+        }
+    }
+    return result;
+}
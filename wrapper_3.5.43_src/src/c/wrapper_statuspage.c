@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 1999, 2020 Tanuki Software, Ltd.
+ * http://www.tanukisoftware.com
+ * All rights reserved.
+ *
+ * This software is the proprietary information of Tanuki Software.
+ * You shall use it only in accordance with the terms of the
+ * license agreement you entered into with Tanuki Software.
+ * http://wrapper.tanukisoftware.com/doc/english/licenseOverview.html
+ */
+
+/**
+ * Author:
+ *   Tanuki Software Development Team <support@tanukisoftware.com>
+ */
+
+#include "wrapper_statuspage.h"
+
+#ifndef WIN32
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#ifndef TRUE
+#define TRUE -1
+#endif
+
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+/* Memory barriers ordering the sequence with the fields.  Compilers without them fall back to
+ *  the volatile sequence alone, which is enough on platforms which do not reorder stores. */
+#if defined(__GNUC__)
+ #define STATUS_PAGE_BARRIER() __sync_synchronize()
+#else
+ #define STATUS_PAGE_BARRIER()
+#endif
+
+/* Number of times a reader tries to get a consistent copy before giving up. */
+#define STATUS_PAGE_READ_ATTEMPTS 1000
+
+WrapperStatusPage *mapStatusPage(int fd) {
+    WrapperStatusPage *page;
+
+    if (ftruncate(fd, sizeof(WrapperStatusPage)) == -1) {
+        return NULL;
+    }
+    page = (WrapperStatusPage *)mmap(NULL, sizeof(WrapperStatusPage), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (page == (WrapperStatusPage *)MAP_FAILED) {
+        return NULL;
+    }
+
+    /* The file is zero filled.  The magic is written last so readers never see a partial header. */
+    page->version = WRAPPER_STATUS_PAGE_VERSION;
+    page->size = sizeof(WrapperStatusPage);
+    page->wrapperPID = (unsigned int)getpid();
+    STATUS_PAGE_BARRIER();
+    page->magic = WRAPPER_STATUS_PAGE_MAGIC;
+    return page;
+}
+
+void beginStatusPageUpdate(WrapperStatusPage *page) {
+    page->sequence++;
+    STATUS_PAGE_BARRIER();
+}
+
+void endStatusPageUpdate(WrapperStatusPage *page) {
+    page->updateTime = (unsigned int)time(NULL);
+    STATUS_PAGE_BARRIER();
+    page->sequence++;
+}
+
+void unmapStatusPage(WrapperStatusPage *page) {
+    munmap((void *)page, sizeof(WrapperStatusPage));
+}
+
+int readStatusPage(const WrapperStatusPage *page, size_t mappedSize, WrapperStatusPage *copy) {
+    unsigned int sequence;
+    size_t copySize;
+    int i;
+
+    if ((mappedSize < WRAPPER_STATUS_PAGE_SIZE_V1) || (page->magic != WRAPPER_STATUS_PAGE_MAGIC)) {
+        return TRUE;
+    }
+    /* Pages written by older Wrappers are shorter, and fields added later are ignored. */
+    copySize = (mappedSize < sizeof(WrapperStatusPage)) ? mappedSize : sizeof(WrapperStatusPage);
+    if (page->size < copySize) {
+        copySize = page->size;
+    }
+    if (copySize < WRAPPER_STATUS_PAGE_SIZE_V1) {
+        return TRUE;
+    }
+    for (i = 0; i < STATUS_PAGE_READ_ATTEMPTS; i++) {
+        sequence = page->sequence;
+        STATUS_PAGE_BARRIER();
+        if ((sequence & 1) == 0) {
+            memset(copy, 0, sizeof(WrapperStatusPage));
+            memcpy(copy, (const void *)page, copySize);
+            STATUS_PAGE_BARRIER();
+            if (page->sequence == sequence) {
+                copy->sequence = sequence;
+                copy->size = (unsigned int)copySize;
+                return FALSE;
+            }
+        }
+    }
+    return TRUE;
+}
+
+#endif
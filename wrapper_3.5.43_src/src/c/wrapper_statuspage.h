@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 1999, 2020 Tanuki Software, Ltd.
+ * http://www.tanukisoftware.com
+ * All rights reserved.
+ *
+ * This software is the proprietary information of Tanuki Software.
+ * You shall use it only in accordance with the terms of the
+ * license agreement you entered into with Tanuki Software.
+ * http://wrapper.tanukisoftware.com/doc/english/licenseOverview.html
+ */
+
+/**
+ * The status page is a small memory mapped file which the main loop keeps up to date with
+ *  the state of the Wrapper and the JVM.  Monitoring tools can map it and sample it without
+ *  any system calls or parsing, whatever the number of Wrappers they watch.
+ *
+ * The page is updated with a sequence lock.  The sequence is odd while an update is in
+ *  progress, so a reader copies the page and accepts the copy only if the sequence was even
+ *  and unchanged before and after.  See readStatusPage().
+ *
+ * All fields are 32 bit values in the native byte order.  Fields are only ever appended, in
+ *  which case the version is incremented.  The size field holds the size of the page actually
+ *  written so readers can tell which fields are present.  See WRAPPER_STATUS_PAGE_HAS_FIELD().
+ *
+ * This file only depends on the C library so that small monitoring tools can be built with it.
+ */
+
+#ifndef _WRAPPER_STATUSPAGE_H
+#define _WRAPPER_STATUSPAGE_H
+
+#ifndef WIN32
+
+#include <stddef.h>
+
+#define WRAPPER_STATUS_PAGE_MAGIC   0x57535047 /* "WSPG" */
+#define WRAPPER_STATUS_PAGE_VERSION 2
+
+typedef struct WrapperStatusPage WrapperStatusPage;
+struct WrapperStatusPage {
+    unsigned int magic;                 /* WRAPPER_STATUS_PAGE_MAGIC. */
+    unsigned int version;               /* WRAPPER_STATUS_PAGE_VERSION. */
+    unsigned int size;                  /* Size of the page in bytes. */
+    volatile unsigned int sequence;     /* Incremented before and after each update.  Odd while an update is in progress. */
+    unsigned int updateTime;            /* Time of the last update, in seconds since the epoch. */
+    unsigned int wrapperPID;            /* PID of the Wrapper process. */
+    unsigned int wState;                /* State of the Wrapper, one of the WRAPPER_WSTATE_* constants. */
+    unsigned int jState;                /* State of the JVM, one of the WRAPPER_JSTATE_* constants. */
+    unsigned int javaPID;               /* PID of the current JVM, 0 if there is none. */
+    unsigned int jvmRestarts;           /* Number of times a JVM has been launched. */
+    unsigned int uptimeSeconds;         /* Number of seconds since the Wrapper was started. */
+    unsigned int lastPingRTT;           /* Round trip time of the last answered ping in microseconds, 0 if none yet. */
+    unsigned int logBytesLow;           /* Bytes written to the log file, low 32 bits. */
+    unsigned int logBytesHigh;          /* Bytes written to the log file, high 32 bits. */
+    unsigned int logMessagesDropped;    /* Log messages dropped because a log queue was full. */
+    unsigned int javaLinesDropped;      /* Lines of JVM output dropped by wrapper.javaio.overflow_policy. */
+    /* Version 2. */
+    unsigned int pingRTTSmoothed;       /* Smoothed ping round trip time of the current JVM in microseconds, 0 if none yet. */
+    unsigned int pingRTTJitter;         /* Mean deviation of the ping round trip times in microseconds. */
+    unsigned int pingRTTRecentP99;      /* 99th percentile of the recent ping round trip times in microseconds, 0 if too few. */
+    unsigned int pingInterval;          /* Number of seconds currently between pings. */
+};
+
+/* Size of a version 1 page, the smallest page which readers accept. */
+#define WRAPPER_STATUS_PAGE_SIZE_V1 (offsetof(WrapperStatusPage, javaLinesDropped) + sizeof(unsigned int))
+
+/**
+ * TRUE if a copy of a page taken with readStatusPage() contains a field.
+ */
+#define WRAPPER_STATUS_PAGE_HAS_FIELD(copy, field) ((copy)->size >= offsetof(WrapperStatusPage, field) + sizeof((copy)->field))
+
+/**
+ * Sizes a newly created file and maps it as the status page.  The descriptor can be closed
+ *  once the page is mapped.
+ *
+ * @param fd Descriptor of the file, open for reading and writing.
+ *
+ * @return The mapped page, or NULL if there were any problems.  errno is set in this case.
+ */
+extern WrapperStatusPage *mapStatusPage(int fd);
+
+/**
+ * Starts an update.  The fields can then be set until endStatusPageUpdate() is called.
+ *  There must only be a single writer.
+ */
+extern void beginStatusPageUpdate(WrapperStatusPage *page);
+
+/**
+ * Completes an update so readers see the new values.
+ */
+extern void endStatusPageUpdate(WrapperStatusPage *page);
+
+/**
+ * Unmaps the page.
+ */
+extern void unmapStatusPage(WrapperStatusPage *page);
+
+/**
+ * Takes a consistent copy of a page, retrying while it is being updated.  A page written by
+ *  an older Wrapper may be shorter than the current structure.  Only the fields it contains
+ *  are copied, the others are set to 0 and the size of the copy tells which ones are present.
+ *
+ * @param page The mapped page.
+ * @param mappedSize Number of bytes mapped at page.
+ * @param copy Receives the copy.
+ *
+ * @return TRUE if no consistent copy could be taken, or the page is not a status page of at
+ *         least version 1.
+ */
+extern int readStatusPage(const WrapperStatusPage *page, size_t mappedSize, WrapperStatusPage *copy);
+
+#endif
+
+#endif
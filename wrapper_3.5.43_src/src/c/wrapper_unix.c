@@ -52,6 +52,7 @@
 #include <pwd.h>
 #include <sys/resource.h>
 #include <sys/timeb.h>
+#include <time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
@@ -62,9 +63,15 @@
 #include "logger.h"
 #include "wrapper_file.h"
 #include "wrapper_encoding.h"
+#include "wrapper_uring.h"
 
 #include <sys/resource.h>
 #include <sys/time.h>
+#include <poll.h>
+#ifdef LINUX
+ #include <sys/syscall.h>
+ #include <sys/inotify.h>
+#endif
 
 #ifndef USE_USLEEP
  #include <time.h>
@@ -82,6 +89,8 @@ pid_t getsid(pid_t pid);
 /* Define a global pipe descriptor so that we don't have to keep allocating
  *  a new pipe each time a JVM is launched. */
 int pipedes[2] = {-1, -1};
+/* Pipe used for the stderr of the JVM when wrapper.java.stderr.separate is set. */
+int pipeErrdes[2] = {-1, -1};
 #define PIPE_READ_END 0
 #define PIPE_WRITE_END 1
 
@@ -106,6 +115,44 @@ int timerThreadStopped = FALSE;
 
 TICKS timerTicks = WRAPPER_TICK_INITIAL;
 
+/* The monotonic clock is not affected by changes to the system time, so it can replace the timer thread.
+ *  Older glibc versions require librt for clock_gettime. */
+#if (defined(LINUX) || defined(FREEBSD)) && defined(CLOCK_MONOTONIC)
+ #define WRAPPER_MONOTONIC_TICKS
+#endif
+#ifdef WRAPPER_MONOTONIC_TICKS
+int monotonicTicksSet = FALSE;
+struct timespec monotonicTicksBase;
+#endif
+
+/* A pidfd becomes readable as soon as the JVM process exits, which lets the main loop
+ *  wake up without waiting for the end of its sleep.  Requires Linux 5.3. */
+#if defined(LINUX) && defined(SYS_pidfd_open)
+ #define WRAPPER_PIDFD_SUPPORTED
+#endif
+#ifdef WRAPPER_PIDFD_SUPPORTED
+int javaPidfd = -1;
+int javaPidfdSignaled = FALSE;
+int javaPidfdUnavailable = FALSE;
+#endif
+
+/* Changes to the command and anchor files can be watched through inotify rather than polled.
+ *  The parent directories are watched so the files can be created and deleted. */
+#if defined(LINUX) && defined(IN_CLOSE_WRITE)
+ #define WRAPPER_INOTIFY_SUPPORTED
+#endif
+#ifdef WRAPPER_INOTIFY_SUPPORTED
+typedef struct WatchedFile WatchedFile;
+struct WatchedFile {
+    TCHAR *path;        /* The watched path, to detect when the configured file changes. */
+    char *name;         /* The base name of the file, as reported in the events. */
+    int wd;             /* The watch descriptor of the parent directory, or -1 if not watched. */
+    uint32_t mask;      /* The events which concern the file. */
+};
+int inotifyFd = -1;
+WatchedFile watchedFiles[2] = {{NULL, NULL, -1, 0}, {NULL, NULL, -1, 0}};
+#endif
+
 TICKS stopSignalLastTick = WRAPPER_TICK_INITIAL;
 
 int handleSignals = TRUE;
@@ -198,6 +245,9 @@ void changePidFileGroup(const TCHAR* filename, gid_t newGroup) {
 int writePidFile(const TCHAR *filename, DWORD pid, int newUmask, gid_t newGroup) {
     FILE *pid_fp = NULL;
     int old_umask;
+#ifdef WRAPPER_URING_SUPPORTED
+    TCHAR pidText[16];
+#endif
 
     old_umask = umask(newUmask);
     pid_fp = _tfopen(filename, TEXT("w"));
@@ -205,6 +255,13 @@ int writePidFile(const TCHAR *filename, DWORD pid, int newUmask, gid_t newGroup)
 
     if (pid_fp != NULL) {
         changePidFileGroup(filename, newGroup);
+#ifdef WRAPPER_URING_SUPPORTED
+        /* The Java pid and id files are written from the main loop, which should not be blocked by a slow file system. */
+        _sntprintf(pidText, 16, TEXT("%d"), (int)pid);
+        if (!wrapperUringWriteLine(pid_fp, pidText)) {
+            return 0;
+        }
+#endif
         _ftprintf(pid_fp, TEXT("%d\n"), (int)pid);
         fclose(pid_fp);
     } else {
@@ -831,6 +888,45 @@ void disposeJavaIO() {
     }
 }
 
+#ifdef WRAPPER_MONOTONIC_TICKS
+/**
+ * Starts counting ticks based on the monotonic clock.  The count starts at WRAPPER_TICK_INITIAL
+ *  as with the timer thread.
+ *
+ * @return TRUE if the monotonic clock is not available.
+ */
+int initializeMonotonicTicks() {
+    if (clock_gettime(CLOCK_MONOTONIC, &monotonicTicksBase)) {
+        return TRUE;
+    }
+    monotonicTicksSet = TRUE;
+    return FALSE;
+}
+
+/**
+ * Returns the number of ticks since initializeMonotonicTicks() was called, offset by
+ *  WRAPPER_TICK_INITIAL.  No locking is needed as nothing is shared.
+ */
+TICKS getMonotonicTicks() {
+    struct timespec now;
+    time_t seconds;
+    long nanos;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &now)) {
+        /* Can not happen once the clock was found to be available. */
+        return WRAPPER_TICK_INITIAL;
+    }
+    seconds = now.tv_sec - monotonicTicksBase.tv_sec;
+    nanos = now.tv_nsec - monotonicTicksBase.tv_nsec;
+    if (nanos < 0) {
+        seconds--;
+        nanos += 1000000000L;
+    }
+    /* The tick count is expected to wrap, so overflowing TICKS is fine. */
+    return WRAPPER_TICK_INITIAL + (TICKS)seconds * (1000 / WRAPPER_TICK_MS) + (TICKS)(nanos / (WRAPPER_TICK_MS * 1000000L));
+}
+#endif
+
 /**
  * The main entry point for the timer thread which is started by
  *  initializeTimer().  Once started, this thread will run for the
@@ -1014,6 +1110,17 @@ int wrapperInitializeRun() {
         /* Unable to set the timerThreadId to a null value on all platforms
          * timerThreadId = 0;*/
     } else {
+#ifdef WRAPPER_MONOTONIC_TICKS
+        if (wrapperData->useMonotonicTime) {
+            if (!initializeMonotonicTicks()) {
+                /* The ticks are calculated from the clock so there is no reason to start up a timer thread. */
+                timerThreadSet = FALSE;
+                return retval;
+            }
+            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_DEBUG,
+                TEXT("The monotonic clock is not available.  Falling back to the tick timer. (%s)"), getLastErrorText());
+        }
+#endif
         /* Create and initialize a timer thread. */
         if ((res = initializeTimer()) != 0) {
             return res;
@@ -1023,6 +1130,302 @@ int wrapperInitializeRun() {
     return retval;
 }
 
+#ifdef WRAPPER_PIDFD_SUPPORTED
+/**
+ * Opens a pidfd for a newly launched JVM process.  The process can not be reaped before this is
+ *  called, so the pid can not have been reused.  Nothing is done if pidfds are not supported
+ *  by the kernel, in which case the main loop simply sleeps.
+ */
+static void openJavaPidfd(pid_t pid) {
+    int fd;
+
+    if (javaPidfdUnavailable) {
+        return;
+    }
+    /* The returned descriptor is always close-on-exec. */
+    fd = (int)syscall(SYS_pidfd_open, pid, 0);
+    if (fd < 0) {
+        if ((errno == ENOSYS) || (errno == EPERM)) {
+            javaPidfdUnavailable = TRUE;
+        }
+        if (wrapperData->isDebugging) {
+            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_DEBUG,
+                TEXT("Unable to open a pidfd for the JVM process.  Its exit will be detected on the next loop cycle. (%s)"), getLastErrorText());
+        }
+        return;
+    }
+    javaPidfd = fd;
+    javaPidfdSignaled = FALSE;
+}
+
+/**
+ * Closes the pidfd of the JVM process once it has been reaped.
+ */
+static void closeJavaPidfd() {
+    if (javaPidfd >= 0) {
+        close(javaPidfd);
+        javaPidfd = -1;
+    }
+    javaPidfdSignaled = FALSE;
+}
+#endif
+
+#ifdef WRAPPER_INOTIFY_SUPPORTED
+/**
+ * Starts watching the parent directory of a file.
+ *
+ * @return TRUE if there were any problems.
+ */
+static int addFileWatch(WatchedFile *watched, const TCHAR *path, uint32_t mask) {
+    char *cPath;
+    char *slash;
+    size_t req;
+
+    req = wcstombs(NULL, path, 0);
+    if (req == (size_t)-1) {
+        return TRUE;
+    }
+    cPath = malloc(req + 1);
+    if (!cPath) {
+        outOfMemory(TEXT("AFW"), 1);
+        return TRUE;
+    }
+    wcstombs(cPath, path, req + 1);
+
+    watched->path = malloc(sizeof(TCHAR) * (_tcslen(path) + 1));
+    watched->name = malloc(req + 1);
+    if ((!watched->path) || (!watched->name)) {
+        outOfMemory(TEXT("AFW"), 2);
+        free(cPath);
+        return TRUE;
+    }
+    _tcsncpy(watched->path, path, _tcslen(path) + 1);
+
+    slash = strrchr(cPath, '/');
+    if (slash) {
+        strncpy(watched->name, slash + 1, req + 1);
+        if (slash == cPath) {
+            /* The file is in the root directory. */
+            slash[1] = '\0';
+        } else {
+            slash[0] = '\0';
+        }
+        watched->wd = inotify_add_watch(inotifyFd, cPath, IN_CREATE | IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM | IN_ONLYDIR);
+    } else {
+        strncpy(watched->name, cPath, req + 1);
+        watched->wd = inotify_add_watch(inotifyFd, ".", IN_CREATE | IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM | IN_ONLYDIR);
+    }
+    watched->mask = mask;
+    free(cPath);
+
+    if (watched->wd < 0) {
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN,
+            TEXT("Unable to watch the directory of %s.  The file will be polled. (%s)"), path, getLastErrorText());
+        return TRUE;
+    }
+    return FALSE;
+}
+#endif
+
+/**
+ * Starts watching the command and anchor files if they are configured.  Files which can not
+ *  be watched are polled as before.
+ */
+void wrapperStartFileWatch() {
+#ifdef WRAPPER_INOTIFY_SUPPORTED
+    if ((!wrapperData->commandFilename) && (!wrapperData->anchorFilename)) {
+        return;
+    }
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd < 0) {
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN,
+            TEXT("Unable to initialize inotify.  The command and anchor files will be polled. (%s)"), getLastErrorText());
+        return;
+    }
+    /* The anchor file only matters once deleted.  The command file must only be read once it has been completely written. */
+    if (wrapperData->anchorFilename) {
+        addFileWatch(&watchedFiles[0], wrapperData->anchorFilename, IN_DELETE | IN_MOVED_FROM);
+    }
+    if (wrapperData->commandFilename) {
+        addFileWatch(&watchedFiles[1], wrapperData->commandFilename, IN_CLOSE_WRITE | IN_MOVED_TO);
+    }
+#else
+    log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO,
+        TEXT("Watching files is not supported on this platform.  The command and anchor files will be polled."));
+#endif
+}
+
+/**
+ * Returns TRUE if changes to the specified file are currently watched, in which case it does
+ *  not need to be polled.
+ *
+ * @param watch WRAPPER_FILE_WATCH_ANCHOR or WRAPPER_FILE_WATCH_COMMAND.
+ * @param path The currently configured path of the file.
+ */
+int wrapperIsFileWatched(int watch, const TCHAR *path) {
+#ifdef WRAPPER_INOTIFY_SUPPORTED
+    WatchedFile *watched = &watchedFiles[(watch == WRAPPER_FILE_WATCH_ANCHOR) ? 0 : 1];
+
+    return (inotifyFd >= 0) && (watched->wd >= 0) && path && (_tcscmp(path, watched->path) == 0);
+#else
+    return FALSE;
+#endif
+}
+
+/**
+ * Reads any pending file watch events without waiting.
+ *
+ * @return A combination of WRAPPER_FILE_WATCH_ANCHOR and WRAPPER_FILE_WATCH_COMMAND for the
+ *         files which need to be checked.
+ */
+int wrapperReadFileWatchEvents() {
+#ifdef WRAPPER_INOTIFY_SUPPORTED
+    union {
+        struct inotify_event event;
+        char buffer[4096];
+    } events;
+    struct inotify_event *event;
+    ssize_t len;
+    char *pos;
+    int i;
+    int result = 0;
+
+    if (inotifyFd < 0) {
+        return 0;
+    }
+    while ((len = read(inotifyFd, events.buffer, sizeof(events.buffer))) > 0) {
+        for (pos = events.buffer; pos < events.buffer + len; pos += sizeof(struct inotify_event) + event->len) {
+            event = (struct inotify_event *)pos;
+            if (event->mask & IN_Q_OVERFLOW) {
+                /* Events were lost. */
+                result |= WRAPPER_FILE_WATCH_ANCHOR | WRAPPER_FILE_WATCH_COMMAND;
+                continue;
+            }
+            for (i = 0; i < 2; i++) {
+                if ((watchedFiles[i].wd < 0) || (event->wd != watchedFiles[i].wd)) {
+                    continue;
+                }
+                if (event->mask & IN_IGNORED) {
+                    /* The directory was deleted or unmounted.  Go back to polling, which is started by checking the file. */
+                    log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN,
+                        TEXT("The directory of %s is no longer watched.  The file will be polled."), watchedFiles[i].path);
+                    watchedFiles[i].wd = -1;
+                    result |= (i == 0) ? WRAPPER_FILE_WATCH_ANCHOR : WRAPPER_FILE_WATCH_COMMAND;
+                } else if ((event->len > 0) && (event->mask & watchedFiles[i].mask) && (strcmp(event->name, watchedFiles[i].name) == 0)) {
+                    result |= (i == 0) ? WRAPPER_FILE_WATCH_ANCHOR : WRAPPER_FILE_WATCH_COMMAND;
+                }
+            }
+        }
+    }
+    if ((len < 0) && (errno != EAGAIN) && (errno != EINTR)) {
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN,
+            TEXT("Unable to read the file watch events.  The command and anchor files will be polled. (%s)"), getLastErrorText());
+        wrapperStopFileWatch();
+        result |= WRAPPER_FILE_WATCH_ANCHOR | WRAPPER_FILE_WATCH_COMMAND;
+    }
+    return result;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * Stops watching the command and anchor files.
+ */
+void wrapperStopFileWatch() {
+#ifdef WRAPPER_INOTIFY_SUPPORTED
+    int i;
+
+    if (inotifyFd >= 0) {
+        close(inotifyFd);
+        inotifyFd = -1;
+    }
+    for (i = 0; i < 2; i++) {
+        if (watchedFiles[i].path) {
+            free(watchedFiles[i].path);
+            watchedFiles[i].path = NULL;
+        }
+        if (watchedFiles[i].name) {
+            free(watchedFiles[i].name);
+            watchedFiles[i].name = NULL;
+        }
+        watchedFiles[i].wd = -1;
+    }
+#endif
+}
+
+/**
+ * Sleeps for up to the specified number of milliseconds, returning as soon as the JVM process
+ *  exits, a watched file changes or one of the specified descriptors has input.  Behaves as
+ *  wrapperSleep() if there is nothing to wait for.
+ *
+ * @param ms Number of milliseconds to wait for.
+ * @param fds Additional descriptors to wait for input on.  May be NULL if fdCount is 0.
+ * @param fdCount Number of descriptors in fds, at most WRAPPER_SLEEP_MAX_FDS.
+ *
+ * @return TRUE if the sleep was interrupted, the JVM exited, a watched file changed or a descriptor has input, FALSE otherwise.  Neither is an error.
+ */
+int wrapperSleepUntilEvent(int ms, const int *fds, int fdCount) {
+    struct pollfd pfds[2 + WRAPPER_SLEEP_MAX_FDS];
+    int count = 0;
+    int pidfdIndex = -1;
+    int i;
+    int rc;
+
+#ifdef WRAPPER_PIDFD_SUPPORTED
+    /* Once the exit was reported, poll would return immediately until the process is reaped. */
+    if ((javaPidfd >= 0) && (!javaPidfdSignaled)) {
+        pfds[count].fd = javaPidfd;
+        pfds[count].events = POLLIN;
+        pfds[count].revents = 0;
+        pidfdIndex = count;
+        count++;
+    }
+#endif
+#ifdef WRAPPER_INOTIFY_SUPPORTED
+    if (inotifyFd >= 0) {
+        pfds[count].fd = inotifyFd;
+        pfds[count].events = POLLIN;
+        pfds[count].revents = 0;
+        count++;
+    }
+#endif
+    for (i = 0; (i < fdCount) && (i < WRAPPER_SLEEP_MAX_FDS); i++) {
+        pfds[count].fd = fds[i];
+        pfds[count].events = POLLIN;
+        pfds[count].revents = 0;
+        count++;
+    }
+    if (count > 0) {
+        if (wrapperData->isSleepOutputEnabled) {
+            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("    Sleep: poll %dms"), ms);
+        }
+        rc = poll(pfds, count, ms);
+        if (rc > 0) {
+            if ((pidfdIndex >= 0) && (pfds[pidfdIndex].revents != 0)) {
+                if (wrapperData->isSleepOutputEnabled) {
+                    log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("    Sleep: JVM process exited"));
+                }
+#ifdef WRAPPER_PIDFD_SUPPORTED
+                javaPidfdSignaled = TRUE;
+#endif
+            } else if (wrapperData->isSleepOutputEnabled) {
+                log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("    Sleep: watched file changed or input available"));
+            }
+            return TRUE;
+        } else if (rc == 0) {
+            return FALSE;
+        } else if (errno == EINTR) {
+            if (wrapperData->isSleepOutputEnabled) {
+                log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("    Sleep: poll interrupted"));
+            }
+            return TRUE;
+        }
+        /* Should not happen.  Fall back to a normal sleep rather than risking a busy loop. */
+    }
+    return wrapperSleep(ms);
+}
+
 /**
  * Cause the current thread to sleep for the specified number of milliseconds.
  *  Sleeps over one second are not allowed.
@@ -1288,17 +1691,237 @@ size_t wrapperCalculateEnvironmentLength() {
     return lenTotal;
 }
 
+/**
+ * Logs why the JVM could not be executed.
+ *
+ * @param command The command which could not be executed.
+ * @param execErrno The errno set by the failed exec call.
+ * @param marker LOG_FORK_MARKER when logging from the child of a fork, an empty string otherwise.
+ */
+static void logJvmExecFailure(TCHAR **command, int execErrno, const TCHAR *marker) {
+    int i;
+    size_t lenCmd;
+    size_t lenEnv;
+
+    log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_ERROR,
+        TEXT("%sUnable to start JVM: %s (%d)"), marker, getErrorText(execErrno, NULL), execErrno);
+    if (execErrno == E2BIG) {
+        /* Command line too long. */
+        /* Calculate the total length of the command line. */
+        lenCmd = 0;
+        for (i = 0; command[i] != NULL; i++) {
+            lenCmd += _tcslen(command[i]) + 1;
+        }
+        lenEnv = wrapperCalculateEnvironmentLength();
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_ERROR, TEXT("%s  The generated command line plus the environment was larger than the maximum allowed."), marker);
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_ERROR, TEXT("%s  The current length is %d bytes of which %d is the command line, and %d is the environment."), marker, lenCmd + lenEnv + 1, lenCmd, lenEnv); 
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_ERROR, TEXT("%s  It is not possible to calculate an exact maximum length as it depends on a number of factors for each system."), marker);
+
+        /* TODO: Figure out a way to inform the Wrapper not to restart and try again as repeatedly doing this is meaningless. */
+    }
+
+    if (wrapperData->isAdviserEnabled) {
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_ADVICE, TEXT("%s"), marker );
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_ADVICE,
+            TEXT("%s------------------------------------------------------------------------"), marker );
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_ADVICE,
+            TEXT("%sAdvice:"), marker );
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_ADVICE,
+            TEXT("%sUsually when the Wrapper fails to start the JVM process, it is because"), marker );
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_ADVICE,
+            TEXT("%sof a problem with the value of the configured Java command.  Currently:"), marker );
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_ADVICE,
+            TEXT("%swrapper.java.command=%s"), marker, getStringProperty(properties, TEXT("wrapper.java.command"), TEXT("java")));
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_ADVICE,
+            TEXT("%sPlease make sure that the PATH or any other referenced environment"), marker );
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_ADVICE,
+            TEXT("%svariables are correctly defined for the current environment."), marker );
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_ADVICE,
+            TEXT("%s------------------------------------------------------------------------"), marker );
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_ADVICE, TEXT("%s"), marker );
+    }
+}
+
+/**
+ * Frees a command converted by wrapperGetMultiByteCommand().
+ */
+static void wrapperFreeMultiByteCommand(char **commandMB) {
+    int i;
+
+    if (commandMB) {
+        for (i = 0; commandMB[i] != NULL; i++) {
+            free(commandMB[i]);
+        }
+        free(commandMB);
+    }
+}
+
+/**
+ * Converts a command to the multi byte strings expected by execvp().
+ *
+ * @return The converted command, or NULL if there were any problems.  errno is set in this case.
+ */
+static char **wrapperGetMultiByteCommand(TCHAR **command) {
+    char **commandMB;
+    size_t req;
+    int size;
+    int i;
+
+    for (size = 0; command[size] != NULL; size++) {
+        ;
+    }
+    commandMB = malloc(sizeof(char *) * (size + 1));
+    if (!commandMB) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    memset(commandMB, 0, sizeof(char *) * (size + 1));
+    for (i = 0; i < size; i++) {
+#ifdef UNICODE
+        req = wcstombs(NULL, command[i], 0);
+        if (req == (size_t)-1) {
+            wrapperFreeMultiByteCommand(commandMB);
+            errno = EILSEQ;
+            return NULL;
+        }
+        commandMB[i] = malloc(req + 1);
+        if (!commandMB[i]) {
+            wrapperFreeMultiByteCommand(commandMB);
+            errno = ENOMEM;
+            return NULL;
+        }
+        wcstombs(commandMB[i], command[i], req + 1);
+#else
+        req = strlen(command[i]);
+        commandMB[i] = malloc(req + 1);
+        if (!commandMB[i]) {
+            wrapperFreeMultiByteCommand(commandMB);
+            errno = ENOMEM;
+            return NULL;
+        }
+        memcpy(commandMB[i], command[i], req + 1);
+#endif
+    }
+    return commandMB;
+}
+
+/* Set by the child of vfork(), which shares the memory of the Wrapper, when it fails.  The
+ *  step tells which call failed: 0 for stdout, 1 for stderr, 2 for the exec. */
+static volatile int vforkChildErrno;
+static volatile int vforkChildStep;
+
+/**
+ * Launches the JVM with vfork().  Unlike fork(), vfork() does not copy the page tables of the
+ *  Wrapper, so the launch time does not grow with the memory used by the Wrapper, and it can't
+ *  fail because the system does not overcommit memory.  The child shares the memory of the
+ *  Wrapper until it calls exec, so it only makes async-signal-safe calls on data prepared
+ *  beforehand.  The resource limits, working directory, groups and environment are those of
+ *  the Wrapper process, as with fork().
+ *
+ * @param command The command to execute.
+ * @param separateStderr TRUE if the stderr of the JVM goes to pipeErrdes.
+ * @param childExitCode The exit code of the child if it fails to execute the JVM.
+ *
+ * @return The pid of the child, or -1 if it could not be created.  errno is set in this case.
+ */
+static pid_t wrapperVforkJvm(TCHAR **command, int separateStderr, int childExitCode) {
+    char **commandMB;
+    sigset_t allSignals;
+    sigset_t oldSignals;
+    struct sigaction action;
+    int javaUmask = wrapperData->javaUmask;
+    pid_t proc;
+    int err;
+    int sig;
+
+    commandMB = wrapperGetMultiByteCommand(command);
+    if (!commandMB) {
+        return -1;
+    }
+
+    /* Signals are blocked around vfork() so the handlers of the Wrapper never run in the child,
+     *  where they would modify the memory of the Wrapper. */
+    sigfillset(&allSignals);
+    pthread_sigmask(SIG_SETMASK, &allSignals, &oldSignals);
+    vforkChildErrno = 0;
+    vforkChildStep = 0;
+
+    proc = vfork();
+    if (proc == 0) {
+        /* We are the child side.  Restore the default action of the handled signals before
+         *  unblocking them.  Ignored signals stay ignored, as after a fork(). */
+#ifdef NSIG
+        for (sig = 1; sig < NSIG; sig++) {
+            if ((sigaction(sig, NULL, &action) == 0) && (action.sa_handler != SIG_DFL) && (action.sa_handler != SIG_IGN)) {
+                memset(&action, 0, sizeof(action));
+                action.sa_handler = SIG_DFL;
+                sigaction(sig, &action, NULL);
+            }
+        }
+#endif
+        sigprocmask(SIG_SETMASK, &oldSignals, NULL);
+
+        /* Set the umask of the JVM */
+        umask(javaUmask);
+
+        /* Send output and errors to the pipes. */
+        if (dup2(pipedes[PIPE_WRITE_END], STDOUT_FILENO) < 0) {
+            vforkChildErrno = errno;
+            _exit(childExitCode);
+        }
+        vforkChildStep = 1;
+        if (dup2(separateStderr ? pipeErrdes[PIPE_WRITE_END] : pipedes[PIPE_WRITE_END], STDERR_FILENO) < 0) {
+            vforkChildErrno = errno;
+            _exit(childExitCode);
+        }
+        /* The pipe descriptors are not modified as they are shared with the Wrapper. */
+        close(pipedes[PIPE_READ_END]);
+        close(pipedes[PIPE_WRITE_END]);
+        if (separateStderr) {
+            close(pipeErrdes[PIPE_READ_END]);
+            close(pipeErrdes[PIPE_WRITE_END]);
+        }
+
+        vforkChildStep = 2;
+        execvp(commandMB[0], commandMB);
+        vforkChildErrno = errno;
+        _exit(childExitCode);
+    }
+
+    /* We are the parent side.  The child has either executed the JVM or exited. */
+    err = errno;
+    pthread_sigmask(SIG_SETMASK, &oldSignals, NULL);
+    wrapperFreeMultiByteCommand(commandMB);
+    if (proc == -1) {
+        errno = err;
+        return -1;
+    }
+
+    if (vforkChildErrno != 0) {
+        /* Report the failure the same way as a forked child would.  The child has exited, and will be reaped as usual. */
+        if (vforkChildStep == 0) {
+            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_ERROR,
+                TEXT("Unable to set JVM's stdout: %s"), getErrorText(vforkChildErrno, NULL));
+        } else if (vforkChildStep == 1) {
+            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_ERROR,
+                TEXT("Unable to set JVM's stderr: %s"), getErrorText(vforkChildErrno, NULL));
+        } else {
+            logJvmExecFailure(command, vforkChildErrno, TEXT(""));
+        }
+    }
+    return proc;
+}
+
 /**
  * Launch a JVM and collect the pid.
  *
  * @return TRUE if there were any problems, FALSE otherwise.
  */
 int wrapperLaunchJvm(TCHAR** command, pid_t *ppid) {
-    int i;
     pid_t proc;
     int execErrno;
-    size_t lenCmd;
-    size_t lenEnv;
+    int separateStderr;
+    int childExitCode;
 
     /* Create the pipe. */
     if (pipe(pipedes) < 0) {
@@ -1307,6 +1930,20 @@ int wrapperLaunchJvm(TCHAR** command, pid_t *ppid) {
         return TRUE;
     }
 
+    /* The output of the java version command is parsed as a whole so always keep its stderr on the main pipe. */
+    separateStderr = wrapperData->javaStderrSeparate && (command != wrapperData->jvmVersionCommand);
+    if (separateStderr) {
+        if (pipe(pipeErrdes) < 0) {
+            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_FATAL,
+                       TEXT("Could not init pipe: %s"), getLastErrorText());
+            close(pipedes[PIPE_READ_END]);
+            pipedes[PIPE_READ_END] = -1;
+            close(pipedes[PIPE_WRITE_END]);
+            pipedes[PIPE_WRITE_END] = -1;
+            return TRUE;
+        }
+    }
+
     /* Again make sure the log file is closed before forking. */
     setLogfileAutoClose(TRUE);
     closeLogfile();
@@ -1314,8 +1951,15 @@ int wrapperLaunchJvm(TCHAR** command, pid_t *ppid) {
     /* Reset the log duration so we get new counts from the time the JVM is launched. */
     resetDuration();
     
+    /* Set an exit code to distinguish cases where we failed to execute the java command. */
+    childExitCode = (command == wrapperData->jvmVersionCommand) ? 127 : wrapperData->errorExitCode;
+
     /* Fork off the child. */
-    proc = fork();
+    if (wrapperData->javaLaunchVfork) {
+        proc = wrapperVforkJvm(command, separateStderr, childExitCode);
+    } else {
+        proc = fork();
+    }
 
     if (proc == -1) {
         /* Fork failed. */
@@ -1331,6 +1975,12 @@ int wrapperLaunchJvm(TCHAR** command, pid_t *ppid) {
         pipedes[PIPE_READ_END] = -1;
         close(pipedes[PIPE_WRITE_END]);
         pipedes[PIPE_WRITE_END] = -1;
+        if (separateStderr) {
+            close(pipeErrdes[PIPE_READ_END]);
+            pipeErrdes[PIPE_READ_END] = -1;
+            close(pipeErrdes[PIPE_WRITE_END]);
+            pipeErrdes[PIPE_WRITE_END] = -1;
+        }
 
         return TRUE;
     } else if (proc == 0) {
@@ -1354,7 +2004,7 @@ int wrapperLaunchJvm(TCHAR** command, pid_t *ppid) {
         }
 
         /* Send errors to the pipe by duplicating the pipe fd and setting the copy as the stderr fd. */
-        if (dup2(pipedes[PIPE_WRITE_END], STDERR_FILENO) < 0) {
+        if (dup2(separateStderr ? pipeErrdes[PIPE_WRITE_END] : pipedes[PIPE_WRITE_END], STDERR_FILENO) < 0) {
             log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_ERROR,
                 TEXT("%sUnable to set JVM's stderr: %s"), LOG_FORK_MARKER, getLastErrorText());
             /* This process needs to end. */
@@ -1367,57 +2017,22 @@ int wrapperLaunchJvm(TCHAR** command, pid_t *ppid) {
         pipedes[PIPE_READ_END] = -1;
         close(pipedes[PIPE_WRITE_END]);
         pipedes[PIPE_WRITE_END] = -1;
+        if (separateStderr) {
+            close(pipeErrdes[PIPE_READ_END]);
+            pipeErrdes[PIPE_READ_END] = -1;
+            close(pipeErrdes[PIPE_WRITE_END]);
+            pipeErrdes[PIPE_WRITE_END] = -1;
+        }
         
         /* Child process: execute the JVM. */
         _texecvp(command[0], command);
         execErrno = errno;
 
         /* We reached this point...meaning we were unable to start. */
-        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_ERROR,
-            TEXT("%sUnable to start JVM: %s (%d)"), LOG_FORK_MARKER, getLastErrorText(), execErrno);
-        if (execErrno == E2BIG) {
-            /* Command line too long. */
-            /* Calculate the total length of the command line. */
-            lenCmd = 0;
-            for (i = 0; command[i] != NULL; i++) {
-                lenCmd += _tcslen(command[i]) + 1;
-            }
-            lenEnv = wrapperCalculateEnvironmentLength();
-            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_ERROR, TEXT("%s  The generated command line plus the environment was larger than the maximum allowed."), LOG_FORK_MARKER);
-            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_ERROR, TEXT("%s  The current length is %d bytes of which %d is the command line, and %d is the environment."), LOG_FORK_MARKER, lenCmd + lenEnv + 1, lenCmd, lenEnv); 
-            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_ERROR, TEXT("%s  It is not possible to calculate an exact maximum length as it depends on a number of factors for each system."), LOG_FORK_MARKER);
-
-            /* TODO: Figure out a way to inform the Wrapper not to restart and try again as repeatedly doing this is meaningless. */
-        }
-
-        if (wrapperData->isAdviserEnabled) {
-            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_ADVICE, TEXT("%s"), LOG_FORK_MARKER );
-            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_ADVICE,
-                TEXT("%s------------------------------------------------------------------------"), LOG_FORK_MARKER );
-            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_ADVICE,
-                TEXT("%sAdvice:"), LOG_FORK_MARKER );
-            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_ADVICE,
-                TEXT("%sUsually when the Wrapper fails to start the JVM process, it is because"), LOG_FORK_MARKER );
-            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_ADVICE,
-                TEXT("%sof a problem with the value of the configured Java command.  Currently:"), LOG_FORK_MARKER );
-            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_ADVICE,
-                TEXT("%swrapper.java.command=%s"), LOG_FORK_MARKER, getStringProperty(properties, TEXT("wrapper.java.command"), TEXT("java")));
-            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_ADVICE,
-                TEXT("%sPlease make sure that the PATH or any other referenced environment"), LOG_FORK_MARKER );
-            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_ADVICE,
-                TEXT("%svariables are correctly defined for the current environment."), LOG_FORK_MARKER );
-            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_ADVICE,
-                TEXT("%s------------------------------------------------------------------------"), LOG_FORK_MARKER );
-            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_ADVICE, TEXT("%s"), LOG_FORK_MARKER );
-        }
+        logJvmExecFailure(command, execErrno, LOG_FORK_MARKER);
 
         /* This process needs to end. */
-        if (command == wrapperData->jvmVersionCommand) {
-            /* Set an exit code to distinguish cases where we failed to execute the java command. */
-            exit(127);
-        } else {
-            exit(wrapperData->errorExitCode);
-        }
+        exit(childExitCode);
         return TRUE; /* Will not get here. */
     } else {
         /* We are the parent side and need to assume that at this point the JVM is up. */
@@ -1444,6 +2059,21 @@ int wrapperLaunchJvm(TCHAR** command, pid_t *ppid) {
                 TEXT("Failed to set JVM output handle to close on JVM exit: %s (%d)"),
                 getLastErrorText(), errno);
         }
+        if (separateStderr) {
+            close(pipeErrdes[PIPE_WRITE_END]);
+            pipeErrdes[PIPE_WRITE_END] = -1;
+
+            if (fcntl(pipeErrdes[PIPE_READ_END], F_SETFL, O_NONBLOCK) < 0) {
+                log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_ERROR,
+                    TEXT("Failed to set JVM error handle to non blocking mode: %s (%d)"),
+                    getLastErrorText(), errno);
+            }
+            if (fcntl(pipeErrdes[PIPE_READ_END], F_SETFD, FD_CLOEXEC) < 0) {
+                log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_ERROR,
+                    TEXT("Failed to set JVM error handle to close on JVM exit: %s (%d)"),
+                    getLastErrorText(), errno);
+            }
+        }
         return FALSE;
     }
 }
@@ -1597,6 +2227,10 @@ int wrapperLaunchJavaApp() {
     
     /* We keep a reference to the process id. */
     wrapperData->javaPID = pid;
+#ifdef WRAPPER_PIDFD_SUPPORTED
+    closeJavaPidfd();
+    openJavaPidfd(pid);
+#endif
 
     /* If a java pid filename is specified then write the pid of the java process. */
     if (wrapperData->javaPidFilename) {
@@ -1617,6 +2251,25 @@ int wrapperLaunchJavaApp() {
     return FALSE;
 }
 
+/**
+ * Returns a time in microseconds from a monotonic clock, for measuring short durations.  The
+ *  value wraps, so only the difference between two values is meaningful.
+ */
+unsigned int wrapperGetMicroTime() {
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+#endif
+    struct timeval tv;
+
+#ifdef CLOCK_MONOTONIC
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+        return (unsigned int)ts.tv_sec * 1000000U + (unsigned int)(ts.tv_nsec / 1000);
+    }
+#endif
+    gettimeofday(&tv, NULL);
+    return (unsigned int)tv.tv_sec * 1000000U + (unsigned int)tv.tv_usec;
+}
+
 /**
  * Returns a tick count that can be used in combination with the
  *  wrapperGetTickAgeSeconds() function to perform time keeping.
@@ -1628,6 +2281,11 @@ TICKS wrapperGetTicks() {
         /* We want to return a tick count that is based on the current system time. */
         ticks = wrapperGetSystemTicks();
 
+#ifdef WRAPPER_MONOTONIC_TICKS
+    } else if (monotonicTicksSet) {
+        ticks = getMonotonicTicks();
+
+#endif
     } else {
         /* Lock the tick mutex whenever the "timerTicks" variable is accessed. */
         if (wrapperData->useTickMutex && wrapperLockTickMutex()) {
@@ -1744,6 +2402,9 @@ int wrapperGetProcessStatus(TICKS nowTicks, int sigChild) {
         }
         res = WRAPPER_PROCESS_UP;
     } else if (retval < 0) {
+#ifdef WRAPPER_PIDFD_SUPPORTED
+        closeJavaPidfd();
+#endif
         if (errno == ECHILD) {
             if ((wrapperData->jState == WRAPPER_JSTATE_DOWN_CHECK) ||
                 (wrapperData->jState == WRAPPER_JSTATE_DOWN_FLUSH) ||
@@ -1771,6 +2432,13 @@ int wrapperGetProcessStatus(TICKS nowTicks, int sigChild) {
         log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("  WTERMSIG=%d"), WTERMSIG(status));
 #endif
 
+#ifdef WRAPPER_PIDFD_SUPPORTED
+        if (WIFEXITED(status) || WIFSIGNALED(status)) {
+            /* The process was reaped. */
+            closeJavaPidfd();
+        }
+#endif
+
         /* Get the exit code of the process. */
         if (WIFEXITED(status)) {
             /* JVM has exited. */
@@ -1805,8 +2473,9 @@ void wrapperReportStatus(int useLoggerQueue, int status, int errorCode, int wait
 }
 
 /**
- * Reads a single block of data from the child pipe.
+ * Reads a single block of data from one of the child pipes.
  *
+ * @param fds The pipe to read from.  Its read end is closed on EOF.
  * @param blockBuffer Pointer to the buffer where the block will be read.
  * @param blockSize Maximum number of bytes to read.
  * @param readCount Pointer to an int which will hold the number of bytes
@@ -1814,8 +2483,8 @@ void wrapperReportStatus(int useLoggerQueue, int status, int errorCode, int wait
  *
  * Returns TRUE if there were any problems, FALSE otherwise.
  */
-int wrapperReadChildOutputBlock(char *blockBuffer, int blockSize, int *readCount) {
-    if (pipedes[PIPE_READ_END] == -1) {
+static int wrapperReadChildPipeBlock(int *fds, char *blockBuffer, int blockSize, int *readCount) {
+    if (fds[PIPE_READ_END] == -1) {
         /* The child is not up. */
         *readCount = 0;
         return FALSE;
@@ -1834,7 +2503,7 @@ int wrapperReadChildOutputBlock(char *blockBuffer, int blockSize, int *readCount
      *  be done once, however, because F_GETFL does not return the accurate
      *  state there is no reliable way to check.  Be safe and always set the
      *  flag. */
-    if (fcntl(pipedes[PIPE_READ_END], F_SETFL, O_NONBLOCK) < 0) {
+    if (fcntl(fds[PIPE_READ_END], F_SETFL, O_NONBLOCK) < 0) {
         log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_ERROR, TEXT(
             "Failed to set JVM output handle to non blocking mode to read child process output: %s (%d)"),
             getLastErrorText(), errno);
@@ -1843,7 +2512,7 @@ int wrapperReadChildOutputBlock(char *blockBuffer, int blockSize, int *readCount
 #endif
 
     /* Fill read buffer. */
-    *readCount = read(pipedes[PIPE_READ_END], blockBuffer, blockSize);
+    *readCount = read(fds[PIPE_READ_END], blockBuffer, blockSize);
     if (*readCount < 0) {
         /* No more bytes available, return for now.  But make sure that this was not an error. */
         if (errno == EAGAIN) {
@@ -1855,14 +2524,87 @@ int wrapperReadChildOutputBlock(char *blockBuffer, int blockSize, int *readCount
             return TRUE;
         }
     } else if (*readCount == 0) {
+        /* We reached the EOF.  This means that the other end of the pipe was closed. */
+        close(fds[PIPE_READ_END]);
+        fds[PIPE_READ_END] = -1;
+    }
+
+    return FALSE;
+}
+
+/**
+ * Reads a single block of data from the child pipe.
+ *
+ * @param blockBuffer Pointer to the buffer where the block will be read.
+ * @param blockSize Maximum number of bytes to read.
+ * @param readCount Pointer to an int which will hold the number of bytes
+ *                  actually read by the call.
+ *
+ * Returns TRUE if there were any problems, FALSE otherwise.
+ */
+int wrapperReadChildOutputBlock(char *blockBuffer, int blockSize, int *readCount) {
+    return wrapperReadChildPipeBlock(pipedes, blockBuffer, blockSize, readCount);
+}
+
+/**
+ * Reads a single block of data from the child stderr pipe.  Only used when
+ *  wrapper.java.stderr.separate is set.
+ *
+ * @param blockBuffer Pointer to the buffer where the block will be read.
+ * @param blockSize Maximum number of bytes to read.
+ * @param readCount Pointer to an int which will hold the number of bytes
+ *                  actually read by the call.
+ *
+ * Returns TRUE if there were any problems, FALSE otherwise.
+ */
+int wrapperReadChildErrorBlock(char *blockBuffer, int blockSize, int *readCount) {
+    return wrapperReadChildPipeBlock(pipeErrdes, blockBuffer, blockSize, readCount);
+}
+
+#ifdef LINUX
+/**
+ * Moves any output available in the child pipe directly into the log file
+ *  without processing it.
+ *
+ * @param readCount Pointer to an int which will hold the number of bytes
+ *                  actually moved by the call.
+ *
+ * Returns TRUE if the output could not be moved and must be read normally, FALSE otherwise.
+ */
+int wrapperReadChildOutputRaw(int *readCount) {
+    int eof;
+    
+    if (pipedes[PIPE_READ_END] == -1) {
+        /* The child is not up. */
+        *readCount = 0;
+        return FALSE;
+    }
+    
+    *readCount = logSpliceToLogfile(pipedes[PIPE_READ_END], wrapperData->jvmRestarts, wrapperData->jvmDefaultLogLevel, &eof);
+    if (*readCount < 0) {
+        *readCount = 0;
+        return TRUE;
+    } else if (eof) {
         /* We reached the EOF.  This means that the other end of the pipe was closed. */
         close(pipedes[PIPE_READ_END]);
         pipedes[PIPE_READ_END] = -1;
     }
-
+    
     return FALSE;
 }
 
+/**
+ * Returns the length of the first line waiting in the child pipe, including its
+ *  line feed, or 0 if there is no complete line.  The pipe is not read.
+ */
+int wrapperPeekChildOutputLine() {
+    if (pipedes[PIPE_READ_END] == -1) {
+        return 0;
+    }
+    return logPeekLineLength(pipedes[PIPE_READ_END]);
+}
+#endif
+
 /**
  * Transform a program into a daemon.
  *
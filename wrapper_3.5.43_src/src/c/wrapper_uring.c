@@ -0,0 +1,594 @@
+/*
+ * Copyright (c) 1999, 2020 Tanuki Software, Ltd.
+ * http://www.tanukisoftware.com
+ * All rights reserved.
+ *
+ * This software is the proprietary information of Tanuki Software.
+ * You shall use it only in accordance with the terms of the
+ * license agreement you entered into with Tanuki Software.
+ * http://wrapper.tanukisoftware.com/doc/english/licenseOverview.html
+ */
+
+/**
+ * Author:
+ *   Tanuki Software Development Team <support@tanukisoftware.com>
+ */
+
+#include "wrapper_uring.h"
+
+#ifdef WRAPPER_URING_SUPPORTED
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "logger.h"
+
+#ifndef TRUE
+#define TRUE -1
+#endif
+
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+/* Number of submission queue entries.  This is also the maximum number of requests in flight. */
+#define URING_ENTRIES 64
+/* Bytes which may be waiting to be written before callers are blocked until the file system catches up. */
+#define URING_PENDING_BYTES_MAX (16 * 1024 * 1024)
+/* Largest write submitted at once. */
+#define URING_WRITE_MAX (1024 * 1024 * 1024)
+
+#define URING_OP_WRITE 1
+#define URING_OP_CLOSE 2
+
+/* A write or close.  Only the oldest request of each descriptor is ever in flight so they
+ *  complete in order.  A write is kept until all of its bytes were written. */
+typedef struct UringRequest UringRequest;
+struct UringRequest {
+    int op;
+    int fd;
+    char *buffer;
+    size_t len;
+    size_t done;
+    int inFlight;
+    unsigned long seq;
+    UringRequest *next;
+};
+
+static pthread_mutex_t uringMutex = PTHREAD_MUTEX_INITIALIZER;
+static int uringFD = -1;
+/* Process which owns the ring.  A forked child must not use it. */
+static pid_t uringPid = 0;
+
+static void *uringSqRing = MAP_FAILED;
+static size_t uringSqRingSize = 0;
+static void *uringCqRing = MAP_FAILED;
+static size_t uringCqRingSize = 0;
+static struct io_uring_sqe *uringSqes = MAP_FAILED;
+static size_t uringSqesSize = 0;
+
+static unsigned *uringSqTail;
+static unsigned *uringSqArray;
+static unsigned uringSqMask;
+static unsigned uringSqEntries;
+static unsigned *uringCqHead;
+static unsigned *uringCqTail;
+static unsigned uringCqMask;
+static struct io_uring_cqe *uringCqes;
+
+/* Entries added to the submission queue which the kernel did not consume yet. */
+static unsigned uringUnsubmitted = 0;
+static unsigned uringInFlight = 0;
+
+/* Requests in the order they were made. */
+static UringRequest *uringRequests = NULL;
+static UringRequest *uringRequestsLast = NULL;
+static size_t uringPendingBytes = 0;
+/* Sequence number of the newest request, and the newest one which must not be appended to. */
+static unsigned long uringSeq = 0;
+static unsigned long uringSealedSeq = 0;
+
+/* Failures since they were last reported. */
+static int uringFailures = 0;
+static int uringLastError = 0;
+
+static void releaseUringMaps() {
+    if (uringSqes != MAP_FAILED) {
+        munmap(uringSqes, uringSqesSize);
+        uringSqes = MAP_FAILED;
+    }
+    if ((uringCqRing != MAP_FAILED) && (uringCqRing != uringSqRing)) {
+        munmap(uringCqRing, uringCqRingSize);
+    }
+    uringCqRing = MAP_FAILED;
+    if (uringSqRing != MAP_FAILED) {
+        munmap(uringSqRing, uringSqRingSize);
+        uringSqRing = MAP_FAILED;
+    }
+}
+
+int wrapperUringInit() {
+    struct io_uring_params params;
+    int fd;
+
+    if (wrapperUringIsAvailable()) {
+        return FALSE;
+    }
+
+    memset(&params, 0, sizeof(params));
+    fd = (int)syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+    if (fd < 0) {
+        /* ENOSYS on kernels older than 5.1, EPERM if disabled with the kernel.io_uring_disabled sysctl or by a seccomp filter. */
+        return TRUE;
+    }
+    /* Writes to the current file position and closing were both added in 5.6. */
+    if (!(params.features & IORING_FEAT_RW_CUR_POS)) {
+        close(fd);
+        errno = ENOSYS;
+        return TRUE;
+    }
+
+    uringSqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    uringCqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        uringSqRingSize = __max(uringSqRingSize, uringCqRingSize);
+        uringCqRingSize = uringSqRingSize;
+    }
+    uringSqRing = mmap(NULL, uringSqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (uringSqRing == MAP_FAILED) {
+        close(fd);
+        return TRUE;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        uringCqRing = uringSqRing;
+    } else {
+        uringCqRing = mmap(NULL, uringCqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (uringCqRing == MAP_FAILED) {
+            releaseUringMaps();
+            close(fd);
+            return TRUE;
+        }
+    }
+    uringSqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    uringSqes = mmap(NULL, uringSqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (uringSqes == MAP_FAILED) {
+        releaseUringMaps();
+        close(fd);
+        return TRUE;
+    }
+
+    uringSqTail = (unsigned *)((char *)uringSqRing + params.sq_off.tail);
+    uringSqArray = (unsigned *)((char *)uringSqRing + params.sq_off.array);
+    uringSqMask = *(unsigned *)((char *)uringSqRing + params.sq_off.ring_mask);
+    uringSqEntries = params.sq_entries;
+    uringCqHead = (unsigned *)((char *)uringCqRing + params.cq_off.head);
+    uringCqTail = (unsigned *)((char *)uringCqRing + params.cq_off.tail);
+    uringCqMask = *(unsigned *)((char *)uringCqRing + params.cq_off.ring_mask);
+    uringCqes = (struct io_uring_cqe *)((char *)uringCqRing + params.cq_off.cqes);
+
+    uringPid = getpid();
+    uringFD = fd;
+    return FALSE;
+}
+
+int wrapperUringIsAvailable() {
+    return (uringFD >= 0) && (uringPid == getpid());
+}
+
+/**
+ * Lets the kernel consume the queued entries, and optionally waits for a completion.
+ *
+ * @return TRUE if the ring can not be used.
+ */
+static int enterUring(int wait) {
+    int result;
+
+    result = (int)syscall(__NR_io_uring_enter, uringFD, uringUnsubmitted, wait ? 1 : 0, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    if (result < 0) {
+        /* Interrupted or temporarily out of resources.  The entries are still queued. */
+        return ((errno == EINTR) || (errno == EAGAIN) || (errno == EBUSY)) ? FALSE : TRUE;
+    }
+    uringUnsubmitted -= (unsigned)result;
+    return FALSE;
+}
+
+/**
+ * Returns TRUE if an older request for the same descriptor still needs to complete first.
+ */
+static int isUringRequestBlocked(UringRequest *request) {
+    UringRequest *other;
+
+    for (other = uringRequests; other != request; other = other->next) {
+        if (other->fd == request->fd) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/**
+ * Queues every request which can be started and lets the kernel consume them.
+ *
+ * Must be called while locked.
+ */
+static int submitUringRequests() {
+    UringRequest *request;
+    struct io_uring_sqe *sqe;
+    unsigned tail;
+    unsigned index;
+
+    for (request = uringRequests; request && (uringInFlight < uringSqEntries); request = request->next) {
+        if (request->inFlight || isUringRequestBlocked(request)) {
+            continue;
+        }
+        /* Entries are only added while locked. */
+        tail = *uringSqTail;
+        index = tail & uringSqMask;
+        sqe = &uringSqes[index];
+        memset(sqe, 0, sizeof(struct io_uring_sqe));
+        sqe->fd = request->fd;
+        if (request->op == URING_OP_WRITE) {
+            sqe->opcode = IORING_OP_WRITE;
+            sqe->addr = (unsigned long)(request->buffer + request->done);
+            sqe->len = (unsigned)__min(request->len - request->done, URING_WRITE_MAX);
+            /* Write at the current position, the end for files opened for appending. */
+            sqe->off = (__u64)-1;
+        } else {
+            sqe->opcode = IORING_OP_CLOSE;
+        }
+        sqe->user_data = (unsigned long)request;
+        uringSqArray[index] = index;
+        __atomic_store_n(uringSqTail, tail + 1, __ATOMIC_RELEASE);
+        request->inFlight = TRUE;
+        uringInFlight++;
+        uringUnsubmitted++;
+    }
+
+    if (uringUnsubmitted > 0) {
+        return enterUring(FALSE);
+    }
+    return FALSE;
+}
+
+static void removeUringRequest(UringRequest *request) {
+    UringRequest *prev = NULL;
+    UringRequest *current;
+
+    for (current = uringRequests; current; current = current->next) {
+        if (current == request) {
+            if (prev) {
+                prev->next = request->next;
+            } else {
+                uringRequests = request->next;
+            }
+            if (uringRequestsLast == request) {
+                uringRequestsLast = prev;
+            }
+            break;
+        }
+        prev = current;
+    }
+    uringPendingBytes -= request->len;
+    if (request->buffer) {
+        free(request->buffer);
+    }
+    free(request);
+}
+
+/**
+ * Processes the completions.  Incomplete writes stay queued so the remaining bytes are written
+ *  by the next submission.
+ *
+ * Must be called while locked.
+ */
+static void reapUringCompletions() {
+    unsigned head = *uringCqHead;
+    struct io_uring_cqe *cqe;
+    UringRequest *request;
+    int res;
+
+    while (head != __atomic_load_n(uringCqTail, __ATOMIC_ACQUIRE)) {
+        cqe = &uringCqes[head & uringCqMask];
+        request = (UringRequest *)(unsigned long)cqe->user_data;
+        res = cqe->res;
+        head++;
+
+        request->inFlight = FALSE;
+        uringInFlight--;
+        if ((res == -EINTR) || (res == -EAGAIN)) {
+            /* Retry. */
+            continue;
+        }
+        if ((request->op == URING_OP_WRITE) && (res > 0)) {
+            request->done += (size_t)res;
+            if (request->done < request->len) {
+                continue;
+            }
+        } else if ((res < 0) || (request->op == URING_OP_WRITE)) {
+            /* A write of nothing would never complete. */
+            uringFailures++;
+            uringLastError = (res < 0) ? -res : EIO;
+        }
+        removeUringRequest(request);
+    }
+    __atomic_store_n(uringCqHead, head, __ATOMIC_RELEASE);
+}
+
+/**
+ * Waits for at least one request to complete and starts any which were waiting for it.
+ *
+ * Must be called while locked.
+ *
+ * @return TRUE if there is nothing to wait for or the ring can not be used.
+ */
+static int waitUringRequests() {
+    if (uringInFlight == 0) {
+        return TRUE;
+    }
+    if (enterUring(TRUE)) {
+        return TRUE;
+    }
+    reapUringCompletions();
+    return submitUringRequests();
+}
+
+static UringRequest* addUringRequest(int op, int fd) {
+    UringRequest *request;
+
+    request = malloc(sizeof(UringRequest));
+    if (!request) {
+        return NULL;
+    }
+    memset(request, 0, sizeof(UringRequest));
+    request->op = op;
+    request->fd = fd;
+    request->seq = ++uringSeq;
+    if (uringRequestsLast) {
+        uringRequestsLast->next = request;
+    } else {
+        uringRequests = request;
+    }
+    uringRequestsLast = request;
+    return request;
+}
+
+/**
+ * Returns the newest request of a descriptor.
+ */
+static UringRequest* getLastUringRequest(int fd) {
+    UringRequest *request;
+    UringRequest *last = NULL;
+
+    for (request = uringRequests; request; request = request->next) {
+        if (request->fd == fd) {
+            last = request;
+        }
+    }
+    return last;
+}
+
+int wrapperUringWrite(int fd, const char *buffer, size_t len) {
+    UringRequest *request;
+    char *newBuffer;
+
+    if (len == 0) {
+        return FALSE;
+    }
+
+    pthread_mutex_lock(&uringMutex);
+    request = getLastUringRequest(fd);
+    if (request && (request->op == URING_OP_WRITE) && !request->inFlight && (request->seq > uringSealedSeq)) {
+        /* Append to a write which is still waiting for the previous one, so a slow file system
+         *  results in fewer but larger writes. */
+        newBuffer = realloc(request->buffer, request->len + len);
+        if (!newBuffer) {
+            pthread_mutex_unlock(&uringMutex);
+            return TRUE;
+        }
+        request->buffer = newBuffer;
+    } else {
+        request = addUringRequest(URING_OP_WRITE, fd);
+        if (!request) {
+            pthread_mutex_unlock(&uringMutex);
+            return TRUE;
+        }
+        request->buffer = malloc(len);
+        if (!request->buffer) {
+            removeUringRequest(request);
+            pthread_mutex_unlock(&uringMutex);
+            return TRUE;
+        }
+    }
+    memcpy(request->buffer + request->len, buffer, len);
+    request->len += len;
+    uringPendingBytes += len;
+
+    submitUringRequests();
+    /* Do not let the memory grow without limit if the file system does not keep up. */
+    while (uringPendingBytes > URING_PENDING_BYTES_MAX) {
+        if (waitUringRequests()) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&uringMutex);
+    return FALSE;
+}
+
+int wrapperUringClose(int fd) {
+    pthread_mutex_lock(&uringMutex);
+    if (!addUringRequest(URING_OP_CLOSE, fd)) {
+        /* The descriptor must not be closed before its writes complete. */
+        while (getLastUringRequest(fd)) {
+            if (waitUringRequests()) {
+                break;
+            }
+        }
+        pthread_mutex_unlock(&uringMutex);
+        close(fd);
+        return TRUE;
+    }
+    submitUringRequests();
+    pthread_mutex_unlock(&uringMutex);
+    return FALSE;
+}
+
+int wrapperUringWriteLine(FILE *fp, const TCHAR *line) {
+    char *buffer;
+    size_t len;
+    int fd;
+
+    if (!wrapperUringIsAvailable()) {
+        return TRUE;
+    }
+#ifdef UNICODE
+    len = wcstombs(NULL, line, MBSTOWCS_QUERY_LENGTH);
+    if (len == (size_t)-1) {
+        return TRUE;
+    }
+    buffer = malloc(len + 2);
+    if (!buffer) {
+        return TRUE;
+    }
+    wcstombs(buffer, line, len + 1);
+#else
+    len = strlen(line);
+    buffer = malloc(len + 2);
+    if (!buffer) {
+        return TRUE;
+    }
+    strcpy(buffer, line);
+#endif
+    buffer[len++] = '\n';
+
+    /* Nothing was written to the stream so it can be closed without blocking. */
+    fd = fcntl(fileno(fp), F_DUPFD_CLOEXEC, 0);
+    if (fd < 0) {
+        free(buffer);
+        return TRUE;
+    }
+    fclose(fp);
+
+    if (wrapperUringWrite(fd, buffer, len)) {
+        /* Out of memory, the line still needs to be written. */
+        if (write(fd, buffer, len) != (ssize_t)len) {
+            /* Nothing more can be done. */
+        }
+    }
+    wrapperUringClose(fd);
+    free(buffer);
+    return FALSE;
+}
+
+void wrapperUringReap() {
+    int failures;
+
+    if (!wrapperUringIsAvailable()) {
+        return;
+    }
+
+    pthread_mutex_lock(&uringMutex);
+    reapUringCompletions();
+    submitUringRequests();
+    failures = uringFailures;
+    errno = uringLastError;
+    uringFailures = 0;
+    pthread_mutex_unlock(&uringMutex);
+
+    if (failures > 0) {
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN,
+            TEXT("%d asynchronous write(s) to the log file or status files failed. %s"), failures, getLastErrorText());
+    }
+}
+
+void wrapperUringDrain() {
+    if (!wrapperUringIsAvailable()) {
+        return;
+    }
+
+    pthread_mutex_lock(&uringMutex);
+    reapUringCompletions();
+    submitUringRequests();
+    while (uringRequests) {
+        if (waitUringRequests()) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&uringMutex);
+}
+
+unsigned long wrapperUringMark() {
+    unsigned long mark;
+
+    if (!wrapperUringIsAvailable()) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&uringMutex);
+    /* Later writes must not be appended to a request which is waited for. */
+    uringSealedSeq = uringSeq;
+    mark = uringSeq;
+    pthread_mutex_unlock(&uringMutex);
+    return mark;
+}
+
+/**
+ * Returns TRUE if a request made up to the mark is still queued.
+ *
+ * Must be called while locked.
+ */
+static int isUringMarkPending(unsigned long mark) {
+    UringRequest *request;
+
+    for (request = uringRequests; request; request = request->next) {
+        if (request->seq <= mark) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+void wrapperUringWaitMark(unsigned long mark) {
+    if ((mark == 0) || !wrapperUringIsAvailable()) {
+        return;
+    }
+
+    pthread_mutex_lock(&uringMutex);
+    reapUringCompletions();
+    submitUringRequests();
+    while (isUringMarkPending(mark)) {
+        if (waitUringRequests()) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&uringMutex);
+}
+
+void wrapperUringDispose() {
+    if (!wrapperUringIsAvailable()) {
+        return;
+    }
+
+    wrapperUringDrain();
+
+    pthread_mutex_lock(&uringMutex);
+    if (uringInFlight == 0) {
+        /* Requests which could not be submitted at all are dropped. */
+        while (uringRequests) {
+            if (uringRequests->op == URING_OP_CLOSE) {
+                close(uringRequests->fd);
+            }
+            removeUringRequest(uringRequests);
+        }
+        releaseUringMaps();
+        close(uringFD);
+        uringFD = -1;
+    }
+    /* Otherwise the kernel may still use the buffers so they are leaked on purpose. */
+    pthread_mutex_unlock(&uringMutex);
+}
+#endif
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 1999, 2020 Tanuki Software, Ltd.
+ * http://www.tanukisoftware.com
+ * All rights reserved.
+ *
+ * This software is the proprietary information of Tanuki Software.
+ * You shall use it only in accordance with the terms of the
+ * license agreement you entered into with Tanuki Software.
+ * http://wrapper.tanukisoftware.com/doc/english/licenseOverview.html
+ */
+
+/**
+ * Asynchronous file writes through an io_uring submission ring.
+ *
+ * Writes are copied and submitted to the kernel without waiting for them to complete, so a slow
+ *  file system does not block the calling thread.  Writes to the same descriptor are always
+ *  completed in the order they were requested.  The completions are reaped by the main event
+ *  loop.  The ring is only available on Linux, and only if the kernel supports it.  Callers must
+ *  fall back to normal file access whenever wrapperUringIsAvailable() returns FALSE.
+ */
+
+#ifndef _WRAPPER_URING_H
+#define _WRAPPER_URING_H
+
+#include <stdio.h>
+#include "wrapper_i18n.h"
+
+/* The headers of old build hosts do not define io_uring. */
+#if defined(LINUX) && defined(__has_include)
+ #if __has_include(<linux/io_uring.h>)
+  #define WRAPPER_URING_SUPPORTED
+ #endif
+#endif
+
+#ifdef WRAPPER_URING_SUPPORTED
+/**
+ * Sets up the ring.  Must be called after the Wrapper was daemonized.
+ *
+ * @return TRUE if io_uring is not available.
+ */
+extern int wrapperUringInit();
+
+/**
+ * Returns TRUE if the ring was set up and can be used.
+ */
+extern int wrapperUringIsAvailable();
+
+/**
+ * Queues a write of a copy of the buffer to the current position of a descriptor.
+ *
+ * @return TRUE if there were any problems.
+ */
+extern int wrapperUringWrite(int fd, const char *buffer, size_t len);
+
+/**
+ * Queues the closing of a descriptor once all of its pending writes are complete.  The
+ *  descriptor must not be used by the caller afterwards.
+ *
+ * @return TRUE if there were any problems.  The descriptor was closed in any case.
+ */
+extern int wrapperUringClose(int fd);
+
+/**
+ * Queues a line followed by a line feed to be written to a newly opened file, which is then
+ *  closed.  The stream must not have been written to.
+ *
+ * @return TRUE if the ring is not available.  The stream is left untouched in this case.
+ */
+extern int wrapperUringWriteLine(FILE *fp, const TCHAR *line);
+
+/**
+ * Processes any completed requests without waiting, and reports failed writes.
+ *  Called from the main event loop.
+ */
+extern void wrapperUringReap();
+
+/**
+ * Waits until all queued requests are complete.
+ */
+extern void wrapperUringDrain();
+
+/**
+ * Marks the requests queued so far so that they can be waited for with wrapperUringWaitMark().
+ *  Data written later is never added to them.
+ * @return The mark, or 0 if the ring is not available.
+ */
+extern unsigned long wrapperUringMark();
+
+/**
+ * Waits until all requests queued before the mark are complete.  Later requests are not
+ *  waited for, so a busy writer does not delay the caller.
+ */
+extern void wrapperUringWaitMark(unsigned long mark);
+
+/**
+ * Waits for all queued requests and releases the ring.
+ */
+extern void wrapperUringDispose();
+#endif
+
+#endif
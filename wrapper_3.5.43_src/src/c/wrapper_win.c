@@ -2966,6 +2966,21 @@ int wrapperLaunchJavaApp() {
     return FALSE;
 }
 
+/**
+ * Returns a time in microseconds from a monotonic clock, for measuring short durations.  The
+ *  value wraps, so only the difference between two values is meaningful.
+ */
+unsigned int wrapperGetMicroTime() {
+    LARGE_INTEGER count;
+    LARGE_INTEGER frequency;
+
+    if ((!QueryPerformanceCounter(&count)) || (!QueryPerformanceFrequency(&frequency)) || (frequency.QuadPart == 0)) {
+        return (unsigned int)GetTickCount() * 1000U;
+    }
+    /* Split the calculation so it can not overflow. */
+    return (unsigned int)((count.QuadPart / frequency.QuadPart) * 1000000 + (count.QuadPart % frequency.QuadPart) * 1000000 / frequency.QuadPart);
+}
+
 /**
  * Returns a tick count that can be used in combination with the
  *  wrapperGetTickAgeSeconds() function to perform time keeping.
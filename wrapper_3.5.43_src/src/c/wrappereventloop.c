@@ -51,6 +51,10 @@
 #else /* UNIX */
 #include <unistd.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #endif
 #include "wrapper.h"
 #include "logger.h"
@@ -59,11 +63,486 @@
 #endif
 #include "wrapper_encoding.h"
 #include "wrapper_i18n.h"
+#include "wrapper_uring.h"
+#include "wrapper_statuspage.h"
+#ifdef CUNIT
+#include "CUnit/Basic.h"
+#endif
 
 #ifndef MAX
 #define MAX(a, b)  (((a) > (b)) ? (a) : (b))
 #endif
 
+/* Deadlines of the periodic tasks of the main loop.  They are kept in a binary heap so each
+ *  cycle only needs to look at the earliest one, whatever the number of tasks.  The timeouts
+ *  of the Java states and pings are checked by the state engine, which runs every cycle. */
+#define LOOP_DEADLINE_ANCHOR            0
+#define LOOP_DEADLINE_COMMAND           1
+#define LOOP_DEADLINE_MEMORY_OUTPUT     2
+#define LOOP_DEADLINE_CPU_OUTPUT        3
+#define LOOP_DEADLINE_PAGEFAULT_OUTPUT  4
+#define LOOP_DEADLINE_LOGFILE_FLUSH     5
+#define LOOP_DEADLINE_LOGFILE_CLOSE     6
+#define LOOP_DEADLINE_LOOP_STATS        7
+#define LOOP_DEADLINE_PING_STATS        8
+#define LOOP_DEADLINE_COUNT             9
+
+static TICKS loopDeadlineTicks[LOOP_DEADLINE_COUNT];
+static int loopDeadlineHeap[LOOP_DEADLINE_COUNT];
+static int loopDeadlinePos[LOOP_DEADLINE_COUNT]; /* Position of each deadline in the heap, or -1 if not set. */
+static int loopDeadlineCount = 0;
+
+/**
+ * Returns TRUE if the heap entry at posA must come before the one at posB.  Ticks wrap, so
+ *  they are compared by their difference, which is valid as long as all deadlines are within
+ *  half the range of TICKS.
+ */
+static int loopDeadlineBefore(int posA, int posB) {
+    return wrapperGetTickAgeTicks(loopDeadlineTicks[loopDeadlineHeap[posB]], loopDeadlineTicks[loopDeadlineHeap[posA]]) < 0;
+}
+
+static void loopDeadlineSwap(int posA, int posB) {
+    int id = loopDeadlineHeap[posA];
+
+    loopDeadlineHeap[posA] = loopDeadlineHeap[posB];
+    loopDeadlineHeap[posB] = id;
+    loopDeadlinePos[loopDeadlineHeap[posA]] = posA;
+    loopDeadlinePos[loopDeadlineHeap[posB]] = posB;
+}
+
+/**
+ * Restores the heap order after the entry at pos was changed.
+ */
+static void loopDeadlineFix(int pos) {
+    int child;
+
+    while ((pos > 0) && loopDeadlineBefore(pos, (pos - 1) / 2)) {
+        loopDeadlineSwap(pos, (pos - 1) / 2);
+        pos = (pos - 1) / 2;
+    }
+    while ((child = pos * 2 + 1) < loopDeadlineCount) {
+        if ((child + 1 < loopDeadlineCount) && loopDeadlineBefore(child + 1, child)) {
+            child++;
+        }
+        if (!loopDeadlineBefore(child, pos)) {
+            break;
+        }
+        loopDeadlineSwap(pos, child);
+        pos = child;
+    }
+}
+
+static void initLoopDeadlines() {
+    int id;
+
+    for (id = 0; id < LOOP_DEADLINE_COUNT; id++) {
+        loopDeadlinePos[id] = -1;
+    }
+    loopDeadlineCount = 0;
+}
+
+/**
+ * Sets or moves a deadline.
+ */
+static void setLoopDeadline(int id, TICKS ticks) {
+    loopDeadlineTicks[id] = ticks;
+    if (loopDeadlinePos[id] < 0) {
+        loopDeadlinePos[id] = loopDeadlineCount;
+        loopDeadlineHeap[loopDeadlineCount] = id;
+        loopDeadlineCount++;
+    }
+    loopDeadlineFix(loopDeadlinePos[id]);
+}
+
+static void cancelLoopDeadline(int id) {
+    int pos = loopDeadlinePos[id];
+
+    if (pos >= 0) {
+        loopDeadlineCount--;
+        if (pos < loopDeadlineCount) {
+            loopDeadlineSwap(pos, loopDeadlineCount);
+            loopDeadlinePos[id] = -1;
+            loopDeadlineFix(pos);
+        } else {
+            loopDeadlinePos[id] = -1;
+        }
+    }
+}
+
+static int isLoopDeadlineSet(int id) {
+    return loopDeadlinePos[id] >= 0;
+}
+
+/**
+ * Removes the earliest deadline if it has expired.
+ *
+ * @return The id of the expired deadline, or -1 if none has expired.
+ */
+static int popExpiredLoopDeadline(TICKS nowTicks) {
+    int id;
+
+    if ((loopDeadlineCount == 0) || (!wrapperTickExpired(nowTicks, loopDeadlineTicks[loopDeadlineHeap[0]]))) {
+        return -1;
+    }
+    id = loopDeadlineHeap[0];
+    cancelLoopDeadline(id);
+    return id;
+}
+
+/* Durations are recorded in histograms with 8 buckets per power of two, so any value is known
+ *  within 12.5%.  This keeps the cost of a sample constant and the memory fixed, whatever the
+ *  range of the values.  240 buckets cover more than an hour in microseconds. */
+#define HISTOGRAM_BUCKETS               240
+
+/**
+ * Returns the histogram bucket of a duration.  Values below 8 have their own bucket.  Above,
+ *  the bucket is given by the position of the highest bit and the 3 bits which follow it.
+ */
+static int getHistogramBucket(unsigned int micros) {
+    int shift = 0;
+
+    if (micros < 8) {
+        return (int)micros;
+    }
+    while ((micros >> shift) >= 16) {
+        shift++;
+    }
+    return 8 + shift * 8 + (int)((micros >> shift) - 8);
+}
+
+/**
+ * Returns the highest duration which falls in a histogram bucket.
+ */
+static unsigned int getHistogramBucketMax(int bucket) {
+    int shift;
+
+    if (bucket < 8) {
+        return (unsigned int)bucket;
+    }
+    shift = (bucket - 8) / 8;
+    return ((unsigned int)(9 + (bucket - 8) % 8) << shift) - 1;
+}
+
+/**
+ * Returns the smallest recorded duration which is at least as large as the specified number of
+ *  samples.  The value is never larger than the maximum.
+ */
+static unsigned int getHistogramPercentile(const unsigned int *histogram, unsigned int max, unsigned int samples) {
+    int bucket;
+    unsigned int count = 0;
+    unsigned int value;
+
+    for (bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+        count += histogram[bucket];
+        if (count >= samples) {
+            value = getHistogramBucketMax(bucket);
+            return (value < max) ? value : max;
+        }
+    }
+    return max;
+}
+
+/* Durations of the phases of each main loop cycle. */
+#define LOOP_PHASE_LOGGER               0
+#define LOOP_PHASE_SIGNALS              1
+#define LOOP_PHASE_OUTPUT               2
+#define LOOP_PHASE_PROTOCOL             3
+#define LOOP_PHASE_PERIODIC             4
+#define LOOP_PHASE_STATE                5
+#define LOOP_PHASE_TOTAL                6
+#define LOOP_PHASE_COUNT                7
+
+static const TCHAR *loopPhaseNames[LOOP_PHASE_COUNT] = {
+    TEXT("logger"), TEXT("signals"), TEXT("output"), TEXT("protocol"), TEXT("periodic"), TEXT("state"), TEXT("total")
+};
+static unsigned int loopPhaseHistograms[LOOP_PHASE_COUNT][HISTOGRAM_BUCKETS];
+static unsigned int loopPhaseMax[LOOP_PHASE_COUNT];
+static unsigned int loopPhaseCycle[LOOP_PHASE_COUNT];
+static unsigned int loopStatsCycles = 0;
+static int loopStatsActive = FALSE; /* TRUE if the current cycle is being recorded. */
+
+/**
+ * Starts a loop cycle and its first phase.  The whole cycle is recorded only if the loop
+ *  statistics are enabled when it starts, as they can be enabled by the command file.
+ */
+static void startLoopCycle(unsigned int *phaseStart) {
+    loopStatsActive = wrapperData->isLoopStatsOutputEnabled;
+    if (loopStatsActive) {
+        *phaseStart = wrapperGetMicroTime();
+    }
+}
+
+/**
+ * Adds the time elapsed since *phaseStart to the current cycle of a phase, and starts the next
+ *  phase.  Does nothing unless the cycle is being recorded.
+ */
+static void recordLoopPhase(int phase, unsigned int *phaseStart) {
+    unsigned int now;
+
+    if (loopStatsActive) {
+        now = wrapperGetMicroTime();
+        loopPhaseCycle[phase] += now - *phaseStart;
+        *phaseStart = now;
+    }
+}
+
+/**
+ * Records the phases of a completed loop cycle in their histograms.
+ */
+static void endLoopCycle() {
+    int phase;
+    unsigned int value;
+    unsigned int total = 0;
+
+    if (!loopStatsActive) {
+        return;
+    }
+    for (phase = 0; phase < LOOP_PHASE_COUNT; phase++) {
+        if (phase == LOOP_PHASE_TOTAL) {
+            value = total;
+        } else {
+            value = loopPhaseCycle[phase];
+            total += value;
+        }
+        loopPhaseHistograms[phase][getHistogramBucket(value)]++;
+        if (value > loopPhaseMax[phase]) {
+            loopPhaseMax[phase] = value;
+        }
+        loopPhaseCycle[phase] = 0;
+    }
+    loopStatsCycles++;
+}
+
+/**
+ * Logs the 50th and 99th percentiles and the maximum duration of each phase of the main loop
+ *  since the statistics were last reset.
+ *
+ * @param reset TRUE if the statistics should be reset afterwards.
+ */
+static void dumpLoopStats(int reset) {
+    int phase;
+
+    if (loopStatsCycles == 0) {
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("Loop phases: no cycles recorded."));
+        return;
+    }
+    for (phase = 0; phase < LOOP_PHASE_COUNT; phase++) {
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS,
+            TEXT("Loop phase %s: p50=%uus, p99=%uus, max=%uus (%u cycles)"),
+            loopPhaseNames[phase],
+            getHistogramPercentile(loopPhaseHistograms[phase], loopPhaseMax[phase], (loopStatsCycles + 1) / 2),
+            getHistogramPercentile(loopPhaseHistograms[phase], loopPhaseMax[phase], loopStatsCycles - loopStatsCycles / 100),
+            loopPhaseMax[phase],
+            loopStatsCycles);
+    }
+    if (reset) {
+        memset(loopPhaseHistograms, 0, sizeof(loopPhaseHistograms));
+        memset(loopPhaseMax, 0, sizeof(loopPhaseMax));
+        loopStatsCycles = 0;
+    }
+}
+
+/* Round trip times of the pings, in microseconds.  The report histogram covers the pings since
+ *  the statistics were last logged.  The recent histogram is halved every PING_RECENT_SAMPLES
+ *  pings so its percentiles follow the trend, whether or not the statistics are logged. */
+#define PING_RECENT_SAMPLES             64
+/* Minimum number of recent pings before their 99th percentile is compared with the timeout. */
+#define PING_TREND_MIN_SAMPLES          16
+/* Number of stable round trips after which an adaptive interval is lengthened by a second. */
+#define PING_STABLE_SAMPLES             4
+/* Round trip times above this are recorded as this value when smoothed, to avoid overflows. */
+#define PING_RTT_SMOOTHED_MAX           1000000000
+
+static unsigned int pingRttHistogram[HISTOGRAM_BUCKETS];
+static unsigned int pingRttMax = 0;
+static unsigned int pingRttCount = 0;
+static unsigned int pingRecentHistogram[HISTOGRAM_BUCKETS];
+static unsigned int pingRecentCount = 0;
+static unsigned int pingRecentSinceDecay = 0;
+static unsigned int pingSmoothedRtt = 0;    /* 0 until the first ping of the current JVM is answered. */
+static unsigned int pingRttVariation = 0;   /* Mean deviation of the round trip times, or jitter. */
+static int pingStableCount = 0;
+static int pingTrendAlerted = FALSE;
+
+/**
+ * Returns the 99th percentile of the recent ping round trip times in microseconds, or 0 if
+ *  there are not enough of them yet.
+ */
+static unsigned int getRecentPingPercentile() {
+    if (pingRecentCount < PING_TREND_MIN_SAMPLES) {
+        return 0;
+    }
+    return getHistogramPercentile(pingRecentHistogram, 0xFFFFFFFF, pingRecentCount - pingRecentCount / 100);
+}
+
+/**
+ * Forgets the recent round trip times when a new JVM is launched, as they say nothing about
+ *  it.  The interval goes back to wrapper.ping.interval.
+ */
+static void resetPingTrend() {
+    memset(pingRecentHistogram, 0, sizeof(pingRecentHistogram));
+    pingRecentCount = 0;
+    pingRecentSinceDecay = 0;
+    pingSmoothedRtt = 0;
+    pingRttVariation = 0;
+    pingStableCount = 0;
+    pingTrendAlerted = FALSE;
+    wrapperData->pingIntervalCurrent = wrapperData->pingInterval;
+}
+
+/**
+ * Shortens the ping interval while the round trip times rise, so a JVM which is getting slower
+ *  is watched more closely, and lengthens it again up to wrapper.ping.interval once they are
+ *  stable.
+ *
+ * @param rising TRUE if the last round trip time was well above the smoothed one.
+ */
+static void adaptPingInterval(int rising, unsigned int micros) {
+    int interval = wrapperData->pingIntervalCurrent;
+
+    if (rising) {
+        pingStableCount = 0;
+        interval = __max(wrapperData->pingIntervalMin, interval / 2);
+    } else if (++pingStableCount >= PING_STABLE_SAMPLES) {
+        pingStableCount = 0;
+        interval = __min(wrapperData->pingInterval, interval + 1);
+    }
+    if (interval != wrapperData->pingIntervalCurrent) {
+        if (wrapperData->isDebugging) {
+            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_DEBUG,
+                TEXT("Ping round trip time %s (%uus, smoothed %uus, jitter %uus).  Pinging every %d seconds."),
+                rising ? TEXT("rising") : TEXT("stable"), micros, pingSmoothedRtt, pingRttVariation, interval);
+        }
+        wrapperData->pingIntervalCurrent = interval;
+    }
+}
+
+/**
+ * Warns, and runs the wrapper.ping.trend.action actions, once the 99th percentile of the recent
+ *  round trip times reaches wrapper.ping.trend.threshold percent of wrapper.ping.timeout.  This
+ *  gives a chance to act on a JVM whose pauses are growing before it is considered hung.  The
+ *  alert is armed again once the percentile falls below half of the threshold.
+ */
+static void checkPingTrend() {
+    unsigned int p99Millis;
+    unsigned int thresholdMillis;
+
+    if ((wrapperData->pingTrendThreshold <= 0) || (wrapperData->pingTimeout <= 0) || (pingRecentCount < PING_TREND_MIN_SAMPLES)) {
+        return;
+    }
+    p99Millis = getRecentPingPercentile() / 1000;
+    thresholdMillis = (unsigned int)wrapperData->pingTimeout * 10 * (unsigned int)wrapperData->pingTrendThreshold;
+
+    if ((!pingTrendAlerted) && (p99Millis >= thresholdMillis)) {
+        pingTrendAlerted = TRUE;
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN,
+            TEXT("The 99th percentile of the recent ping round trip times is %ums, %d%% or more of wrapper.ping.timeout (%d seconds)."),
+            p99Millis, wrapperData->pingTrendThreshold, wrapperData->pingTimeout);
+        wrapperProcessActionList(wrapperData->pingTrendActionList, TEXT("JVM ping responses are approaching the timeout."),
+                                 WRAPPER_ACTION_SOURCE_CODE_PING_TREND, 0, FALSE, wrapperData->errorExitCode);
+    } else if (pingTrendAlerted && (p99Millis < thresholdMillis / 2)) {
+        pingTrendAlerted = FALSE;
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS,
+            TEXT("The 99th percentile of the recent ping round trip times is back down to %ums."), p99Millis);
+    }
+}
+
+void wrapperRecordPingRTT(unsigned int micros) {
+    int bucket = getHistogramBucket(micros);
+    unsigned int smoothed;
+    unsigned int deviation;
+    int rising = FALSE;
+    int i;
+
+    pingRttHistogram[bucket]++;
+    if (micros > pingRttMax) {
+        pingRttMax = micros;
+    }
+    pingRttCount++;
+
+    if (pingRecentSinceDecay >= PING_RECENT_SAMPLES) {
+        pingRecentCount = 0;
+        for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+            pingRecentHistogram[i] >>= 1;
+            pingRecentCount += pingRecentHistogram[i];
+        }
+        pingRecentSinceDecay = 0;
+    }
+    pingRecentHistogram[bucket]++;
+    pingRecentCount++;
+    pingRecentSinceDecay++;
+
+    /* Smoothed round trip time and mean deviation, computed as TCP does for its retransmission timeout. */
+    smoothed = __min(micros, PING_RTT_SMOOTHED_MAX);
+    if (pingSmoothedRtt == 0) {
+        pingSmoothedRtt = smoothed;
+        pingRttVariation = smoothed / 2;
+    } else {
+        deviation = (smoothed > pingSmoothedRtt) ? smoothed - pingSmoothedRtt : pingSmoothedRtt - smoothed;
+        rising = (smoothed > pingSmoothedRtt) && (deviation > 4 * pingRttVariation);
+        pingRttVariation = pingRttVariation - pingRttVariation / 4 + deviation / 4;
+        pingSmoothedRtt = pingSmoothedRtt - pingSmoothedRtt / 8 + smoothed / 8;
+    }
+
+    if (wrapperData->pingIntervalAdaptive) {
+        adaptPingInterval(rising, micros);
+    }
+    checkPingTrend();
+}
+
+/**
+ * Logs the 50th and 99th percentiles and the maximum of the ping round trip times since the
+ *  statistics were last reset, along with the smoothed round trip time and its jitter.
+ *
+ * @param reset TRUE if the statistics should be reset afterwards.
+ */
+static void dumpPingStats(int reset) {
+    if (pingRttCount == 0) {
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("Ping round trips: no pings answered."));
+        return;
+    }
+    log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS,
+        TEXT("Ping round trips: p50=%uus, p99=%uus, max=%uus, smoothed=%uus, jitter=%uus, interval=%ds (%u pings)"),
+        getHistogramPercentile(pingRttHistogram, pingRttMax, (pingRttCount + 1) / 2),
+        getHistogramPercentile(pingRttHistogram, pingRttMax, pingRttCount - pingRttCount / 100),
+        pingRttMax, pingSmoothedRtt, pingRttVariation, wrapperData->pingIntervalCurrent, pingRttCount);
+    if (reset) {
+        memset(pingRttHistogram, 0, sizeof(pingRttHistogram));
+        pingRttMax = 0;
+        pingRttCount = 0;
+    }
+}
+
+/**
+ * Returns TRUE if changes to the specified file are watched so it does not need to be polled.
+ */
+static int isFileWatched(int watch, const TCHAR *filename) {
+#ifdef WIN32
+    return FALSE;
+#else
+    return wrapperIsFileWatched(watch, filename);
+#endif
+}
+
+/**
+ * Returns the number of milliseconds the main loop can sleep before the earliest deadline,
+ *  which is never more than maxMs.
+ */
+static int getLoopSleepMs(TICKS nowTicks, int maxMs) {
+    int ticks;
+
+    if (loopDeadlineCount == 0) {
+        return maxMs;
+    }
+    ticks = wrapperGetTickAgeTicks(nowTicks, loopDeadlineTicks[loopDeadlineHeap[0]]);
+    if (ticks <= 0) {
+        return 0;
+    } else if (ticks >= maxMs / WRAPPER_TICK_MS) {
+        return maxMs;
+    }
+    return ticks * WRAPPER_TICK_MS;
+}
+
 /**
  * Returns a constant text representation of the specified Wrapper State.
  *
@@ -258,6 +737,12 @@ void writeStateFile(const TCHAR *filename, const TCHAR *state, int newUmask
         if (fp != NULL) {
 #ifndef WIN32
             changePidFileGroup(filename, newGroup);
+#endif
+#ifdef WRAPPER_URING_SUPPORTED
+            /* Do not block the main loop if the file system is slow. */
+            if (!wrapperUringWriteLine(fp, state)) {
+                return;
+            }
 #endif
             _ftprintf(fp, TEXT("%s\n"), state);
             fclose(fp);
@@ -477,441 +962,959 @@ void handleDebugJVMTimeout(TICKS nowTicks, const TCHAR *message, const TCHAR *ti
         log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS,
             TEXT("      DebugJVM timeout.  Disable current %s timeout."), timer);
     }
-    wrapperUpdateJavaStateTimeout(nowTicks, -1);
+    wrapperUpdateJavaStateTimeout(nowTicks, -1);
+}
+
+/**
+ * Tests for the existence of the anchor file.  If it does not exist then
+ *  the Wrapper will begin its shutdown process.  Called each time the
+ *  anchor deadline expires.
+ *
+ * nowTicks: The tick counter value this time through the event loop.
+ */
+void anchorPoll(TICKS nowTicks) {
+#if defined(WIN32) && !defined(WIN64)
+    struct _stat64i32 fileStat;
+#else
+    struct stat fileStat;
+#endif
+    int result;
+
+#ifdef _DEBUG
+    log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO,
+        TEXT("Anchor poll, now=%d"), nowTicks);
+#endif
+
+    if (wrapperData->anchorFilename) {
+        if (wrapperData->isLoopOutputEnabled) {
+            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("    Loop: check anchor file"));
+        }
+
+        result = _tstat(wrapperData->anchorFilename, &fileStat);
+        if (result == 0) {
+            /* Anchor file exists.  Do nothing. */
+#ifdef _DEBUG
+            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO,
+                TEXT("The anchor file %s exists."), wrapperData->anchorFilename);
+#endif
+        } else {
+            /* Anchor file is gone. */
+#ifdef _DEBUG
+            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO,
+                TEXT("The anchor file %s was deleted."), wrapperData->anchorFilename);
+#endif
+
+            /* Unless we are already doing so, start the shudown process. */
+            if (wrapperData->exitRequested || wrapperData->restartRequested ||
+                (wrapperData->jState == WRAPPER_JSTATE_STOP) ||
+                (wrapperData->jState == WRAPPER_JSTATE_STOPPING) ||
+                (wrapperData->jState == WRAPPER_JSTATE_STOPPED) ||
+                (wrapperData->jState == WRAPPER_JSTATE_KILLING) ||
+                (wrapperData->jState == WRAPPER_JSTATE_KILL) ||
+                (wrapperData->jState == WRAPPER_JSTATE_KILLED) ||
+                (wrapperData->jState == WRAPPER_JSTATE_DOWN_CHECK) ||
+                (wrapperData->jState == WRAPPER_JSTATE_DOWN_FLUSH) ||
+                (wrapperData->jState == WRAPPER_JSTATE_DOWN_CLEAN)) {
+                /* Already shutting down, so nothing more to do. */
+            } else {
+                /* Always force the shutdown as this was an external event. */
+                wrapperStopProcess(0, TRUE);
+            }
+
+            /* To make sure that the JVM will not be restarted for any reason,
+             *  start the Wrapper shutdown process as well. */
+            if ((wrapperData->wState == WRAPPER_WSTATE_STOPPING) ||
+                (wrapperData->wState == WRAPPER_WSTATE_STOPPED)) {
+                /* Already stopping. */
+            } else {
+                /* Start the shutdown process. */
+                log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("Anchor file deleted.  Shutting down."));
+                
+                wrapperSetWrapperState(WRAPPER_WSTATE_STOPPING);
+            }
+        }
+
+    }
+
+    /* Always rescheduled, as the anchor file may be set when the configuration is reloaded.  No polling is needed while the file is watched. */
+    if (!isFileWatched(WRAPPER_FILE_WATCH_ANCHOR, wrapperData->anchorFilename)) {
+        setLoopDeadline(LOOP_DEADLINE_ANCHOR, wrapperAddToTicks(nowTicks, wrapperData->anchorPollInterval));
+    }
+}
+
+#ifdef TEST_FORTIFY_SOURCE
+struct S {
+    struct T {
+        char buf[5];
+        int x;
+    } t;
+    char buf[20];
+} var;
+#endif
+
+#define MAX_COMMAND_LENGTH 80
+
+/* Results of a command. */
+#define COMMAND_RESULT_OK       0
+#define COMMAND_RESULT_EMPTY    1
+#define COMMAND_RESULT_UNKNOWN  2
+#define COMMAND_RESULT_INVALID  3
+#define COMMAND_RESULT_DISABLED 4
+
+/* Crashes which can be requested by the test commands. */
+#define COMMAND_CRASH_NONE             0
+#define COMMAND_CRASH_ACCESS_VIOLATION 1
+#define COMMAND_CRASH_BUFFER_OVERFLOW1 2
+
+/**
+ * Parses and executes a single command, as read from the command file or the
+ *  control socket.
+ *
+ * line: The command and its parameters, without any line feed.  It will be
+ *       modified.
+ * crash: Set to one of the COMMAND_CRASH_* constants if a test command requested
+ *        a crash.  The crash is caused later by performCommandCrash().
+ *
+ * Returns one of the COMMAND_RESULT_* constants.
+ */
+static int executeCommand(TCHAR *line, int *crash) {
+    TCHAR levelBuffer[16];
+    TCHAR *d;
+    TCHAR *command;
+    TCHAR *param1;
+    TCHAR *param2;
+    int exitCode;
+    int pauseTime;
+    int logLevel;
+    int oldLowLogLevel;
+    int newLowLogLevel;
+    int flag;
+    size_t i;
+    int result = COMMAND_RESULT_OK;
+
+    command = line;
+
+    /* Remove any leading space or tabs */
+    while (command[0] == TEXT(' ') || command[0] == TEXT('\t')) {
+        command++;
+    }
+    if (command[0] == TEXT('\0')) {
+        /* Empty line. Ignore it silently. */
+        return COMMAND_RESULT_EMPTY;
+    }
+    /* Remove any tailing space or tabs */
+    i = _tcslen(command) - 1;
+    while (command[i] == TEXT(' ') || command[i] == TEXT('\t')) {
+        i--;
+    }
+    command[i + 1] = TEXT('\0');
+
+    /** Look for the first space, everything after it will be the parameter(s). */
+    /* Look for parameter 1. */
+    if ((param1 = _tcschr(command, ' ')) != NULL ) {
+        param1[0] = TEXT('\0'); /* Terminate the command. */
+
+        /* Find the first non-space character. */
+        do {
+            param1++;
+        } while (param1[0] == TEXT(' '));
+    }
+    if (param1 != NULL) {
+        /* Look for parameter 2. */
+        if ((param2 = _tcschr(param1, ' ')) != NULL ) {
+            param2[0] = TEXT('\0'); /* Terminate param1. */
+
+            /* Find the first non-space character. */
+            do {
+                param2++;
+            } while (param2[0] == TEXT(' '));
+        }
+        if (param2 != NULL) {
+            /* Make sure parameter 2 is terminated. */
+            if ((d = _tcschr(param2, ' ')) != NULL ) {
+                d[0] = TEXT('\0'); /* Terminate param2. */
+            }
+        }
+    } else {
+        param2 = NULL;
+    }
+
+    /* Process the command. */
+    if (strcmpIgnoreCase(command, TEXT("RESTART")) == 0) {
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("Command '%s'. %s"), command, wrapperGetRestartProcessMessage());
+        wrapperRestartProcess();
+    } else if (strcmpIgnoreCase(command, TEXT("STOP")) == 0) {
+        if (param1 == NULL) {
+            exitCode = 0;
+        } else {
+            exitCode = _ttoi(param1);
+        }
+
+        if (exitCode < 0 || exitCode > 255) {
+            exitCode = wrapperData->errorExitCode;
+            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN,
+                TEXT("The exit code specified along with the 'STOP' command must be in the range %d to %d.\n  Changing to the default error exit code %d."), 1, 255, exitCode);
+        }
+
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("Command '%s'. Shutting down with exit code %d."), command, exitCode);
+
+        /* Always force the shutdown as this is an external event. */
+        wrapperStopProcess(exitCode, TRUE);
+
+        /* To make sure that the JVM will not be restarted for any reason,
+         *  start the Wrapper shutdown process as well. */
+        if ((wrapperData->wState == WRAPPER_WSTATE_STOPPING) ||
+            (wrapperData->wState == WRAPPER_WSTATE_STOPPED)) {
+            /* Already stopping. */
+        } else {
+            wrapperSetWrapperState(WRAPPER_WSTATE_STOPPING);
+        }
+    } else if (strcmpIgnoreCase(command, TEXT("PAUSE")) == 0) {
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("Command '%s'. %s"), command, wrapperGetPauseProcessMessage());
+        wrapperPauseProcess(WRAPPER_ACTION_SOURCE_CODE_COMMANDFILE);
+    } else if (strcmpIgnoreCase(command, TEXT("RESUME")) == 0) {
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("Command '%s'. %s"), command, wrapperGetResumeProcessMessage());
+        wrapperResumeProcess(WRAPPER_ACTION_SOURCE_CODE_COMMANDFILE);
+    } else if (strcmpIgnoreCase(command, TEXT("DUMP")) == 0) {
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("Command '%s'. Requesting a Thread Dump."), command);
+        wrapperRequestDumpJVMState();
+    } else if (strcmpIgnoreCase(command, TEXT("GC")) == 0) {
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("Command '%s'. Requesting a GC."), command);
+        wrapperRequestJVMGC(WRAPPER_ACTION_SOURCE_CODE_COMMANDFILE);
+    } else if ((strcmpIgnoreCase(command, TEXT("CONSOLE_LOGLEVEL")) == 0) ||
+            (strcmpIgnoreCase(command, TEXT("LOGFILE_LOGLEVEL")) == 0) ||
+            (strcmpIgnoreCase(command, TEXT("SYSLOG_LOGLEVEL")) == 0)) {
+        if (param1 == NULL) {
+            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN, TEXT("Command '%s' is missing its log level."), command);
+            result = COMMAND_RESULT_INVALID;
+        } else {
+            logLevel = getLogLevelForName(param1);
+            if (logLevel == LEVEL_UNKNOWN) {
+                log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN, TEXT("Command '%s' specified an unknown log level: '%'"), command, param1);
+                result = COMMAND_RESULT_INVALID;
+            } else {
+                oldLowLogLevel = getLowLogLevel();
+
+                if (strcmpIgnoreCase(command, TEXT("CONSOLE_LOGLEVEL")) == 0) {
+                    setConsoleLogLevelInt(logLevel);
+                    log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("Command '%s'. Set console log level to '%s'."), command, param1);
+                } else if (strcmpIgnoreCase(command, TEXT("LOGFILE_LOGLEVEL")) == 0) {
+                    setLogfileLevelInt(logLevel);
+                    log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("Command '%s'. Set log file log level to '%s'."), command, param1);
+                } else if (strcmpIgnoreCase(command, TEXT("SYSLOG_LOGLEVEL")) == 0) {
+                    setSyslogLevelInt(logLevel);
+                    log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("Command '%s'. Set syslog log level to '%s'."), command, param1);
+                } else {
+                    /* Shouldn't get here. */
+                    log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN, TEXT("Command '%s' lead to an unexpected state."), command);
+                    result = COMMAND_RESULT_INVALID;
+                }
+
+                newLowLogLevel = getLowLogLevel();
+                if (oldLowLogLevel != newLowLogLevel) {
+                    wrapperData->isDebugging = (newLowLogLevel <= LEVEL_DEBUG) || (getCrashBufferLevelInt() <= LEVEL_DEBUG);
+
+                    _sntprintf(levelBuffer, 16, TEXT("%d"), getLowLogLevel());
+                    wrapperProtocolFunction(WRAPPER_MSG_LOW_LOG_LEVEL, levelBuffer);
+                }
+            }
+        }
+    } else if ((strcmpIgnoreCase(command, TEXT("LOOP_OUTPUT")) == 0) ||
+            (strcmpIgnoreCase(command, TEXT("STATE_OUTPUT")) == 0) ||
+            (strcmpIgnoreCase(command, TEXT("MEMORY_OUTPUT")) == 0) ||
+            (strcmpIgnoreCase(command, TEXT("CPU_OUTPUT")) == 0) ||
+            (strcmpIgnoreCase(command, TEXT("TIMER_OUTPUT")) == 0) ||
+            (strcmpIgnoreCase(command, TEXT("SLEEP_OUTPUT")) == 0) ||
+            (strcmpIgnoreCase(command, TEXT("LOOP_STATS_OUTPUT")) == 0) ||
+            (strcmpIgnoreCase(command, TEXT("PING_STATS_OUTPUT")) == 0)) {
+        flag = ((param1 != NULL) && (strcmpIgnoreCase(param1, TEXT("TRUE")) == 0));
+        if (strcmpIgnoreCase(command, TEXT("LOOP_OUTPUT")) == 0) {
+            wrapperData->isLoopOutputEnabled = flag;
+        } else if (strcmpIgnoreCase(command, TEXT("STATE_OUTPUT")) == 0) {
+            wrapperData->isStateOutputEnabled = flag;
+        } else if (strcmpIgnoreCase(command, TEXT("MEMORY_OUTPUT")) == 0) {
+            wrapperData->isMemoryOutputEnabled = flag;
+        } else if (strcmpIgnoreCase(command, TEXT("CPU_OUTPUT")) == 0) {
+            wrapperData->isCPUOutputEnabled = flag;
+        } else if (strcmpIgnoreCase(command, TEXT("TIMER_OUTPUT")) == 0) {
+            wrapperData->isTickOutputEnabled = flag;
+        } else if (strcmpIgnoreCase(command, TEXT("SLEEP_OUTPUT")) == 0) {
+            wrapperData->isSleepOutputEnabled = flag;
+        } else if (strcmpIgnoreCase(command, TEXT("LOOP_STATS_OUTPUT")) == 0) {
+            wrapperData->isLoopStatsOutputEnabled = flag;
+        } else if (strcmpIgnoreCase(command, TEXT("PING_STATS_OUTPUT")) == 0) {
+            wrapperData->isPingStatsOutputEnabled = flag;
+        }
+        if (flag) {
+            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("Command '%s'. Enable %s."), command, command);
+        } else {
+            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("Command '%s'. Disable %s."), command, command);
+        }
+    } else if (strcmpIgnoreCase(command, TEXT("LOOP_STATS")) == 0) {
+        if (wrapperData->isLoopStatsOutputEnabled) {
+            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("Command '%s'. Main loop statistics:"), command);
+            dumpLoopStats(FALSE);
+        } else {
+            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN, TEXT("Command '%s'.  Main loop statistics are not enabled."), command);
+            result = COMMAND_RESULT_DISABLED;
+        }
+    } else if (strcmpIgnoreCase(command, TEXT("PING_STATS")) == 0) {
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("Command '%s'. Ping statistics:"), command);
+        dumpPingStats(FALSE);
+    } else if ((strcmpIgnoreCase(command, TEXT("CLOSE_SOCKET")) == 0) || (strcmpIgnoreCase(command, TEXT("CLOSE_BACKEND")) == 0)) {
+        if (wrapperData->commandFileTests) {
+            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN, TEXT("Command '%s'.  Closing backend socket to JVM..."), command);
+            wrapperProtocolClose();
+        } else {
+            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN, TEXT("Command '%s'.  Tests disabled."), command);
+            result = COMMAND_RESULT_DISABLED;
+        }
+    } else if (strcmpIgnoreCase(command, TEXT("PAUSE_THREAD")) == 0) {
+        if (wrapperData->commandFileTests) {
+            if (param2 == NULL) {
+                pauseTime = -1;
+            } else {
+                pauseTime = __max(0, __min(3600, _ttoi(param2)));
+            }
+            if (strcmpIgnoreCase(param1, TEXT("MAIN")) == 0) {
+                wrapperData->pauseThreadMain = pauseTime;
+            } else if (strcmpIgnoreCase(param1, TEXT("TIMER")) == 0) {
+                wrapperData->pauseThreadTimer = pauseTime;
+            } else if (strcmpIgnoreCase(param1, TEXT("JAVAIO")) == 0) {
+                wrapperData->pauseThreadJavaIO = pauseTime;
+            } else {
+                log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN, TEXT("Command '%s'.  Enqueue request to pause unknown thread."), command);
+                result = COMMAND_RESULT_INVALID;
+                pauseTime = 0;
+            }
+            if (pauseTime > 0) {
+                log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN, TEXT("Command '%s'.  Enqueue request to pause %s thread for %d seconds..."), command, param1, pauseTime);
+            } else if (pauseTime < 0) {
+                log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN, TEXT("Command '%s'.  Enqueue request to pause %s thread indefinitely..."), command, param1);
+            }
+        } else {
+            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN, TEXT("Command '%s'.  Tests disabled."), command);
+            result = COMMAND_RESULT_DISABLED;
+        }
+    } else if (strcmpIgnoreCase(command, TEXT("PAUSE_LOGGER")) == 0) {
+        if (wrapperData->commandFileTests) {
+            if (param1 == NULL) {
+                pauseTime = -1;
+            } else {
+                pauseTime = __max(0, __min(3600, _ttoi(param1)));
+            }
+            if (pauseTime > 0) {
+                log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN, TEXT("Command '%s'.  Enqueue request to pause logger for %d seconds..."), command, pauseTime);
+            } else {
+                log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN, TEXT("Command '%s'.  Enqueue request to pause logger indefinitely..."), command);
+            }
+            setPauseTime(pauseTime);
+        } else {
+            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN, TEXT("Command '%s'.  Tests disabled."), command);
+            result = COMMAND_RESULT_DISABLED;
+        }
+    } else if (strcmpIgnoreCase(command, TEXT("ACCESS_VIOLATION")) == 0) {
+        if (wrapperData->commandFileTests) {
+            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_FATAL, TEXT("Command '%s'.  Intentionally causing an Access Violation in Wrapper..."), command);
+            /* We can't do the access violation here because we want to make sure the
+             *  command has been acknowledged, otherwise a command file would be executed again when the Wrapper is restarted. */
+            *crash = COMMAND_CRASH_ACCESS_VIOLATION;
+        } else {
+            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN, TEXT("Command '%s'.  Tests disabled."), command);
+            result = COMMAND_RESULT_DISABLED;
+        }
+#ifdef TEST_FORTIFY_SOURCE
+    } else if (strcmpIgnoreCase(command, TEXT("BUFFER_OVERFLOW1")) == 0) {
+        if (wrapperData->commandFileTests) {
+            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_FATAL, TEXT("Command '%s'.  Intentionally causing a Buffer Overflow in Wrapper..."), command);
+            *crash = COMMAND_CRASH_BUFFER_OVERFLOW1;
+        } else {
+            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN, TEXT("Command '%s'.  Tests disabled."), command);
+            result = COMMAND_RESULT_DISABLED;
+        }
+#endif
+    } else {
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN, TEXT("Command '%s' is unknown, ignoring."), command);
+        result = COMMAND_RESULT_UNKNOWN;
+    }
+
+    return result;
+}
+
+/**
+ * Causes the crash requested by a test command, once the command has been
+ *  acknowledged.  Returns only if no crash was requested.
+ */
+static void performCommandCrash(int crash) {
+    TCHAR *c;
+
+    if (crash != COMMAND_CRASH_NONE) {
+        /* Make sure that everything is logged before the crash. */
+        flushLogfile();
+
+        if (crash == COMMAND_CRASH_ACCESS_VIOLATION) {
+            /* Actually cause the access violation. */
+            c = NULL;
+            c[0] = TEXT('\0');
+            /* Should never get here. */
+        }
+#ifdef TEST_FORTIFY_SOURCE
+        if (crash == COMMAND_CRASH_BUFFER_OVERFLOW1) {
+            /* Actually cause the buffer overflow. */
+            strcpy (&var.t.buf[1], "abcdefg");
+            /* Should never get here. */
+        }
+#endif
+    }
+}
+
+/**
+ * Tests for the existence of the command file.  If it exists then it will be
+ *  opened and any included commands will be processed.  On completion, the
+ *  file will be deleted.  Called each time the command deadline expires.
+ *
+ * nowTicks: The tick counter value this time through the event loop.
+ */
+void commandPoll(TICKS nowTicks) {
+#if defined(WIN32) && !defined(WIN64)
+    struct _stat64i32 fileStat;
+#else
+    struct stat fileStat;
+#endif
+    int result;
+    FILE *stream;
+    int cnt;
+    int maxAttempts;
+    TCHAR buffer[MAX_COMMAND_LENGTH];
+    TCHAR *c;
+    TCHAR *d;
+    int crash = COMMAND_CRASH_NONE;
+
+#ifdef _DEBUG
+    log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO,
+        TEXT("Command poll, now=%08x"), nowTicks);
+#endif
+
+    if (wrapperData->commandFilename) {
+        if (wrapperData->isLoopOutputEnabled) {
+            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("    Loop: check command file"));
+        }
+
+        result = _tstat(wrapperData->commandFilename, &fileStat);
+        if (result == 0) {
+            /* Command file exists. */
+#ifdef _DEBUG
+            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO,
+                TEXT("The command file %s exists."), wrapperData->commandFilename);
+#endif
+            /* We need to be able to lock and then read the command file.  Other
+             *  applications will be creating this file so we need to handle the
+             *  case where it is locked for a few moments.  A watched file is only
+             *  checked once it has been completely written, so it is not waited for.
+             *  It will be checked again on the next change. */
+            maxAttempts = isFileWatched(WRAPPER_FILE_WATCH_COMMAND, wrapperData->commandFilename) ? 1 : 10;
+            cnt = 0;
+            do {
+                stream = _tfopen(wrapperData->commandFilename, TEXT("r+t"));
+                cnt++;
+                if ((stream == NULL) && (cnt < maxAttempts)) {
+                    /* Sleep for a tenth of a second. */
+                    wrapperSleep(100);
+                }
+            } while ((cnt < maxAttempts) && (stream == NULL));
+
+            if (stream == NULL) {
+                log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN,
+                    TEXT("Unable to read the command file: %s"), wrapperData->commandFilename);
+            } else {
+                /* Read in each of the commands line by line. */
+                do {
+                    c = _fgetts(buffer, MAX_COMMAND_LENGTH, stream);
+                    if (c != NULL) {
+                        /* Always strip both ^M and ^J off the end of the line, this is done rather
+                         *  than simply checking for \n so that files will work on all platforms
+                         *  even if their line feeds are incorrect. */
+                        if ((d = _tcschr(buffer, 13 /* ^M */)) != NULL) {
+                            d[0] = TEXT('\0');
+                        }
+                        if ((d = _tcschr(buffer, 10 /* ^J */)) != NULL) {
+                            d[0] = TEXT('\0');
+                        }
+
+                        executeCommand(buffer, &crash);
+                    }
+                } while (c != NULL);
+
+                /* Close the file. */
+                fclose(stream);
+
+                /* Delete the file. */
+                if (_tremove(wrapperData->commandFilename) == -1) {
+                    log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_FATAL,
+                        TEXT("Unable to delete the command file, %s: %s"),
+                        wrapperData->commandFilename, getLastErrorText());
+                } else {
+                    log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO,
+                        TEXT("Command file has been processed and deleted."));
+                }
+                
+                performCommandCrash(crash);
+            }
+        } else {
+            /* Command file does not exist. */
+#ifdef _DEBUG
+            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO,
+                TEXT("The command file %s does not exist."), wrapperData->commandFilename);
+#endif
+        }
+
+    }
+
+    /* Always rescheduled, as the command file may be set when the configuration is reloaded.  No polling is needed while the file is watched. */
+    if (!isFileWatched(WRAPPER_FILE_WATCH_COMMAND, wrapperData->commandFilename)) {
+        setLoopDeadline(LOOP_DEADLINE_COMMAND, wrapperAddToTicks(nowTicks, wrapperData->commandPollInterval));
+    }
+}
+
+#ifndef WIN32
+/********************************************************************
+ * Control Socket
+ *******************************************************************/
+/* Maximum number of simultaneous control socket connections. */
+#define CONTROL_MAX_CLIENTS 8
+/* Size of the line buffer of each connection.  Large enough for any valid command in any encoding. */
+#define CONTROL_LINE_SIZE   (MAX_COMMAND_LENGTH * 4)
+
+#ifdef MSG_NOSIGNAL
+ #define CONTROL_SEND_FLAGS MSG_NOSIGNAL
+#else
+ #define CONTROL_SEND_FLAGS 0
+#endif
+
+typedef struct ControlClient ControlClient;
+struct ControlClient {
+    int fd;                             /* Connection, -1 if the slot is free. */
+    size_t len;                         /* Number of bytes in buffer. */
+    int discarding;                     /* TRUE while the rest of a line which was too long is being skipped. */
+    char buffer[CONTROL_LINE_SIZE];     /* Start of the current line. */
+};
+
+static int controlListenFd = -1;
+static char *controlSocketPath = NULL;
+static ControlClient controlClients[CONTROL_MAX_CLIENTS];
+
+/**
+ * Sets the close-on-exec and non-blocking flags of a descriptor so it is not inherited by the JVM
+ *  and never blocks the main loop.
+ *
+ * Returns TRUE if there were any problems.
+ */
+static int prepareControlFd(int fd) {
+    int flags;
+
+    if (fcntl(fd, F_SETFD, FD_CLOEXEC) == -1) {
+        return TRUE;
+    }
+    flags = fcntl(fd, F_GETFL, 0);
+    if ((flags == -1) || (fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1)) {
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/**
+ * Creates the control socket if one is configured.  Commands sent to it are processed in the
+ *  same way as those of the command file.  Each line receives a reply line of either "OK" or
+ *  "ERROR <reason>" once the command has been executed.
+ */
+static void startControlSocket() {
+    struct sockaddr_un addr;
+    struct stat fileStat;
+    size_t req;
+    mode_t oldUmask;
+    int fd;
+    int i;
+
+    for (i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+        controlClients[i].fd = -1;
+    }
+    if (!wrapperData->controlSocketFilename) {
+        return;
+    }
+
+    req = wcstombs(NULL, wrapperData->controlSocketFilename, 0);
+    if (req == (size_t)-1) {
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN,
+            TEXT("Unable to create the control socket %s: %s"), wrapperData->controlSocketFilename, TEXT("Invalid path"));
+        return;
+    }
+    memset(&addr, 0, sizeof(addr));
+    if (req >= sizeof(addr.sun_path)) {
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN,
+            TEXT("Unable to create the control socket %s: %s"), wrapperData->controlSocketFilename, TEXT("Path too long"));
+        return;
+    }
+    controlSocketPath = malloc(req + 1);
+    if (!controlSocketPath) {
+        outOfMemory(TEXT("SCS"), 1);
+        return;
+    }
+    wcstombs(controlSocketPath, wrapperData->controlSocketFilename, req + 1);
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, controlSocketPath, sizeof(addr.sun_path) - 1);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) {
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN,
+            TEXT("Unable to create the control socket %s: %s"), wrapperData->controlSocketFilename, getLastErrorText());
+        free(controlSocketPath);
+        controlSocketPath = NULL;
+        return;
+    }
+
+    /* A socket left behind by a Wrapper which was killed is replaced.  One which is still in use,
+     *  or any other kind of file, is never touched. */
+    if (lstat(controlSocketPath, &fileStat) == 0) {
+        if (!S_ISSOCK(fileStat.st_mode)) {
+            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN,
+                TEXT("Unable to create the control socket %s: %s"), wrapperData->controlSocketFilename, TEXT("A file already exists"));
+            close(fd);
+            free(controlSocketPath);
+            controlSocketPath = NULL;
+            return;
+        }
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN,
+                TEXT("Unable to create the control socket %s: %s"), wrapperData->controlSocketFilename, TEXT("Already in use"));
+            close(fd);
+            free(controlSocketPath);
+            controlSocketPath = NULL;
+            return;
+        }
+        unlink(controlSocketPath);
+        close(fd);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd == -1) {
+            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN,
+                TEXT("Unable to create the control socket %s: %s"), wrapperData->controlSocketFilename, getLastErrorText());
+            free(controlSocketPath);
+            controlSocketPath = NULL;
+            return;
+        }
+    }
+
+    /* The permissions of the socket file decide who is able to connect. */
+    oldUmask = umask((mode_t)wrapperData->controlSocketUmask);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        umask(oldUmask);
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN,
+            TEXT("Unable to create the control socket %s: %s"), wrapperData->controlSocketFilename, getLastErrorText());
+        close(fd);
+        free(controlSocketPath);
+        controlSocketPath = NULL;
+        return;
+    }
+    umask(oldUmask);
+
+    if (prepareControlFd(fd) || (listen(fd, CONTROL_MAX_CLIENTS) == -1)) {
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN,
+            TEXT("Unable to create the control socket %s: %s"), wrapperData->controlSocketFilename, getLastErrorText());
+        close(fd);
+        unlink(controlSocketPath);
+        free(controlSocketPath);
+        controlSocketPath = NULL;
+        return;
+    }
+    controlListenFd = fd;
+
+    if (wrapperData->isDebugging) {
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_DEBUG, TEXT("Accepting commands on the control socket %s."), wrapperData->controlSocketFilename);
+    }
+}
+
+/**
+ * Closes a control socket connection and frees its slot.
+ */
+static void closeControlClient(ControlClient *client) {
+    close(client->fd);
+    client->fd = -1;
+    client->len = 0;
+    client->discarding = FALSE;
+}
+
+/**
+ * Sends a reply line.  The connection is closed if the reply can not be sent in full, which only
+ *  happens if the client does not read its replies.
+ *
+ * Returns TRUE if the connection was closed.
+ */
+static int sendControlReply(ControlClient *client, const char *reply) {
+    size_t len = strlen(reply);
+
+    if (send(client->fd, reply, len, CONTROL_SEND_FLAGS) != (ssize_t)len) {
+        closeControlClient(client);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/**
+ * Executes a command line received on the control socket and sends its reply.
+ *
+ * Returns TRUE if the connection was closed.
+ */
+static int processControlLine(ControlClient *client, char *line) {
+    TCHAR buffer[MAX_COMMAND_LENGTH];
+    size_t req;
+    int crash = COMMAND_CRASH_NONE;
+    int result;
+    int closed;
+    const char *reply;
+
+    req = mbstowcs(NULL, line, MBSTOWCS_QUERY_LENGTH);
+    if (req == (size_t)-1) {
+        return sendControlReply(client, "ERROR INVALID\n");
+    } else if (req >= MAX_COMMAND_LENGTH) {
+        return sendControlReply(client, "ERROR TOO_LONG\n");
+    }
+    mbstowcs(buffer, line, MAX_COMMAND_LENGTH);
+    buffer[req] = TEXT('\0');
+
+    result = executeCommand(buffer, &crash);
+    switch (result) {
+    case COMMAND_RESULT_EMPTY:
+        /* Ignored silently, as in the command file. */
+        return FALSE;
+    case COMMAND_RESULT_UNKNOWN:
+        reply = "ERROR UNKNOWN\n";
+        break;
+    case COMMAND_RESULT_INVALID:
+        reply = "ERROR INVALID\n";
+        break;
+    case COMMAND_RESULT_DISABLED:
+        reply = "ERROR DISABLED\n";
+        break;
+    default:
+        reply = "OK\n";
+        break;
+    }
+    closed = sendControlReply(client, reply);
+    performCommandCrash(crash);
+    return closed;
 }
 
 /**
- * Tests for the existence of the anchor file.  If it does not exist then
- *  the Wrapper will begin its shutdown process.
- *
- * nowTicks: The tick counter value this time through the event loop.
+ * Reads any pending input of a connection and processes each complete line.
  */
-void anchorPoll(TICKS nowTicks) {
-#if defined(WIN32) && !defined(WIN64)
-    struct _stat64i32 fileStat;
-#else
-    struct stat fileStat;
-#endif
-    int result;
-
-#ifdef _DEBUG
-    log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO,
-        TEXT("Anchor timeout=%d, now=%d"), wrapperData->anchorTimeoutTicks, nowTicks);
-#endif
-
-    if (wrapperData->anchorFilename) {
-        if (wrapperTickExpired(nowTicks, wrapperData->anchorTimeoutTicks)) {
-            if (wrapperData->isLoopOutputEnabled) {
-                log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("    Loop: check anchor file"));
+static void readControlClient(ControlClient *client) {
+    ssize_t len;
+    char *start;
+    char *lf;
+
+    while (client->fd >= 0) {
+        len = read(client->fd, client->buffer + client->len, CONTROL_LINE_SIZE - client->len);
+        if (len == 0) {
+            /* Closed by the client.  Any incomplete last line is ignored. */
+            closeControlClient(client);
+            return;
+        } else if (len < 0) {
+            if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+                closeControlClient(client);
             }
+            return;
+        }
+        client->len += len;
 
-            result = _tstat(wrapperData->anchorFilename, &fileStat);
-            if (result == 0) {
-                /* Anchor file exists.  Do nothing. */
-#ifdef _DEBUG
-                log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO,
-                    TEXT("The anchor file %s exists."), wrapperData->anchorFilename);
-#endif
-            } else {
-                /* Anchor file is gone. */
-#ifdef _DEBUG
-                log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO,
-                    TEXT("The anchor file %s was deleted."), wrapperData->anchorFilename);
-#endif
-
-                /* Unless we are already doing so, start the shudown process. */
-                if (wrapperData->exitRequested || wrapperData->restartRequested ||
-                    (wrapperData->jState == WRAPPER_JSTATE_STOP) ||
-                    (wrapperData->jState == WRAPPER_JSTATE_STOPPING) ||
-                    (wrapperData->jState == WRAPPER_JSTATE_STOPPED) ||
-                    (wrapperData->jState == WRAPPER_JSTATE_KILLING) ||
-                    (wrapperData->jState == WRAPPER_JSTATE_KILL) ||
-                    (wrapperData->jState == WRAPPER_JSTATE_KILLED) ||
-                    (wrapperData->jState == WRAPPER_JSTATE_DOWN_CHECK) ||
-                    (wrapperData->jState == WRAPPER_JSTATE_DOWN_FLUSH) ||
-                    (wrapperData->jState == WRAPPER_JSTATE_DOWN_CLEAN)) {
-                    /* Already shutting down, so nothing more to do. */
-                } else {
-                    /* Always force the shutdown as this was an external event. */
-                    wrapperStopProcess(0, TRUE);
-                }
-
-                /* To make sure that the JVM will not be restarted for any reason,
-                 *  start the Wrapper shutdown process as well. */
-                if ((wrapperData->wState == WRAPPER_WSTATE_STOPPING) ||
-                    (wrapperData->wState == WRAPPER_WSTATE_STOPPED)) {
-                    /* Already stopping. */
-                } else {
-                    /* Start the shutdown process. */
-                    log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("Anchor file deleted.  Shutting down."));
-                    
-                    wrapperSetWrapperState(WRAPPER_WSTATE_STOPPING);
+        start = client->buffer;
+        while ((lf = memchr(start, '\n', client->len - (start - client->buffer))) != NULL) {
+            lf[0] = '\0';
+            if ((lf > start) && (lf[-1] == '\r')) {
+                lf[-1] = '\0';
+            }
+            if (client->discarding) {
+                client->discarding = FALSE;
+                if (sendControlReply(client, "ERROR TOO_LONG\n")) {
+                    return;
                 }
+            } else if (processControlLine(client, start)) {
+                return;
             }
-
-            wrapperData->anchorTimeoutTicks = wrapperAddToTicks(nowTicks, wrapperData->anchorPollInterval);
+            start = lf + 1;
+        }
+        client->len -= start - client->buffer;
+        if (client->len == CONTROL_LINE_SIZE) {
+            /* No valid command is this long.  Skip up to the end of the line. */
+            client->discarding = TRUE;
+            client->len = 0;
+        } else if ((client->len > 0) && (start > client->buffer)) {
+            memmove(client->buffer, start, client->len);
         }
     }
 }
 
-#ifdef TEST_FORTIFY_SOURCE
-struct S {
-    struct T {
-        char buf[5];
-        int x;
-    } t;
-    char buf[20];
-} var;
-#endif
-
 /**
- * Tests for the existence of the command file.  If it exists then it will be
- *  opened and any included commands will be processed.  On completion, the
- *  file will be deleted.
- *
- * nowTicks: The tick counter value this time through the event loop.
+ * Accepts any new connections and processes the commands received on the control socket.
+ *  Called each time through the main loop.
  */
-#define MAX_COMMAND_LENGTH 80
-void commandPoll(TICKS nowTicks) {
-#if defined(WIN32) && !defined(WIN64)
-    struct _stat64i32 fileStat;
-#else
-    struct stat fileStat;
+static void serviceControlSocket() {
+    int fd;
+    int i;
+#ifdef SO_NOSIGPIPE
+    int on = 1;
 #endif
-    int result;
-    FILE *stream;
-    int cnt;
-    TCHAR buffer[MAX_COMMAND_LENGTH];
-    TCHAR *c;
-    TCHAR *d;
-    TCHAR *command;
-    TCHAR *param1;
-    TCHAR *param2;
-    int exitCode;
-    int pauseTime;
-    int logLevel;
-    int oldLowLogLevel;
-    int newLowLogLevel;
-    int flag;
-    int accessViolation = FALSE;
-    int bufferOverflow1 = FALSE;
-    size_t i;
 
-#ifdef _DEBUG
-    log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO,
-        TEXT("Command timeout=%08x, now=%08x"), wrapperData->commandTimeoutTicks, nowTicks);
-#endif
+    if (controlListenFd < 0) {
+        return;
+    }
 
-    if (wrapperData->commandFilename) {
-        if (wrapperTickExpired(nowTicks, wrapperData->commandTimeoutTicks)) {
-            if (wrapperData->isLoopOutputEnabled) {
-                log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("    Loop: check command file"));
+    while ((fd = accept(controlListenFd, NULL, NULL)) >= 0) {
+        for (i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+            if (controlClients[i].fd < 0) {
+                break;
             }
-
-            result = _tstat(wrapperData->commandFilename, &fileStat);
-            if (result == 0) {
-                /* Command file exists. */
-#ifdef _DEBUG
-                log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO,
-                    TEXT("The command file %s exists."), wrapperData->commandFilename);
+        }
+        if ((i == CONTROL_MAX_CLIENTS) || prepareControlFd(fd)) {
+            /* Refused, without blocking the loop. */
+            send(fd, "ERROR BUSY\n", 11, CONTROL_SEND_FLAGS);
+            close(fd);
+            continue;
+        }
+#ifdef SO_NOSIGPIPE
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
 #endif
-                /* We need to be able to lock and then read the command file.  Other
-                 *  applications will be creating this file so we need to handle the
-                 *  case where it is locked for a few moments. */
-                cnt = 0;
-                do {
-                    stream = _tfopen(wrapperData->commandFilename, TEXT("r+t"));
-                    if (stream == NULL) {
-                        /* Sleep for a tenth of a second. */
-                        wrapperSleep(100);
-                    }
-
-                    cnt++;
-                } while ((cnt < 10) && (stream == NULL));
-
-                if (stream == NULL) {
-                    log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN,
-                        TEXT("Unable to read the command file: %s"), wrapperData->commandFilename);
-                } else {
-                    /* Read in each of the commands line by line. */
-                    do {
-                        c = _fgetts(buffer, MAX_COMMAND_LENGTH, stream);
-                        if (c != NULL) {
-                            /* Always strip both ^M and ^J off the end of the line, this is done rather
-                             *  than simply checking for \n so that files will work on all platforms
-                             *  even if their line feeds are incorrect. */
-                            if ((d = _tcschr(buffer, 13 /* ^M */)) != NULL) {
-                                d[0] = TEXT('\0');
-                            }
-                            if ((d = _tcschr(buffer, 10 /* ^J */)) != NULL) {
-                                d[0] = TEXT('\0');
-                            }
+        controlClients[i].fd = fd;
+        controlClients[i].len = 0;
+        controlClients[i].discarding = FALSE;
+    }
 
-                            command = buffer;
-                            
-                            /* Remove any leading space or tabs */
-                            while (command[0] == TEXT(' ') || command[0] == TEXT('\t')) {
-                                command++;
-                            }
-                            if (command[0] == TEXT('\0')) {
-                                /* Empty line. Ignore it silently. */
-                                continue;
-                            }
-                            /* Remove any tailing space or tabs */
-                            i = _tcslen(command) - 1;
-                            while (command[i] == TEXT(' ') || command[i] == TEXT('\t')) {
-                                i--;
-                            }
-                            command[i + 1] = TEXT('\0');
+    for (i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+        if (controlClients[i].fd >= 0) {
+            readControlClient(&controlClients[i]);
+        }
+    }
+}
 
-                            /** Look for the first space, everything after it will be the parameter(s). */
-                            /* Look for parameter 1. */
-                            if ((param1 = _tcschr(command, ' ')) != NULL ) {
-                                param1[0] = TEXT('\0'); /* Terminate the command. */
+/**
+ * Fills in the descriptors of the control socket which the main loop should wait for.
+ *
+ * Returns the number of descriptors.
+ */
+static int getControlSocketFds(int *fds) {
+    int count = 0;
+    int i;
+
+    if (controlListenFd >= 0) {
+        fds[count++] = controlListenFd;
+        for (i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+            if (controlClients[i].fd >= 0) {
+                fds[count++] = controlClients[i].fd;
+            }
+        }
+    }
+    return count;
+}
 
-                                /* Find the first non-space character. */
-                                do {
-                                    param1++;
-                                } while (param1[0] == TEXT(' '));
-                            }
-                            if (param1 != NULL) {
-                                /* Look for parameter 2. */
-                                if ((param2 = _tcschr(param1, ' ')) != NULL ) {
-                                    param2[0] = TEXT('\0'); /* Terminate param1. */
-    
-                                    /* Find the first non-space character. */
-                                    do {
-                                        param2++;
-                                    } while (param2[0] == TEXT(' '));
-                                }
-                                if (param2 != NULL) {
-                                    /* Make sure parameter 2 is terminated. */
-                                    if ((d = _tcschr(param2, ' ')) != NULL ) {
-                                        d[0] = TEXT('\0'); /* Terminate param2. */
-                                    }
-                                }
-                            } else {
-                                param2 = NULL;
-                            }
+/**
+ * Closes the control socket and all of its connections, and removes the socket file.
+ */
+static void stopControlSocket() {
+    int i;
 
-                            /* Process the command. */
-                            if (strcmpIgnoreCase(command, TEXT("RESTART")) == 0) {
-                                log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("Command '%s'. %s"), command, wrapperGetRestartProcessMessage());
-                                wrapperRestartProcess();
-                            } else if (strcmpIgnoreCase(command, TEXT("STOP")) == 0) {
-                                if (param1 == NULL) {
-                                    exitCode = 0;
-                                } else {
-                                    exitCode = _ttoi(param1);
-                                }
-                                
-                                if (exitCode < 0 || exitCode > 255) {
-                                    exitCode = wrapperData->errorExitCode;
-                                    log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN,
-                                        TEXT("The exit code specified along with the 'STOP' command must be in the range %d to %d.\n  Changing to the default error exit code %d."), 1, 255, exitCode);
-                                }
-                                
-                                log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("Command '%s'. Shutting down with exit code %d."), command, exitCode);
-
-                                /* Always force the shutdown as this is an external event. */
-                                wrapperStopProcess(exitCode, TRUE);
-                                
-                                /* To make sure that the JVM will not be restarted for any reason,
-                                 *  start the Wrapper shutdown process as well. */
-                                if ((wrapperData->wState == WRAPPER_WSTATE_STOPPING) ||
-                                    (wrapperData->wState == WRAPPER_WSTATE_STOPPED)) {
-                                    /* Already stopping. */
-                                } else {
-                                    wrapperSetWrapperState(WRAPPER_WSTATE_STOPPING);
-                                }
-                            } else if (strcmpIgnoreCase(command, TEXT("PAUSE")) == 0) {
-                                log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("Command '%s'. %s"), command, wrapperGetPauseProcessMessage());
-                                wrapperPauseProcess(WRAPPER_ACTION_SOURCE_CODE_COMMANDFILE);
-                            } else if (strcmpIgnoreCase(command, TEXT("RESUME")) == 0) {
-                                log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("Command '%s'. %s"), command, wrapperGetResumeProcessMessage());
-                                wrapperResumeProcess(WRAPPER_ACTION_SOURCE_CODE_COMMANDFILE);
-                            } else if (strcmpIgnoreCase(command, TEXT("DUMP")) == 0) {
-                                log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("Command '%s'. Requesting a Thread Dump."), command);
-                                wrapperRequestDumpJVMState();
-                            } else if (strcmpIgnoreCase(command, TEXT("GC")) == 0) {
-                                log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("Command '%s'. Requesting a GC."), command);
-                                wrapperRequestJVMGC(WRAPPER_ACTION_SOURCE_CODE_COMMANDFILE);
-                            } else if ((strcmpIgnoreCase(command, TEXT("CONSOLE_LOGLEVEL")) == 0) ||
-                                    (strcmpIgnoreCase(command, TEXT("LOGFILE_LOGLEVEL")) == 0) ||
-                                    (strcmpIgnoreCase(command, TEXT("SYSLOG_LOGLEVEL")) == 0)) {
-                                if (param1 == NULL) {
-                                    log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN, TEXT("Command '%s' is missing its log level."), command);
-                                } else {
-                                    logLevel = getLogLevelForName(param1);
-                                    if (logLevel == LEVEL_UNKNOWN) {
-                                        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN, TEXT("Command '%s' specified an unknown log level: '%'"), command, param1);
-                                    } else {
-                                        oldLowLogLevel = getLowLogLevel();
-
-                                        if (strcmpIgnoreCase(command, TEXT("CONSOLE_LOGLEVEL")) == 0) {
-                                            setConsoleLogLevelInt(logLevel);
-                                            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("Command '%s'. Set console log level to '%s'."), command, param1);
-                                        } else if (strcmpIgnoreCase(command, TEXT("LOGFILE_LOGLEVEL")) == 0) {
-                                            setLogfileLevelInt(logLevel);
-                                            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("Command '%s'. Set log file log level to '%s'."), command, param1);
-                                        } else if (strcmpIgnoreCase(command, TEXT("SYSLOG_LOGLEVEL")) == 0) {
-                                            setSyslogLevelInt(logLevel);
-                                            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("Command '%s'. Set syslog log level to '%s'."), command, param1);
-                                        } else {
-                                            /* Shouldn't get here. */
-                                            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN, TEXT("Command '%s' lead to an unexpected state."), command);
-                                        }
-
-                                        newLowLogLevel = getLowLogLevel();
-                                        if (oldLowLogLevel != newLowLogLevel) {
-                                            wrapperData->isDebugging = (newLowLogLevel <= LEVEL_DEBUG);
-
-                                            _sntprintf(buffer, MAX_COMMAND_LENGTH, TEXT("%d"), getLowLogLevel());
-                                            wrapperProtocolFunction(WRAPPER_MSG_LOW_LOG_LEVEL, buffer);
-                                        }
-                                    }
-                                }
-                            } else if ((strcmpIgnoreCase(command, TEXT("LOOP_OUTPUT")) == 0) ||
-                                    (strcmpIgnoreCase(command, TEXT("STATE_OUTPUT")) == 0) ||
-                                    (strcmpIgnoreCase(command, TEXT("MEMORY_OUTPUT")) == 0) ||
-                                    (strcmpIgnoreCase(command, TEXT("CPU_OUTPUT")) == 0) ||
-                                    (strcmpIgnoreCase(command, TEXT("TIMER_OUTPUT")) == 0) ||
-                                    (strcmpIgnoreCase(command, TEXT("SLEEP_OUTPUT")) == 0)) {
-                                flag = ((param1 != NULL) && (strcmpIgnoreCase(param1, TEXT("TRUE")) == 0));
-                                if (strcmpIgnoreCase(command, TEXT("LOOP_OUTPUT")) == 0) {
-                                    wrapperData->isLoopOutputEnabled = flag;
-                                } else if (strcmpIgnoreCase(command, TEXT("STATE_OUTPUT")) == 0) {
-                                    wrapperData->isStateOutputEnabled = flag;
-                                } else if (strcmpIgnoreCase(command, TEXT("MEMORY_OUTPUT")) == 0) {
-                                    wrapperData->isMemoryOutputEnabled = flag;
-                                } else if (strcmpIgnoreCase(command, TEXT("CPU_OUTPUT")) == 0) {
-                                    wrapperData->isCPUOutputEnabled = flag;
-                                } else if (strcmpIgnoreCase(command, TEXT("TIMER_OUTPUT")) == 0) {
-                                    wrapperData->isTickOutputEnabled = flag;
-                                } else if (strcmpIgnoreCase(command, TEXT("SLEEP_OUTPUT")) == 0) {
-                                    wrapperData->isSleepOutputEnabled = flag;
-                                }
-                                if (flag) {
-                                    log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("Command '%s'. Enable %s."), command, command);
-                                } else {
-                                    log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("Command '%s'. Disable %s."), command, command);
-                                }
-                            } else if ((strcmpIgnoreCase(command, TEXT("CLOSE_SOCKET")) == 0) || (strcmpIgnoreCase(command, TEXT("CLOSE_BACKEND")) == 0)) {
-                                if (wrapperData->commandFileTests) {
-                                    log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN, TEXT("Command '%s'.  Closing backend socket to JVM..."), command);
-                                    wrapperProtocolClose();
-                                } else {
-                                    log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN, TEXT("Command '%s'.  Tests disabled."), command);
-                                }
-                            } else if (strcmpIgnoreCase(command, TEXT("PAUSE_THREAD")) == 0) {
-                                if (wrapperData->commandFileTests) {
-                                    if (param2 == NULL) {
-                                        pauseTime = -1;
-                                    } else {
-                                        pauseTime = __max(0, __min(3600, _ttoi(param2)));
-                                    }
-                                    if (strcmpIgnoreCase(param1, TEXT("MAIN")) == 0) {
-                                        wrapperData->pauseThreadMain = pauseTime;
-                                    } else if (strcmpIgnoreCase(param1, TEXT("TIMER")) == 0) {
-                                        wrapperData->pauseThreadTimer = pauseTime;
-                                    } else if (strcmpIgnoreCase(param1, TEXT("JAVAIO")) == 0) {
-                                        wrapperData->pauseThreadJavaIO = pauseTime;
-                                    } else {
-                                        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN, TEXT("Command '%s'.  Enqueue request to pause unknown thread."), command);
-                                        pauseTime = 0;
-                                    }
-                                    if (pauseTime > 0) {
-                                        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN, TEXT("Command '%s'.  Enqueue request to pause %s thread for %d seconds..."), command, param1, pauseTime);
-                                    } else if (pauseTime < 0) {
-                                        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN, TEXT("Command '%s'.  Enqueue request to pause %s thread indefinitely..."), command, param1);
-                                    }
-                                } else {
-                                    log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN, TEXT("Command '%s'.  Tests disabled."), command);
-                                }
-                            } else if (strcmpIgnoreCase(command, TEXT("PAUSE_LOGGER")) == 0) {
-                                if (wrapperData->commandFileTests) {
-                                    if (param1 == NULL) {
-                                        pauseTime = -1;
-                                    } else {
-                                        pauseTime = __max(0, __min(3600, _ttoi(param1)));
-                                    }
-                                    if (pauseTime > 0) {
-                                        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN, TEXT("Command '%s'.  Enqueue request to pause logger for %d seconds..."), command, pauseTime);
-                                    } else {
-                                        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN, TEXT("Command '%s'.  Enqueue request to pause logger indefinitely..."), command);
-                                    }
-                                    setPauseTime(pauseTime);
-                                } else {
-                                    log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN, TEXT("Command '%s'.  Tests disabled."), command);
-                                }
-                            } else if (strcmpIgnoreCase(command, TEXT("ACCESS_VIOLATION")) == 0) {
-                                if (wrapperData->commandFileTests) {
-                                    log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_FATAL, TEXT("Command '%s'.  Intentionally causing an Access Violation in Wrapper..."), command);
-                                    /* We can't do the access violation here because we want to make sure the
-                                     *  file is deleted first, otherwise it be executed again when the Wrapper is restarted. */
-                                    accessViolation = TRUE;
-                                } else {
-                                    log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN, TEXT("Command '%s'.  Tests disabled."), command);
-                                }
-#ifdef TEST_FORTIFY_SOURCE
-                            } else if (strcmpIgnoreCase(command, TEXT("BUFFER_OVERFLOW1")) == 0) {
-                                if (wrapperData->commandFileTests) {
-                                    log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_FATAL, TEXT("Command '%s'.  Intentionally causing a Buffer Overflow in Wrapper..."), command);
-                                    bufferOverflow1 = TRUE;
-                                } else {
-                                    log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN, TEXT("Command '%s'.  Tests disabled."), command);
-                                }
+    for (i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+        if (controlClients[i].fd >= 0) {
+            closeControlClient(&controlClients[i]);
+        }
+    }
+    if (controlListenFd >= 0) {
+        close(controlListenFd);
+        controlListenFd = -1;
+        unlink(controlSocketPath);
+    }
+    if (controlSocketPath) {
+        free(controlSocketPath);
+        controlSocketPath = NULL;
+    }
+}
 #endif
-                            } else {
-                                log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN, TEXT("Command '%s' is unknown, ignoring."), command);
-                            }
-                        }
-                    } while (c != NULL);
 
-                    /* Close the file. */
-                    fclose(stream);
+#ifndef WIN32
+/********************************************************************
+ * Status Page
+ *******************************************************************/
+static WrapperStatusPage *statusPage = NULL;
 
-                    /* Delete the file. */
-                    if (_tremove(wrapperData->commandFilename) == -1) {
-                        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_FATAL,
-                            TEXT("Unable to delete the command file, %s: %s"),
-                            wrapperData->commandFilename, getLastErrorText());
-                    } else {
-                        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO,
-                            TEXT("Command file has been processed and deleted."));
-                    }
-                    
-                    if (accessViolation || bufferOverflow1) {
-                        /* Make sure that everything is logged before the crash. */
-                        flushLogfile();
-                        
-                        if (accessViolation) {
-                            /* Actually cause the access violation. */
-                            c = NULL;
-                            c[0] = TEXT('\0');
-                            /* Should never get here. */
-                        }
-#ifdef TEST_FORTIFY_SOURCE
-                        if (bufferOverflow1) {
-                            /* Actually cause the buffer overflow. */
-                            strcpy (&var.t.buf[1], "abcdefg");
-                            /* Should never get here. */
-                        }
-#endif
-                    }
-                }
-            } else {
-                /* Command file does not exist. */
-#ifdef _DEBUG
-                log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_INFO,
-                    TEXT("The command file %s does not exist."), wrapperData->commandFilename);
-#endif
-            }
+/**
+ * Creates the status page if one is configured.
+ */
+static void startStatusPage() {
+    int fd;
+    mode_t oldUmask;
+    int err;
 
-            wrapperData->commandTimeoutTicks = wrapperAddToTicks(nowTicks, wrapperData->commandPollInterval);
+    if (!wrapperData->statusPageFilename) {
+        return;
+    }
+    /* A new file is always created so a monitor which still maps the page of a previous
+     *  Wrapper does not see this one being initialized. */
+    _tunlink(wrapperData->statusPageFilename);
+    oldUmask = umask((mode_t)wrapperData->statusPageUmask);
+    fd = _topen(wrapperData->statusPageFilename, O_RDWR | O_CREAT | O_EXCL, 0666);
+    umask(oldUmask);
+    if (fd != -1) {
+        statusPage = mapStatusPage(fd);
+        err = errno;
+        /* The mapping stays valid once the descriptor is closed. */
+        close(fd);
+        if (!statusPage) {
+            _tunlink(wrapperData->statusPageFilename);
         }
+        errno = err;
+    }
+    if (!statusPage) {
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_WARN,
+            TEXT("Unable to create the status page %s: %s"), wrapperData->statusPageFilename, getLastErrorText());
+    } else if (wrapperData->isDebugging) {
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_DEBUG, TEXT("Publishing the status on the page %s."), wrapperData->statusPageFilename);
+    }
+}
+
+/**
+ * Publishes the current status.  Called each time through the main loop.
+ *
+ * nowTicks: The tick counter value this time through the event loop.
+ */
+static void updateStatusPage(TICKS nowTicks) {
+    if (!statusPage) {
+        return;
+    }
+    beginStatusPageUpdate(statusPage);
+    statusPage->wState = (unsigned int)wrapperData->wState;
+    statusPage->jState = (unsigned int)wrapperData->jState;
+    statusPage->javaPID = (unsigned int)wrapperData->javaPID;
+    statusPage->jvmRestarts = (unsigned int)wrapperData->jvmRestarts;
+    statusPage->uptimeSeconds = (unsigned int)wrapperGetTickAgeSeconds(WRAPPER_TICK_INITIAL, nowTicks);
+    statusPage->lastPingRTT = wrapperData->lastPingRTT;
+    getLogfileBytesWritten(&statusPage->logBytesLow, &statusPage->logBytesHigh);
+    statusPage->logMessagesDropped = getLogQueueDropped();
+    statusPage->javaLinesDropped = wrapperGetDroppedJavaOutputLines();
+    statusPage->pingRTTSmoothed = pingSmoothedRtt;
+    statusPage->pingRTTJitter = pingRttVariation;
+    statusPage->pingRTTRecentP99 = getRecentPingPercentile();
+    statusPage->pingInterval = (unsigned int)wrapperData->pingIntervalCurrent;
+    endStatusPageUpdate(statusPage);
+}
+
+/**
+ * Removes the status page.
+ */
+static void stopStatusPage() {
+    if (statusPage) {
+        unmapStatusPage(statusPage);
+        _tunlink(wrapperData->statusPageFilename);
+        statusPage = NULL;
     }
 }
+#endif
 
 /********************************************************************
  * Wrapper States
@@ -1493,6 +2496,10 @@ void jStateLaunchDelay(TICKS nowTicks, int nextSleep) {
                     TEXT("%s wrapper.ping.interval=%d, wrapper.ping.interval.logged=%d, wrapper.ping.timeout=%d, wrapper.ping.alert.threshold=%d"),
                     TEXT("Ping settings:"),
                     wrapperData->pingInterval, wrapperData->pingIntervalLogged, wrapperData->pingTimeout, wrapperData->pingAlertThreshold);
+                log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_DEBUG,
+                    TEXT("%s wrapper.ping.interval.adaptive=%s, wrapper.ping.interval.min=%d, wrapper.ping.trend.threshold=%d"),
+                    TEXT("Ping trend settings:"),
+                    wrapperData->pingIntervalAdaptive ? TEXT("TRUE") : TEXT("FALSE"), wrapperData->pingIntervalMin, wrapperData->pingTrendThreshold);
                 log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_DEBUG,
                     TEXT("%s wrapper.shutdown.timeout=%d, wrapper.jvm_exit.timeout=%d, wrapper.jvm_cleanup.timeout=%d, wrapper.jvm_terminate.timeout=%d"),
                     TEXT("Shutdown Timeouts:"), 
@@ -1504,6 +2511,7 @@ void jStateLaunchDelay(TICKS nowTicks, int nextSleep) {
             } else {
                 /* Increment the JVM restart Id to keep track of how many JVMs we have launched. */
                 wrapperData->jvmRestarts++;
+                resetPingTrend();
 
                 wrapperSetJavaState(WRAPPER_JSTATE_LAUNCH, nowTicks, -1);
             }
@@ -1536,6 +2544,7 @@ void jStateRestart(TICKS nowTicks, int nextSleep) {
         (wrapperData->wState == WRAPPER_WSTATE_RESUMING)) {
         /* Increment the JVM restart Id to keep track of how many JVMs we have launched. */
         wrapperData->jvmRestarts++;
+        resetPingTrend();
 
         wrapperSetJavaState(WRAPPER_JSTATE_LAUNCH, nowTicks, -1);
     } else {
@@ -1729,12 +2738,13 @@ void jStateStarted(TICKS nowTicks, int nextSleep) {
     } else {
         /* Look for any PendingPings which are slow but that we have not yet made a note of.
          *  Don't worry about the posibility of finding more than one in a single pass as that should only happen if the Wrapper process was without CPU for a while.  We will quickly catchup on the following cycles. */
-        if (wrapperData->firstUnwarnedPendingPing != NULL) {
-            if ((wrapperData->pingAlertThreshold > 0) && (wrapperGetTickAgeTicks(wrapperData->firstUnwarnedPendingPing->slowTicks, nowTicks) >= 0)) {
+        if (wrapperData->pendingPingWarnedCount < wrapperData->pendingPingCount) {
+            pendingPing = &(wrapperData->pendingPings[(wrapperData->pendingPingFirst + wrapperData->pendingPingWarnedCount) % WRAPPER_MAX_PENDING_PINGS]);
+            if ((wrapperData->pingAlertThreshold > 0) && (wrapperGetTickAgeTicks(pendingPing->slowTicks, nowTicks) >= 0)) {
                 wrapperPingSlow();
                 
-                /* Remove the PendingPing so it won't be warned again.  It still exists in the main list, so it should not be cleaned up here. */
-                wrapperData->firstUnwarnedPendingPing = wrapperData->firstUnwarnedPendingPing->nextPendingPing;
+                /* Count the PendingPing as warned so it won't be warned again.  It is still in the queue until it is answered. */
+                wrapperData->pendingPingWarnedCount++;
             }
         }
         
@@ -1755,7 +2765,7 @@ void jStateStarted(TICKS nowTicks, int nextSleep) {
                     wrapperData->pingTimedOut = TRUE;
                 }
             }
-        } else if (wrapperGetTickAgeTicks(wrapperAddToTicks(wrapperData->lastPingTicks, wrapperData->pingInterval), nowTicks) >= 0) {
+        } else if (wrapperGetTickAgeTicks(wrapperAddToTicks(wrapperData->lastPingTicks, wrapperData->pingIntervalCurrent), nowTicks) >= 0) {
             /* It is time to send another ping to the JVM */
                 if (wrapperGetTickAgeTicks(wrapperAddToTicks(wrapperData->lastLoggedPingTicks, wrapperData->pingIntervalLogged), nowTicks) >= 0) {
                     if (wrapperData->isLoopOutputEnabled) {
@@ -1790,38 +2800,19 @@ void jStateStarted(TICKS nowTicks, int nextSleep) {
                         log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("    PING QUEUE Set Overflow"));
 #endif
                     } else {
-                        pendingPing = malloc(sizeof(PendingPing));
-                        if (!pendingPing) {
-                            outOfMemory(TEXT("JSS"), 1);
-                        } else {
-                            memset(pendingPing, 0, sizeof(PendingPing));
-                            
-                            pendingPing->sentTicks = nowTicks;
-                            pendingPing->slowTicks = wrapperAddToTicks(nowTicks, wrapperData->pingAlertThreshold);
-                            
-                            /*  Add it to the PendingPing queue. */
-                            if (wrapperData->firstPendingPing == NULL) {
-                                /* The queue was empty. */
-                                wrapperData->pendingPingCount = 1;
-                                wrapperData->firstUnwarnedPendingPing = pendingPing;
-                                wrapperData->firstPendingPing = pendingPing;
-                                wrapperData->lastPendingPing = pendingPing;
-                            } else {
-                                /* Add to the end of an existing queue. */
-                                wrapperData->pendingPingCount++;
-                                if (wrapperData->firstUnwarnedPendingPing == NULL) {
-                                    wrapperData->firstUnwarnedPendingPing = pendingPing;
-                                }
-                                wrapperData->lastPendingPing->nextPendingPing = pendingPing;
-                                wrapperData->lastPendingPing = pendingPing;
-                            }
+                        /* Add it to the end of the PendingPing ring.  There is always a free slot as the queue is not full. */
+                        pendingPing = &(wrapperData->pendingPings[(wrapperData->pendingPingFirst + wrapperData->pendingPingCount) % WRAPPER_MAX_PENDING_PINGS]);
+                        pendingPing->sentTicks = nowTicks;
+                        pendingPing->slowTicks = wrapperAddToTicks(nowTicks, wrapperData->pingAlertThreshold);
+                        pendingPing->sentMicros = wrapperGetMicroTime();
+                        pendingPing->receivedMicros = 0;
+                        wrapperData->pendingPingCount++;
 #ifdef DEBUG_PING_QUEUE
-                            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("+++ PING QUEUE Size: %d"), wrapperData->pendingPingCount);
+                        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("+++ PING QUEUE Size: %d"), wrapperData->pendingPingCount);
 #endif
-                            
-                            if ((wrapperData->pendingPingCount > 1) && wrapperData->isDebugging) {
-                                log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_DEBUG, TEXT("Pending Pings %d"), wrapperData->pendingPingCount);
-                            }
+                        
+                        if ((wrapperData->pendingPingCount > 1) && wrapperData->isDebugging) {
+                            log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_DEBUG, TEXT("Pending Pings %d"), wrapperData->pendingPingCount);
                         }
                     }
                 }
@@ -2058,8 +3049,6 @@ void jStateDownCheck(TICKS nowTicks, int nextSleep) {
  *            function will be called again immediately.
  */
 void jStateDownFlush(TICKS nowTicks, int nextSleep) {
-    PPendingPing pendingPing;
-    
     /* Always proceed after a single cycle. */
     /* TODO - Look into ways of reliably detecting when the backend and stdout piles are closed. */
     
@@ -2069,41 +3058,16 @@ void jStateDownFlush(TICKS nowTicks, int nextSleep) {
      *  still open at this point. */
     wrapperProtocolClose();
     
-    /* Make sure that the PendingPing pool is empty so they don't cause strange behavior with the next JVM invocation. */
-    if (wrapperData->firstPendingPing != NULL) {
+    /* Make sure that the PendingPing ring is empty so they don't cause strange behavior with the next JVM invocation. */
+    if (wrapperData->pendingPingCount > 0) {
         if (wrapperData->isDebugging) {
             log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_DEBUG, TEXT("%d pings were not replied to when the JVM process exited."), wrapperData->pendingPingCount);
         }
-        while (wrapperData->firstPendingPing != NULL) {
-            pendingPing = wrapperData->firstPendingPing;
-            if (pendingPing->nextPendingPing != NULL) {
-                /* This was the first PendingPing of several in the queue. */
-                wrapperData->pendingPingCount--;
-                if (wrapperData->firstUnwarnedPendingPing == wrapperData->firstPendingPing) {
-                    wrapperData->firstUnwarnedPendingPing = pendingPing->nextPendingPing;
-                }
-                wrapperData->firstPendingPing = pendingPing->nextPendingPing;
-                pendingPing->nextPendingPing = NULL;
-#ifdef DEBUG_PING_QUEUE
-                log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("--- PING QUEUE Size: %d"), wrapperData->pendingPingCount);
-#endif
-            } else {
-                /* This was the only PendingPing in the queue. */
-                wrapperData->pendingPingCount = 0;
-                wrapperData->firstUnwarnedPendingPing = NULL;
-                wrapperData->firstPendingPing = NULL;
-                wrapperData->lastPendingPing = NULL;
+        wrapperData->pendingPingCount = 0;
+        wrapperData->pendingPingWarnedCount = 0;
 #ifdef DEBUG_PING_QUEUE
-                log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("--- PING QUEUE Empty.") );
+        log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("--- PING QUEUE Empty.") );
 #endif
-            }
-            
-            /* Free up the pendingPing object. */
-            if (pendingPing != NULL) {
-                free(pendingPing);
-                pendingPing = NULL;
-            }
-        }
     }
     if (wrapperData->pendingPingQueueOverflow) {
         wrapperData->pendingPingQueueOverflow = FALSE;
@@ -2173,21 +3137,48 @@ void wrapperEventLoop() {
     int uptimeSeconds;
     TICKS lastCycleTicks = wrapperGetTicks();
     int nextSleep;
+    int sleepMs;
+    int deadline;
+    int anchorPending = FALSE;
+    int commandPending = FALSE;
+    unsigned int phaseStart = 0;
+#ifndef WIN32
+    int watchEvents;
+    int sleepFds[WRAPPER_SLEEP_MAX_FDS];
+    int sleepFdCount;
+#endif
 
-    /* Initialize the tick timeouts. */
-    wrapperData->anchorTimeoutTicks = lastCycleTicks;
-    wrapperData->commandTimeoutTicks = lastCycleTicks;
-    wrapperData->memoryOutputTimeoutTicks = lastCycleTicks;
-    wrapperData->cpuOutputTimeoutTicks = lastCycleTicks;
-    wrapperData->pageFaultOutputTimeoutTicks = lastCycleTicks;
-    wrapperData->logfileCloseTimeoutTicks = lastCycleTicks;
-    wrapperData->logfileCloseTimeoutTicksSet = FALSE;
-    wrapperData->logfileFlushTimeoutTicks = lastCycleTicks;
-    wrapperData->logfileFlushTimeoutTicksSet = FALSE;
+    /* Initialize the tick timeouts.  The periodic tasks are always scheduled as they may be
+     *  enabled when the configuration is reloaded.  The log file deadlines are set on activity. */
+    initLoopDeadlines();
+    setLoopDeadline(LOOP_DEADLINE_ANCHOR, lastCycleTicks);
+    setLoopDeadline(LOOP_DEADLINE_COMMAND, lastCycleTicks);
+    setLoopDeadline(LOOP_DEADLINE_MEMORY_OUTPUT, lastCycleTicks);
+    setLoopDeadline(LOOP_DEADLINE_CPU_OUTPUT, lastCycleTicks);
+#ifdef WIN32
+    setLoopDeadline(LOOP_DEADLINE_PAGEFAULT_OUTPUT, lastCycleTicks);
+#endif
+    setLoopDeadline(LOOP_DEADLINE_LOOP_STATS, wrapperAddToTicks(lastCycleTicks, wrapperData->loopStatsOutputInterval));
+    setLoopDeadline(LOOP_DEADLINE_PING_STATS, wrapperAddToTicks(lastCycleTicks, wrapperData->pingStatsOutputInterval));
     
     /* Always auto-flush untils the main loop is reached. This guaranties us all log outputs even if the Wrapper
      *  stops suddenly or get blocked before this point. (had problems when waiting for network interfaces to be up). */
     setLogfileAutoFlush(wrapperData->logfileFlushTimeout == 0);
+    
+    /* Start syncing the log file in the background if configured.  This can only be done once the Wrapper is daemonized. */
+    startLogfileSync();
+    
+    /* Likewise, io_uring can only be set up once the Wrapper is daemonized. */
+    startLogfileUring();
+
+#ifndef WIN32
+    if (wrapperData->watchFiles) {
+        /* The files are still checked once right away, as they may already exist. */
+        wrapperStartFileWatch();
+    }
+    startControlSocket();
+    startStatusPage();
+#endif
 
     if (wrapperData->isDebugging) {
         log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_DEBUG, TEXT("Use tick timer mutex=%s"), wrapperData->useTickMutex ? TEXT("TRUE") : TEXT("FALSE"));
@@ -2212,10 +3203,20 @@ void wrapperEventLoop() {
             log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("    Loop: %ssleep"), (nextSleep ? TEXT("") : TEXT("no ")));
         }
         if (nextSleep) {
-            /* Sleep for a tenth of a second. */
-            wrapperSleep(100);
+            /* Sleep for a tenth of a second, unless a deadline has already expired. */
+            sleepMs = getLoopSleepMs(wrapperGetTicks(), 100);
+            if (sleepMs > 0) {
+#ifdef WIN32
+                wrapperSleep(sleepMs);
+#else
+                /* Wake up right away if the JVM exits so a restart is not delayed, if a watched file changes, or if a command is received. */
+                sleepFdCount = getControlSocketFds(sleepFds);
+                wrapperSleepUntilEvent(sleepMs, sleepFds, sleepFdCount);
+#endif
+            }
         }
         nextSleep = TRUE;
+        startLoopCycle(&phaseStart);
         
         /* Before doing anything else, always maintain the logger to make sure
          *  that any queued messages are logged before doing anything else.
@@ -2227,6 +3228,11 @@ void wrapperEventLoop() {
             log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("    Loop: maintain logger"));
         }
         maintainLogger();
+#ifdef WRAPPER_URING_SUPPORTED
+        /* Release the asynchronous writes which completed. */
+        wrapperUringReap();
+#endif
+        recordLoopPhase(LOOP_PHASE_LOGGER, &phaseStart);
         
         if (wrapperData->pauseThreadMain) {
             wrapperPauseThread(wrapperData->pauseThreadMain, TEXT("main"));
@@ -2246,6 +3252,7 @@ void wrapperEventLoop() {
          * Users have also reported that the console can be redisplayed when a user logs back in or switches users. */
         wrapperCheckConsoleWindows();
 #endif
+        recordLoopPhase(LOOP_PHASE_SIGNALS, &phaseStart);
 
         if (!wrapperData->useJavaIOThread) {
             /* Check the stout pipe of the child process. */
@@ -2261,6 +3268,7 @@ void wrapperEventLoop() {
                 nextSleep = FALSE;
             }
         }
+        recordLoopPhase(LOOP_PHASE_OUTPUT, &phaseStart);
 
         /* Check for incoming data packets. */
         if (wrapperData->isLoopOutputEnabled) {
@@ -2281,11 +3289,14 @@ void wrapperEventLoop() {
             }
         }
 
+        recordLoopPhase(LOOP_PHASE_PROTOCOL, &phaseStart);
+
         /* See comment for first call above. */
         if (wrapperData->isLoopOutputEnabled) {
             log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("    Loop: maintain logger(2)"));
         }
         maintainLogger();
+        recordLoopPhase(LOOP_PHASE_LOGGER, &phaseStart);
 
         /* Get the current time for use in this cycle. */
         nowTicks = wrapperGetTicks();
@@ -2301,65 +3312,100 @@ void wrapperEventLoop() {
             }
         }
 
-        /* Log memory usage. */
-        if (wrapperData->isMemoryOutputEnabled) {
-            if (wrapperTickExpired(nowTicks, wrapperData->memoryOutputTimeoutTicks)) {
-                wrapperDumpMemory();
-                wrapperData->memoryOutputTimeoutTicks = wrapperAddToTicks(nowTicks, wrapperData->memoryOutputInterval);
-            }
-        }
-
-        /* Log CPU usage. */
-        if (wrapperData->isCPUOutputEnabled) {
-            if (wrapperTickExpired(nowTicks, wrapperData->cpuOutputTimeoutTicks)) {
-                wrapperDumpCPUUsage();
-                wrapperData->cpuOutputTimeoutTicks = wrapperAddToTicks(nowTicks, wrapperData->cpuOutputInterval);
-            }
-        }
-
-#ifdef WIN32
-        /* Log PageFault info. */
-        if (wrapperData->isPageFaultOutputEnabled) {
-            if (wrapperTickExpired(nowTicks, wrapperData->pageFaultOutputTimeoutTicks)) {
-                wrapperDumpPageFaultUsage();
-                wrapperData->pageFaultOutputTimeoutTicks = wrapperAddToTicks(nowTicks, wrapperData->pageFaultOutputInterval);
-            }
-        }
-#endif
-
         /* Test the activity of the logfile. */
         if (getLogfileActivity() != 0) {
             /* There was log output since the last pass. */
             
             /* Set the close timeout if enabled.  This is based on inactivity, so we always want to extend it from the current time when there was output. */
             if (wrapperData->logfileCloseTimeout > 0) {
-                wrapperData->logfileCloseTimeoutTicks = wrapperAddToTicks(nowTicks, wrapperData->logfileCloseTimeout);
-                wrapperData->logfileCloseTimeoutTicksSet = TRUE;
+                setLoopDeadline(LOOP_DEADLINE_LOGFILE_CLOSE, wrapperAddToTicks(nowTicks, wrapperData->logfileCloseTimeout));
             }
             
             /* Set the flush timeout if enabled, and it is not already set. */
             if (wrapperData->logfileFlushTimeout > 0) {
-                if (!wrapperData->logfileFlushTimeoutTicksSet) {
-                    wrapperData->logfileFlushTimeoutTicks = wrapperAddToTicks(nowTicks, wrapperData->logfileFlushTimeout);
-                    wrapperData->logfileFlushTimeoutTicksSet = TRUE;
+                if (!isLoopDeadlineSet(LOOP_DEADLINE_LOGFILE_FLUSH)) {
+                    setLoopDeadline(LOOP_DEADLINE_LOGFILE_FLUSH, wrapperAddToTicks(nowTicks, wrapperData->logfileFlushTimeout));
                 }
             }
-        } else if (wrapperData->logfileCloseTimeoutTicksSet && (wrapperTickExpired(nowTicks, wrapperData->logfileCloseTimeoutTicks))) {
-            /* If the inactivity timeout has expired then we want to close the logfile, otherwise simply flush it. */
-            closeLogfile();
-            
-            /* Reset the timeout ticks so we don't start another timeout until something has been logged. */
-            wrapperData->logfileCloseTimeoutTicksSet = FALSE;
-            /* If we close the file, it is automatically flushed. */
-            wrapperData->logfileFlushTimeoutTicksSet = FALSE;
         }
-        
-        /* Is it is time to flush the logfile? */
-        if (wrapperData->logfileFlushTimeoutTicksSet && (wrapperTickExpired(nowTicks, wrapperData->logfileFlushTimeoutTicks))) {
-            /* Time to flush the output. */
-            flushLogfile();
-            /* Reset the timeout until more output is logged. */
-            wrapperData->logfileFlushTimeoutTicksSet = FALSE;
+
+#ifndef WIN32
+        /* Check the watched files which changed right away. */
+        watchEvents = wrapperReadFileWatchEvents();
+        if (watchEvents & WRAPPER_FILE_WATCH_ANCHOR) {
+            anchorPending = TRUE;
+        }
+        if (watchEvents & WRAPPER_FILE_WATCH_COMMAND) {
+            commandPending = TRUE;
+        }
+#endif
+
+        /* Run the periodic tasks whose deadlines expired.  The anchor and command files are
+         *  checked later in the cycle, in the same order as before. */
+        while ((deadline = popExpiredLoopDeadline(nowTicks)) >= 0) {
+            switch (deadline) {
+            case LOOP_DEADLINE_MEMORY_OUTPUT:
+                /* Log memory usage. */
+                if (wrapperData->isMemoryOutputEnabled) {
+                    wrapperDumpMemory();
+                }
+                setLoopDeadline(deadline, wrapperAddToTicks(nowTicks, wrapperData->memoryOutputInterval));
+                break;
+
+            case LOOP_DEADLINE_CPU_OUTPUT:
+                /* Log CPU usage. */
+                if (wrapperData->isCPUOutputEnabled) {
+                    wrapperDumpCPUUsage();
+                }
+                setLoopDeadline(deadline, wrapperAddToTicks(nowTicks, wrapperData->cpuOutputInterval));
+                break;
+
+#ifdef WIN32
+            case LOOP_DEADLINE_PAGEFAULT_OUTPUT:
+                /* Log PageFault info. */
+                if (wrapperData->isPageFaultOutputEnabled) {
+                    wrapperDumpPageFaultUsage();
+                }
+                setLoopDeadline(deadline, wrapperAddToTicks(nowTicks, wrapperData->pageFaultOutputInterval));
+                break;
+#endif
+
+            case LOOP_DEADLINE_LOGFILE_CLOSE:
+                /* The inactivity timeout has expired so close the logfile.  The deadline is not set again until something has been logged. */
+                closeLogfile();
+                /* If we close the file, it is automatically flushed. */
+                cancelLoopDeadline(LOOP_DEADLINE_LOGFILE_FLUSH);
+                break;
+
+            case LOOP_DEADLINE_LOGFILE_FLUSH:
+                /* Time to flush the output.  The deadline is not set again until more output is logged. */
+                flushLogfile();
+                break;
+
+            case LOOP_DEADLINE_ANCHOR:
+                anchorPending = TRUE;
+                break;
+
+            case LOOP_DEADLINE_COMMAND:
+                commandPending = TRUE;
+                break;
+
+            case LOOP_DEADLINE_LOOP_STATS:
+                /* Log the durations of the loop phases over the last interval. */
+                if (wrapperData->isLoopStatsOutputEnabled) {
+                    dumpLoopStats(TRUE);
+                }
+                setLoopDeadline(deadline, wrapperAddToTicks(nowTicks, wrapperData->loopStatsOutputInterval));
+                break;
+
+            case LOOP_DEADLINE_PING_STATS:
+                /* Log the ping round trip times over the last interval. */
+                if (wrapperData->isPingStatsOutputEnabled) {
+                    dumpPingStats(TRUE);
+                }
+                setLoopDeadline(deadline, wrapperAddToTicks(nowTicks, wrapperData->pingStatsOutputInterval));
+                break;
+            }
         }
 
         /* Has the process been getting CPU? This check will only detect a lag
@@ -2379,11 +3425,23 @@ void wrapperEventLoop() {
         printStateOutput(nowTicks);
 
         /* If we are configured to do so, confirm that the anchor file still exists. */
-        anchorPoll(nowTicks);
+        if (anchorPending) {
+            anchorPending = FALSE;
+            anchorPoll(nowTicks);
+        }
 
         /* If we are configured to do so, look for a command file and perform any
          *  requested operations. */
-        commandPoll(nowTicks);
+        if (commandPending) {
+            commandPending = FALSE;
+            commandPoll(nowTicks);
+        }
+
+#ifndef WIN32
+        /* Execute any commands received on the control socket. */
+        serviceControlSocket();
+#endif
+        recordLoopPhase(LOOP_PHASE_PERIODIC, &phaseStart);
 
         if (wrapperData->exitRequested) {
             /* A new request for the JVM to be stopped has been made. */
@@ -2550,6 +3608,11 @@ void wrapperEventLoop() {
             log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_ERROR, TEXT("Unknown jState=%d"), wrapperData->jState);
             break;
         }
+        recordLoopPhase(LOOP_PHASE_STATE, &phaseStart);
+#ifndef WIN32
+        updateStatusPage(nowTicks);
+#endif
+        endLoopCycle();
     } while (wrapperData->wState != WRAPPER_WSTATE_STOPPED);
 
     /* Assertion check of Java State. */
@@ -2557,7 +3620,196 @@ void wrapperEventLoop() {
         log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_FATAL, TEXT("Wrapper shutting down while java state still %s."), wrapperGetJState(wrapperData->jState));
     }
 
+#ifndef WIN32
+    wrapperStopFileWatch();
+    stopControlSocket();
+    stopStatusPage();
+#endif
+
     if (wrapperData->isLoopOutputEnabled) {
         log_printf(WRAPPER_SOURCE_WRAPPER, LEVEL_STATUS, TEXT("Event loop stopped."));
     }
 }
+
+#ifdef CUNIT
+void tsLOOP_testDeadlineHeap(void) {
+    TICKS ticks[5] = { 50, 10, 30, 20, 40 };
+    int expected[5] = { 1, 3, 2, 4, 0 };
+    int id;
+    int i;
+
+    initLoopDeadlines();
+    CU_ASSERT_EQUAL(popExpiredLoopDeadline(0), -1);
+
+    /* Deadlines come out in the order of their ticks, once expired. */
+    for (id = 0; id < 5; id++) {
+        setLoopDeadline(id, ticks[id]);
+    }
+    CU_ASSERT_EQUAL(popExpiredLoopDeadline(5), -1);
+    CU_ASSERT_EQUAL(popExpiredLoopDeadline(20), 1);
+    CU_ASSERT_EQUAL(popExpiredLoopDeadline(20), 3);
+    CU_ASSERT_EQUAL(popExpiredLoopDeadline(20), -1);
+    CU_ASSERT_FALSE(isLoopDeadlineSet(1));
+    CU_ASSERT_TRUE(isLoopDeadlineSet(2));
+
+    /* Moving and cancelling. */
+    setLoopDeadline(1, 10);
+    setLoopDeadline(3, 20);
+    setLoopDeadline(0, 5);
+    CU_ASSERT_EQUAL(popExpiredLoopDeadline(100), 0);
+    setLoopDeadline(0, 50);
+    setLoopDeadline(2, 60);
+    cancelLoopDeadline(2);
+    CU_ASSERT_FALSE(isLoopDeadlineSet(2));
+    setLoopDeadline(2, 30);
+    for (i = 0; i < 5; i++) {
+        CU_ASSERT_EQUAL(popExpiredLoopDeadline(100), expected[i]);
+    }
+    CU_ASSERT_EQUAL(popExpiredLoopDeadline(100), -1);
+
+    /* Ticks which wrapped are still later. */
+    setLoopDeadline(LOOP_DEADLINE_COMMAND, (TICKS)0x10);
+    setLoopDeadline(LOOP_DEADLINE_ANCHOR, (TICKS)0xFFFFFFF0);
+    CU_ASSERT_EQUAL(popExpiredLoopDeadline((TICKS)0xFFFFFFF8), LOOP_DEADLINE_ANCHOR);
+    CU_ASSERT_EQUAL(popExpiredLoopDeadline((TICKS)0xFFFFFFF8), -1);
+    CU_ASSERT_EQUAL(popExpiredLoopDeadline((TICKS)0x20), LOOP_DEADLINE_COMMAND);
+
+    /* All deadlines at once. */
+    for (id = 0; id < LOOP_DEADLINE_COUNT; id++) {
+        setLoopDeadline(id, (TICKS)(1000 - id));
+    }
+    for (id = LOOP_DEADLINE_COUNT - 1; id >= 0; id--) {
+        CU_ASSERT_EQUAL(popExpiredLoopDeadline(1000), id);
+    }
+    CU_ASSERT_EQUAL(loopDeadlineCount, 0);
+}
+
+void tsLOOP_testHistogram(void) {
+    unsigned int histogram[HISTOGRAM_BUCKETS];
+    unsigned int value;
+    unsigned int max;
+    int bucket;
+    int i;
+
+    /* Values below 8 are exact. */
+    for (value = 0; value < 8; value++) {
+        CU_ASSERT_EQUAL(getHistogramBucket(value), (int)value);
+        CU_ASSERT_EQUAL(getHistogramBucketMax((int)value), value);
+    }
+    CU_ASSERT_EQUAL(getHistogramBucket(16), 16);
+    CU_ASSERT_EQUAL(getHistogramBucket(17), 16);
+    CU_ASSERT_EQUAL(getHistogramBucket(18), 17);
+    CU_ASSERT_EQUAL(getHistogramBucket(0xFFFFFFFF), HISTOGRAM_BUCKETS - 1);
+    CU_ASSERT_EQUAL(getHistogramBucketMax(HISTOGRAM_BUCKETS - 1), 0xFFFFFFFF);
+
+    /* The buckets are contiguous. */
+    for (bucket = 0; bucket < HISTOGRAM_BUCKETS - 1; bucket++) {
+        max = getHistogramBucketMax(bucket);
+        CU_ASSERT_EQUAL(getHistogramBucket(max), bucket);
+        CU_ASSERT_EQUAL(getHistogramBucket(max + 1), bucket + 1);
+    }
+
+    /* Any value is known within 12.5%. */
+    for (value = 1; value < 0x7FFFFFFF; value = value * 3 + 1) {
+        max = getHistogramBucketMax(getHistogramBucket(value));
+        CU_ASSERT(max >= value);
+        CU_ASSERT(max - value <= value / 8);
+    }
+
+    /* Percentiles of the values 1 to 100. */
+    memset(histogram, 0, sizeof(histogram));
+    for (i = 1; i <= 100; i++) {
+        histogram[getHistogramBucket((unsigned int)i)]++;
+    }
+    value = getHistogramPercentile(histogram, 100, 50);
+    CU_ASSERT((value >= 50) && (value <= 50 + 50 / 8));
+    value = getHistogramPercentile(histogram, 100, 90);
+    CU_ASSERT((value >= 90) && (value <= 90 + 90 / 8));
+    /* Never larger than the maximum. */
+    CU_ASSERT_EQUAL(getHistogramPercentile(histogram, 100, 99), 100);
+    CU_ASSERT_EQUAL(getHistogramPercentile(histogram, 100, 1000), 100);
+    CU_ASSERT_EQUAL(getHistogramPercentile(histogram, 100, 1), 1);
+}
+
+void tsLOOP_testPingRTT(void) {
+    WrapperConfig *savedWrapperData = wrapperData;
+    unsigned int variation;
+    int i;
+
+    wrapperData = malloc(sizeof(WrapperConfig));
+    CU_ASSERT_PTR_NOT_NULL_FATAL(wrapperData);
+    memset(wrapperData, 0, sizeof(WrapperConfig));
+    wrapperData->pingInterval = 8;
+    wrapperData->pingIntervalMin = 1;
+    wrapperData->pingIntervalAdaptive = TRUE;
+    resetPingTrend();
+    CU_ASSERT_EQUAL(wrapperData->pingIntervalCurrent, 8);
+
+    /* The first round trip starts the smoothed value, with half of it as jitter. */
+    wrapperRecordPingRTT(1000);
+    CU_ASSERT_EQUAL(pingSmoothedRtt, 1000);
+    CU_ASSERT_EQUAL(pingRttVariation, 500);
+
+    /* Stable round trips decay the jitter and never lengthen the interval past wrapper.ping.interval. */
+    variation = pingRttVariation;
+    for (i = 0; i < PING_STABLE_SAMPLES; i++) {
+        wrapperRecordPingRTT(1000);
+        CU_ASSERT_EQUAL(pingSmoothedRtt, 1000);
+        CU_ASSERT(pingRttVariation < variation);
+        variation = pingRttVariation;
+    }
+    CU_ASSERT_EQUAL(wrapperData->pingIntervalCurrent, 8);
+
+    /* Rising round trips halve the interval, down to wrapper.ping.interval.min. */
+    wrapperRecordPingRTT(10000);
+    CU_ASSERT_EQUAL(pingSmoothedRtt, 1000 - 1000 / 8 + 10000 / 8);
+    CU_ASSERT_EQUAL(wrapperData->pingIntervalCurrent, 4);
+    wrapperRecordPingRTT(100000);
+    CU_ASSERT_EQUAL(wrapperData->pingIntervalCurrent, 2);
+    wrapperRecordPingRTT(1000000);
+    CU_ASSERT_EQUAL(wrapperData->pingIntervalCurrent, 1);
+    wrapperRecordPingRTT(10000000);
+    CU_ASSERT_EQUAL(wrapperData->pingIntervalCurrent, 1);
+
+    /* Falling round trips are not rising.  The interval is lengthened a second at a time. */
+    for (i = 0; i < PING_STABLE_SAMPLES - 1; i++) {
+        wrapperRecordPingRTT(1000);
+    }
+    CU_ASSERT_EQUAL(wrapperData->pingIntervalCurrent, 1);
+    wrapperRecordPingRTT(1000);
+    CU_ASSERT_EQUAL(wrapperData->pingIntervalCurrent, 2);
+
+    /* Not enough recent round trips for a percentile yet. */
+    CU_ASSERT_EQUAL(getRecentPingPercentile(), 0);
+    for (i = 0; i < PING_TREND_MIN_SAMPLES; i++) {
+        wrapperRecordPingRTT(1000);
+    }
+    CU_ASSERT(getRecentPingPercentile() >= 10000000);
+
+    /* The recent round trips are halved every PING_RECENT_SAMPLES pings. */
+    for (i = 0; i < PING_RECENT_SAMPLES * 4; i++) {
+        wrapperRecordPingRTT(1000);
+    }
+    CU_ASSERT(getRecentPingPercentile() >= 1000);
+    CU_ASSERT(getRecentPingPercentile() <= 1000 + 1000 / 8);
+    CU_ASSERT(pingRecentCount <= PING_RECENT_SAMPLES * 2);
+
+    /* A new JVM starts over.  Huge round trips do not overflow the smoothed value. */
+    resetPingTrend();
+    CU_ASSERT_EQUAL(pingSmoothedRtt, 0);
+    CU_ASSERT_EQUAL(pingRecentCount, 0);
+    CU_ASSERT_EQUAL(wrapperData->pingIntervalCurrent, 8);
+    wrapperRecordPingRTT(0xFFFFFFFF);
+    CU_ASSERT_EQUAL(pingSmoothedRtt, PING_RTT_SMOOTHED_MAX);
+    wrapperRecordPingRTT(0xFFFFFFFF);
+    CU_ASSERT_EQUAL(pingSmoothedRtt, PING_RTT_SMOOTHED_MAX);
+    CU_ASSERT_EQUAL(pingRttMax, 0xFFFFFFFF);
+
+    resetPingTrend();
+    memset(pingRttHistogram, 0, sizeof(pingRttHistogram));
+    pingRttMax = 0;
+    pingRttCount = 0;
+    free(wrapperData);
+    wrapperData = savedWrapperData;
+}
+#endif /* CUNIT */